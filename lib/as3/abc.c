@@ -1226,6 +1226,15 @@ static pool_t*writeABC(TAG*abctag, void*code, pool_t*pool)
     return pool;
 }
 
+void abc_file_optimize(abc_file_t*file)
+{
+    int t;
+    for(t=0;t<file->method_bodies->num;t++) {
+        abc_method_body_t*m = (abc_method_body_t*)array_getvalue(file->method_bodies, t);
+        m->code = code_optimize(m->code, m->exceptions);
+    }
+}
+
 void swf_WriteABC(TAG*abctag, void*code)
 {
     pool_t*pool = writeABC(abctag, code, 0);
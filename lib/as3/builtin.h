@@ -28,6 +28,31 @@
 #include "../types.h"
 #include "registry.h"
 
-dict_t* builtin_getclasses();
+/* The builtin classes, functions and variables are static data in
+   builtin.c, generated by mklib. They are indexed by a perfect hash table
+   over (package, name): an entry's position is derived from the key's
+   hash and the seed stored for its bucket. Members of a class are only
+   put into the class' dictionaries when the class is first looked into
+   (see registry.c). */
+
+typedef struct _builtin_entry {
+    slotinfo_t*s;
+    int members; // index into builtin_image_t.members
+    U16 num_members;
+    U16 num_static_members;
+} builtin_entry_t;
+
+typedef struct _builtin_image {
+    const builtin_entry_t*entries;
+    int num_entries; // power of two
+    const U16*seeds;
+    int num_buckets; // power of two
+    slotinfo_t*const*members;
+} builtin_image_t;
+
+const builtin_image_t* builtin_getimage();
+
+uint64_t builtin_hash(const char*package, const char*name);
+int builtin_position(uint64_t hash, U16 seed, int num_entries);
 
 #endif
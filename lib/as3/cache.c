@@ -0,0 +1,572 @@
+/* cache.c
+
+   Persistent build cache for the ActionScript compiler
+
+   Extension module for the rfxswf library.
+   Part of the swftools package.
+
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+/* For every source file compiled in pass 2, we store the abc code it
+   generated (its methods, method bodies, package init script and classes)
+   in <cachedir>/<hash of filename>.as3c, together with
+
+     - a hash of the file's contents, and of the contents of every file
+       it pulled in through "include"
+     - a hash of the compile environment, i.e. everything the registry knows
+       about non-private classes, members and globals after pass 1 (including
+       imported classes), the builtin classes compiled into as3compile, the
+       -D definitions, and the compile time constants of all files compiled
+       before this one
+     - the classes the file declared, and their static-init dependencies
+     - the registry entries the file used (for asset tracking)
+
+   If both hashes still match on the next build, pass 2 of that file is
+   replaced by merging the cached code into the global abc file. Pass 1 still
+   runs on every file: it's what fills the registry the environment hash is
+   computed from, and it allows a file whose environment changed to fall back
+   to a normal pass 2 in the same run.
+
+   All hashes are computed with hash_block64() and hash_mix(), which don't
+   depend on the byte order, so a cache directory can be shared between
+   machines. */
+
+#include <stdio.h>
+#include <string.h>
+#include "../../config.h"
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#include "../os.h"
+#include "parser_help.h"
+#include "cache.h"
+
+#define CACHE_FORMAT "as3cache 2"
+
+/* from parser_help.c */
+extern char*as3_globalclass;
+
+static char*cache_dir = 0;
+static char env_valid = 0;
+static uint64_t env_base = 0;
+static uint64_t env_constants = 0;
+static uint64_t env_builtins = 0;
+static cache_mark_t*current = 0;
+
+static uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+    h = (h ^ v) * 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 32);
+}
+static uint64_t hash_string(uint64_t h, const char*s)
+{
+    return hash_mix(h, s?hash_block64(s, strlen(s)):1);
+}
+
+void as3cache_set_directory(const char*dir)
+{
+    if(cache_dir) {
+        free(cache_dir);cache_dir=0;
+    }
+    if(!dir || !*dir)
+        return;
+    cache_dir = strdup(dir);
+#ifdef HAVE_SYS_STAT_H
+#ifdef WIN32
+    mkdir(cache_dir);
+#else
+    mkdir(cache_dir, 0755);
+#endif
+#endif
+}
+
+char as3cache_enabled()
+{
+    return cache_dir!=0;
+}
+
+void as3cache_invalidate()
+{
+    env_valid = 0;
+}
+
+static char* entry_filename(const char*filename)
+{
+    uint64_t h = hash_block64(filename, strlen(filename));
+    char name[32];
+    sprintf(name, "%08x%08x.as3c", (unsigned int)(h>>32), (unsigned int)h);
+    return concatPaths(cache_dir, name);
+}
+
+static void* read_file(const char*filename, int*len)
+{
+    FILE*fi = fopen(filename, "rb");
+    if(!fi)
+        return 0;
+    fseek(fi, 0, SEEK_END);
+    *len = ftell(fi);
+    fseek(fi, 0, SEEK_SET);
+    char*data = malloc(*len+1);
+    if(fread(data, *len, 1, fi)!=1 && *len) {
+        free(data);
+        fclose(fi);
+        return 0;
+    }
+    data[*len] = 0;
+    fclose(fi);
+    return data;
+}
+
+static char content_hash(const char*filename, uint64_t*h)
+{
+    int len = 0;
+    void*data = read_file(filename, &len);
+    if(!data)
+        return 0;
+    *h = hash_block64(data, len);
+    free(data);
+    return 1;
+}
+
+static uint64_t hash_traits(uint64_t h, trait_list_t*l)
+{
+    for(;l;l=l->next) {
+        trait_t*trait = l->trait;
+        if(!trait->value)
+            continue;
+        if(trait->name->ns && trait->name->ns->access == ACCESS_PRIVATE)
+            continue;
+        h = hash_string(h, trait->name->name);
+        h = hash_mix(h, trait->kind);
+        h = hash_mix(h, constant_hash(trait->value));
+    }
+    return h;
+}
+
+/* compile time constants a file exports. These are only filled in
+   by pass 2, so they're not part of registry_hash() */
+static uint64_t hash_constants(cache_mark_t*m)
+{
+    uint64_t h = 0;
+    int t;
+    for(t=m->scripts;t<global->file->scripts->num;t++) {
+        abc_script_t*s = (abc_script_t*)array_getvalue(global->file->scripts, t);
+        h = hash_traits(h, s->traits);
+    }
+    parsedclass_list_t*l = global->classes;
+    for(t=0;l;l=l->next,t++) {
+        if(t<m->classes)
+            continue;
+        h = hash_traits(h, l->parsedclass->abc->traits);
+        h = hash_traits(h, l->parsedclass->abc->static_traits);
+    }
+    return h;
+}
+
+void as3cache_mark(cache_mark_t*m)
+{
+    if(!env_builtins)
+        env_builtins = hash_mix(registry_builtin_hash(), 1);
+    if(!env_valid) {
+        env_base = registry_hash() + env_builtins;
+        if(definitions) {
+            DICT_ITERATE_KEY(definitions, char*, d) {
+                env_base += hash_string(0, d);
+            }
+        }
+        env_constants = 0;
+        env_valid = 1;
+    }
+    m->methods = global->file->methods->num;
+    m->method_bodies = global->file->method_bodies->num;
+    m->scripts = global->file->scripts->num;
+    m->classes = list_length(global->classes);
+    m->env = hash_mix(env_base, env_constants);
+    m->uses = dict_new2(&ptr_type);
+    m->includes = dict_new();
+    registry_log_uses(m->uses);
+    current = m;
+}
+
+void as3cache_include(const char*filename)
+{
+    if(current && !dict_contains(current->includes, filename))
+        dict_put(current->includes, filename, 0);
+}
+
+// ----------------------------- storing ---------------------------------
+
+static void write_entry(FILE*fo, const char*type, slotinfo_t*s)
+{
+    fprintf(fo, "%s\t%s\t%s\n", type, s->package?s->package:"", s->name);
+}
+
+static void store(cache_mark_t*m, const char*filename)
+{
+    uint64_t content;
+    if(!content_hash(filename, &content))
+        return;
+
+    /* hash the included files now, so that an entry is only ever
+       written with a complete set of dependencies */
+    int num_includes = 0;
+    uint64_t*include_hashes = rfx_calloc(sizeof(uint64_t)*(dict_count(m->includes)+1));
+    DICT_ITERATE_KEY(m->includes, char*, inc) {
+        if(!content_hash(inc, &include_hashes[num_includes++])) {
+            free(include_hashes);
+            return;
+        }
+    }
+
+    /* collect everything this file added to the global abc file */
+    abc_file_t*file = abc_file_new();
+    int t;
+    for(t=m->methods;t<global->file->methods->num;t++)
+        array_append(file->methods, "", array_getvalue(global->file->methods, t));
+    for(t=m->method_bodies;t<global->file->method_bodies->num;t++)
+        array_append(file->method_bodies, "", array_getvalue(global->file->method_bodies, t));
+    for(t=m->scripts;t<global->file->scripts->num;t++)
+        array_append(file->scripts, "", array_getvalue(global->file->scripts, t));
+
+    int num_methods = file->methods->num;
+    int num_classes = list_length(global->classes) - m->classes;
+    parsedclass_t**classes = rfx_calloc(sizeof(parsedclass_t*)*(num_classes+1));
+    abc_method_t**constructors = rfx_calloc(sizeof(abc_method_t*)*(num_classes*2+1));
+    parsedclass_list_t*l = global->classes;
+    for(t=0;l;l=l->next,t++) {
+        if(t>=m->classes) {
+            int nr = t-m->classes;
+            abc_class_t*cls = l->parsedclass->abc;
+            classes[nr] = l->parsedclass;
+            constructors[nr*2+0] = cls->constructor;
+            constructors[nr*2+1] = cls->static_constructor;
+            array_append(file->classes, "", cls);
+        }
+    }
+
+    TAG*tag = swf_InsertTag(0, ST_RAWABC);
+    swf_WriteABC(tag, file);
+
+    /* swf_WriteABC() fills in default constructors where they're missing.
+       Undo that, so the final abc file gets them at the same position
+       as in a non-cached build */
+    for(t=0;t<num_classes;t++) {
+        classes[t]->abc->constructor = constructors[t*2+0];
+        classes[t]->abc->static_constructor = constructors[t*2+1];
+    }
+
+    char*entry = entry_filename(filename);
+    char*tmp = concat2(entry, ".tmp");
+    FILE*fo = fopen(tmp, "wb");
+    if(!fo) {
+        as3_warning("couldn't write cache file %s", tmp);
+    } else {
+        fprintf(fo, "%s %s\n", CACHE_FORMAT, VERSION);
+        fprintf(fo, "source\t%s\n", filename);
+        fprintf(fo, "content\t%08x%08x\n", (unsigned int)(content>>32), (unsigned int)content);
+        fprintf(fo, "env\t%08x%08x\n", (unsigned int)(m->env>>32), (unsigned int)m->env);
+        t = 0;
+        DICT_ITERATE_KEY(m->includes, char*, inc) {
+            uint64_t h = include_hashes[t++];
+            fprintf(fo, "include\t%s\t%08x%08x\n", inc, (unsigned int)(h>>32), (unsigned int)h);
+        }
+        for(t=0;t<num_classes;t++) {
+            write_entry(fo, "class", (slotinfo_t*)classes[t]->cls);
+            DICT_ITERATE_KEY(&classes[t]->usedclasses, slotinfo_t*, c) {
+                write_entry(fo, "depends", c);
+            }
+        }
+        dict_t*used = dict_new2(&ptr_type);
+        DICT_ITERATE_KEY(m->uses, slotinfo_t*, s) {
+            if((s->kind == INFOTYPE_METHOD || s->kind == INFOTYPE_VAR) && ((memberinfo_t*)s)->parent)
+                s = (slotinfo_t*)((memberinfo_t*)s)->parent;
+            if(dict_contains(used, s))
+                continue;
+            dict_put(used, s, 0);
+            write_entry(fo, "use", s);
+        }
+        dict_destroy(used);
+        fprintf(fo, "abc\t%d\t%d\n", tag->len, num_methods);
+        fwrite(tag->data, tag->len, 1, fo);
+        fclose(fo);
+        move_file(tmp, entry);
+    }
+    free(tmp);
+    free(entry);
+
+    free(include_hashes);
+    swf_DeleteTag(0, tag);
+    free(classes);
+    free(constructors);
+    array_free(file->metadata);
+    array_free(file->methods);
+    array_free(file->method_bodies);
+    array_free(file->scripts);
+    array_free(file->classes);
+    free(file);
+}
+
+void as3cache_finish(cache_mark_t*m, const char*filename)
+{
+    registry_log_uses(0);
+    current = 0;
+    if(filename)
+        store(m, filename);
+    env_constants = hash_mix(env_constants, hash_constants(m));
+    dict_destroy(m->uses);m->uses=0;
+    dict_destroy(m->includes);m->includes=0;
+}
+
+// ----------------------------- restoring -------------------------------
+
+typedef struct _entry_line {
+    char*type;
+    char*field1;
+    char*field2;
+} entry_line_t;
+
+/* splits the next line of the cache file into (up to) three tab
+   separated fields. Returns 0 at the end of the header */
+static char next_line(char**pos, char*end, entry_line_t*line)
+{
+    char*p = *pos;
+    char*eol = memchr(p, '\n', end-p);
+    if(!eol)
+        return 0;
+    *eol = 0;
+    *pos = eol+1;
+    line->type = p;
+    line->field1 = line->field2 = "";
+    char*tab = strchr(p, '\t');
+    if(tab) {
+        *tab = 0;
+        line->field1 = tab+1;
+        tab = strchr(line->field1, '\t');
+        if(tab) {
+            *tab = 0;
+            line->field2 = tab+1;
+        }
+    }
+    return 1;
+}
+
+static uint64_t parse_hash(const char*s)
+{
+    unsigned int hi=0, lo=0;
+    if(strlen(s)!=16 || sscanf(s, "%08x%08x", &hi, &lo)!=2)
+        return 0;
+    return ((uint64_t)hi)<<32 | lo;
+}
+
+/* look up the registry entry for a cached slot or const trait,
+   and copy the information only pass 2 would have filled in */
+static char restore_trait(classinfo_t*cls, trait_t*trait, char is_static, char apply)
+{
+    if(trait->kind != TRAIT_SLOT && trait->kind != TRAIT_CONST)
+        return 1;
+    if(trait->kind == TRAIT_SLOT && !trait->value)
+        return 1;
+    namespace_t*ns = trait->name->ns;
+    varinfo_t*v = 0;
+    if(cls) {
+        const char*nsname = ns && ns->access==ACCESS_NAMESPACE?ns->name:"";
+        v = (varinfo_t*)registry_findmember(cls, nsname, trait->name->name, 0, is_static);
+    } else {
+        v = (varinfo_t*)registry_find(ns?ns->name:"", trait->name->name);
+    }
+    if(!v || v->kind != INFOTYPE_VAR)
+        return 0;
+    if(apply) {
+        if(trait->kind == TRAIT_CONST)
+            v->flags |= FLAG_CONST;
+        if(trait->value)
+            v->value = constant_clone(trait->value);
+    }
+    return 1;
+}
+
+static char restore_traits(classinfo_t*cls, trait_list_t*l, char is_static, char apply)
+{
+    for(;l;l=l->next) {
+        if(!restore_trait(cls, l->trait, is_static, apply))
+            return 0;
+    }
+    return 1;
+}
+
+char as3cache_restore(cache_mark_t*m, const char*filename)
+{
+    uint64_t content;
+    if(!content_hash(filename, &content))
+        return 0;
+
+    char*entry = entry_filename(filename);
+    int len = 0;
+    char*data = read_file(entry, &len);
+    free(entry);
+    if(!data)
+        return 0;
+
+    char*pos = data;
+    char*end = data+len;
+    char header[64];
+    sprintf(header, "%s %s", CACHE_FORMAT, VERSION);
+
+    entry_line_t*lines = 0;
+    int num_lines = 0;
+    int num_classes = 0;
+    classinfo_t**classes = 0;
+    parsedclass_t**parsed = 0;
+    abc_file_t*file = 0;
+    int num_methods = 0;
+    char ok = 0;
+    int t;
+
+    entry_line_t line;
+    if(!next_line(&pos, end, &line) || strcmp(line.type, header))
+        goto done;
+    while(next_line(&pos, end, &line)) {
+        if(!strcmp(line.type, "abc")) {
+            int abc_len = atoi(line.field1);
+            num_methods = atoi(line.field2);
+            if(abc_len <= 0 || abc_len > end-pos)
+                goto done;
+            TAG*tag = swf_InsertTag(0, ST_RAWABC);
+            swf_SetBlock(tag, (U8*)pos, abc_len);
+            file = swf_ReadABC(tag);
+            swf_DeleteTag(0, tag);
+            break;
+        }
+        lines = rfx_realloc(lines, sizeof(entry_line_t)*(num_lines+1));
+        lines[num_lines++] = line;
+    }
+    if(!file)
+        goto done;
+
+    /* check whether the entry is still valid */
+    char content_ok = 0, env_ok = 0;
+    for(t=0;t<num_lines;t++) {
+        if(!strcmp(lines[t].type, "source")) {
+            if(strcmp(lines[t].field1, filename))
+                goto done;
+        } else if(!strcmp(lines[t].type, "content")) {
+            content_ok = parse_hash(lines[t].field1) == content;
+        } else if(!strcmp(lines[t].type, "env")) {
+            env_ok = parse_hash(lines[t].field1) == m->env;
+        } else if(!strcmp(lines[t].type, "include")) {
+            uint64_t h;
+            if(!content_hash(lines[t].field1, &h) || parse_hash(lines[t].field2) != h)
+                goto done;
+        } else if(!strcmp(lines[t].type, "class")) {
+            classinfo_t*c = (classinfo_t*)registry_find(lines[t].field1, lines[t].field2);
+            if(!c || c->kind != INFOTYPE_CLASS)
+                goto done;
+            classes = rfx_realloc(classes, sizeof(classinfo_t*)*(num_classes+1));
+            classes[num_classes++] = c;
+        }
+    }
+    if(!content_ok || !env_ok)
+        goto done;
+    if(file->classes->num != num_classes || num_methods > file->methods->num)
+        goto done;
+    for(t=0;t<num_classes;t++) {
+        abc_class_t*cls = (abc_class_t*)array_getvalue(file->classes, t);
+        if(!restore_traits(classes[t], cls->traits, 0, 0) ||
+           !restore_traits(classes[t], cls->static_traits, 1, 0))
+            goto done;
+    }
+    for(t=0;t<file->scripts->num;t++) {
+        abc_script_t*s = (abc_script_t*)array_getvalue(file->scripts, t);
+        if(!restore_traits(0, s->traits, 0, 0))
+            goto done;
+    }
+
+    /* from here on, we can't fail anymore. Merge the cached code into
+       the global abc file, leaving out the default constructors
+       swf_WriteABC() generated */
+    ok = 1;
+    for(t=0;t<num_methods;t++) {
+        abc_method_t*method = (abc_method_t*)array_getvalue(file->methods, t);
+        if(method->name && !*method->name) {
+            /* swf_ReadABC() turns missing method names into "" */
+            free((void*)method->name);method->name=0;
+        }
+        array_append(global->file->methods, "", method);
+        if(method->body) {
+            method->body->file = global->file;
+            array_append(global->file->method_bodies, "", method->body);
+        }
+    }
+    for(t=0;t<file->scripts->num;t++) {
+        abc_script_t*s = (abc_script_t*)array_getvalue(file->scripts, t);
+        s->file = global->file;
+        array_append(global->file->scripts, "", s);
+        restore_traits(0, s->traits, 0, 1);
+    }
+    parsed = rfx_calloc(sizeof(parsedclass_t*)*(num_classes+1));
+    for(t=0;t<num_classes;t++) {
+        abc_class_t*cls = (abc_class_t*)array_getvalue(file->classes, t);
+        if(cls->constructor && cls->constructor->index >= num_methods)
+            cls->constructor = 0;
+        if(cls->static_constructor && cls->static_constructor->index >= num_methods)
+            cls->static_constructor = 0;
+        cls->file = global->file;
+        restore_traits(classes[t], cls->traits, 0, 1);
+        restore_traits(classes[t], cls->static_traits, 1, 1);
+
+        parsed[t] = parsedclass_new(classes[t], cls);
+        list_append(global->classes, parsed[t]);
+
+        /* see startclass() */
+        if(!as3_globalclass && classes[t]->access == ACCESS_PACKAGE &&
+           slotinfo_equals((slotinfo_t*)registry_getMovieClip(), (slotinfo_t*)classes[t]->superclass)) {
+            if(classes[t]->package && classes[t]->package[0]) {
+                as3_globalclass = concat3(classes[t]->package, ".", classes[t]->name);
+            } else {
+                as3_globalclass = strdup(classes[t]->name);
+            }
+        }
+    }
+    int nr = -1;
+    for(t=0;t<num_lines;t++) {
+        if(!strcmp(lines[t].type, "class")) {
+            nr++;
+        } else if(!strcmp(lines[t].type, "depends") && nr>=0) {
+            classinfo_t*c = (classinfo_t*)registry_find(lines[t].field1, lines[t].field2);
+            if(c)
+                parsedclass_add_dependency(parsed[nr], c);
+        } else if(!strcmp(lines[t].type, "use")) {
+            registry_use(registry_find(lines[t].field1, lines[t].field2));
+        }
+    }
+
+    array_free(file->metadata);
+    array_free(file->methods);
+    array_free(file->method_bodies);
+    array_free(file->scripts);
+    array_free(file->classes);
+    free(file);file=0;
+
+done:
+    if(file)
+        swf_FreeABC(file);
+    free(parsed);
+    free(classes);
+    free(lines);
+    free(data);
+    return ok;
+}
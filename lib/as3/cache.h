@@ -0,0 +1,54 @@
+/* cache.h
+
+   Persistent build cache for the ActionScript compiler
+
+   Extension module for the rfxswf library.
+   Part of the swftools package.
+
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __as3_cache_h__
+#define __as3_cache_h__
+
+#include "../q.h"
+
+/* state of the global abc file (and of the compile environment)
+   before pass 2 of a source file */
+typedef struct _cache_mark {
+    int methods;
+    int method_bodies;
+    int scripts;
+    int classes;
+    uint64_t env;
+    dict_t*uses;
+    dict_t*includes;
+} cache_mark_t;
+
+void as3cache_set_directory(const char*dir);
+char as3cache_enabled();
+
+/* call whenever pass 1 changed the registry */
+void as3cache_invalidate();
+
+void as3cache_mark(cache_mark_t*m);
+char as3cache_restore(cache_mark_t*m, const char*filename);
+void as3cache_finish(cache_mark_t*m, const char*filename);
+
+/* called by the tokenizer for every file entered through "include" */
+void as3cache_include(const char*filename);
+
+#endif //__as3_cache_h__
@@ -1301,4 +1301,341 @@ code_t* cut_last_push(code_t*c)
     return c;
 }
 
+/* ------------------------------- peephole optimizer ------------------------- */
 
+static int get_register(code_t*c)
+{
+    if(c->opcode == OPCODE_GETLOCAL)
+        return (ptroff_t)c->data[0];
+    if(c->opcode >= OPCODE_GETLOCAL_0 && c->opcode <= OPCODE_GETLOCAL_3)
+        return c->opcode - OPCODE_GETLOCAL_0;
+    return -1;
+}
+static int set_register(code_t*c)
+{
+    if(c->opcode == OPCODE_SETLOCAL)
+        return (ptroff_t)c->data[0];
+    if(c->opcode >= OPCODE_SETLOCAL_0 && c->opcode <= OPCODE_SETLOCAL_3)
+        return c->opcode - OPCODE_SETLOCAL_0;
+    return -1;
+}
+
+/* instructions which push a value, and have no side effects */
+static char is_pure_push(code_t*c)
+{
+    switch(c->opcode) {
+        case OPCODE_PUSHBYTE: case OPCODE_PUSHSHORT: case OPCODE_PUSHINT:
+        case OPCODE_PUSHUINT: case OPCODE_PUSHDOUBLE: case OPCODE_PUSHSTRING:
+        case OPCODE_PUSHTRUE: case OPCODE_PUSHFALSE: case OPCODE_PUSHNULL:
+        case OPCODE_PUSHUNDEFINED: case OPCODE_PUSHNAN: case OPCODE_PUSHNAMESPACE:
+        case OPCODE_GETGLOBALSCOPE: case OPCODE_DUP:
+            return 1;
+    }
+    return get_register(c)>=0;
+}
+
+/* the branch which jumps if the given one doesn't, or 0 */
+static U8 invert_branch(U8 opcode)
+{
+    switch(opcode) {
+        case OPCODE_IFTRUE: return OPCODE_IFFALSE;
+        case OPCODE_IFFALSE: return OPCODE_IFTRUE;
+        case OPCODE_IFEQ: return OPCODE_IFNE;
+        case OPCODE_IFNE: return OPCODE_IFEQ;
+        case OPCODE_IFSTRICTEQ: return OPCODE_IFSTRICTNE;
+        case OPCODE_IFSTRICTNE: return OPCODE_IFSTRICTEQ;
+        case OPCODE_IFLT: return OPCODE_IFNLT;
+        case OPCODE_IFNLT: return OPCODE_IFLT;
+        case OPCODE_IFLE: return OPCODE_IFNLE;
+        case OPCODE_IFNLE: return OPCODE_IFLE;
+        case OPCODE_IFGT: return OPCODE_IFNGT;
+        case OPCODE_IFNGT: return OPCODE_IFGT;
+        case OPCODE_IFGE: return OPCODE_IFNGE;
+        case OPCODE_IFNGE: return OPCODE_IFGE;
+    }
+    return 0;
+}
+
+/* the branch which does "compare;iftrue" */
+static U8 compare_branch(U8 opcode)
+{
+    switch(opcode) {
+        case OPCODE_EQUALS: return OPCODE_IFEQ;
+        case OPCODE_STRICTEQUALS: return OPCODE_IFSTRICTEQ;
+        case OPCODE_LESSTHAN: return OPCODE_IFLT;
+        case OPCODE_LESSEQUALS: return OPCODE_IFLE;
+        case OPCODE_GREATERTHAN: return OPCODE_IFGT;
+        case OPCODE_GREATEREQUALS: return OPCODE_IFGE;
+        case OPCODE_NOT: return OPCODE_IFFALSE;
+    }
+    return 0;
+}
+
+static void add_target(dict_t*targets, code_t*c)
+{
+    if(c && !dict_contains(targets, c))
+        dict_put(targets, c, 0);
+}
+
+/* everything which is referenced from somewhere else (and hence must not be
+   removed, or merged with the instruction before it) */
+static dict_t* find_targets(code_t*c, abc_exception_list_t*exceptions)
+{
+    dict_t*targets = dict_new2(&ptr_type);
+    while(c) {
+        opcode_t*op = opcode_get(c->opcode);
+        if(op->flags & (OP_JUMP|OP_BRANCH)) {
+            add_target(targets, c->branch);
+        } else if(op->flags & OP_LOOKUPSWITCH) {
+            lookupswitch_t*l = (lookupswitch_t*)c->data[0];
+            add_target(targets, l->def);
+            code_list_t*t = l->targets;
+            while(t) {
+                add_target(targets, t->code);
+                t = t->next;
+            }
+        }
+        c = c->next;
+    }
+    while(exceptions) {
+        add_target(targets, exceptions->abc_exception->from);
+        add_target(targets, exceptions->abc_exception->to);
+        add_target(targets, exceptions->abc_exception->target);
+        exceptions = exceptions->next;
+    }
+    return targets;
+}
+
+/* the first instruction at or after c which isn't a nop */
+static code_t* skip_nops(code_t*c)
+{
+    while(c && c->opcode == OPCODE_NOP)
+        c = c->next;
+    return c;
+}
+
+/* The compiler uses nops as jump targets. Redirect all jumps to the
+   instruction after the nop, so that the nops can be removed. */
+static void redirect_nops(code_t*c, abc_exception_list_t*exceptions)
+{
+    while(c) {
+        opcode_t*op = opcode_get(c->opcode);
+        if(op->flags & (OP_JUMP|OP_BRANCH)) {
+            /* a jump to trailing nops keeps its target */
+            if(skip_nops(c->branch))
+                c->branch = skip_nops(c->branch);
+        } else if(op->flags & OP_LOOKUPSWITCH) {
+            lookupswitch_t*l = (lookupswitch_t*)c->data[0];
+            if(skip_nops(l->def))
+                l->def = skip_nops(l->def);
+            code_list_t*t = l->targets;
+            while(t) {
+                if(skip_nops(t->code))
+                    t->code = skip_nops(t->code);
+                t = t->next;
+            }
+        }
+        c = c->next;
+    }
+    /* exception ranges need an actual instruction to point to */
+    while(exceptions) {
+        abc_exception_t*e = exceptions->abc_exception;
+        if(skip_nops(e->from)) e->from = skip_nops(e->from);
+        if(skip_nops(e->to)) e->to = skip_nops(e->to);
+        if(skip_nops(e->target)) e->target = skip_nops(e->target);
+        exceptions = exceptions->next;
+    }
+}
+
+/* unlink and free c */
+static void remove_op(code_t**start, code_t*c)
+{
+    if(*start == c)
+        *start = c->next;
+    if(c->prev) c->prev->next = c->next;
+    if(c->next) c->next->prev = c->prev;
+    c->prev = c->next = 0;
+    code_free(c);
+}
+
+/* try the rewrites starting at instruction c. Returns the instruction to
+   continue with, or c if nothing was changed. */
+static code_t* optimize_at(code_t**start, code_t*c, dict_t*targets, char*changed)
+{
+#define IS_TARGET(x) dict_contains(targets, (x))
+#define CHANGED(x) {*changed=1;return (x);}
+    code_t*n = c->next;
+    opcode_t*op = opcode_get(c->opcode);
+    int reg;
+
+    /* nops can be removed once nothing jumps to them anymore */
+    if(c->opcode == OPCODE_NOP && !IS_TARGET(c)) {
+        code_t*cont = c->prev;
+        remove_op(start, c);
+        CHANGED(cont?cont:*start);
+    }
+
+    /* getlocal <i>, setlocal <i> -> getlocal_i, setlocal_i for i<4 */
+    if(c->opcode == OPCODE_GETLOCAL && (ptroff_t)c->data[0] < 4) {
+        c->opcode = OPCODE_GETLOCAL_0 + (ptroff_t)c->data[0];
+        c->data[0] = 0;
+        CHANGED(c);
+    }
+    if(c->opcode == OPCODE_SETLOCAL && (ptroff_t)c->data[0] < 4) {
+        c->opcode = OPCODE_SETLOCAL_0 + (ptroff_t)c->data[0];
+        c->data[0] = 0;
+        CHANGED(c);
+    }
+
+    /* jump threading: a jump to a jump can be redirected */
+    if(op->flags & (OP_JUMP|OP_BRANCH)) {
+        code_t*t = c->branch;
+        int count = 0;
+        while(t && t->opcode == OPCODE_JUMP && t->branch && t->branch != t && count++ < 16)
+            t = t->branch;
+        if(t != c->branch) {
+            c->branch = t;
+            add_target(targets, t);
+            CHANGED(c);
+        }
+    }
+
+    if(!n)
+        return c;
+
+    /* "jump next;next:" can be removed */
+    if(c->opcode == OPCODE_JUMP && c->branch == n && !IS_TARGET(c)) {
+        remove_op(start, c);
+        CHANGED(n->prev?n->prev:n);
+    }
+    /* "iftrue next;next:" -> "pop" */
+    if((c->opcode == OPCODE_IFTRUE || c->opcode == OPCODE_IFFALSE) && c->branch == n) {
+        c->opcode = OPCODE_POP;
+        c->branch = 0;
+        c->data[0] = 0;
+        CHANGED(c);
+    }
+    /* "iffalse xx;jump yy;xx:" -> "iftrue yy" */
+    if((op->flags & OP_BRANCH) && invert_branch(c->opcode) && 
+       n->opcode == OPCODE_JUMP && !IS_TARGET(n) && 
+       c->branch && c->branch == n->next) {
+        c->opcode = invert_branch(c->opcode);
+        c->branch = n->branch;
+        remove_op(start, n);
+        CHANGED(c);
+    }
+    /* "greaterthan;iftrue" -> "ifgt", "equals;iffalse" -> "ifne" etc. */
+    if(compare_branch(c->opcode) && !IS_TARGET(n) &&
+       (n->opcode == OPCODE_IFTRUE || n->opcode == OPCODE_IFFALSE)) {
+        U8 branch = compare_branch(c->opcode);
+        if(n->opcode == OPCODE_IFFALSE)
+            branch = invert_branch(branch);
+        c->opcode = branch;
+        c->branch = n->branch;
+        remove_op(start, n);
+        CHANGED(c);
+    }
+    /* "push<anything>;(coerce_a);pop" can be removed */
+    if(is_pure_push(c) && !IS_TARGET(c)) {
+        code_t*p = n;
+        while(p && p->opcode == OPCODE_COERCE_A && !IS_TARGET(p))
+            p = p->next;
+        if(p && p->opcode == OPCODE_POP && !IS_TARGET(p)) {
+            code_t*cont = c->prev;
+            p = p->next;
+            while(c != p) {
+                code_t*next = c->next;
+                remove_op(start, c);
+                c = next;
+            }
+            CHANGED(cont?cont:*start);
+        }
+    }
+    /* "callproperty;(coerce_a);pop" -> "callpropvoid" */
+    if(c->opcode == OPCODE_CALLPROPERTY || c->opcode == OPCODE_CALLSUPER) {
+        code_t*p = n;
+        while(p && p->opcode == OPCODE_COERCE_A && !IS_TARGET(p))
+            p = p->next;
+        if(p && p->opcode == OPCODE_POP && !IS_TARGET(p)) {
+            c->opcode = c->opcode == OPCODE_CALLPROPERTY?OPCODE_CALLPROPVOID:OPCODE_CALLSUPERVOID;
+            p = p->next;
+            while(c->next != p)
+                remove_op(start, c->next);
+            CHANGED(c);
+        }
+    }
+    /* "dup;xxx;pop" -> "xxx" (xxx=setlocal_i, setglobalslot, pushscope) */
+    if(c->opcode == OPCODE_DUP && !IS_TARGET(n) && 
+       (set_register(n)>=0 || n->opcode == OPCODE_SETGLOBALSLOT || n->opcode == OPCODE_PUSHSCOPE) &&
+       n->next && n->next->opcode == OPCODE_POP && !IS_TARGET(n->next)) {
+        remove_op(start, n->next);
+        c->opcode = n->opcode;
+        c->data[0] = n->data[0];
+        n->opcode = OPCODE_NOP; // so that code_free() doesn't touch the data
+        n->data[0] = 0;
+        remove_op(start, n);
+        CHANGED(c);
+    }
+    /* "getlocal_i;setlocal_i" can be removed */
+    if((reg = get_register(c))>=0 && set_register(n) == reg && !IS_TARGET(c) && !IS_TARGET(n)) {
+        code_t*cont = c->prev;
+        remove_op(start, n);
+        remove_op(start, c);
+        CHANGED(cont?cont:*start);
+    }
+    /* "getlocal_i;increment;setlocal_i" -> "inclocal_i" (same for decrement) */
+    if((reg = get_register(c))>=0 && !IS_TARGET(n) && 
+       n->next && set_register(n->next) == reg && !IS_TARGET(n->next)) {
+        U8 opcode = 0;
+        switch(n->opcode) {
+            case OPCODE_INCREMENT: opcode = OPCODE_INCLOCAL;break;
+            case OPCODE_INCREMENT_I: opcode = OPCODE_INCLOCAL_I;break;
+            case OPCODE_DECREMENT: opcode = OPCODE_DECLOCAL;break;
+            case OPCODE_DECREMENT_I: opcode = OPCODE_DECLOCAL_I;break;
+        }
+        if(opcode) {
+            c->opcode = opcode;
+            c->data[0] = (void*)(ptroff_t)reg;
+            remove_op(start, n->next);
+            remove_op(start, n);
+            CHANGED(c);
+        }
+    }
+    /* a kill before a return can be eliminated */
+    if(c->opcode == OPCODE_KILL && !IS_TARGET(c) &&
+       (n->opcode == OPCODE_RETURNVALUE || n->opcode == OPCODE_RETURNVOID)) {
+        remove_op(start, c);
+        CHANGED(n->prev?n->prev:n);
+    }
+    return c;
+#undef IS_TARGET
+#undef CHANGED
+}
+
+code_t* code_optimize(code_t*code, abc_exception_list_t*exceptions)
+{
+    code_t*start = code_start(code);
+    if(!start)
+        return 0;
+    redirect_nops(start, exceptions);
+    dict_t*targets = find_targets(start, exceptions);
+    char changed = 1;
+    int pass;
+    for(pass=0;changed && pass<16;pass++) {
+        changed = 0;
+        code_t*c = start;
+        while(c) {
+            char c_changed = 0;
+            code_t*next = optimize_at(&start, c, targets, &c_changed);
+            if(c_changed) {
+                changed = 1;
+                /* try again at the same position, or the one before */
+                c = next;
+            } else {
+                c = c->next;
+            }
+        }
+    }
+    dict_destroy(targets);
+    return code_end(start);
+}
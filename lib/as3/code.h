@@ -93,6 +93,9 @@ code_t*code_cutlast(code_t*c);
 
 codestats_t* code_get_statistics(code_t*code, abc_exception_list_t*exceptions);
 
+/* peephole optimizations (see optimizations.txt). Returns the new end of the code. */
+code_t* code_optimize(code_t*code, abc_exception_list_t*exceptions);
+
 void codestats_print(codestats_t*s);
 void codestats_free(codestats_t*s);
 
@@ -29,7 +29,9 @@
 #include "compiler.h"
 #include "registry.h"
 #include "assets.h"
+#include "cache.h"
 #include "../os.h"
+#include "../threads.h"
 #ifdef HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #endif
@@ -43,6 +45,8 @@ extern int as3_lex();
 extern int as3_lex_destroy();
 
 static char config_recurse = 0;
+static char config_optimize = 0;
+static int config_threads = 1;
 
 void as3_setverbosity(int level)
 {
@@ -57,6 +61,19 @@ void as3_set_option(const char*key, const char*value)
     if(!strcmp(key, "recurse")) {
         config_recurse=atoi(value);
     }
+    if(!strcmp(key, "optimize")) {
+        config_optimize=atoi(value);
+    }
+    if(!strcmp(key, "cache")) {
+        as3cache_set_directory(value);
+    }
+    if(!strcmp(key, "threads")) {
+#ifdef TOKENIZER_THREADSAFE
+        config_threads=atoi(value);
+        if(config_threads<=0)
+            config_threads = threads_num_cpus();
+#endif
+    }
 }
 
 static char registry_initialized = 0;
@@ -80,7 +97,7 @@ typedef struct _compile_list {
 } compile_list_t;
 static compile_list_t*compile_list=0;
 
-static void as3_parse_file_or_array(const char*name, const char*filename, const void*mem, int length)
+static void as3_parse_file_or_array(const char*name, const char*filename, const void*mem, int length, tokenstream_t*tokens)
 {
     if(!registry_initialized) {
         registry_initialized = 1;
@@ -91,6 +108,20 @@ static void as3_parse_file_or_array(const char*name, const char*filename, const
         initialize_parser();
     }
 
+    cache_mark_t mark;
+    if(as3cache_enabled()) {
+        if(as3_pass==1) {
+            as3cache_invalidate();
+        } else if(as3_pass==2) {
+            as3cache_mark(&mark);
+            if(filename && as3cache_restore(&mark, filename)) {
+                DEBUG printf("[pass %d] restored %s from cache\n", as3_pass, filename);
+                as3cache_finish(&mark, 0);
+                return;
+            }
+        }
+    }
+
     FILE*fi = 0;
     if(filename) {
         if(as3_pass==1 && !mem) {
@@ -102,8 +133,13 @@ static void as3_parse_file_or_array(const char*name, const char*filename, const
             compile_list = c;
         }
         DEBUG printf("[pass %d] parse file %s %s\n", as3_pass, name, filename);
-        fi = enter_file2(name, filename, 0);
-        as3_file_input(fi);
+        if(tokens) {
+            enter_file(name, filename, 0);
+            as3_tokenstream_input(tokens);
+        } else {
+            fi = enter_file2(name, filename, 0);
+            as3_file_input(fi);
+        }
     } else {
         DEBUG printf("[pass %d] parse bytearray %s (%d bytes)\n", as3_pass, name, length);
         enter_file(name, name, 0);
@@ -116,17 +152,49 @@ static void as3_parse_file_or_array(const char*name, const char*filename, const
     as3_lex_destroy();
     finish_file();
     if(fi) fclose(fi);
+    if(tokens) as3_tokenstream_free(tokens);
+
+    if(as3cache_enabled() && as3_pass==2) {
+        as3cache_finish(&mark, filename);
+    }
 }
 
 typedef struct _scheduled_file {
     char*name;
     char*filename;
+    tokenstream_t*tokens;
     struct _scheduled_file*next;
 } scheduled_file_t;
 
 static scheduled_file_t*scheduled=0;
 dict_t*scheduled_dict=0;
 
+static void tokenize_job(void*data, int job, int thread)
+{
+    scheduled_file_t*f = ((scheduled_file_t**)data)[job];
+    f->tokens = as3_tokenstream_scan(f->filename);
+}
+
+/* Tokenize the files of one pass 1 round on worker threads. Parsing them
+   (and hence filling the registry) still happens one file after the
+   other, in the same order as before, so the output doesn't change. */
+static void tokenize_scheduled(scheduled_file_t*s)
+{
+    int num = 0;
+    scheduled_file_t*f;
+    for(f=s;f;f=f->next)
+        num++;
+    if(config_threads<=1 || num<2)
+        return;
+    scheduled_file_t**files = rfx_alloc(sizeof(scheduled_file_t*)*num);
+    num = 0;
+    for(f=s;f;f=f->next)
+        files[num++] = f;
+    DEBUG printf("[pass %d] tokenize %d files on %d threads\n", as3_pass, num, config_threads);
+    threads_run(config_threads, num, tokenize_job, files);
+    free(files);
+}
+
 void as3_parse_scheduled()
 {
     DEBUG printf("[pass %d] parse scheduled\n", as3_pass);
@@ -134,9 +202,10 @@ void as3_parse_scheduled()
     while(scheduled) {
         scheduled_file_t*s = scheduled;
         scheduled = 0;
+        tokenize_scheduled(s);
         while(s) {
             scheduled_file_t*old = s;
-            as3_parse_file_or_array(s->name, s->filename, 0,0);
+            as3_parse_file_or_array(s->name, s->filename, 0,0, s->tokens);
             s = s->next;
 
             free(old->filename);
@@ -176,7 +245,7 @@ void as3_schedule_file(const char*name, const char*filename)
 void as3_parse_list()
 {
     while(compile_list) {
-        as3_parse_file_or_array(compile_list->name, compile_list->filename, 0,0);
+        as3_parse_file_or_array(compile_list->name, compile_list->filename, 0,0, 0);
         compile_list = compile_list->next;
     }
 }
@@ -184,13 +253,13 @@ void as3_parse_list()
 void as3_parse_bytearray(const char*name, const void*mem, int length)
 {
     as3_pass = 1;
-    as3_parse_file_or_array(name, 0, mem, length);
+    as3_parse_file_or_array(name, 0, mem, length, 0);
     as3_parse_scheduled();
     
     registry_resolve_all();
     
     as3_pass = 2;
-    as3_parse_file_or_array(name, 0, mem, length);
+    as3_parse_file_or_array(name, 0, mem, length, 0);
     as3_parse_list();
 }
 
@@ -341,6 +410,8 @@ void* as3_getcode()
     if(parser_initialized) {
         parser_initialized = 0;
         as3code = finish_parser();
+        if(config_optimize)
+            abc_file_optimize((abc_file_t*)as3code);
     }
     return as3code;
 }
@@ -245,7 +245,8 @@ void as3_import_file(char*filename)
     fclose(fi);
     if (l != 1) return;
     if(!strncmp(head, "FWS", 3) ||
-       !strncmp(head, "CWS", 3)) {
+       !strncmp(head, "CWS", 3) ||
+       !strncmp(head, "ZWS", 3)) {
         as3_import_swf(filename);
     } else if(!strncmp(head, "PK", 2)) {
 	as3_import_zipfile(filename);
@@ -31,6 +31,7 @@
 #include "parser.tab.h"
 #include "parser.h"
 #include "import.h"
+#include "builtin.h"
 
 void fixstring(char*s)
 {
@@ -112,9 +113,10 @@ static int compare_traits(const void*v1, const void*v2)
     return strcmp(x1->name->name, x2->name->name);
 }
 
-dict_t* builtin_getclasses()
+const builtin_image_t* builtin_getimage()
 {
-    return dict_new2(&slotinfo_type);
+    static builtin_image_t empty;
+    return &empty;
 }
 
 extern dict_t*registry_classes;
@@ -145,34 +147,22 @@ void write_slotinfo_decl(FILE*fi, slotinfo_t*s, char*prefix)
 	DICT_ITERATE_DATA(d, slotinfo_t*, s1) {
             fprintf(fi, "static %s %s;\n", mktype(s1), mkid2(id, s1->name));
 	}
+        d = &c->static_members;
 	DICT_ITERATE_DATA(d, slotinfo_t*, s2) {
             fprintf(fi, "static %s %s;\n", mktype(s2), mkid2(id, s2->name));
 	}
     }
 }
-void write_initinfo(FILE*fi, slotinfo_t*s, char*prefix)
+
+/* write the member list of a class, and return the number of members written */
+int write_members(FILE*fi, dict_t*d, char*id)
 {
-    if(s->kind == INFOTYPE_CLASS) {
-        classinfo_t*c = (classinfo_t*)s;
-        char*id = mkid(c);
-        dict_t*d1 = &c->members;
-        dict_t*d2 = &c->static_members;
-        fprintf(fi, "%s", prefix);
-        fprintf(fi, "dict_init2(&%s.members, &memberinfo_type, %d);\n", id, d1->hashsize);
-	fprintf(fi, "%s", prefix);
-        fprintf(fi, "dict_init2(&%s.static_members, &memberinfo_type, %d);\n", id, d2->hashsize);
-        int t;
-	DICT_ITERATE_DATA(d1,slotinfo_t*,s1) {
-	   fprintf(fi, "%s", prefix);
-	   char*id2 = mkid2(id, s1->name);
-	   fprintf(fi, "dict_put(&%s.members, &%s, &%s);\n", id, id2, id2);
-	}
-	DICT_ITERATE_DATA(d2,slotinfo_t*,s2) {
-	   fprintf(fi, "%s", prefix);
-	   char*id2 = mkid2(id, s2->name);
-	   fprintf(fi, "dict_put(&%s.static_members, &%s, &%s);\n", id, id2, id2);
-	}
+    int num = 0;
+    DICT_ITERATE_DATA(d, slotinfo_t*, s) {
+        fprintf(fi, "    (slotinfo_t*)&%s,\n", mkid2(id, s->name));
+        num++;
     }
+    return num;
 }
 
 void write_constant(FILE*fi, constant_t*value, char*id, char*prefix)
@@ -188,16 +178,20 @@ void write_constant(FILE*fi, constant_t*value, char*id, char*prefix)
     fprintf(fi, "static constant_t %s_constant = ", id);
     fprintf(fi, "{type: %d", value->type);
     if(NS_TYPE(value->type)) {
-        fprintf(fi, ", &%s_constant_ns", id);
+        fprintf(fi, ", ns: &%s_constant_ns", id);
     } else if(value->type == CONSTANT_INT) {
-        fprintf(fi, ",i: %d,", value->type);
+        fprintf(fi, ", i: %d", value->i);
     } else if(value->type == CONSTANT_UINT) {
-        fprintf(fi, ",u: %u", value->u);
+        fprintf(fi, ", u: %u", value->u);
     } else if(value->type == CONSTANT_FLOAT) {
-        if(!isnan(value->f) && !isinf(value->f))
-            fprintf(fi, ", %f", value->f);
+        if(isnan(value->f))
+            fprintf(fi, ", f: __builtin_nan(\"\")");
+        else if(isinf(value->f))
+            fprintf(fi, ", f: %s__builtin_inf()", value->f<0?"-":"");
+        else
+            fprintf(fi, ", f: %f", value->f);
     } else if(value->type == CONSTANT_STRING) {
-        fprintf(fi, ", &%s_constant_s", id);
+        fprintf(fi, ", s: &%s_constant_s", id);
     }
     fprintf(fi, "};\n");
 }
@@ -265,52 +259,161 @@ void write_slotinfo(FILE*fi, slotinfo_t*s, char*id, char*prefix)
     }
 }
 
+/* find a seed for every bucket, so that the keys of all buckets end up
+   in distinct positions. Returns 0 if that's impossible. */
+static char place_buckets(uint64_t*hashes, int num, U16*seeds, int num_buckets, int*pos, int num_entries)
+{
+    int*bucketsize = rfx_calloc(sizeof(int)*num_buckets);
+    int*order = rfx_calloc(sizeof(int)*num_buckets);
+    char*taken = rfx_calloc(num_entries);
+    int*p = rfx_calloc(sizeof(int)*num);
+    int t,b,i;
+    for(t=0;t<num;t++)
+        bucketsize[(hashes[t] >> 32) & (num_buckets-1)]++;
+    /* biggest buckets first */
+    for(b=0;b<num_buckets;b++)
+        order[b] = b;
+    for(b=1;b<num_buckets;b++) {
+        int o = order[b];
+        for(i=b;i>0 && bucketsize[order[i-1]] < bucketsize[o];i--)
+            order[i] = order[i-1];
+        order[i] = o;
+    }
+    char ok = 1;
+    for(b=0;b<num_buckets && ok;b++) {
+        int bucket = order[b];
+        if(!bucketsize[bucket])
+            break;
+        int seed;
+        for(seed=0;seed<65536;seed++) {
+            int n = 0;
+            for(t=0;t<num;t++) {
+                if(((hashes[t] >> 32) & (num_buckets-1)) != bucket)
+                    continue;
+                pos[t] = builtin_position(hashes[t], seed, num_entries);
+                for(i=0;i<n;i++)
+                    if(p[i] == pos[t]) break;
+                if(i<n || taken[pos[t]])
+                    break;
+                p[n++] = pos[t];
+            }
+            if(t==num)
+                break;
+        }
+        if(seed==65536) {
+            ok = 0;
+        } else {
+            seeds[bucket] = seed;
+            for(i=0;i<bucketsize[bucket];i++)
+                taken[p[i]] = 1;
+        }
+    }
+    free(bucketsize);free(order);free(taken);free(p);
+    return ok;
+}
+
+void write_image(FILE*fi)
+{
+    int num = dict_count(registry_classes);
+    slotinfo_t**slots = rfx_calloc(sizeof(slotinfo_t*)*num);
+    uint64_t*hashes = rfx_calloc(sizeof(uint64_t)*num);
+    int*pos = rfx_calloc(sizeof(int)*num);
+    int*members = rfx_calloc(sizeof(int)*num);
+    int*num_members = rfx_calloc(sizeof(int)*num);
+    int*num_static_members = rfx_calloc(sizeof(int)*num);
+    int t = 0;
+    DICT_ITERATE_KEY(registry_classes, slotinfo_t*, s) {
+        slots[t] = s;
+        hashes[t] = builtin_hash(s->package, s->name);
+        t++;
+    }
+
+    int num_entries = 1;
+    while(num_entries < num + num/4)
+        num_entries <<= 1;
+    int num_buckets;
+    U16*seeds;
+    while(1) {
+        num_buckets = num_entries/4;
+        if(!num_buckets)
+            num_buckets = 1;
+        seeds = rfx_calloc(sizeof(U16)*num_buckets);
+        if(place_buckets(hashes, num, seeds, num_buckets, pos, num_entries))
+            break;
+        free(seeds);
+        num_entries <<= 1;
+    }
+
+    fprintf(fi, "static slotinfo_t* const members[] = {\n");
+    int count = 0;
+    for(t=0;t<num;t++) {
+        if(slots[t]->kind != INFOTYPE_CLASS)
+            continue;
+        classinfo_t*c = (classinfo_t*)slots[t];
+        members[t] = count;
+        num_members[t] = write_members(fi, &c->members, mkid(c));
+        num_static_members[t] = write_members(fi, &c->static_members, mkid(c));
+        count += num_members[t] + num_static_members[t];
+    }
+    fprintf(fi, "    0\n};\n\n");
+
+    builtin_entry_t*entries = rfx_calloc(sizeof(builtin_entry_t)*num_entries);
+    int*index = rfx_calloc(sizeof(int)*num_entries);
+    for(t=0;t<num;t++) {
+        entries[pos[t]].s = slots[t];
+        index[pos[t]] = t;
+    }
+    fprintf(fi, "static const builtin_entry_t entries[%d] = {\n", num_entries);
+    for(t=0;t<num_entries;t++) {
+        if(!entries[t].s) {
+            fprintf(fi, "    {0},\n");
+        } else {
+            int i = index[t];
+            fprintf(fi, "    {(slotinfo_t*)%s, %d, %d, %d},\n", mkptr(slots[i]), members[i], num_members[i], num_static_members[i]);
+        }
+    }
+    fprintf(fi, "};\n\n");
+
+    fprintf(fi, "static const U16 seeds[%d] = {", num_buckets);
+    for(t=0;t<num_buckets;t++) {
+        fprintf(fi, "%s%d,", t%16?" ":"\n    ", seeds[t]);
+    }
+    fprintf(fi, "\n};\n\n");
+
+    fprintf(fi, "static const builtin_image_t image = {entries, %d, seeds, %d, members};\n\n", num_entries, num_buckets);
+    fprintf(fi, "const builtin_image_t* builtin_getimage()\n");
+    fprintf(fi, "{\n");
+    fprintf(fi, "    return &image;\n");
+    fprintf(fi, "}\n");
+}
+
 int main()
 {
-    registry_classes = builtin_getclasses();
+    registry_init();
 
     as3_import_abc("builtin.abc");
     as3_import_abc("playerglobal.abc");
 
     FILE*fi = fopen("builtin.c", "wb");
 
-    int t;
     int pass;
-
-
-    for(pass=1;pass<=3;pass++) {
+    for(pass=1;pass<=2;pass++) {
         if(pass==1) {
             fprintf(fi, "#include \"builtin.h\"\n");
             fprintf(fi, "\n");
         }
-        if(pass==3) {
-            fprintf(fi, "dict_t* builtin_getclasses()\n");
-            fprintf(fi, "{\n");
-            fprintf(fi, "    dict_t*d = dict_new2(&slotinfo_type);\n");
-        }
-        for(t=0;t<registry_classes->hashsize;t++) {
-            dictentry_t*l = registry_classes->slots[t];
-            while(l) {
-                slotinfo_t*s = (slotinfo_t*)l->key;
-                //printf("%08x %s %s\n", s, s->package, s->name);
-                char*id = mkid(s);
-                if(pass==1) {
-                    write_slotinfo_decl(fi, s, "");
-                }
-                if(pass==2) {
-                    write_slotinfo(fi, s, mkid(s), "");
-                }
-                if(pass==3) {
-                    fprintf(fi, "    dict_put(d, &%s, &%s);\n", id, id);
-                    write_initinfo(fi, s, "    ");
-                }
-                l = l->next;
+        DICT_ITERATE_KEY(registry_classes, slotinfo_t*, s) {
+            //printf("%08x %s %s\n", s, s->package, s->name);
+            if(pass==1) {
+                write_slotinfo_decl(fi, s, "");
+            }
+            if(pass==2) {
+                write_slotinfo(fi, s, mkid(s), "");
             }
         }
+        fprintf(fi, "\n");
     }
-    fprintf(fi, "    _NaN_constant.f =  __builtin_nan(\"\");\n");
-    fprintf(fi, "    _Infinity_constant.f = __builtin_inf();\n");
-    fprintf(fi, "    return d;\n");
-    fprintf(fi, "}\n");
+    write_image(fi);
+    fclose(fi);
     return 0;
 }
@@ -1193,11 +1193,9 @@ const char* get_package_from_name(const char*name)
     /* try explicit imports */
     dictentry_t* e = dict_get_slot(state->imports, name);
     while(e) {
-        if(!strcmp(e->key, name)) {
-            slotinfo_t*c = (slotinfo_t*)e->data;
-            if(c) return c->package;
-        }
-        e = e->next;
+        slotinfo_t*c = (slotinfo_t*)e->data;
+        if(c) return c->package;
+        e = dict_get_next(state->imports, e);
     }
     return 0;
 }
@@ -1230,11 +1228,9 @@ slotinfo_t* find_class(const char*name)
     dictentry_t* e = dict_get_slot(state->imports, name);
     if(c) return c;
     while(e) {
-        if(!strcmp(e->key, name)) {
-            c = (slotinfo_t*)e->data;
-            if(c) return c;
-        }
-        e = e->next;
+        c = (slotinfo_t*)e->data;
+        if(c) return c;
+        e = dict_get_next(state->imports, e);
     }
 
     /* try package.* imports */
@@ -779,6 +779,29 @@ char* constant_tostring(constant_t*c)
         return 0;
     }
 }
+/* a hash over the type and value of a constant which, unlike constant_tostring(),
+   doesn't lose precision on floats */
+uint64_t constant_hash(constant_t*c)
+{
+    if(!c)
+        return 0;
+    uint64_t h = 0;
+    if(NS_TYPE(c->type)) {
+        h = c->ns->access;
+        if(c->ns->name)
+            h ^= hash_block64(c->ns->name, strlen(c->ns->name));
+    } else if(c->type == CONSTANT_INT) {
+        h = (U32)c->i;
+    } else if(c->type == CONSTANT_UINT) {
+        h = c->u;
+    } else if(c->type == CONSTANT_FLOAT) {
+        /* the bit pattern, as a number (so it doesn't depend on byte order) */
+        memcpy(&h, &c->f, sizeof(h));
+    } else if(c->type == CONSTANT_STRING) {
+        h = hash_block64(c->s->str, c->s->len);
+    }
+    return h * 0x9e3779b97f4a7c15ull + c->type;
+}
 char constant_has_index(constant_t*c) 
 {
     if(!c)
@@ -110,6 +110,7 @@ constant_t* constant_new_undefined();
 char constant_has_index(constant_t*c);
 constant_t* constant_fromindex(pool_t*pool, int index, int type);
 char* constant_tostring(constant_t*c);
+uint64_t constant_hash(constant_t*c);
 int constant_get_index(pool_t*pool, constant_t*c);
 void constant_free(constant_t*c);
 
@@ -84,9 +84,16 @@ static void use_asset(asset_bundle_t*a)
 	l = l->next;
     }
 }
+static dict_t*use_log = 0;
+void registry_log_uses(dict_t*log)
+{
+    use_log = log;
+}
 void registry_use(slotinfo_t*s)
 {
     if(!s) return;
+    if(use_log)
+        dict_put(use_log, s, 0);
     if(!(s->flags&FLAG_USED)) {
 	s->flags |= FLAG_USED;
 	if(s->kind == INFOTYPE_CLASS) {
@@ -274,10 +281,66 @@ varinfo_t* varinfo_register_global(U8 access, const char*package, const char*nam
 
 // --------------- builtin classes (from builtin.c) ----------------------
 
+static const builtin_image_t*builtin = 0;
+
+uint64_t builtin_hash(const char*package, const char*name)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(;*package;package++)
+        h = (h ^ (U8)*package) * 0x100000001b3ull;
+    h *= 0x100000001b3ull;
+    for(;*name;name++)
+        h = (h ^ (U8)*name) * 0x100000001b3ull;
+    return h;
+}
+int builtin_position(uint64_t hash, U16 seed, int num_entries)
+{
+    uint64_t h = hash ^ (seed * 0x9e3779b97f4a7c15ull);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h & (num_entries-1);
+}
+static const builtin_entry_t* builtin_lookup(const char*package, const char*name)
+{
+    if(!builtin->num_entries)
+        return 0;
+    uint64_t hash = builtin_hash(package, name);
+    U16 seed = builtin->seeds[(hash >> 32) & (builtin->num_buckets-1)];
+    const builtin_entry_t*e = &builtin->entries[builtin_position(hash, seed, builtin->num_entries)];
+    if(!e->s || strcmp(e->s->name, name) || strcmp(e->s->package, package))
+        return 0;
+    return e;
+}
+
+/* fill in the member dictionaries of a builtin class. Until this is done,
+   the dictionaries are all zero (builtin.c doesn't initialize them). */
+static void builtin_load_members(classinfo_t*c)
+{
+    if(c->members.key_type || !(c->flags&FLAG_BUILTIN))
+        return;
+    const builtin_entry_t*e = builtin_lookup(c->package, c->name);
+    if(!e || e->s != (slotinfo_t*)c) {
+        dict_init2(&c->members, &memberinfo_type, 1);
+        dict_init2(&c->static_members, &memberinfo_type, 1);
+        return;
+    }
+    dict_init2(&c->members, &memberinfo_type, e->num_members*4/3+1);
+    dict_init2(&c->static_members, &memberinfo_type, e->num_static_members*4/3+1);
+    slotinfo_t*const*m = &builtin->members[e->members];
+    int t;
+    for(t=0;t<e->num_members;t++,m++)
+        dict_put(&c->members, *m, *m);
+    for(t=0;t<e->num_static_members;t++,m++)
+        dict_put(&c->static_members, *m, *m);
+}
+
 void registry_init()
 {
-    if(!registry_classes)
-        registry_classes = builtin_getclasses();
+    if(!registry_classes) {
+        registry_classes = dict_new2(&slotinfo_type);
+        builtin = builtin_getimage();
+    }
 }
 slotinfo_t* registry_find(const char*package, const char*name)
 {
@@ -285,7 +348,14 @@ slotinfo_t* registry_find(const char*package, const char*name)
     slotinfo_t tmp;
     tmp.package = package;
     tmp.name = name;
+    /* classes defined in the source (or imported) take precedence
+       over builtin ones */
     slotinfo_t* c = (slotinfo_t*)dict_lookup(registry_classes, &tmp);
+    if(!c) {
+        const builtin_entry_t*e = builtin_lookup(package, name);
+        if(e)
+            c = e->s;
+    }
     /*if(c)
         printf("%s.%s->%08x (%s.%s)\n", package, name, c, c->package, c->name);*/
     return c;
@@ -301,15 +371,126 @@ slotinfo_t* registry_safefind(const char*package, const char*name)
 }
 void registry_dump()
 {
+    DICT_ITERATE_KEY(registry_classes, slotinfo_t*, i) {
+        printf("[%s] %s.%s\n", access2str(i->access), i->package, i->name);
+    }
+    int t;
+    for(t=0;t<builtin->num_entries;t++) {
+        slotinfo_t*i = builtin->entries[t].s;
+        if(i)
+            printf("[%s] %s.%s (builtin)\n", access2str(i->access), i->package, i->name);
+    }
+}
+
+// ----------------------- hashing -----------------------------------
+
+static uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+    h = (h ^ v) * 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 32);
+}
+static uint64_t hash_string(uint64_t h, const char*s)
+{
+    return hash_mix(h, s?hash_block64(s, strlen(s)):1);
+}
+static uint64_t hash_slotinfo_head(uint64_t h, slotinfo_t*s)
+{
+    h = hash_mix(h, s->kind | s->subtype<<8 | (s->flags&~FLAG_USED)<<16 | s->access<<24);
+    h = hash_mix(h, s->slot);
+    h = hash_string(h, s->package);
+    return hash_string(h, s->name);
+}
+static uint64_t hash_typeref(uint64_t h, slotinfo_t*s)
+{
+    if(!s)
+        return hash_mix(h, 0);
+    h = hash_string(h, s->package);
+    return hash_string(h, s->name);
+}
+static uint64_t hash_member(slotinfo_t*s)
+{
+    uint64_t h = hash_slotinfo_head(0, s);
+    if(s->kind == INFOTYPE_METHOD) {
+        h = hash_typeref(h, (slotinfo_t*)((methodinfo_t*)s)->return_type);
+    } else if(s->kind == INFOTYPE_VAR) {
+        varinfo_t*v = (varinfo_t*)s;
+        h = hash_typeref(h, (slotinfo_t*)v->type);
+        /* getters and setters are methodinfos in disguise, and
+           don't have a value */
+        if(!(s->subtype & SUBTYPE_GETSET))
+            h = hash_mix(h, constant_hash(v->value));
+    }
+    return hash_mix(h, 0);
+}
+static uint64_t hash_members(dict_t*members)
+{
+    uint64_t sum = 0;
+    DICT_ITERATE_KEY(members, slotinfo_t*, m) {
+        if(m->access != ACCESS_PRIVATE)
+            sum += hash_member(m);
+    }
+    return sum;
+}
+
+/* returns a hash over everything the registry knows about non-private classes,
+   functions and variables, including imported ones. (Builtin ones are
+   static data, see registry_builtin_hash()). Entries are
+   combined in an order-independent way, so the result only depends on the
+   registry contents, not on the order in which files were parsed. */
+uint64_t registry_hash()
+{
+    uint64_t sum = 0;
+    DICT_ITERATE_KEY(registry_classes, slotinfo_t*, s) {
+        if(s->access == ACCESS_PRIVATE)
+            continue;
+        if(s->kind == INFOTYPE_CLASS) {
+            classinfo_t*c = (classinfo_t*)s;
+            uint64_t h = hash_slotinfo_head(0, s);
+            h = hash_typeref(h, (slotinfo_t*)c->superclass);
+            int t;
+            for(t=0;c->interfaces[t];t++) {
+                h = hash_typeref(h, (slotinfo_t*)c->interfaces[t]);
+            }
+            h = hash_mix(h, hash_members(&c->members));
+            h = hash_mix(h, hash_members(&c->static_members));
+            sum += hash_mix(h, 0);
+        } else {
+            sum += hash_member(s);
+        }
+    }
+    return sum;
+}
+
+/* returns a hash over the builtin classes, functions and variables (as
+   compiled into this binary by mklib), including the members of builtin
+   classes. Unlike registry_hash(), this doesn't load the member tables. */
+uint64_t registry_builtin_hash()
+{
+    uint64_t sum = 0;
     int t;
-    for(t=0;t<registry_classes->hashsize;t++) {
-        dictentry_t*e = registry_classes->slots[t];
-        while(e) {
-            slotinfo_t*i = (slotinfo_t*)e->key;
-            printf("[%s] %s.%s\n", access2str(i->access), i->package, i->name);
-            e = e->next;
+    for(t=0;t<builtin->num_entries;t++) {
+        const builtin_entry_t*e = &builtin->entries[t];
+        slotinfo_t*s = e->s;
+        if(!s)
+            continue;
+        if(s->kind == INFOTYPE_CLASS) {
+            classinfo_t*c = (classinfo_t*)s;
+            uint64_t h = hash_slotinfo_head(0, s);
+            h = hash_typeref(h, (slotinfo_t*)c->superclass);
+            int i;
+            for(i=0;c->interfaces[i];i++) {
+                h = hash_typeref(h, (slotinfo_t*)c->interfaces[i]);
+            }
+            slotinfo_t*const*m = &builtin->members[e->members];
+            for(i=0;i<e->num_members+e->num_static_members;i++) {
+                h = hash_mix(h, hash_member(m[i]) + (i>=e->num_members));
+            }
+            sum += hash_mix(h, 0);
+        } else {
+            sum += hash_member(s);
         }
     }
+    return hash_mix(sum, builtin->num_entries);
 }
 
 memberinfo_t* registry_findmember(classinfo_t*cls, const char*ns, const char*name, char recursive, char is_static)
@@ -319,6 +500,7 @@ memberinfo_t* registry_findmember(classinfo_t*cls, const char*ns, const char*nam
     tmp.package = ns?ns:"";
 
     if(!recursive) {
+        builtin_load_members(cls);
 	if(!is_static) 
 	    return (memberinfo_t*)dict_lookup(&cls->members, &tmp);
 	else
@@ -334,6 +516,7 @@ memberinfo_t* registry_findmember(classinfo_t*cls, const char*ns, const char*nam
     while(s) {
         if(s->kind == INFOTYPE_UNRESOLVED)
             break;
+        builtin_load_members(s);
 
 	if(!is_static) {
 	    m = (slotinfo_t*)dict_lookup(&s->members, &tmp);
@@ -350,6 +533,7 @@ memberinfo_t* registry_findmember(classinfo_t*cls, const char*ns, const char*nam
         classinfo_t*s = cls->interfaces[t];
         if(s->kind != INFOTYPE_UNRESOLVED) {
             while(s) {
+                builtin_load_members(s);
 		if(!is_static) {
 		    m = (slotinfo_t*)dict_lookup(&s->members, &tmp);
 		    if(m) return (memberinfo_t*)m;
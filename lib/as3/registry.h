@@ -150,6 +150,9 @@ char registry_ispackage(const char*package);
 
 void registry_add_asset(asset_bundle_t*bundle);
 void registry_use(slotinfo_t*s);
+void registry_log_uses(dict_t*log);
+uint64_t registry_hash();
+uint64_t registry_builtin_hash();
 asset_bundle_list_t*registry_getassets();
 
 // static multinames
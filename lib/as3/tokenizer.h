@@ -19,6 +19,7 @@
 #ifndef __parser_h__
 #define __parser_h__
 
+#include "../../config.h"
 #include "../q.h"
 #include "abc.h"
 #include "pool.h"
@@ -90,6 +91,24 @@ void tokenizer_begin_xmltext();
 void tokenizer_end_xmltext();
 void tokenizer_end_xml();
 
+/* thread local storage for the scanner state. Without it, only one
+   thread at a time may run the scanner. */
+#if defined(HAVE_THREADS) && defined(__GNUC__)
+#define TOKENIZER_TLS __thread
+#define TOKENIZER_THREADSAFE
+#else
+#define TOKENIZER_TLS
+#endif
+
+/* a source file which was tokenized before parsing it.
+   as3_tokenstream_scan() doesn't touch any global state, and can be
+   called from any thread. It returns 0 if the file needs to be tokenized
+   the normal way (it has includes, errors or warnings) */
+typedef struct _tokenstream tokenstream_t;
+tokenstream_t* as3_tokenstream_scan(const char*filename);
+void as3_tokenstream_input(tokenstream_t*s);
+void as3_tokenstream_free(tokenstream_t*s);
+
 #define T_EOF 0
 
 extern int avm2_lex();
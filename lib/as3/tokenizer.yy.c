@@ -1,6 +1,8 @@
 #line 2 "tokenizer.yy.c"
+#line 24 "tokenizer.lex"
+#include "tokenizer.h"
 
-#line 4 "tokenizer.yy.c"
+#line 6 "tokenizer.yy.c"
 
 #define  YY_INT_ALIGNED short int
 
@@ -177,9 +179,9 @@ typedef struct yy_buffer_state *YY_BUFFER_STATE;
 typedef size_t yy_size_t;
 #endif
 
-extern yy_size_t as3_leng;
+extern TOKENIZER_TLS yy_size_t as3_leng;
 
-extern FILE *as3_in, *as3_out;
+extern TOKENIZER_TLS FILE *as3_in, *as3_out;
 
 #define EOB_ACT_CONTINUE_SCAN 0
 #define EOB_ACT_END_OF_FILE 1
@@ -269,9 +271,9 @@ struct yy_buffer_state
 #endif /* !YY_STRUCT_YY_BUFFER_STATE */
 
 /* Stack of input buffers. */
-static size_t yy_buffer_stack_top = 0; /**< index of top of stack. */
-static size_t yy_buffer_stack_max = 0; /**< capacity of stack. */
-static YY_BUFFER_STATE * yy_buffer_stack = 0; /**< Stack as an array. */
+static TOKENIZER_TLS size_t yy_buffer_stack_top = 0; /**< index of top of stack. */
+static TOKENIZER_TLS size_t yy_buffer_stack_max = 0; /**< capacity of stack. */
+static TOKENIZER_TLS YY_BUFFER_STATE * yy_buffer_stack = 0; /**< Stack as an array. */
 
 /* We provide macros for accessing buffer states in case in the
  * future we want to put the buffer states in a more general
@@ -289,19 +291,19 @@ static YY_BUFFER_STATE * yy_buffer_stack = 0; /**< Stack as an array. */
 #define YY_CURRENT_BUFFER_LVALUE (yy_buffer_stack)[(yy_buffer_stack_top)]
 
 /* yy_hold_char holds the character lost when as3_text is formed. */
-static char yy_hold_char;
-static yy_size_t yy_n_chars;		/* number of characters read into yy_ch_buf */
-yy_size_t as3_leng;
+static TOKENIZER_TLS char yy_hold_char;
+static TOKENIZER_TLS yy_size_t yy_n_chars;		/* number of characters read into yy_ch_buf */
+TOKENIZER_TLS yy_size_t as3_leng;
 
 /* Points to current character in buffer. */
-static char *yy_c_buf_p = (char *) 0;
-static int yy_init = 0;		/* whether we need to initialize */
-static int yy_start = 0;	/* start state number */
+static TOKENIZER_TLS char *yy_c_buf_p = (char *) 0;
+static TOKENIZER_TLS int yy_init = 0;		/* whether we need to initialize */
+static TOKENIZER_TLS int yy_start = 0;	/* start state number */
 
 /* Flag which is used to allow as3_wrap()'s to do buffer switches
  * instead of setting up a fresh as3_in.  A bit of a hack ...
  */
-static int yy_did_buffer_switch_on_eof;
+static TOKENIZER_TLS int yy_did_buffer_switch_on_eof;
 
 void as3_restart (FILE *input_file  );
 void as3__switch_to_buffer (YY_BUFFER_STATE new_buffer  );
@@ -353,7 +355,7 @@ void as3_free (void *  );
 
 typedef unsigned char YY_CHAR;
 
-FILE *as3_in = (FILE *) 0, *as3_out = (FILE *) 0;
+TOKENIZER_TLS FILE *as3_in = (FILE *) 0, *as3_out = (FILE *) 0;
 
 typedef int yy_state_type;
 
@@ -361,7 +363,7 @@ extern int as3_lineno;
 
 int as3_lineno = 1;
 
-extern char *as3_text;
+extern TOKENIZER_TLS char *as3_text;
 #define yytext_ptr as3_text
 
 static yy_state_type yy_get_previous_state (void );
@@ -1565,8 +1567,8 @@ static yyconst flex_int16_t yy_chk[3969] =
       704,  704,  704,  704,  704,  704,  704,  704
     } ;
 
-static yy_state_type yy_last_accepting_state;
-static char *yy_last_accepting_cpos;
+static TOKENIZER_TLS yy_state_type yy_last_accepting_state;
+static TOKENIZER_TLS char *yy_last_accepting_cpos;
 
 extern int as3__flex_debug;
 int as3__flex_debug = 0;
@@ -1578,7 +1580,7 @@ int as3__flex_debug = 0;
 #define yymore() yymore_used_but_not_detected
 #define YY_MORE_ADJ 0
 #define YY_RESTORE_YY_MORE_OFFSET
-char *as3_text;
+TOKENIZER_TLS char *as3_text;
 #line 1 "tokenizer.lex"
 /* tokenizer.lex
 
@@ -1602,20 +1604,48 @@ char *as3_text;
    You should have received a copy of the GNU General Public License
    along with this program; if not, write to the Free Software
    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
-#line 24 "tokenizer.lex"
+#line 27 "tokenizer.lex"
 
 
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <setjmp.h>
 #include "../utf8.h"
 #include "common.h"
 #include "tokenizer.h"
 #include "files.h"
+#include "cache.h"
 
 unsigned int as3_tokencount = 0;
 
+/* The scanner can also run on worker threads, tokenizing files before
+   the parser gets to them (see as3_tokenstream_scan()). Its state is
+   therefore thread local (the Makefile tags the flex globals with
+   TOKENIZER_TLS, too), and line numbers and token values are written
+   through the pointers below, which point to the parser's globals on
+   the main thread. */
+static TOKENIZER_TLS int*scan_line = &current_line;
+static TOKENIZER_TLS int*scan_column = &current_column;
+static TOKENIZER_TLS YYSTYPE*scan_lval = &a3_lval;
+#define current_line (*scan_line)
+#define current_column (*scan_column)
+#define a3_lval (*scan_lval)
+
+/* input offset of the next token */
+static TOKENIZER_TLS int scan_pos = 0;
+#define YY_USER_ACTION scan_pos += yyleng;
+
+/* set while tokenizing ahead of time. Errors and warnings can't be
+   reported then (they would come out of order), and includes can't be
+   followed, so we give up, and leave the file to the parser. */
+static TOKENIZER_TLS jmp_buf*scan_abort = 0;
+#undef syntaxerror
+#define syntaxerror(...) (scan_abort ? longjmp(*scan_abort, 1) : as3_error(__VA_ARGS__))
+#define as3_softwarning(...) (scan_abort ? longjmp(*scan_abort, 1) : as3_softwarning(__VA_ARGS__))
+#define leave_file() (scan_abort ? (void*)0 : leave_file())
+
 static void dbg(const char*format, ...)
 {
     char buf[1024];
@@ -1640,9 +1670,9 @@ static void dbg(const char*format, ...)
 #define YY_CURRENT_BUFFER yy_current_buffer
 #endif
 
-static void*as3_buffer=0;
-static int as3_buffer_pos=0;
-static int as3_buffer_len=0;
+static TOKENIZER_TLS void*as3_buffer=0;
+static TOKENIZER_TLS int as3_buffer_pos=0;
+static TOKENIZER_TLS int as3_buffer_len=0;
 void as3_file_input(FILE*fi)
 {
     as3_in = fi;
@@ -1680,6 +1710,8 @@ void as3_buffer_input(void*buffer, int len)
 
 void handleInclude(char*text, int len, char quotes)
 {
+    if(scan_abort)
+        longjmp(*scan_abort, 1);
     char*filename = 0;
     if(quotes) {
         char*p1 = strchr(text, '"');
@@ -1701,6 +1733,7 @@ void handleInclude(char*text, int len, char quotes)
     }
     
     char*fullfilename = find_file(filename, 1);
+    as3cache_include(fullfilename);
     enter_file2(filename, fullfilename, YY_CURRENT_BUFFER);
     as3_in = fopen(fullfilename, "rb");
     if (!as3_in) {
@@ -1867,7 +1900,7 @@ static inline int m(int type)
     return type;
 }
 
-static char numberbuf[64];
+static TOKENIZER_TLS char numberbuf[64];
 static char*nrbuf()
 {
     if(as3_leng>sizeof(numberbuf)-1)
@@ -2035,6 +2068,9 @@ static int handleregexp()
 void initialize_scanner();
 #define YY_USER_INIT initialize_scanner();
 
+/* as3_lex() (below) either runs the scanner or replays a token stream */
+#define YY_DECL static int as3_scan(void)
+
 /* count the number of lines+columns consumed by this token */
 static inline void l() {
     int t;
@@ -2076,7 +2112,7 @@ static int tokenerror();
 
 
 
-#line 2080 "tokenizer.yy.c"
+#line 2114 "tokenizer.yy.c"
 
 #define INITIAL 0
 #define REGEXPOK 1
@@ -2266,11 +2302,11 @@ YY_DECL
 	register char *yy_cp, *yy_bp;
 	register int yy_act;
     
-#line 536 "tokenizer.lex"
+#line 571 "tokenizer.lex"
 
 
 
-#line 2274 "tokenizer.yy.c"
+#line 2308 "tokenizer.yy.c"
 
 	if ( !(yy_init) )
 		{
@@ -2353,18 +2389,18 @@ do_action:	/* This label is used only to access EOF actions. */
 case 1:
 /* rule 1 can match eol */
 YY_RULE_SETUP
-#line 539 "tokenizer.lex"
+#line 574 "tokenizer.lex"
 {l(); /* single line comment */}
 	YY_BREAK
 case 2:
 /* rule 2 can match eol */
 YY_RULE_SETUP
-#line 540 "tokenizer.lex"
+#line 575 "tokenizer.lex"
 {l(); /* multi line comment */}
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 541 "tokenizer.lex"
+#line 576 "tokenizer.lex"
 {syntaxerror("syntax error: unterminated comment", as3_text);}
 	YY_BREAK
 case 4:
@@ -2373,7 +2409,7 @@ case 4:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 543 "tokenizer.lex"
+#line 578 "tokenizer.lex"
 {l();handleInclude(as3_text, as3_leng, 1);}
 	YY_BREAK
 case 5:
@@ -2382,26 +2418,26 @@ case 5:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 544 "tokenizer.lex"
+#line 579 "tokenizer.lex"
 {l();handleInclude(as3_text, as3_leng, 0);}
 	YY_BREAK
 case 6:
 /* rule 6 can match eol */
 YY_RULE_SETUP
-#line 545 "tokenizer.lex"
+#line 580 "tokenizer.lex"
 {l(); BEGIN(DEFAULT);handleString(as3_text, as3_leng);return T_STRING;}
 	YY_BREAK
 case 7:
 /* rule 7 can match eol */
 YY_RULE_SETUP
-#line 546 "tokenizer.lex"
+#line 581 "tokenizer.lex"
 {l(); BEGIN(DEFAULT);handleCData(as3_text, as3_leng);return T_STRING;}
 	YY_BREAK
 
 case 8:
 /* rule 8 can match eol */
 YY_RULE_SETUP
-#line 549 "tokenizer.lex"
+#line 584 "tokenizer.lex"
 {l(); BEGIN(DEFAULT);handleRaw(as3_text, as3_leng);return T_STRING;}
 	YY_BREAK
 
@@ -2409,47 +2445,47 @@ YY_RULE_SETUP
 case 9:
 /* rule 9 can match eol */
 YY_RULE_SETUP
-#line 553 "tokenizer.lex"
+#line 588 "tokenizer.lex"
 {l(); handleRaw(as3_text, as3_leng);return T_STRING;}
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 554 "tokenizer.lex"
+#line 589 "tokenizer.lex"
 {c(); BEGIN(REGEXPOK);return m('{');}
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 555 "tokenizer.lex"
+#line 590 "tokenizer.lex"
 {c(); return m('<');}
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 556 "tokenizer.lex"
+#line 591 "tokenizer.lex"
 {c(); return m('/');}
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 557 "tokenizer.lex"
+#line 592 "tokenizer.lex"
 {c(); return m('>');}
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 558 "tokenizer.lex"
+#line 593 "tokenizer.lex"
 {c(); return m('=');}
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 559 "tokenizer.lex"
+#line 594 "tokenizer.lex"
 {c(); handleRaw(as3_text, as3_leng);return T_IDENTIFIER;}
 	YY_BREAK
 case 16:
 /* rule 16 can match eol */
 YY_RULE_SETUP
-#line 560 "tokenizer.lex"
+#line 595 "tokenizer.lex"
 {l(); handleRaw(as3_text, as3_leng);return T_STRING;}
 	YY_BREAK
 case YY_STATE_EOF(XML):
-#line 561 "tokenizer.lex"
+#line 596 "tokenizer.lex"
 {syntaxerror("unexpected end of file");}
 	YY_BREAK
 
@@ -2457,45 +2493,45 @@ case YY_STATE_EOF(XML):
 case 17:
 /* rule 17 can match eol */
 YY_RULE_SETUP
-#line 565 "tokenizer.lex"
+#line 600 "tokenizer.lex"
 {l(); handleRaw(as3_text, as3_leng);return T_STRING;}
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 566 "tokenizer.lex"
+#line 601 "tokenizer.lex"
 {c(); BEGIN(REGEXPOK);return m('{');}
 	YY_BREAK
 case 19:
 YY_RULE_SETUP
-#line 567 "tokenizer.lex"
+#line 602 "tokenizer.lex"
 {c(); BEGIN(XML);return m('<');}
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 568 "tokenizer.lex"
+#line 603 "tokenizer.lex"
 {c(); return m('>');}
 	YY_BREAK
 case 21:
 /* rule 21 can match eol */
 YY_RULE_SETUP
-#line 569 "tokenizer.lex"
+#line 604 "tokenizer.lex"
 {l(); handleRaw(as3_text, as3_leng);return T_STRING;}
 	YY_BREAK
 case 22:
 /* rule 22 can match eol */
 YY_RULE_SETUP
-#line 570 "tokenizer.lex"
+#line 605 "tokenizer.lex"
 {l(); handleRaw(as3_text, as3_leng);return T_STRING;}
 	YY_BREAK
 case YY_STATE_EOF(XMLTEXT):
-#line 571 "tokenizer.lex"
+#line 606 "tokenizer.lex"
 {syntaxerror("unexpected end of file");}
 	YY_BREAK
 
 
 case 23:
 YY_RULE_SETUP
-#line 575 "tokenizer.lex"
+#line 610 "tokenizer.lex"
 {c(); BEGIN(DEFAULT);return handleregexp();} 
 	YY_BREAK
 case 24:
@@ -2504,7 +2540,7 @@ case 24:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 576 "tokenizer.lex"
+#line 611 "tokenizer.lex"
 {c(); BEGIN(DEFAULT);return handlehex();}
 	YY_BREAK
 case 25:
@@ -2513,7 +2549,7 @@ case 25:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 577 "tokenizer.lex"
+#line 612 "tokenizer.lex"
 {c(); BEGIN(DEFAULT);return handlehexfloat();}
 	YY_BREAK
 case 26:
@@ -2522,7 +2558,7 @@ case 26:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 578 "tokenizer.lex"
+#line 613 "tokenizer.lex"
 {c(); BEGIN(DEFAULT);return handleint();}
 	YY_BREAK
 case 27:
@@ -2531,29 +2567,29 @@ case 27:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 579 "tokenizer.lex"
+#line 614 "tokenizer.lex"
 {c(); BEGIN(DEFAULT);return handlefloat();}
 	YY_BREAK
 
 case 28:
 YY_RULE_SETUP
-#line 582 "tokenizer.lex"
+#line 617 "tokenizer.lex"
 {c(); BEGIN(REGEXPOK);return m(T_DICTSTART);}
 	YY_BREAK
 case 29:
 YY_RULE_SETUP
-#line 583 "tokenizer.lex"
+#line 618 "tokenizer.lex"
 {c(); BEGIN(DEFAULT); return m('{');}
 	YY_BREAK
 case 30:
 YY_RULE_SETUP
-#line 585 "tokenizer.lex"
+#line 620 "tokenizer.lex"
 {/* utf 8 bom (0xfeff) */}
 	YY_BREAK
 case 31:
 /* rule 31 can match eol */
 YY_RULE_SETUP
-#line 586 "tokenizer.lex"
+#line 621 "tokenizer.lex"
 {l();}
 	YY_BREAK
 case 32:
@@ -2562,7 +2598,7 @@ case 32:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 588 "tokenizer.lex"
+#line 623 "tokenizer.lex"
 {c(); BEGIN(DEFAULT);return handlehex();}
 	YY_BREAK
 case 33:
@@ -2571,7 +2607,7 @@ case 33:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 589 "tokenizer.lex"
+#line 624 "tokenizer.lex"
 {c(); BEGIN(DEFAULT);return handlehexfloat();}
 	YY_BREAK
 case 34:
@@ -2580,7 +2616,7 @@ case 34:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 590 "tokenizer.lex"
+#line 625 "tokenizer.lex"
 {c(); BEGIN(DEFAULT);return handleint();}
 	YY_BREAK
 case 35:
@@ -2589,17 +2625,17 @@ case 35:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 591 "tokenizer.lex"
+#line 626 "tokenizer.lex"
 {c(); BEGIN(DEFAULT);return handlefloat();}
 	YY_BREAK
 case 36:
 YY_RULE_SETUP
-#line 592 "tokenizer.lex"
+#line 627 "tokenizer.lex"
 {c(); BEGIN(DEFAULT);return m(KW_NAN);}
 	YY_BREAK
 case 37:
 YY_RULE_SETUP
-#line 594 "tokenizer.lex"
+#line 629 "tokenizer.lex"
 {/* for debugging: generates a tokenizer-level error */
                               syntaxerror("3rr0r");}
 	YY_BREAK
@@ -2609,7 +2645,7 @@ case 38:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 597 "tokenizer.lex"
+#line 632 "tokenizer.lex"
 {l();BEGIN(DEFAULT);handleLabel(as3_text, as3_leng-3);return T_FOR;}
 	YY_BREAK
 case 39:
@@ -2618,7 +2654,7 @@ case 39:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 598 "tokenizer.lex"
+#line 633 "tokenizer.lex"
 {l();BEGIN(DEFAULT);handleLabel(as3_text, as3_leng-2);return T_DO;}
 	YY_BREAK
 case 40:
@@ -2627,7 +2663,7 @@ case 40:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 599 "tokenizer.lex"
+#line 634 "tokenizer.lex"
 {l();BEGIN(DEFAULT);handleLabel(as3_text, as3_leng-5);return T_WHILE;}
 	YY_BREAK
 case 41:
@@ -2636,449 +2672,449 @@ case 41:
 (yy_c_buf_p) = yy_cp -= 1;
 YY_DO_BEFORE_ACTION; /* set up as3_text again */
 YY_RULE_SETUP
-#line 600 "tokenizer.lex"
+#line 635 "tokenizer.lex"
 {l();BEGIN(DEFAULT);handleLabel(as3_text, as3_leng-6);return T_SWITCH;}
 	YY_BREAK
 case 42:
 /* rule 42 can match eol */
 YY_RULE_SETUP
-#line 601 "tokenizer.lex"
+#line 636 "tokenizer.lex"
 {l();BEGIN(DEFAULT);return m(KW_DEFAULT_XML);}
 	YY_BREAK
 case 43:
 YY_RULE_SETUP
-#line 602 "tokenizer.lex"
+#line 637 "tokenizer.lex"
 {c();BEGIN(DEFAULT);a3_lval.id="";return T_FOR;}
 	YY_BREAK
 case 44:
 YY_RULE_SETUP
-#line 603 "tokenizer.lex"
+#line 638 "tokenizer.lex"
 {c();BEGIN(DEFAULT);a3_lval.id="";return T_DO;}
 	YY_BREAK
 case 45:
 YY_RULE_SETUP
-#line 604 "tokenizer.lex"
+#line 639 "tokenizer.lex"
 {c();BEGIN(DEFAULT);a3_lval.id="";return T_WHILE;}
 	YY_BREAK
 case 46:
 YY_RULE_SETUP
-#line 605 "tokenizer.lex"
+#line 640 "tokenizer.lex"
 {c();BEGIN(DEFAULT);a3_lval.id="";return T_SWITCH;}
 	YY_BREAK
 case 47:
 YY_RULE_SETUP
-#line 607 "tokenizer.lex"
+#line 642 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_ANDAND);}
 	YY_BREAK
 case 48:
 YY_RULE_SETUP
-#line 608 "tokenizer.lex"
+#line 643 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_OROR);}
 	YY_BREAK
 case 49:
 YY_RULE_SETUP
-#line 609 "tokenizer.lex"
+#line 644 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_NE);}
 	YY_BREAK
 case 50:
 YY_RULE_SETUP
-#line 610 "tokenizer.lex"
+#line 645 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_NEE);}
 	YY_BREAK
 case 51:
 YY_RULE_SETUP
-#line 611 "tokenizer.lex"
+#line 646 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_EQEQEQ);}
 	YY_BREAK
 case 52:
 YY_RULE_SETUP
-#line 612 "tokenizer.lex"
+#line 647 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_EQEQ);}
 	YY_BREAK
 case 53:
 YY_RULE_SETUP
-#line 613 "tokenizer.lex"
+#line 648 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_GE);}
 	YY_BREAK
 case 54:
 YY_RULE_SETUP
-#line 614 "tokenizer.lex"
+#line 649 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_LE);}
 	YY_BREAK
 case 55:
 YY_RULE_SETUP
-#line 615 "tokenizer.lex"
+#line 650 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(T_MINUSMINUS);}
 	YY_BREAK
 case 56:
 YY_RULE_SETUP
-#line 616 "tokenizer.lex"
+#line 651 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(T_PLUSPLUS);}
 	YY_BREAK
 case 57:
 YY_RULE_SETUP
-#line 617 "tokenizer.lex"
+#line 652 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_PLUSBY);}
 	YY_BREAK
 case 58:
 YY_RULE_SETUP
-#line 618 "tokenizer.lex"
+#line 653 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_XORBY);}
 	YY_BREAK
 case 59:
 YY_RULE_SETUP
-#line 619 "tokenizer.lex"
+#line 654 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_MINUSBY);}
 	YY_BREAK
 case 60:
 YY_RULE_SETUP
-#line 620 "tokenizer.lex"
+#line 655 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_DIVBY);}
 	YY_BREAK
 case 61:
 YY_RULE_SETUP
-#line 621 "tokenizer.lex"
+#line 656 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_MODBY);}
 	YY_BREAK
 case 62:
 YY_RULE_SETUP
-#line 622 "tokenizer.lex"
+#line 657 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_MULBY);}
 	YY_BREAK
 case 63:
 YY_RULE_SETUP
-#line 623 "tokenizer.lex"
+#line 658 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_ORBY);}
 	YY_BREAK
 case 64:
 YY_RULE_SETUP
-#line 624 "tokenizer.lex"
+#line 659 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_ANDBY);}
 	YY_BREAK
 case 65:
 YY_RULE_SETUP
-#line 625 "tokenizer.lex"
+#line 660 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_SHRBY);}
 	YY_BREAK
 case 66:
 YY_RULE_SETUP
-#line 626 "tokenizer.lex"
+#line 661 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_SHLBY);}
 	YY_BREAK
 case 67:
 YY_RULE_SETUP
-#line 627 "tokenizer.lex"
+#line 662 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_USHRBY);}
 	YY_BREAK
 case 68:
 YY_RULE_SETUP
-#line 628 "tokenizer.lex"
+#line 663 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_SHL);}
 	YY_BREAK
 case 69:
 YY_RULE_SETUP
-#line 629 "tokenizer.lex"
+#line 664 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_USHR);}
 	YY_BREAK
 case 70:
 YY_RULE_SETUP
-#line 630 "tokenizer.lex"
+#line 665 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_SHR);}
 	YY_BREAK
 case 71:
 YY_RULE_SETUP
-#line 631 "tokenizer.lex"
+#line 666 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_DOTDOTDOT);}
 	YY_BREAK
 case 72:
 YY_RULE_SETUP
-#line 632 "tokenizer.lex"
+#line 667 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_DOTDOT);}
 	YY_BREAK
 case 73:
 YY_RULE_SETUP
-#line 633 "tokenizer.lex"
+#line 668 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m('.');}
 	YY_BREAK
 case 74:
 YY_RULE_SETUP
-#line 634 "tokenizer.lex"
+#line 669 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(T_COLONCOLON);}
 	YY_BREAK
 case 75:
 YY_RULE_SETUP
-#line 635 "tokenizer.lex"
+#line 670 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(':');}
 	YY_BREAK
 case 76:
 YY_RULE_SETUP
-#line 636 "tokenizer.lex"
+#line 671 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_INSTANCEOF);}
 	YY_BREAK
 case 77:
 YY_RULE_SETUP
-#line 637 "tokenizer.lex"
+#line 672 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_IMPLEMENTS);}
 	YY_BREAK
 case 78:
 YY_RULE_SETUP
-#line 638 "tokenizer.lex"
+#line 673 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_INTERFACE);}
 	YY_BREAK
 case 79:
 YY_RULE_SETUP
-#line 639 "tokenizer.lex"
+#line 674 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_PROTECTED);}
 	YY_BREAK
 case 80:
 YY_RULE_SETUP
-#line 640 "tokenizer.lex"
+#line 675 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_NAMESPACE);}
 	YY_BREAK
 case 81:
 YY_RULE_SETUP
-#line 641 "tokenizer.lex"
+#line 676 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_UNDEFINED);}
 	YY_BREAK
 case 82:
 YY_RULE_SETUP
-#line 642 "tokenizer.lex"
+#line 677 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_ARGUMENTS);}
 	YY_BREAK
 case 83:
 YY_RULE_SETUP
-#line 643 "tokenizer.lex"
+#line 678 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_CONTINUE);}
 	YY_BREAK
 case 84:
 YY_RULE_SETUP
-#line 644 "tokenizer.lex"
+#line 679 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_OVERRIDE);}
 	YY_BREAK
 case 85:
 YY_RULE_SETUP
-#line 645 "tokenizer.lex"
+#line 680 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_INTERNAL);}
 	YY_BREAK
 case 86:
 YY_RULE_SETUP
-#line 646 "tokenizer.lex"
+#line 681 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_FUNCTION);}
 	YY_BREAK
 case 87:
 YY_RULE_SETUP
-#line 647 "tokenizer.lex"
+#line 682 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_FINALLY);}
 	YY_BREAK
 case 88:
 YY_RULE_SETUP
-#line 648 "tokenizer.lex"
+#line 683 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_DEFAULT);}
 	YY_BREAK
 case 89:
 YY_RULE_SETUP
-#line 649 "tokenizer.lex"
+#line 684 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_PACKAGE);}
 	YY_BREAK
 case 90:
 YY_RULE_SETUP
-#line 650 "tokenizer.lex"
+#line 685 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_PRIVATE);}
 	YY_BREAK
 case 91:
 YY_RULE_SETUP
-#line 651 "tokenizer.lex"
+#line 686 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_DYNAMIC);}
 	YY_BREAK
 case 92:
 YY_RULE_SETUP
-#line 652 "tokenizer.lex"
+#line 687 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_EXTENDS);}
 	YY_BREAK
 case 93:
 YY_RULE_SETUP
-#line 653 "tokenizer.lex"
+#line 688 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_DELETE);}
 	YY_BREAK
 case 94:
 YY_RULE_SETUP
-#line 654 "tokenizer.lex"
+#line 689 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_RETURN);}
 	YY_BREAK
 case 95:
 YY_RULE_SETUP
-#line 655 "tokenizer.lex"
+#line 690 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_PUBLIC);}
 	YY_BREAK
 case 96:
 YY_RULE_SETUP
-#line 656 "tokenizer.lex"
+#line 691 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_NATIVE);}
 	YY_BREAK
 case 97:
 YY_RULE_SETUP
-#line 657 "tokenizer.lex"
+#line 692 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_STATIC);}
 	YY_BREAK
 case 98:
 YY_RULE_SETUP
-#line 658 "tokenizer.lex"
+#line 693 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_IMPORT);}
 	YY_BREAK
 case 99:
 YY_RULE_SETUP
-#line 659 "tokenizer.lex"
+#line 694 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_TYPEOF);}
 	YY_BREAK
 case 100:
 YY_RULE_SETUP
-#line 660 "tokenizer.lex"
+#line 695 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_THROW);}
 	YY_BREAK
 case 101:
 YY_RULE_SETUP
-#line 661 "tokenizer.lex"
+#line 696 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_CLASS);}
 	YY_BREAK
 case 102:
 YY_RULE_SETUP
-#line 662 "tokenizer.lex"
+#line 697 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_CONST);}
 	YY_BREAK
 case 103:
 YY_RULE_SETUP
-#line 663 "tokenizer.lex"
+#line 698 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_CATCH);}
 	YY_BREAK
 case 104:
 YY_RULE_SETUP
-#line 664 "tokenizer.lex"
+#line 699 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_FINAL);}
 	YY_BREAK
 case 105:
 YY_RULE_SETUP
-#line 665 "tokenizer.lex"
+#line 700 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_FALSE);}
 	YY_BREAK
 case 106:
 YY_RULE_SETUP
-#line 666 "tokenizer.lex"
+#line 701 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_BREAK);}
 	YY_BREAK
 case 107:
 YY_RULE_SETUP
-#line 667 "tokenizer.lex"
+#line 702 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_SUPER);}
 	YY_BREAK
 case 108:
 YY_RULE_SETUP
-#line 668 "tokenizer.lex"
+#line 703 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_EACH);}
 	YY_BREAK
 case 109:
 YY_RULE_SETUP
-#line 669 "tokenizer.lex"
+#line 704 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_VOID);}
 	YY_BREAK
 case 110:
 YY_RULE_SETUP
-#line 670 "tokenizer.lex"
+#line 705 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_TRUE);}
 	YY_BREAK
 case 111:
 YY_RULE_SETUP
-#line 671 "tokenizer.lex"
+#line 706 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_NULL);}
 	YY_BREAK
 case 112:
 YY_RULE_SETUP
-#line 672 "tokenizer.lex"
+#line 707 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_ELSE);}
 	YY_BREAK
 case 113:
 YY_RULE_SETUP
-#line 673 "tokenizer.lex"
+#line 708 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_CASE);}
 	YY_BREAK
 case 114:
 YY_RULE_SETUP
-#line 674 "tokenizer.lex"
+#line 709 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_WITH);}
 	YY_BREAK
 case 115:
 YY_RULE_SETUP
-#line 675 "tokenizer.lex"
+#line 710 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_USE);}
 	YY_BREAK
 case 116:
 YY_RULE_SETUP
-#line 676 "tokenizer.lex"
+#line 711 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_NEW);}
 	YY_BREAK
 case 117:
 YY_RULE_SETUP
-#line 677 "tokenizer.lex"
+#line 712 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_GET);}
 	YY_BREAK
 case 118:
 YY_RULE_SETUP
-#line 678 "tokenizer.lex"
+#line 713 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_SET);}
 	YY_BREAK
 case 119:
 YY_RULE_SETUP
-#line 679 "tokenizer.lex"
+#line 714 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_VAR);}
 	YY_BREAK
 case 120:
 YY_RULE_SETUP
-#line 680 "tokenizer.lex"
+#line 715 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_TRY);}
 	YY_BREAK
 case 121:
 YY_RULE_SETUP
-#line 681 "tokenizer.lex"
+#line 716 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_IS) ;}
 	YY_BREAK
 case 122:
 YY_RULE_SETUP
-#line 682 "tokenizer.lex"
+#line 717 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_IN) ;}
 	YY_BREAK
 case 123:
 YY_RULE_SETUP
-#line 683 "tokenizer.lex"
+#line 718 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(KW_IF) ;}
 	YY_BREAK
 case 124:
 YY_RULE_SETUP
-#line 684 "tokenizer.lex"
+#line 719 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(KW_AS);}
 	YY_BREAK
 case 125:
 YY_RULE_SETUP
-#line 685 "tokenizer.lex"
+#line 720 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return handleIdentifier();}
 	YY_BREAK
 case 126:
 YY_RULE_SETUP
-#line 687 "tokenizer.lex"
+#line 722 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(as3_text[0]);}
 	YY_BREAK
 case 127:
 YY_RULE_SETUP
-#line 688 "tokenizer.lex"
+#line 723 "tokenizer.lex"
 {c();BEGIN(REGEXPOK);return m(as3_text[0]);}
 	YY_BREAK
 case 128:
 YY_RULE_SETUP
-#line 689 "tokenizer.lex"
+#line 724 "tokenizer.lex"
 {c();BEGIN(DEFAULT);return m(as3_text[0]);}
 	YY_BREAK
 
 case 129:
 YY_RULE_SETUP
-#line 692 "tokenizer.lex"
+#line 727 "tokenizer.lex"
 {tokenerror();}
 	YY_BREAK
 
@@ -3086,7 +3122,7 @@ case YY_STATE_EOF(INITIAL):
 case YY_STATE_EOF(REGEXPOK):
 case YY_STATE_EOF(BEGINNING):
 case YY_STATE_EOF(DEFAULT):
-#line 694 "tokenizer.lex"
+#line 729 "tokenizer.lex"
 {l();
                               void*b = leave_file();
 			      if (!b) {
@@ -3101,10 +3137,10 @@ case YY_STATE_EOF(DEFAULT):
 	YY_BREAK
 case 130:
 YY_RULE_SETUP
-#line 706 "tokenizer.lex"
+#line 741 "tokenizer.lex"
 ECHO;
 	YY_BREAK
-#line 3108 "tokenizer.yy.c"
+#line 3142 "tokenizer.yy.c"
 
 	case YY_END_OF_BUFFER:
 		{
@@ -4103,7 +4139,7 @@ void as3_free (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 706 "tokenizer.lex"
+#line 741 "tokenizer.lex"
 
 
 
@@ -4202,23 +4238,158 @@ char*token2string(enum yytokentype nr, YYSTYPE v)
     }
 }
 
+/* a file tokenized ahead of time, see as3_tokenstream_scan() */
+typedef struct _streamtoken {
+    int type;
+    YYSTYPE value;
+    int line, column; // after the token
+    int end; // input offset after the token
+} streamtoken_t;
+
+struct _tokenstream {
+    char*data;
+    int len;
+    streamtoken_t*tokens;
+    int num;
+    int size;
+    int pos;
+};
+
+/* the stream the parser currently reads from */
+static tokenstream_t*replay = 0;
+
+tokenstream_t* as3_tokenstream_scan(const char*filename)
+{
+    FILE*fi = fopen(filename, "rb");
+    if(!fi)
+        return 0;
+    fseek(fi, 0, SEEK_END);
+    int len = ftell(fi);
+    fseek(fi, 0, SEEK_SET);
+
+    tokenstream_t*s = calloc(1, sizeof(tokenstream_t));
+    s->data = malloc(len+1);
+    s->len = fread(s->data, 1, len, fi);
+    fclose(fi);
+
+    int line = 1, column = 0;
+    YYSTYPE lval;
+    memset(&lval, 0, sizeof(lval));
+    jmp_buf bail;
+
+    int*old_line = scan_line;
+    int*old_column = scan_column;
+    YYSTYPE*old_lval = scan_lval;
+    scan_line = &line;
+    scan_column = &column;
+    scan_lval = &lval;
+    scan_abort = &bail;
+    scan_pos = 0;
+    as3_buffer_input(s->data, s->len);
+
+    char ok = 0;
+    if(!setjmp(bail)) {
+        while(1) {
+            int type = as3_scan();
+            if(s->num == s->size) {
+                s->size = s->size ? s->size*2 : 1024;
+                s->tokens = realloc(s->tokens, s->size*sizeof(streamtoken_t));
+            }
+            streamtoken_t*t = &s->tokens[s->num++];
+            t->type = type;
+            t->value = lval;
+            t->line = line;
+            t->column = column;
+            t->end = scan_pos;
+            if(!type)
+                break;
+        }
+        ok = 1;
+    }
+    as3_lex_destroy();
+    scan_abort = 0;
+    scan_line = old_line;
+    scan_column = old_column;
+    scan_lval = old_lval;
+
+    if(!ok) {
+        as3_tokenstream_free(s);
+        return 0;
+    }
+    return s;
+}
+
+void as3_tokenstream_input(tokenstream_t*s)
+{
+    s->pos = 0;
+    replay = s;
+}
+
+void as3_tokenstream_free(tokenstream_t*s)
+{
+    if(replay == s)
+        replay = 0;
+    free(s->tokens);
+    free(s->data);
+    free(s);
+}
+
+int as3_lex()
+{
+    if(!replay)
+        return as3_scan();
+    if(replay->pos == replay->num)
+        return T_EOF;
+    streamtoken_t*t = &replay->tokens[replay->pos++];
+    a3_lval = t->value;
+    current_line = t->line;
+    current_column = t->column;
+    if(t->type == T_EOF) {
+        /* what the <<EOF>> rule does */
+        leave_file();
+    }
+    return t->type;
+}
+
+/* The parser is about to switch the scanner to a different state (for
+   inline XML), which the recorded tokens don't reflect. Scan the rest of
+   the file directly. */
+static void scan_live()
+{
+    tokenstream_t*s = replay;
+    if(!s)
+        return;
+    replay = 0;
+    int pos = s->pos ? s->tokens[s->pos-1].end : 0;
+    as3_buffer_input(s->data+pos, s->len-pos);
+    yy_switch_to_buffer(yy_create_buffer(yyin, YY_BUF_SIZE));
+    yy_set_bol(!pos || s->data[pos-1]=='\n');
+    yyout = stdout;
+    yy_init = 1; // don't run YY_USER_INIT, we set the state ourselves
+    scan_pos = pos;
+}
+
 void tokenizer_begin_xml()
 {
+    scan_live();
     dbg("begin reading xml");
     BEGIN(XML);
 }
 void tokenizer_begin_xmltext()
 {
+    scan_live();
     dbg("begin reading xml text");
     BEGIN(XMLTEXT);
 }
 void tokenizer_end_xmltext()
 {
+    scan_live();
     dbg("end reading xml text");
     BEGIN(XML);
 }
 void tokenizer_end_xml()
 {
+    scan_live();
     dbg("end reading xml");
     BEGIN(DEFAULT);
 }
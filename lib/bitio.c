@@ -38,6 +38,10 @@
 #include <zlib.h>
 #define ZLIB_BUFFER_SIZE 16384
 #endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#define LZMA_BUFFER_SIZE 16384
+#endif
 #include "./bitio.h"
 
 /* ---------------------------- null reader ------------------------------- */
@@ -676,6 +680,255 @@ void writer_init_zlibdeflate(writer_t*w, writer_t*output)
 #endif
 }
 
+/* ---------------------------- lzmainflate reader -------------------------- */
+
+/* LZMA streams as used in SWF files (ZWS): a 32 bit length of the
+   compressed data, followed by the 5 byte LZMA properties and the
+   raw LZMA data */
+typedef struct _lzmainflate
+{
+#ifdef HAVE_LZMA
+    lzma_stream ls;
+    reader_t*input;
+    U32 input_left;
+    unsigned char readbuffer[LZMA_BUFFER_SIZE];
+#endif
+} lzmainflate_t;
+
+#ifdef HAVE_LZMA
+static void lzma_error(lzma_ret ret, char* msg)
+{
+    fprintf(stderr, "%s: lzma error (%d)\n", msg, ret);
+    exit(1);
+}
+#endif
+
+static int reader_lzmainflate(reader_t*reader, void* data, int len) 
+{
+#ifdef HAVE_LZMA
+    lzmainflate_t*z = (lzmainflate_t*)reader->internal;
+    lzma_ret ret;
+    if(!z) {
+	return 0;
+    }
+    if(!len)
+	return 0;
+    
+    z->ls.next_out = (uint8_t*)data;
+    z->ls.avail_out = len;
+
+    while(1) {
+	if(!z->ls.avail_in && z->input_left) {
+	    int l = z->input_left < LZMA_BUFFER_SIZE ? z->input_left : LZMA_BUFFER_SIZE;
+	    l = z->input->read(z->input, z->readbuffer, l);
+	    z->input_left = l>0 ? z->input_left - l : 0;
+	    z->ls.next_in = z->readbuffer;
+	    z->ls.avail_in = l>0 ? l : 0;
+	}
+	ret = lzma_code(&z->ls, z->ls.avail_in ? LZMA_RUN : LZMA_FINISH);
+
+	/* not all encoders write an end marker, so running out of
+	   input is treated like the end of the stream */
+	if (ret == LZMA_STREAM_END || 
+	   (ret == LZMA_BUF_ERROR && !z->ls.avail_in && !z->input_left)) {
+		int pos = z->ls.next_out - (uint8_t*)data;
+		lzma_end(&z->ls);
+		free(reader->internal);
+		reader->internal = 0;
+		reader->pos += pos;
+		return pos;
+	}
+	if (ret != LZMA_OK) lzma_error(ret, "bitio:lzma_decode");
+
+	if(!z->ls.avail_out) {
+	    break;
+	}
+    }
+    reader->pos += len;
+    return len;
+#else
+    fprintf(stderr, "Error: swftools was compiled without lzma support");
+    exit(1);
+#endif
+}
+static int reader_lzmaseek(reader_t*reader, int pos)
+{
+    fprintf(stderr, "Error: seeking not supported for lzma streams");
+    return -1;
+}
+static void reader_lzmainflate_dealloc(reader_t*reader)
+{
+#ifdef HAVE_LZMA
+    lzmainflate_t*z = (lzmainflate_t*)reader->internal;
+    /* test whether read() already did basic deallocation */
+    if(reader->internal) {
+	lzma_end(&z->ls);
+	free(reader->internal);
+    }
+    memset(reader, 0, sizeof(reader_t));
+#endif
+}
+void reader_init_lzmainflate(reader_t*r, reader_t*input)
+{
+#ifdef HAVE_LZMA
+    lzmainflate_t*z = (lzmainflate_t*)malloc(sizeof(lzmainflate_t));
+    lzma_stream init = LZMA_STREAM_INIT;
+    lzma_ret ret;
+    memset(z, 0, sizeof(lzmainflate_t));
+    memset(r, 0, sizeof(reader_t));
+    r->internal = z;
+    r->read = reader_lzmainflate;
+    r->seek = reader_lzmaseek;
+    r->dealloc = reader_lzmainflate_dealloc;
+    r->type = READER_TYPE_LZMA;
+    r->pos = 0;
+    z->input = input;
+    z->ls = init;
+    ret = lzma_alone_decoder(&z->ls, UINT64_MAX);
+    if (ret != LZMA_OK) lzma_error(ret, "bitio:lzma_init");
+
+    /* translate the SWF header into a .lzma header (properties, followed
+       by a 64 bit uncompressed size, which we don't know) */
+    z->input_left = reader_readU32(input);
+    memset(z->readbuffer, 0xff, 13);
+    input->read(input, z->readbuffer, 5);
+    z->ls.next_in = z->readbuffer;
+    z->ls.avail_in = 13;
+    reader_resetbits(r);
+#else
+    fprintf(stderr, "Error: swftools was compiled without lzma support");
+    exit(1);
+#endif
+}
+
+/* ---------------------------- lzmadeflate writer -------------------------- */
+
+typedef struct _lzmadeflate
+{
+#ifdef HAVE_LZMA
+    lzma_stream ls;
+    writer_t*output;
+    writer_t buffer;
+    unsigned char writebuffer[LZMA_BUFFER_SIZE];
+#endif
+} lzmadeflate_t;
+
+#ifdef HAVE_LZMA
+static void writer_lzmadeflate_run(writer_t*writer, lzma_action action)
+{
+    lzmadeflate_t*z = (lzmadeflate_t*)writer->internal;
+    while(1) {
+	lzma_ret ret = lzma_code(&z->ls, action);
+	if (ret != LZMA_OK && ret != LZMA_STREAM_END) lzma_error(ret, "bitio:lzma_encode");
+
+	if(z->ls.next_out != z->writebuffer) {
+	    z->buffer.write(&z->buffer, z->writebuffer, z->ls.next_out - (uint8_t*)z->writebuffer);
+	    z->ls.next_out = z->writebuffer;
+	    z->ls.avail_out = LZMA_BUFFER_SIZE;
+	}
+	if(ret == LZMA_STREAM_END || (action == LZMA_RUN && !z->ls.avail_in))
+	    break;
+    }
+}
+#endif
+
+static int writer_lzmadeflate_write(writer_t*writer, void* data, int len) 
+{
+#ifdef HAVE_LZMA
+    lzmadeflate_t*z = (lzmadeflate_t*)writer->internal;
+    if(writer->type != WRITER_TYPE_LZMA) {
+	fprintf(stderr, "Wrong writer ID (writer not initialized?)\n");
+	return 0;
+    }
+    if(!z) {
+	fprintf(stderr, "lzma not initialized!\n");
+	return 0;
+    }
+    if(!len)
+	return 0;
+    
+    z->ls.next_in = (uint8_t*)data;
+    z->ls.avail_in = len;
+    writer_lzmadeflate_run(writer, LZMA_RUN);
+    return len;
+#else
+    fprintf(stderr, "Error: swftools was compiled without lzma support");
+    exit(1);
+#endif
+}
+
+static void writer_lzmadeflate_flush(writer_t*writer)
+{
+    /* lzma_alone streams can't be flushed in the middle */
+}
+
+static void writer_lzmadeflate_finish(writer_t*writer)
+{
+#ifdef HAVE_LZMA
+    lzmadeflate_t*z = (lzmadeflate_t*)writer->internal;
+    unsigned char*data;
+    int len;
+    if(writer->type != WRITER_TYPE_LZMA) {
+	fprintf(stderr, "Wrong writer ID (writer not initialized?)\n");
+	return;
+    }
+    if(!z)
+	return;
+    z->ls.next_in = 0;
+    z->ls.avail_in = 0;
+    writer_lzmadeflate_run(writer, LZMA_FINISH);
+    lzma_end(&z->ls);
+
+    /* the compressed data starts with a .lzma header (5 bytes properties,
+       8 bytes uncompressed size). Store the compressed length in front of
+       the properties instead of the size after them. */
+    data = (unsigned char*)writer_growmemwrite_memptr(&z->buffer, &len);
+    if(len >= 13) {
+	writer_writeU32(z->output, len-13);
+	z->output->write(z->output, data, 5);
+	z->output->write(z->output, &data[13], len-13);
+	writer->pos += len-13+4+5;
+    }
+    z->buffer.finish(&z->buffer);
+    free(writer->internal);
+    memset(writer, 0, sizeof(writer_t));
+#else
+    fprintf(stderr, "Error: swftools was compiled without lzma support");
+    exit(1);
+#endif
+}
+void writer_init_lzmadeflate(writer_t*w, writer_t*output)
+{
+#ifdef HAVE_LZMA
+    lzmadeflate_t*z;
+    lzma_stream init = LZMA_STREAM_INIT;
+    lzma_options_lzma opt;
+    lzma_ret ret;
+    memset(w, 0, sizeof(writer_t));
+    z = (lzmadeflate_t*)malloc(sizeof(lzmadeflate_t));
+    memset(z, 0, sizeof(lzmadeflate_t));
+    w->internal = z;
+    w->write = writer_lzmadeflate_write;
+    w->flush = writer_lzmadeflate_flush;
+    w->finish = writer_lzmadeflate_finish;
+    w->type = WRITER_TYPE_LZMA;
+    w->pos = 0;
+    z->output = output;
+    z->ls = init;
+    writer_init_growingmemwriter(&z->buffer, 65536);
+    lzma_lzma_preset(&opt, LZMA_PRESET_DEFAULT);
+    ret = lzma_alone_encoder(&z->ls, &opt);
+    if (ret != LZMA_OK) lzma_error(ret, "bitio:lzma_init");
+    w->bitpos = 0;
+    w->mybyte = 0;
+    z->ls.next_out = z->writebuffer;
+    z->ls.avail_out = LZMA_BUFFER_SIZE;
+#else
+    fprintf(stderr, "Error: swftools was compiled without lzma support");
+    exit(1);
+#endif
+}
+
 /* ----------------------- bit handling routines -------------------------- */
 
 void writer_writebit(writer_t*w, int bit)
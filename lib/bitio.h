@@ -30,6 +30,10 @@
 #ifndef __rfxswf_bitio_h__
 #define __rfxswf_bitio_h__
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define READER_TYPE_FILE 1
 #define READER_TYPE_MEM  2
 #define READER_TYPE_ZLIB_U 3
@@ -38,6 +42,7 @@
 #define READER_TYPE_NULL 5
 #define READER_TYPE_FILE2 6
 #define READER_TYPE_ZZIP 7
+#define READER_TYPE_LZMA 8
 
 #define WRITER_TYPE_FILE 1
 #define WRITER_TYPE_MEM  2
@@ -46,6 +51,7 @@
 #define WRITER_TYPE_NULL 5
 #define WRITER_TYPE_GROWING_MEM  6
 #define WRITER_TYPE_ZLIB WRITER_TYPE_ZLIB_C
+#define WRITER_TYPE_LZMA 7
 
 typedef struct _reader
 {
@@ -106,6 +112,7 @@ void write_compressed_int(writer_t*w, int i);
 void reader_init_filereader(reader_t*r, int handle);
 int reader_init_filereader2(reader_t*r, const char*filename);
 void reader_init_zlibinflate(reader_t*r, reader_t*input);
+void reader_init_lzmainflate(reader_t*r, reader_t*input);
 void reader_init_memreader(reader_t*r, void*data, int length);
 void reader_init_nullreader(reader_t*r);
 #ifdef HAVE_ZZIP
@@ -115,6 +122,7 @@ void reader_init_zzipreader(reader_t*r,ZZIP_FILE*z);
 void writer_init_filewriter(writer_t*w, int handle);
 void writer_init_filewriter2(writer_t*w, char*filename);
 void writer_init_zlibdeflate(writer_t*w, writer_t*output);
+void writer_init_lzmadeflate(writer_t*w, writer_t*output);
 void writer_init_memwriter(writer_t*r, void*data, int length);
 void writer_init_nullwriter(writer_t*w);
 
@@ -123,4 +131,8 @@ void* writer_growmemwrite_memptr(writer_t*w, int*len);
 void* writer_growmemwrite_getmem(writer_t*w);
 void writer_growmemwrite_reset(writer_t*w);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif //__rfxswf_bitio_h__
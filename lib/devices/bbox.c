@@ -30,16 +30,19 @@
 #include "../mem.h"
 #include "../gfxdevice.h"
 #include "../gfxtools.h"
+#include "../gfxpath.h"
 
 typedef struct _internal {
     gfxbbox_t bbox;
     int do_graphics;
     int do_text;
+
+    gfxpathcache_t*glyphs;
+    gfxpath_t*glyphpath;
 } internal_t;
 
-void measuregfxline(internal_t*i, gfxline_t*line)
+static void measurebbox(internal_t*i, gfxbbox_t b)
 {
-    gfxbbox_t b = gfxline_getbbox(line);
     if(b.xmin==0 && b.ymin==0 && b.xmax==0 && b.ymax==0) {
 	return;
     }
@@ -47,6 +50,11 @@ void measuregfxline(internal_t*i, gfxline_t*line)
     i->bbox = gfxbbox_expand_to_point(i->bbox, b.xmax, b.ymax);
 }
 
+void measuregfxline(internal_t*i, gfxline_t*line)
+{
+    measurebbox(i, gfxline_getbbox(line));
+}
+
 int bbox_setparameter(gfxdevice_t*dev, const char*key, const char*value)
 {
     internal_t*i = (internal_t*)dev->internal;
@@ -93,6 +101,13 @@ void bbox_fill(gfxdevice_t*dev, gfxline_t*line, gfxcolor_t*color)
 	measuregfxline(i, line);
 }
 
+void bbox_fillpath(gfxdevice_t*dev, gfxpath_t*path, gfxcolor_t*color)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    if(i->do_graphics)
+	measurebbox(i, gfxpath_getbbox(path));
+}
+
 void bbox_fillbitmap(gfxdevice_t*dev, gfxline_t*line, gfximage_t*img, gfxmatrix_t*matrix, gfxcxform_t*cxform)
 {
     internal_t*i = (internal_t*)dev->internal;
@@ -119,11 +134,9 @@ void bbox_drawchar(gfxdevice_t*dev, gfxfont_t*font, int glyphnr, gfxcolor_t*colo
 	return;
 
     if(i->do_text) {
-	gfxglyph_t*glyph = &font->glyphs[glyphnr];
-	gfxline_t*line2 = gfxline_clone(glyph->line);
-	gfxline_transform(line2, matrix);
-	measuregfxline(i, line2);
-	gfxline_free(line2);
+	gfxpath_t*glyph = gfxpathcache_getglyph(i->glyphs, font, glyphnr);
+	gfxpath_transform_to(i->glyphpath, glyph, matrix);
+	measurebbox(i, gfxpath_getbbox(i->glyphpath));
     }
 }
 
@@ -139,6 +152,9 @@ void bbox_endpage(gfxdevice_t*dev)
 
 gfxresult_t* bbox_finish(gfxdevice_t*dev)
 {
+    internal_t*i = (internal_t*)dev->internal;
+    gfxpathcache_destroy(i->glyphs);
+    gfxpath_free(i->glyphpath);
     free(dev->internal);dev->internal = 0;
     return 0;
 }
@@ -164,6 +180,7 @@ void gfxdevice_bbox_init(gfxdevice_t*dev)
     dev->endclip = bbox_endclip;
     dev->stroke = bbox_stroke;
     dev->fill = bbox_fill;
+    dev->fillpath = bbox_fillpath;
     dev->fillbitmap = bbox_fillbitmap;
     dev->fillgradient = bbox_fillgradient;
     dev->addfont = bbox_addfont;
@@ -172,6 +189,8 @@ void gfxdevice_bbox_init(gfxdevice_t*dev)
     dev->endpage = bbox_endpage;
     dev->finish = bbox_finish;
 
+    i->glyphs = gfxpathcache_new();
+    i->glyphpath = gfxpath_new();
     i->do_graphics = 1;
     i->do_text = 1;
 }
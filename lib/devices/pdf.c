@@ -46,6 +46,8 @@ typedef struct _internal {
     double config_ypad;
     int config_maxdpi;
     int config_mindpi;
+    gfxrescale_filter_t config_rescalefilter;
+    int config_rescalethreads;
 
     int width,height;
     int num_pages;
@@ -147,6 +149,11 @@ int pdf_setparameter(gfxdevice_t*dev, const char*key, const char*value)
 	i->config_xpad = atof(value);
     } else if(!strcmp(key, "ypad")) {
 	i->config_ypad = atof(value);
+    } else if(!strcmp(key, "rescalefilter")) {
+	if(!gfxrescale_filter_byname(value, &i->config_rescalefilter))
+	    msg("<error> Unknown rescale filter: %s", value);
+    } else if(!strcmp(key, "rescalethreads")) {
+	i->config_rescalethreads = atoi(value);
     }
     return 0;
 }
@@ -280,7 +287,7 @@ void pdf_fillbitmap(gfxdevice_t*dev, gfxline_t*line, gfximage_t*img, gfxmatrix_t
         matrix->m01 *= s;
         matrix->m10 *= s;
         matrix->m11 *= s;
-	rescaled_image = gfximage_rescale(img, newwidth, newheight);
+	rescaled_image = gfximage_rescale2(img, newwidth, newheight, i->config_rescalefilter, i->config_rescalethreads);
 	msg("<notice> Downscaling %dx%d image (dpi %f, %.0fx%.0f on page) to %dx%d (dpi %d)", 
 		img->width, img->height, dpi, l1, l2, newwidth, newheight, i->config_maxdpi);
 	img = rescaled_image;
@@ -601,5 +608,7 @@ void gfxdevice_pdf_init(gfxdevice_t*dev)
     i->lasty = -1e38;
     i->has_matrix = 0;
     i->config_maxdpi = 72;
+    i->config_rescalefilter = gfxrescale_legacy;
+    i->config_rescalethreads = 1;
     i->p = PDF_new();
 }
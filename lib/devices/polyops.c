@@ -45,6 +45,10 @@ typedef struct _internal {
     gfxdevice_t*out;
     clip_t*clip;
     gfxpoly_t*polyunion;
+
+    /* if >1, big intersections/unions are split into bands which
+       are processed in parallel */
+    int threads;
     
     int good_polygons;
     int bad_polygons;
@@ -75,6 +79,10 @@ int polyops_setparameter(struct _gfxdevice*dev, const char*key, const char*value
 {
     dbg("polyops_setparameter");
     internal_t*i = (internal_t*)dev->internal;
+    if(!strcmp(key, "polythreads")) {
+	i->threads = atoi(value);
+	return 1;
+    }
     if(i->out) return i->out->setparameter(i->out,key,value);
     else return 0;
 }
@@ -121,7 +129,7 @@ void polyops_startclip(struct _gfxdevice*dev, gfxline_t*line)
 	currentclip = 0;
 	type = 2;
     } else if(poly && oldclip) {
-	gfxpoly_t*intersection = gfxpoly_intersect(poly, oldclip);
+	gfxpoly_t*intersection = gfxpoly_intersect_tiled(poly, oldclip, i->threads);
 	if(intersection) {
             i->good_polygons++;
 	    // this case is what usually happens 
@@ -174,7 +182,7 @@ static void addtounion(struct _gfxdevice*dev, gfxpoly_t*poly)
     internal_t*i = (internal_t*)dev->internal;
     if(poly && i->polyunion) {
 	gfxpoly_t*old = i->polyunion;
-	gfxpoly_t*newpoly = gfxpoly_union(poly,i->polyunion);
+	gfxpoly_t*newpoly = gfxpoly_union_tiled(poly,i->polyunion,i->threads);
 	i->polyunion = newpoly;
 	gfxpoly_destroy(old);
     }
@@ -186,7 +194,7 @@ static gfxline_t* handle_poly(gfxdevice_t*dev, gfxpoly_t*poly, char*ok)
     if(i->clip && i->clip->poly) {
 	gfxpoly_t*old = poly;
 	if(poly) {
-	    poly = gfxpoly_intersect(poly, i->clip->poly);
+	    poly = gfxpoly_intersect_tiled(poly, i->clip->poly, i->threads);
 	    gfxpoly_destroy(old);
 	}
     }
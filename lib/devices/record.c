@@ -50,11 +50,35 @@
 //#define COMPRESS_IMAGES
 //#define FILTER_IMAGES
 
+/* Version 2 streams code colors, matrices and font ids against the previously
+   written ones. If the stream has a subpixel grid, the outlines of fills,
+   strokes, clips and links, and character positions, are rounded to that
+   grid and stored as varint deltas. Otherwise (and always for font outlines)
+   coordinates are stored as doubles, like in version 1 streams. */
+#define RECORD_VERSION 2
+
+/* quantized coordinates are clamped to +/- this, so that deltas fit into an int */
+#define MAX_QCOORD 0x3fffffff
+
 typedef struct _state {
     char*last_string[16];
     gfxcolor_t last_color[16];
     gfxmatrix_t last_matrix[16];
 
+    /* stream version, and coordinate grid (version 2 only) */
+    int version;
+    int subpixel;
+
+    /* dictionaries of recently used colors and (drawchar) matrices */
+    gfxcolor_t colors[16];
+    int num_colors;
+    gfxmatrix_t matrices[16];
+    int num_matrices;
+    int last_x, last_y;
+
+    /* size of the data being read, if known (for sanity checks) */
+    int size;
+
 #ifdef STATS
     int size_matrices;
     int size_positions;
@@ -97,6 +121,7 @@ typedef struct _internal_result {
 #define OP_STARTPAGE 0x0b
 #define OP_ENDPAGE 0x0c
 #define OP_FINISH 0x0d
+#define OP_VERSION 0x0e
 
 #define FLAG_SAME_AS_LAST 0x10
 #define FLAG_ZERO_FONT 0x20
@@ -107,48 +132,78 @@ typedef struct _internal_result {
 
 /* ----------------- reading/writing of low level primitives -------------- */
 
-static void dumpLine(writer_t*w, state_t*state, gfxline_t*line)
+static int quantize(int subpixel, double v)
+{
+    double q = floor(v*subpixel + 0.5);
+    if(!(q > -MAX_QCOORD)) // also catches NaN
+	return -MAX_QCOORD;
+    if(q > MAX_QCOORD)
+	return MAX_QCOORD;
+    return (int)q;
+}
+static double dequantize(int subpixel, int q)
+{
+    return q / (double)subpixel;
+}
+
+/* with subpixel=0, coordinates are written as doubles. Otherwise, they're
+   rounded to 1/subpixel units and written as deltas to the previous point */
+static void dumpLine(writer_t*w, state_t*state, gfxline_t*line, int subpixel)
 {
+#ifdef STATS
+    int oldpos = w->pos;
+#endif
+    int lastx = 0, lasty = 0;
     while(line) {
 	if(line->type == gfx_moveTo) {
 	    writer_writeU8(w, LINE_MOVETO);
-	    writer_writeDouble(w, line->x);
-	    writer_writeDouble(w, line->y);
-#ifdef STATS
-	    state->size_lines += 1+8+8;
-#endif
 	} else if(line->type == gfx_lineTo) {
 	    writer_writeU8(w, LINE_LINETO);
-	    writer_writeDouble(w, line->x);
-	    writer_writeDouble(w, line->y);
-#ifdef STATS
-	    state->size_lines += 1+8+8;
-#endif
 	} else if(line->type == gfx_splineTo) {
 	    writer_writeU8(w, LINE_SPLINETO);
+	} else {
+	    line = line->next;
+	    continue;
+	}
+	if(!subpixel) {
 	    writer_writeDouble(w, line->x);
 	    writer_writeDouble(w, line->y);
-	    writer_writeDouble(w, line->sx);
-	    writer_writeDouble(w, line->sy);
-#ifdef STATS
-	    state->size_lines += 1+8+8+8+8;
-#endif
+	    if(line->type == gfx_splineTo) {
+		writer_writeDouble(w, line->sx);
+		writer_writeDouble(w, line->sy);
+	    }
+	} else {
+	    if(line->type == gfx_splineTo) {
+		int sx = quantize(subpixel, line->sx);
+		int sy = quantize(subpixel, line->sy);
+		write_compressed_int(w, sx - lastx);
+		write_compressed_int(w, sy - lasty);
+		lastx = sx;
+		lasty = sy;
+	    }
+	    int x = quantize(subpixel, line->x);
+	    int y = quantize(subpixel, line->y);
+	    write_compressed_int(w, x - lastx);
+	    write_compressed_int(w, y - lasty);
+	    lastx = x;
+	    lasty = y;
 	}
 	line = line->next;
     }
     writer_writeU8(w, OP_END);
 #ifdef STATS
-    state->size_lines += 1;
+    state->size_lines += w->pos - oldpos;
 #endif
 }
-static gfxline_t* readLine(reader_t*r, state_t*s)
+static gfxline_t* readLine(reader_t*r, state_t*s, gfxlinearena_t*arena, int subpixel)
 {
     gfxline_t*start = 0, *pos = 0;
+    int lastx = 0, lasty = 0;
     while(1) {
 	unsigned char op = reader_readU8(r);
 	if(op == OP_END)
 	    break;
-	gfxline_t*line = (gfxline_t*)rfx_calloc(sizeof(gfxline_t));
+	gfxline_t*line = arena?gfxlinearena_alloc(arena):(gfxline_t*)rfx_calloc(sizeof(gfxline_t));
 	if(!start) {
 	    start = pos = line;
 	} else {
@@ -157,18 +212,31 @@ static gfxline_t* readLine(reader_t*r, state_t*s)
 	}
 	if(op == LINE_MOVETO) {
 	    line->type = gfx_moveTo;
-	    line->x = reader_readDouble(r);
-	    line->y = reader_readDouble(r);
 	} else if(op == LINE_LINETO) {
 	    line->type = gfx_lineTo;
-	    line->x = reader_readDouble(r);
-	    line->y = reader_readDouble(r);
 	} else if(op == LINE_SPLINETO) {
 	    line->type = gfx_splineTo;
+	} else {
+	    continue;
+	}
+	if(!subpixel) {
 	    line->x = reader_readDouble(r);
 	    line->y = reader_readDouble(r);
-	    line->sx = reader_readDouble(r);
-	    line->sy = reader_readDouble(r);
+	    if(op == LINE_SPLINETO) {
+		line->sx = reader_readDouble(r);
+		line->sy = reader_readDouble(r);
+	    }
+	} else {
+	    if(op == LINE_SPLINETO) {
+		lastx += read_compressed_int(r);
+		lasty += read_compressed_int(r);
+		line->sx = dequantize(subpixel, lastx);
+		line->sy = dequantize(subpixel, lasty);
+	    }
+	    lastx += read_compressed_int(r);
+	    lasty += read_compressed_int(r);
+	    line->x = dequantize(subpixel, lastx);
+	    line->y = dequantize(subpixel, lasty);
 	}
     }
     return start;
@@ -395,7 +463,7 @@ static void dumpFont(writer_t*w, state_t*state, gfxfont_t*font)
     writer_writeDouble(w, font->descent);
     int t;
     for(t=0;t<font->num_glyphs;t++) {
-	dumpLine(w, state, font->glyphs[t].line);
+	dumpLine(w, state, font->glyphs[t].line, 0);
 	writer_writeDouble(w, font->glyphs[t].advance);
 	writer_writeU32(w, font->glyphs[t].unicode);
 	if(font->glyphs[t].name) {
@@ -420,11 +488,17 @@ static gfxfont_t*readFont(reader_t*r, state_t*state)
     font->max_unicode = reader_readU32(r);
     font->ascent = reader_readDouble(r);
     font->descent = reader_readDouble(r);
+    if(state->size && ((U32)font->num_glyphs > (U32)(state->size - r->pos) ||
+	               (U32)font->max_unicode > (U32)(state->size - r->pos))) {
+	free((void*)font->id);
+	free(font);
+	return 0;
+    }
     font->glyphs = (gfxglyph_t*)rfx_calloc(sizeof(gfxglyph_t)*font->num_glyphs);
     font->unicode2glyph = (int*)rfx_calloc(sizeof(font->unicode2glyph[0])*font->max_unicode);
     int t;
     for(t=0;t<font->num_glyphs;t++) {
-	font->glyphs[t].line = readLine(r, state);
+	font->glyphs[t].line = readLine(r, state, 0, 0);
 	font->glyphs[t].advance = reader_readDouble(r);
 	font->glyphs[t].unicode = reader_readU32(r);
 	font->glyphs[t].name = reader_readString(r);
@@ -439,6 +513,20 @@ static gfxfont_t*readFont(reader_t*r, state_t*state)
     return font;
 }
 
+void gfxfont_record_write(writer_t*w, gfxfont_t*font)
+{
+    state_t state;
+    memset(&state, 0, sizeof(state));
+    dumpFont(w, &state, font);
+}
+gfxfont_t* gfxfont_record_read(reader_t*r, int size)
+{
+    state_t state;
+    memset(&state, 0, sizeof(state));
+    state.size = size;
+    return readFont(r, &state);
+}
+
 /* ----------------- reading/writing of primitives with caching -------------- */
 
 void state_clear(state_t*state)
@@ -488,8 +576,129 @@ static gfxmatrix_t read_matrix(reader_t*r, state_t*state, U8 id, U8 flags)
     return m;
 }
 
+/* ----------------- compact (version 2) encoding of primitives -------------- */
+
+/* colors and matrices are stored as an index into a table of the last 16
+   distinct values, or as 16 followed by the value itself, which then
+   replaces the oldest table entry. */
+static void dumpColorCached(writer_t*w, state_t*state, gfxcolor_t*color)
+{
+    if(state->version<2) {
+	dumpColor(w, state, color);
+	return;
+    }
+    int num = state->num_colors<16?state->num_colors:16;
+    int t;
+    for(t=0;t<num;t++) {
+	gfxcolor_t*c = &state->colors[t];
+	if(c->r == color->r && c->g == color->g && c->b == color->b && c->a == color->a) {
+	    writer_writeU8(w, t);
+#ifdef STATS
+	    state->size_colors += 1;
+#endif
+	    return;
+	}
+    }
+    writer_writeU8(w, 16);
+    dumpColor(w, state, color);
+    state->colors[state->num_colors++&15] = *color;
+}
+static gfxcolor_t readColorCached(reader_t*r, state_t*state)
+{
+    if(state->version<2) {
+	return readColor(r, state);
+    }
+    U8 index = reader_readU8(r);
+    if(index<16)
+	return state->colors[index];
+    gfxcolor_t c = readColor(r, state);
+    state->colors[state->num_colors++&15] = c;
+    return c;
+}
+
+/* only the linear part of the matrix is cached, the position is stored
+   as a delta to the position of the previous character */
+static void dumpMatrixCached(writer_t*w, state_t*state, gfxmatrix_t*matrix)
+{
+    int num = state->num_matrices<16?state->num_matrices:16;
+    int t;
+    for(t=0;t<num;t++) {
+	gfxmatrix_t*m = &state->matrices[t];
+	if(m->m00 == matrix->m00 && m->m01 == matrix->m01 && m->m10 == matrix->m10 && m->m11 == matrix->m11)
+	    break;
+    }
+    if(t<num) {
+	writer_writeU8(w, t);
+#ifdef STATS
+	state->size_matrices += 1;
+#endif
+    } else {
+	writer_writeU8(w, 16);
+	writer_writeDouble(w, matrix->m00);
+	writer_writeDouble(w, matrix->m01);
+	writer_writeDouble(w, matrix->m10);
+	writer_writeDouble(w, matrix->m11);
+	state->matrices[state->num_matrices++&15] = *matrix;
+#ifdef STATS
+	state->size_matrices += 1+4*8;
+#endif
+    }
+    if(state->subpixel) {
+#ifdef STATS
+	int oldpos = w->pos;
+#endif
+	int x = quantize(state->subpixel, matrix->tx);
+	int y = quantize(state->subpixel, matrix->ty);
+	write_compressed_int(w, x - state->last_x);
+	write_compressed_int(w, y - state->last_y);
+	state->last_x = x;
+	state->last_y = y;
+#ifdef STATS
+	state->size_positions += w->pos - oldpos;
+#endif
+    } else {
+	dumpXY(w, state, matrix);
+    }
+}
+static gfxmatrix_t readMatrixCached(reader_t*r, state_t*state)
+{
+    gfxmatrix_t m;
+    U8 index = reader_readU8(r);
+    if(index<16) {
+	m = state->matrices[index];
+    } else {
+	m.m00 = reader_readDouble(r);
+	m.m01 = reader_readDouble(r);
+	m.m10 = reader_readDouble(r);
+	m.m11 = reader_readDouble(r);
+	state->matrices[state->num_matrices++&15] = m;
+    }
+    if(state->subpixel) {
+	state->last_x += read_compressed_int(r);
+	state->last_y += read_compressed_int(r);
+	m.tx = dequantize(state->subpixel, state->last_x);
+	m.ty = dequantize(state->subpixel, state->last_y);
+    } else {
+	readXY(r, state, &m);
+    }
+    return m;
+}
+
 /* --------------------------- record device operations ---------------------- */
 
+static void record_writeheader(internal_t*i, int subpixel)
+{
+    state_clear(&i->state);
+    i->state.num_colors = 0;
+    i->state.num_matrices = 0;
+    i->state.last_x = i->state.last_y = 0;
+    i->state.version = RECORD_VERSION;
+    i->state.subpixel = subpixel;
+    writer_writeU8(&i->w, OP_VERSION);
+    writer_writeU8(&i->w, i->state.version);
+    write_compressed_uint(&i->w, i->state.subpixel);
+}
+
 static int record_setparameter(struct _gfxdevice*dev, const char*key, const char*value)
 {
     internal_t*i = (internal_t*)dev->internal;
@@ -507,10 +716,10 @@ static void record_stroke(struct _gfxdevice*dev, gfxline_t*line, gfxcoord_t widt
     writer_writeU8(&i->w, OP_STROKE);
     writer_writeDouble(&i->w, width);
     writer_writeDouble(&i->w, miterLimit);
-    dumpColor(&i->w, &i->state, color);
+    dumpColorCached(&i->w, &i->state, color);
     writer_writeU8(&i->w, cap_style);
     writer_writeU8(&i->w, joint_style);
-    dumpLine(&i->w, &i->state, line);
+    dumpLine(&i->w, &i->state, line, i->state.subpixel);
 }
 
 static void record_startclip(struct _gfxdevice*dev, gfxline_t*line)
@@ -518,7 +727,7 @@ static void record_startclip(struct _gfxdevice*dev, gfxline_t*line)
     internal_t*i = (internal_t*)dev->internal;
     msg("<trace> record: %08x STARTCLIP\n", dev);
     writer_writeU8(&i->w, OP_STARTCLIP);
-    dumpLine(&i->w, &i->state, line);
+    dumpLine(&i->w, &i->state, line, i->state.subpixel);
     i->cliplevel++;
 }
 
@@ -538,8 +747,8 @@ static void record_fill(struct _gfxdevice*dev, gfxline_t*line, gfxcolor_t*color)
     internal_t*i = (internal_t*)dev->internal;
     msg("<trace> record: %08x FILL\n", dev);
     writer_writeU8(&i->w, OP_FILL);
-    dumpColor(&i->w, &i->state, color);
-    dumpLine(&i->w, &i->state, line);
+    dumpColorCached(&i->w, &i->state, color);
+    dumpLine(&i->w, &i->state, line, i->state.subpixel);
 }
 
 static void record_fillbitmap(struct _gfxdevice*dev, gfxline_t*line, gfximage_t*img, gfxmatrix_t*matrix, gfxcxform_t*cxform)
@@ -549,7 +758,7 @@ static void record_fillbitmap(struct _gfxdevice*dev, gfxline_t*line, gfximage_t*
     writer_writeU8(&i->w, OP_FILLBITMAP);
     dumpImage(&i->w, &i->state, img);
     dumpMatrix(&i->w, &i->state, matrix);
-    dumpLine(&i->w, &i->state, line);
+    dumpLine(&i->w, &i->state, line, i->state.subpixel);
     dumpCXForm(&i->w, &i->state, cxform);
 }
 
@@ -561,7 +770,7 @@ static void record_fillgradient(struct _gfxdevice*dev, gfxline_t*line, gfxgradie
     writer_writeU8(&i->w, type);
     dumpGradient(&i->w, &i->state, gradient);
     dumpMatrix(&i->w, &i->state, matrix);
-    dumpLine(&i->w, &i->state, line);
+    dumpLine(&i->w, &i->state, line, i->state.subpixel);
 }
 
 static void record_addfont(struct _gfxdevice*dev, gfxfont_t*font)
@@ -584,6 +793,31 @@ static void record_drawchar(struct _gfxdevice*dev, gfxfont_t*font, int glyphnr,
 
     msg("<trace> record: %08x DRAWCHAR %d\n", glyphnr, dev);
     const char*font_id = (font&&font->id)?font->id:"*NULL*";
+
+    if(i->state.version>=2) {
+	U8 flags = 0;
+	if(!font)
+	    flags |= FLAG_ZERO_FONT;
+	else if(i->state.last_string[OP_DRAWCHAR] && !strcmp(i->state.last_string[OP_DRAWCHAR], font_id))
+	    flags |= FLAG_SAME_AS_LAST;
+#ifdef STATS
+	int oldpos = i->w.pos;
+#endif
+	writer_writeU8(&i->w, OP_DRAWCHAR|flags);
+	write_compressed_uint(&i->w, glyphnr);
+	if(!flags) {
+	    writer_writeString(&i->w, font_id);
+	    if(i->state.last_string[OP_DRAWCHAR])
+		free(i->state.last_string[OP_DRAWCHAR]);
+	    i->state.last_string[OP_DRAWCHAR] = strdup(font_id);
+	}
+#ifdef STATS
+	i->state.size_chars += i->w.pos - oldpos;
+#endif
+	dumpColorCached(&i->w, &i->state, color);
+	dumpMatrixCached(&i->w, &i->state, matrix);
+	return;
+    }
     
     gfxmatrix_t*l = &i->state.last_matrix[OP_DRAWCHAR];
 
@@ -644,7 +878,7 @@ static void record_drawlink(struct _gfxdevice*dev, gfxline_t*line, const char*ac
     internal_t*i = (internal_t*)dev->internal;
     msg("<trace> record: %08x DRAWLINK\n", dev);
     writer_writeU8(&i->w, OP_DRAWLINK);
-    dumpLine(&i->w, &i->state, line);
+    dumpLine(&i->w, &i->state, line, i->state.subpixel);
     writer_writeString(&i->w, action?action:"");
     writer_writeString(&i->w, text?text:"");
 }
@@ -665,6 +899,9 @@ static void replay(struct _gfxdevice*dev, gfxdevice_t*out, reader_t*r, gfxfontli
     state_t state;
     memset(&state, 0, sizeof(state));
 
+    /* the outlines only live until the output device has processed them */
+    gfxlinearena_t*arena = gfxlinearena_new();
+
     while(1) {
 	unsigned char op;
 	if(r->read(r, &op, 1)!=1)
@@ -702,11 +939,21 @@ static void replay(struct _gfxdevice*dev, gfxdevice_t*out, reader_t*r, gfxfontli
 		msg("<trace> replay: FINISH");
 		break;
 	    }
+	    case OP_VERSION: {
+		state.version = reader_readU8(r);
+		state.subpixel = read_compressed_uint(r);
+		msg("<trace> replay: VERSION %d (1/%d pixel)", state.version, state.subpixel);
+		if(state.version > RECORD_VERSION) {
+		    msg("<error> Can't replay version %d recording", state.version);
+		    goto finish;
+		}
+		break;
+	    }
 	    case OP_STROKE: {
 		msg("<trace> replay: STROKE");
 		double width = reader_readDouble(r);
 		double miterlimit = reader_readDouble(r);
-		gfxcolor_t color = readColor(r, &state);
+		gfxcolor_t color = readColorCached(r, &state);
 		gfx_capType captype;
 		int v = reader_readU8(r);
 		switch (v) {
@@ -721,16 +968,16 @@ static void replay(struct _gfxdevice*dev, gfxdevice_t*out, reader_t*r, gfxfontli
 		    case 1: jointtype = gfx_joinRound; break;
 		    case 2: jointtype = gfx_joinBevel; break;
 		}
-		gfxline_t* line = readLine(r, &state);
+		gfxline_t* line = readLine(r, &state, arena, state.subpixel);
 		out->stroke(out, line, width, &color, captype, jointtype,miterlimit);
-		gfxline_free(line);
+		gfxline_free_arena(line, arena);
 		break;
 	    }
 	    case OP_STARTCLIP: {
 		msg("<trace> replay: STARTCLIP");
-		gfxline_t* line = readLine(r, &state);
+		gfxline_t* line = readLine(r, &state, arena, state.subpixel);
 		out->startclip(out, line);
-		gfxline_free(line);
+		gfxline_free_arena(line, arena);
 		break;
 	    }
 	    case OP_ENDCLIP: {
@@ -740,20 +987,20 @@ static void replay(struct _gfxdevice*dev, gfxdevice_t*out, reader_t*r, gfxfontli
 	    }
 	    case OP_FILL: {
 		msg("<trace> replay: FILL");
-		gfxcolor_t color = readColor(r, &state);
-		gfxline_t* line = readLine(r, &state);
+		gfxcolor_t color = readColorCached(r, &state);
+		gfxline_t* line = readLine(r, &state, arena, state.subpixel);
 		out->fill(out, line, &color);
-		gfxline_free(line);
+		gfxline_free_arena(line, arena);
 		break;
 	    }
 	    case OP_FILLBITMAP: {
 		msg("<trace> replay: FILLBITMAP");
 		gfximage_t img = readImage(r, &state);
 		gfxmatrix_t matrix = readMatrix(r, &state);
-		gfxline_t* line = readLine(r, &state);
+		gfxline_t* line = readLine(r, &state, arena, state.subpixel);
 		gfxcxform_t* cxform = readCXForm(r, &state);
 		out->fillbitmap(out, line, &img, &matrix, cxform);
-		gfxline_free(line);
+		gfxline_free_arena(line, arena);
 		if(cxform)
 		    free(cxform);
 		free(img.data);img.data=0;
@@ -771,17 +1018,18 @@ static void replay(struct _gfxdevice*dev, gfxdevice_t*out, reader_t*r, gfxfontli
 		}  
 		gfxgradient_t*gradient = readGradient(r, &state);
 		gfxmatrix_t matrix = readMatrix(r, &state);
-		gfxline_t* line = readLine(r, &state);
+		gfxline_t* line = readLine(r, &state, arena, state.subpixel);
 		out->fillgradient(out, line, gradient, type, &matrix);
+		gfxline_free_arena(line, arena);
 		break;
 	    }
 	    case OP_DRAWLINK: {
 		msg("<trace> replay: DRAWLINK");
-		gfxline_t* line = readLine(r, &state);
+		gfxline_t* line = readLine(r, &state, arena, state.subpixel);
 		char* s = reader_readString(r);
 		char* t = reader_readString(r);
 		out->drawlink(out,line,s, t);
-		gfxline_free(line);
+		gfxline_free_arena(line, arena);
 		free(s);
 		break;
 	    }
@@ -797,13 +1045,23 @@ static void replay(struct _gfxdevice*dev, gfxdevice_t*out, reader_t*r, gfxfontli
 		break;
 	    }
 	    case OP_DRAWCHAR: {
-		U32 glyph = reader_readU32(r);
-		gfxmatrix_t m = {1,0,0, 0,1,0};
+		U32 glyph;
 		char* id = 0;
-		if(!(flags&FLAG_ZERO_FONT))
-		    id = read_string(r, &state, op, flags);
-		gfxcolor_t color = read_color(r, &state, op, flags);
-		gfxmatrix_t matrix = read_matrix(r, &state, op, flags);
+		gfxcolor_t color;
+		gfxmatrix_t matrix;
+		if(state.version>=2) {
+		    glyph = read_compressed_uint(r);
+		    if(!(flags&FLAG_ZERO_FONT))
+			id = read_string(r, &state, op, flags);
+		    color = readColorCached(r, &state);
+		    matrix = readMatrixCached(r, &state);
+		} else {
+		    glyph = reader_readU32(r);
+		    if(!(flags&FLAG_ZERO_FONT))
+			id = read_string(r, &state, op, flags);
+		    color = read_color(r, &state, op, flags);
+		    matrix = read_matrix(r, &state, op, flags);
+		}
 
 		gfxfont_t*font = id?gfxfontlist_findfont(*fontlist, id):0;
 		if(i && !font) {
@@ -819,6 +1077,7 @@ static void replay(struct _gfxdevice*dev, gfxdevice_t*out, reader_t*r, gfxfontli
     }
 finish:
     state_clear(&state);
+    gfxlinearena_destroy(arena);
     r->dealloc(r);
     if(_fontlist)
 	gfxfontlist_free(_fontlist, 0);
@@ -936,6 +1195,7 @@ void gfxdevice_record_flush(gfxdevice_t*dev, gfxdevice_t*out, gfxfontlist_t**fon
 	    reader_init_memreader(&r, data, len);
 	    replay(dev, out, &r, fontlist);
 	    writer_growmemwrite_reset(&i->w);
+	    record_writeheader(i, i->state.subpixel);
 	} else {
 	    msg("<fatal> Flushing not supported for file based record device");
 	    exit(1);
@@ -997,6 +1257,11 @@ static gfxresult_t* record_finish(struct _gfxdevice*dev)
 }
 
 void gfxdevice_record_init(gfxdevice_t*dev, char use_tempfile)
+{
+    gfxdevice_record_init2(dev, use_tempfile, 0);
+}
+
+void gfxdevice_record_init2(gfxdevice_t*dev, char use_tempfile, int subpixel)
 {
     internal_t*i = (internal_t*)rfx_calloc(sizeof(internal_t));
     memset(dev, 0, sizeof(gfxdevice_t));
@@ -1015,6 +1280,7 @@ void gfxdevice_record_init(gfxdevice_t*dev, char use_tempfile)
     }
     i->fontlist = gfxfontlist_create();
     i->cliplevel = 0;
+    record_writeheader(i, subpixel);
 
     dev->setparameter = record_setparameter;
     dev->startpage = record_startpage;
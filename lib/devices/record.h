@@ -24,6 +24,7 @@
 
 #include "../gfxdevice.h"
 #include "../gfxtools.h"
+#include "../bitio.h"
 
 
 #ifdef __cplusplus
@@ -32,6 +33,12 @@ extern "C" {
 
 void gfxdevice_record_init(gfxdevice_t*, char use_tempfile);
 
+/* like gfxdevice_record_init, but round coordinates to 1/subpixel pixels
+   (e.g. GFX_SUBPIXEL from gfxdevice.h), which makes the recording a lot
+   smaller. subpixel=0 stores them exactly, which is what
+   gfxdevice_record_init does. */
+void gfxdevice_record_init2(gfxdevice_t*, char use_tempfile, int subpixel);
+
 gfxdevice_t* gfxdevice_record_new(char*filename);
 
 void gfxdevice_record_flush(gfxdevice_t*, gfxdevice_t*, gfxfontlist_t**);
@@ -40,6 +47,12 @@ void gfxresult_record_replay(gfxresult_t*, gfxdevice_t*, gfxfontlist_t**);
 
 void gfxdevice_record_show(gfxdevice_t*dev);
 
+/* (de)serialize a font, in the format used for recorded addfont() calls.
+   gfxfont_record_read() returns 0 if the glyph counts don't fit into the
+   size bytes r is reading from. */
+void gfxfont_record_write(writer_t*w, gfxfont_t*font);
+gfxfont_t* gfxfont_record_read(reader_t*r, int size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -27,7 +27,13 @@
 #include "../mem.h"
 #include "../types.h"
 #include "../png.h"
+#include "../jpeg.h"
+#include "../gfximage.h"
 #include "../log.h"
+#include "../threads.h"
+#include "../spanfill.h"
+#include "../gfxpath.h"
+#include "record.h"
 #include "render.h"
 
 typedef gfxcolor_t RGBA;
@@ -48,6 +54,13 @@ typedef struct _internal_result {
     gfximage_t img;
     struct _internal_result*next;
     char palette;
+    int threads;
+    int jpegquality;
+
+    /* in strip mode, the page is only rasterized while saving: recording
+       holds the drawing operations, and page the page geometry */
+    gfxresult_t*recording;
+    struct _internal*page;
 } internal_result_t;
 
 typedef struct _clipbuffer {
@@ -69,12 +82,32 @@ typedef struct _internal {
 
     char palette;
 
+    /* number of threads to render with. If >1, all drawing operations
+       of a page are recorded, and at endpage() replayed once for every
+       horizontal band of the page, in parallel. Also used for
+       compressing the resulting png files. */
+    int threads;
+
+    /* If >0, don't keep a bitmap of the whole page, but record the page,
+       and rasterize it stripheight (output) lines at a time while saving */
+    int stripheight;
+    int jpegquality;
+    gfxdevice_t*recorder;
+
+    /* first scanline of this device. Nonzero only for the per-band
+       devices, which only store lines ystart..ystart+height2-1 */
+    int ystart;
+
     RGBA* img;
 
     clipbuffer_t*clipbuf;
 
     renderline_t*lines;
 
+    /* glyph outlines, and a buffer for transforming them (created on demand) */
+    gfxpathcache_t*glyphs;
+    gfxpath_t*glyphpath;
+
     internal_result_t*results;
     internal_result_t*result_next;
 } internal_t;
@@ -96,6 +129,7 @@ static inline void add_pixel(internal_t*i, float x, int y)
 {
     renderpoint_t p;
 
+    y -= i->ystart;
     if(x >= i->width2 || y >= i->height2 || y<0) return;
     p.x = x;
     if(y<i->ymin) i->ymin = y;
@@ -160,6 +194,14 @@ static void add_line(gfxdevice_t*dev , double x1, double y1, double x2, double y
 	double posx=0;
 	double startx = x1;
 
+	/* only walk the part of the line that intersects this device's band
+	   (posx is still stepped one line at a time, so that the results are
+	   identical to those of the unbanded renderer) */
+	if(endy < i->ystart)
+	    return;
+	if(endy >= i->ystart + i->height2)
+	    endy = i->ystart + i->height2 - 1;
+
 	while(posy<=endy) {
 	    float xx = (float)(startx + posx);
 	    add_pixel(i, xx ,posy);
@@ -267,42 +309,13 @@ static int compare_renderpoints(const void * _a, const void * _b)
 
 static void fill_line_solid(RGBA*line, U32*z, int y, int x1, int x2, RGBA col)
 {
-    int x = x1;
-
-    U32 bit = 1<<(x1&31);
-    int bitpos = (x1/32);
-
-    if(col.a!=255) {
-        int ainv = 255-col.a;
-        col.r = (col.r*col.a)/255;
-        col.g = (col.g*col.a)/255;
-        col.b = (col.b*col.a)/255;
-        do {
-	    if(z[bitpos]&bit) {
-		line[x].r = ((line[x].r*ainv)/255)+col.r;
-		line[x].g = ((line[x].g*ainv)/255)+col.g;
-		line[x].b = ((line[x].b*ainv)/255)+col.b;
-		//line[x].a = 255;
-		line[x].a = ((line[x].a*ainv)/255)+col.a;
-	    }
-	    bit <<= 1;
-	    if(!bit) {
-		bit = 1;bitpos++;
-	    }
-        } while(++x<x2);
-    } else {
-        do {
-	    if(z[bitpos]&bit) {
-		line[x] = col;
-	    }
-	    bit <<= 1;
-	    if(!bit) {
-		bit = 1;bitpos++;
-	    }
-        } while(++x<x2);
-    }
+    spanfill_solid_bitmask(line, z, x1, x2, col);
 }
 
+/* bitmap and gradient pixels are computed for up to this many
+   pixels at a time, and then blended in one go */
+#define SPAN_BUFFER 256
+
 static void fill_line_bitmap(RGBA*line, U32*z, int y, int x1, int x2, fillinfo_t*info)
 {
     int x = x1;
@@ -327,15 +340,16 @@ static void fill_line_bitmap(RGBA*line, U32*z, int y, int x1, int x2, fillinfo_t
     double xinc1 = m->m11 * det;
     double yinc1 = m->m01 * det;
     
-    U32 bit = 1<<(x1&31);
-    int bitpos = (x1/32);
-
-    do {
-	if(z[bitpos]&bit) {
-	    RGBA col;
+    RGBA buf[SPAN_BUFFER];
+    while(x<x2) {
+	int start = x;
+	int end = x2 < start+SPAN_BUFFER ? x2 : start+SPAN_BUFFER;
+	for(;x<end;x++) {
+	    if(!(z[x>>5]&(1u<<(x&31)))) {
+		continue;
+	    }
 	    int xx = (int)(xx1 + x * xinc1);
 	    int yy = (int)(yy1 - x * yinc1);
-	    int ainv;
 
 	    if(info->linear_or_radial) {
 		if(xx<0) xx=0;
@@ -349,20 +363,11 @@ static void fill_line_bitmap(RGBA*line, U32*z, int y, int x1, int x2, fillinfo_t
 		if(yy<0) yy += b->height;
 	    }
 
-	    col = b->data[yy*b->width+xx];
-	    ainv = 255-col.a;
-
-	    /* needs bitmap with premultiplied alpha */
-	    line[x].r = ((line[x].r*ainv)/255)+col.r;
-	    line[x].g = ((line[x].g*ainv)/255)+col.g;
-	    line[x].b = ((line[x].b*ainv)/255)+col.b;
-	    line[x].a = 255;
-	}
-	bit <<= 1;
-	if(!bit) {
-	    bit = 1;bitpos++;
+	    buf[x-start] = b->data[yy*b->width+xx];
 	}
-    } while(++x<x2);
+	/* needs bitmap with premultiplied alpha */
+	spanfill_blend_bitmask(line, z, start, end, buf);
+    }
 }
 
 static void fill_line_gradient(RGBA*line, U32*z, int y, int x1, int x2, fillinfo_t*info)
@@ -384,14 +389,14 @@ static void fill_line_gradient(RGBA*line, U32*z, int y, int x1, int x2, fillinfo
     double xinc1 = m->m11 * det;
     double yinc1 = m->m01 * det;
     
-    U32 bit = 1<<(x1&31);
-    int bitpos = (x1/32);
-
-    do {
-	if(z[bitpos]&bit) {
-	    RGBA col;
-	    int ainv;
-
+    RGBA buf[SPAN_BUFFER];
+    while(x<x2) {
+	int start = x;
+	int end = x2 < start+SPAN_BUFFER ? x2 : start+SPAN_BUFFER;
+	for(;x<end;x++) {
+	    if(!(z[x>>5]&(1u<<(x&31)))) {
+		continue;
+	    }
             int pos = 0;
             if(info->linear_or_radial) {
                 double xx = xx1 + x * xinc1;
@@ -405,20 +410,11 @@ static void fill_line_gradient(RGBA*line, U32*z, int y, int x1, int x2, fillinfo
                 if(r<-1) r = -1;
                 pos = (int)((r+1)*127.999);
             }
-	    col = g[pos];
-	    ainv = 255-col.a;
-
-	    /* needs bitmap with premultiplied alpha */
-	    line[x].r = ((line[x].r*ainv)/255)+col.r;
-	    line[x].g = ((line[x].g*ainv)/255)+col.g;
-	    line[x].b = ((line[x].b*ainv)/255)+col.b;
-	    line[x].a = 255;
-	}
-	bit <<= 1;
-	if(!bit) {
-	    bit = 1;bitpos++;
+	    buf[x-start] = g[pos];
 	}
-    } while(++x<x2);
+	/* needs gradient with premultiplied alpha */
+	spanfill_blend_bitmask(line, z, start, end, buf);
+    }
 }
 
 static void fill_line_clip(RGBA*line, U32*z, int y, int x1, int x2)
@@ -439,6 +435,9 @@ static void fill_line_clip(RGBA*line, U32*z, int y, int x1, int x2)
 
 void fill_line(gfxdevice_t*dev, RGBA*line, U32*zline, int y, int startx, int endx, fillinfo_t*fill)
 {
+    /* spans always cover at least the start pixel */
+    if(endx <= startx)
+	endx = startx+1;
     if(fill->type == filltype_solid)
 	fill_line_solid(line, zline, y, startx, endx, *fill->color);
     else if(fill->type == filltype_clip)
@@ -477,7 +476,7 @@ void fill(gfxdevice_t*dev, fillinfo_t*fill)
                 endx = 0;
 
 	    if(!(n&1))
-		fill_line(dev, line, zline, y, startx, endx, fill);
+		fill_line(dev, line, zline, i->ystart + y, startx, endx, fill);
 
 	    lastx = endx;
             if(endx == i->width2)
@@ -523,6 +522,15 @@ int render_setparameter(struct _gfxdevice*dev, const char*key, const char*value)
     } else if(!strcmp(key, "palette")) {
 	i->palette = atoi(value);
 	return 1;
+    } else if(!strcmp(key, "threads")) {
+	i->threads = atoi(value);
+	return 1;
+    } else if(!strcmp(key, "stripheight")) {
+	i->stripheight = atoi(value);
+	return 1;
+    } else if(!strcmp(key, "jpegquality")) {
+	i->jpegquality = atoi(value);
+	return 1;
     }
     return 0;
 }
@@ -559,6 +567,11 @@ void render_stroke(struct _gfxdevice*dev, gfxline_t*line, gfxcoord_t width, gfxc
 {
     internal_t*i = (internal_t*)dev->internal;
     double x,y;
+
+    if(i->recorder) {
+	i->recorder->stroke(i->recorder, line, width, color, cap_style, joint_style, miterLimit);
+	return;
+    }
     
     /*if(cap_style != gfx_capRound || joint_style != gfx_joinRound) {
 	fprintf(stderr, "Warning: cap/joint style != round not yet supported\n");
@@ -602,54 +615,79 @@ void render_stroke(struct _gfxdevice*dev, gfxline_t*line, gfxcoord_t width, gfxc
     }
 }
 
-static void draw_line(gfxdevice_t*dev, gfxline_t*line)
+/* draw a segment from x,y to (type,lx,ly,lsx,lsy) */
+static inline void draw_segment(gfxdevice_t*dev, double x, double y, int type, double lx, double ly, double lsx, double lsy)
 {
     internal_t*i = (internal_t*)dev->internal;
-    double x=0,y=0;
-
-    while(line)
-    {
-        int x1,y1,x2,y2,x3,y3;
-
-        if(line->type == gfx_moveTo) {
-        } else if(line->type == gfx_lineTo) {
-	    double x1=x*i->zoom,y1=y*i->zoom;
-	    double x3=line->x*i->zoom,y3=line->y*i->zoom;
-            
-            add_line(dev, x1, y1, x3, y3);
-        } else if(line->type == gfx_splineTo) {
-	    int c,t,parts,qparts;
-	    double xx,yy;
-            
-	    double x1=x*i->zoom,y1=y*i->zoom;
-	    double x2=line->sx*i->zoom,y2=line->sy*i->zoom;
-	    double x3=line->x*i->zoom,y3=line->y*i->zoom;
-            
-            c = abs(x3-2*x2+x1) + abs(y3-2*y2+y1);
-            xx=x1;
-	    yy=y1;
-
-            parts = (int)(sqrt(c));
-            if(!parts) parts = 1;
+    if(type == gfx_moveTo) {
+    } else if(type == gfx_lineTo) {
+	double x1=x*i->zoom,y1=y*i->zoom;
+	double x3=lx*i->zoom,y3=ly*i->zoom;
+	
+	add_line(dev, x1, y1, x3, y3);
+    } else if(type == gfx_splineTo) {
+	int c,t,parts,qparts;
+	double xx,yy;
+	
+	double x1=x*i->zoom,y1=y*i->zoom;
+	double x2=lsx*i->zoom,y2=lsy*i->zoom;
+	double x3=lx*i->zoom,y3=ly*i->zoom;
+	
+	c = abs(x3-2*x2+x1) + abs(y3-2*y2+y1);
+	xx=x1;
+	yy=y1;
+
+	parts = (int)(sqrt(c));
+	if(!parts) parts = 1;
+
+	for(t=1;t<=parts;t++) {
+	    double nx = (double)(t*t*x3 + 2*t*(parts-t)*x2 + (parts-t)*(parts-t)*x1)/(double)(parts*parts);
+	    double ny = (double)(t*t*y3 + 2*t*(parts-t)*y2 + (parts-t)*(parts-t)*y1)/(double)(parts*parts);
+	    
+	    add_line(dev, xx, yy, nx, ny);
+	    xx = nx;
+	    yy = ny;
+	}
+    }
+}
 
-            for(t=1;t<=parts;t++) {
-                double nx = (double)(t*t*x3 + 2*t*(parts-t)*x2 + (parts-t)*(parts-t)*x1)/(double)(parts*parts);
-                double ny = (double)(t*t*y3 + 2*t*(parts-t)*y2 + (parts-t)*(parts-t)*y1)/(double)(parts*parts);
-                
-                add_line(dev, xx, yy, nx, ny);
-                xx = nx;
-                yy = ny;
-            }
-        }
+static void draw_line(gfxdevice_t*dev, gfxline_t*line)
+{
+    double x=0,y=0;
+    while(line) {
+	draw_segment(dev, x, y, line->type, line->x, line->y, line->sx, line->sy);
         x = line->x;
         y = line->y;
         line = line->next;
     }
 }
 
+static void draw_path(gfxdevice_t*dev, gfxpath_t*path)
+{
+    double x=0,y=0;
+    int t;
+    for(t=0;t<path->num;t++) {
+	draw_segment(dev, x, y, path->type[t], path->x[t], path->y[t], path->sx[t], path->sy[t]);
+        x = path->x[t];
+        y = path->y[t];
+    }
+}
+
+static void free_glyphs(internal_t*i)
+{
+    if(i->glyphs) {
+	gfxpathcache_destroy(i->glyphs);i->glyphs = 0;
+	gfxpath_free(i->glyphpath);i->glyphpath = 0;
+    }
+}
+
 void render_startclip(struct _gfxdevice*dev, gfxline_t*line)
 {
     internal_t*i = (internal_t*)dev->internal;
+    if(i->recorder) {
+	i->recorder->startclip(i->recorder, line);
+	return;
+    }
     fillinfo_t info;
     memset(&info, 0, sizeof(info));
     newclip(dev);
@@ -661,20 +699,46 @@ void render_startclip(struct _gfxdevice*dev, gfxline_t*line)
 void render_endclip(struct _gfxdevice*dev)
 {
     internal_t*i = (internal_t*)dev->internal;
+    if(i->recorder) {
+	i->recorder->endclip(i->recorder);
+	return;
+    }
     endclip(dev, 0);
 }
 
 void render_fill(struct _gfxdevice*dev, gfxline_t*line, gfxcolor_t*color)
 {
     internal_t*i = (internal_t*)dev->internal;
+    if(i->recorder) {
+	i->recorder->fill(i->recorder, line, color);
+	return;
+    }
 
     draw_line(dev, line);
     fill_solid(dev, color);
 }
 
+void render_fillpath(struct _gfxdevice*dev, gfxpath_t*path, gfxcolor_t*color)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    if(i->recorder) {
+	gfxline_t*line = gfxpath_to_gfxline(path);
+	i->recorder->fill(i->recorder, line, color);
+	gfxline_free(line);
+	return;
+    }
+
+    draw_path(dev, path);
+    fill_solid(dev, color);
+}
+
 void render_fillbitmap(struct _gfxdevice*dev, gfxline_t*line, gfximage_t*img, gfxmatrix_t*matrix, gfxcxform_t*cxform)
 {
     internal_t*i = (internal_t*)dev->internal;
+    if(i->recorder) {
+	i->recorder->fillbitmap(i->recorder, line, img, matrix, cxform);
+	return;
+    }
 
     gfxmatrix_t m2 = *matrix;
 
@@ -696,6 +760,10 @@ void render_fillbitmap(struct _gfxdevice*dev, gfxline_t*line, gfximage_t*img, gf
 void render_fillgradient(struct _gfxdevice*dev, gfxline_t*line, gfxgradient_t*gradient, gfxgradienttype_t type, gfxmatrix_t*matrix)
 {
     internal_t*i = (internal_t*)dev->internal;
+    if(i->recorder) {
+	i->recorder->fillgradient(i->recorder, line, gradient, type, matrix);
+	return;
+    }
     
     gfxmatrix_t m2 = *matrix;
 
@@ -753,6 +821,10 @@ void render_fillgradient(struct _gfxdevice*dev, gfxline_t*line, gfxgradient_t*gr
 
 void render_addfont(struct _gfxdevice*dev, gfxfont_t*font)
 {
+    internal_t*i = (internal_t*)dev->internal;
+    if(i->recorder) {
+	i->recorder->addfont(i->recorder, font);
+    }
 }
 
 void render_drawchar(struct _gfxdevice*dev, gfxfont_t*font, int glyphnr, gfxcolor_t*color, gfxmatrix_t*matrix)
@@ -760,17 +832,23 @@ void render_drawchar(struct _gfxdevice*dev, gfxfont_t*font, int glyphnr, gfxcolo
     internal_t*i = (internal_t*)dev->internal;
     if(!font)
 	return;
+    if(i->recorder) {
+	i->recorder->drawchar(i->recorder, font, glyphnr, color, matrix);
+	return;
+    }
 
     /* align characters to whole pixels */
     matrix->tx = (int)(matrix->tx * i->antialize) / i->antialize;
     matrix->ty = (int)(matrix->ty * i->antialize) / i->antialize;
 
-    gfxglyph_t*glyph = &font->glyphs[glyphnr];
-    gfxline_t*line2 = gfxline_clone(glyph->line);
-    gfxline_transform(line2, matrix);
-    draw_line(dev, line2);
+    if(!i->glyphs) {
+	i->glyphs = gfxpathcache_new();
+	i->glyphpath = gfxpath_new();
+    }
+    gfxpath_t*glyph = gfxpathcache_getglyph(i->glyphs, font, glyphnr);
+    gfxpath_transform_to(i->glyphpath, glyph, matrix);
+    draw_path(dev, i->glyphpath);
     fill_solid(dev, color);
-    gfxline_free(line2);
     
     return;
 }
@@ -779,6 +857,68 @@ void render_result_write(gfxresult_t*r, int filedesc)
 {
     internal_result_t*i= (internal_result_t*)r->internal;
 }
+static char is_jpeg(const char*filename)
+{
+    int l = strlen(filename);
+    return (l>4 && strchr("gG",filename[l-1]) && strchr("pP",filename[l-2]) &&
+	     strchr("jJ",filename[l-3]) && filename[l-4]=='.') ||
+	   (l>5 && strchr("gG",filename[l-1]) && strchr("eE",filename[l-2]) &&
+	     strchr("pP",filename[l-3]) && strchr("jJ",filename[l-4]) && filename[l-5]=='.');
+}
+
+typedef void (*stripoutput_func_t)(void*ctx, gfxcolor_t*rows, int width, int num_rows);
+static void render_strips(internal_result_t*ir, stripoutput_func_t output, void*ctx);
+
+static void strip_to_png(void*ctx, gfxcolor_t*rows, int width, int num_rows)
+{
+    png_writer_add_rows((pngwriter_t*)ctx, (unsigned char*)rows, num_rows);
+}
+static void strip_to_jpeg(void*ctx, gfxcolor_t*rows, int width, int num_rows)
+{
+    jpegwriter_t*w = (jpegwriter_t*)ctx;
+    int l = num_rows*width;
+    unsigned char*data = (unsigned char*)rfx_alloc(l*3);
+    int s,t;
+    for(t=0,s=0;t<l;s+=3,t++) {
+	data[s+0] = rows[t].r;
+	data[s+1] = rows[t].g;
+	data[s+2] = rows[t].b;
+    }
+    jpeg_writer_add_rows(w, data, num_rows);
+    rfx_free(data);
+}
+
+static void save_image(internal_result_t*i, const char*filename)
+{
+    int quality = i->jpegquality > 0 ? i->jpegquality : 85;
+    if(i->recording && !i->img.data) {
+	/* strip mode: encode the page while rasterizing it */
+	if(is_jpeg(filename)) {
+	    jpegwriter_t*w = jpeg_writer_start(filename, i->page->width, i->page->height, quality);
+	    if(w) {
+		render_strips(i, strip_to_jpeg, w);
+		jpeg_writer_finish(w);
+	    }
+	} else {
+	    pngwriter_t*w = png_writer_start(filename, i->page->width, i->page->height);
+	    if(w) {
+		render_strips(i, strip_to_png, w);
+		png_writer_finish(w);
+	    }
+	}
+	return;
+    }
+    if(is_jpeg(filename)) {
+	gfximage_save_jpeg(&i->img, filename, quality);
+	return;
+    }
+    int threads = i->threads > 1 ? i->threads : 1;
+    if(!i->palette) {
+	png_write_threaded(filename, (unsigned char*)i->img.data, i->img.width, i->img.height, threads);
+    } else {
+	png_write_palette_based_2_threaded(filename, (unsigned char*)i->img.data, i->img.width, i->img.height, threads);
+    }
+}
 int render_result_save(gfxresult_t*r, const char*filename)
 {
     internal_result_t*i= (internal_result_t*)r->internal;
@@ -789,27 +929,21 @@ int render_result_save(gfxresult_t*r, const char*filename)
 	int nr=0;
 	char filenamebuf[256];
 	char*origname = strdup(filename);
+	const char*ext = is_jpeg(filename)?"jpg":"png";
 	int l = strlen(origname);
-	if(l>3 && strchr("gG",origname[l-1]) && strchr("nN",filename[l-2]) &&
-		strchr("pP",origname[l-3]) && filename[l-4]=='.') {
-	    origname[l-4] = 0;
+	if(l>3 && ((strchr("gG",origname[l-1]) && strchr("nN",filename[l-2]) &&
+		 strchr("pP",origname[l-3]) && filename[l-4]=='.') || is_jpeg(filename))) {
+	    *strrchr(origname, '.') = 0;
 	}
-	while(i->next) {
-	    sprintf(filenamebuf, "%s.%d.png", origname, nr);
-            if(!i->palette) {
-	        png_write(filename, (unsigned char*)i->img.data, i->img.width, i->img.height);
-            } else {
-	        png_write_palette_based_2(filename, (unsigned char*)i->img.data, i->img.width, i->img.height);
-            }
+	while(i) {
+	    sprintf(filenamebuf, "%s.%d.%s", origname, nr, ext);
+	    save_image(i, filenamebuf);
+	    i = i->next;
 	    nr++;
 	}
 	free(origname);
     } else {
-        if(!i->palette) {
-	    png_write(filename, (unsigned char*)i->img.data, i->img.width, i->img.height);
-	} else {
-	    png_write_palette_based_2(filename, (unsigned char*)i->img.data, i->img.width, i->img.height);
-	}
+	save_image(i, filename);
     }
     return 1;
 }
@@ -838,6 +972,23 @@ char*gfximage_asXPM(gfximage_t*img, int depth)
     *p = 0;
     return p;
 }
+static void strip_to_image(void*ctx, gfxcolor_t*rows, int width, int num_rows)
+{
+    gfximage_t*img = (gfximage_t*)ctx;
+    memcpy(&img->data[img->width*img->height], rows, sizeof(gfxcolor_t)*width*num_rows);
+    img->height += num_rows;
+}
+static gfximage_t* result_image(internal_result_t*i)
+{
+    if(i->recording && !i->img.data) {
+	/* strip mode: the caller wants the whole bitmap after all */
+	i->img.data = (gfxcolor_t*)malloc(i->page->width*i->page->height*sizeof(gfxcolor_t));
+	i->img.width = i->page->width;
+	i->img.height = 0;
+	render_strips(i, strip_to_image, &i->img);
+    }
+    return &i->img;
+}
 void*render_result_get(gfxresult_t*r, const char*name)
 {
     internal_result_t*i= (internal_result_t*)r->internal;
@@ -851,7 +1002,7 @@ void*render_result_get(gfxresult_t*r, const char*name)
 		return 0;
             pagenr--;
 	}
-	return gfximage_asXPM(&i->img, 64);
+	return gfximage_asXPM(result_image(i), 64);
     } else if(!strncmp(name,"page",4)) {
 	int pagenr = atoi(&name[4]);
 	if(pagenr<0)
@@ -862,7 +1013,7 @@ void*render_result_get(gfxresult_t*r, const char*name)
 		return 0;
             pagenr--;
 	}
-	return &i->img;
+	return result_image(i);
     }
     return 0;
 }
@@ -873,6 +1024,10 @@ void render_result_destroy(gfxresult_t*r)
     while(i) {
 	internal_result_t*next = i->next;
 	free(i->img.data);i->img.data = 0;
+	if(i->recording) {
+	    i->recording->destroy(i->recording);i->recording = 0;
+	    rfx_free(i->page);i->page = 0;
+	}
 
         /* FIXME memleak
            the following rfx_free causes a segfault on WIN32 machines,
@@ -896,6 +1051,7 @@ gfxresult_t* render_finish(struct _gfxdevice*dev)
     res->get = render_result_get;
     res->destroy = render_result_destroy;
 
+    free_glyphs(i);
     free(dev->internal); dev->internal = 0; i = 0;
 
     return res;
@@ -917,16 +1073,31 @@ void render_startpage(struct _gfxdevice*dev, int width, int height)
     i->height2 = height*i->zoom;
     i->bitwidth = (i->width2+31)/32;
 
+    if(i->stripheight > 0) {
+	/* the page is rasterized when the result is saved */
+	i->recorder = (gfxdevice_t*)rfx_calloc(sizeof(gfxdevice_t));
+	gfxdevice_record_init(i->recorder, 0);
+	return;
+    }
+
+    i->img = (RGBA*)rfx_calloc(sizeof(RGBA)*i->width2*i->height2);
+    if(i->fillwhite) {
+	memset(i->img, 0xff, sizeof(RGBA)*i->width2*i->height2);
+    }
+
+    if(i->threads > 1) {
+	/* lines and clip buffers are allocated per band in endpage() */
+	i->recorder = (gfxdevice_t*)rfx_calloc(sizeof(gfxdevice_t));
+	gfxdevice_record_init(i->recorder, 0);
+	return;
+    }
+
     i->lines = (renderline_t*)rfx_alloc(i->height2*sizeof(renderline_t));
     for(y=0;y<i->height2;y++) {
 	memset(&i->lines[y], 0, sizeof(renderline_t));
         i->lines[y].points = 0;
         i->lines[y].num = 0;
     }
-    i->img = (RGBA*)rfx_calloc(sizeof(RGBA)*i->width2*i->height2);
-    if(i->fillwhite) {
-	memset(i->img, 0xff, sizeof(RGBA)*i->width2*i->height2);
-    }
 
     i->ymin = 0x7fffffff;
     i->ymax = -0x80000000;
@@ -937,30 +1108,27 @@ void render_startpage(struct _gfxdevice*dev, int width, int height)
     memset(i->clipbuf->data, 255, sizeof(U32)*i->bitwidth*i->height2);
 }
 
-static void store_image(internal_t*i, internal_result_t*ir)
+/* convert num_lines (antialiased) lines of src to output pixels. Returns
+   the number of lines written to dest. */
+static int downsample(internal_t*i, RGBA*src, int num_lines, gfxcolor_t*dest)
 {
-    ir->img.data = (gfxcolor_t*)malloc(i->width*i->height*sizeof(gfxcolor_t));
-    ir->img.width = i->width;
-    ir->img.height = i->height;
-
-    gfxcolor_t*dest = ir->img.data;
-
     if(i->antialize <= 1) /* no antializing */ {
 	int y;
-	for(y=0;y<i->height;y++) {
-	    RGBA*line = &i->img[y*i->width];
+	for(y=0;y<num_lines;y++) {
+	    RGBA*line = &src[y*i->width];
 	    memcpy(&dest[y*i->width], line, sizeof(RGBA)*i->width);
 	}
+	return num_lines;
     } else {
 	RGBA**lines = (RGBA**)rfx_calloc(sizeof(RGBA*)*i->antialize);
 	int q = i->antialize*i->antialize;
 	int ypos = 0;
 	int y;
 	int y2=0;
-	for(y=0;y<i->height2;y++) {
+	for(y=0;y<num_lines;y++) {
 	    int n;
 	    ypos = y % i->antialize;
-	    lines[ypos] = &i->img[y*i->width2];
+	    lines[ypos] = &src[y*i->width2];
 	    if(ypos == i->antialize-1) {
 		RGBA*out = &dest[(y2++)*i->width];
 		int x;
@@ -988,35 +1156,212 @@ static void store_image(internal_t*i, internal_result_t*ir)
 	    }
 	}
 	rfx_free(lines);
+	return y2;
     }
 }
 
-void render_endpage(struct _gfxdevice*dev)
+static void store_image(internal_t*i, internal_result_t*ir)
 {
-    internal_t*i = (internal_t*)dev->internal;
-    
-    if(!i->width2 || !i->height2) {
-	fprintf(stderr, "Error: endpage() called without corresponding startpage()\n");
-	exit(1);
-    }
+    ir->img.data = (gfxcolor_t*)malloc(i->width*i->height*sizeof(gfxcolor_t));
+    ir->img.width = i->width;
+    ir->img.height = i->height;
+    downsample(i, i->img, i->height2, ir->img.data);
+}
 
+static int free_clipbuffers(gfxdevice_t*dev)
+{
+    internal_t*i = (internal_t*)dev->internal;
     endclip(dev, 1);
     int unclosed = 0;
     while(i->clipbuf) {
 	endclip(dev, 1);
         unclosed++;
     }
+    return unclosed;
+}
+
+/* render lines ystart..ystart+height2-1 of a recorded page into img */
+static void render_lines(gfxdevice_t*dev, internal_t*page, gfxresult_t*recording, RGBA*img, int ystart, int height2)
+{
+    int y;
 
-    if(unclosed) {
+    /* a device of its own for these lines. Since all work the renderer does
+       is per scanline, rendering a page in bands yields exactly the pixels
+       of rendering it at once */
+    internal_t b;
+    memset(&b, 0, sizeof(b));
+    b.width = page->width;
+    b.height = page->height;
+    b.width2 = page->width2;
+    b.bitwidth = page->bitwidth;
+    b.multiply = page->multiply;
+    b.antialize = page->antialize;
+    b.zoom = page->zoom;
+    b.ystart = ystart;
+    b.height2 = height2;
+    b.img = img;
+    b.lines = (renderline_t*)rfx_calloc(b.height2*sizeof(renderline_t));
+    b.ymin = 0x7fffffff;
+    b.ymax = -0x80000000;
+
+    gfxdevice_t band = *dev;
+    band.internal = &b;
+
+    newclip(&band);
+    memset(b.clipbuf->data, 255, sizeof(U32)*b.bitwidth*b.height2);
+
+    gfxresult_record_replay(recording, &band, 0);
+
+    int unclosed = free_clipbuffers(&band);
+    if(unclosed && !ystart) {
         fprintf(stderr, "Warning: %d unclosed clip(s) while processing endpage()\n", unclosed);
     }
+    for(y=0;y<b.height2;y++) {
+	rfx_free(b.lines[y].points);
+    }
+    rfx_free(b.lines);
+    free_glyphs(&b);
+}
+
+typedef struct _bandjob {
+    gfxdevice_t*dev;
+    internal_t*page;
+    gfxresult_t*recording;
+    /* the lines to render, and where to store them */
+    RGBA*img;
+    int ystart;
+    int height2;
+    int bandheight;
+} bandjob_t;
+
+static void render_band(void*data, int job, int thread)
+{
+    bandjob_t*j = (bandjob_t*)data;
+    int y = job*j->bandheight;
+    int height2 = j->height2 - y;
+    if(height2 > j->bandheight)
+	height2 = j->bandheight;
+    render_lines(j->dev, j->page, j->recording, &j->img[y*j->page->width2], j->ystart + y, height2);
+}
+
+static void render_bands(gfxdevice_t*dev)
+{
+    internal_t*i = (internal_t*)dev->internal;
+
+    gfxresult_t*recording = i->recorder->finish(i->recorder);
+    rfx_free(i->recorder);i->recorder = 0;
+
+    /* every band replays the whole page, so use only one band
+       per thread, and don't make them too small */
+    int num_bands = i->threads;
+    int bandheight = (i->height2 + num_bands - 1) / num_bands;
+    if(bandheight < 16)
+	bandheight = 16;
+    num_bands = (i->height2 + bandheight - 1) / bandheight;
+
+    bandjob_t job;
+    job.dev = dev;
+    job.page = i;
+    job.recording = recording;
+    job.img = i->img;
+    job.ystart = 0;
+    job.height2 = i->height2;
+    job.bandheight = bandheight;
+    threads_run(i->threads, num_bands, render_band, &job);
+
+    recording->destroy(recording);
+}
+
+static void render_set_functions(gfxdevice_t*dev);
+
+/* rasterize a page recorded in strip mode, and pass it to output() a few
+   lines at a time. With threads, several strips are rendered in parallel. */
+static void render_strips(internal_result_t*ir, stripoutput_func_t output, void*ctx)
+{
+    internal_t*page = ir->page;
+    gfxdevice_t dev;
+    memset(&dev, 0, sizeof(dev));
+    render_set_functions(&dev);
+
+    int threads = page->threads > 1 ? page->threads : 1;
+    int striplines = page->stripheight * page->antialize;
+    int grouplines = striplines * threads;
+    if(grouplines > page->height2)
+	grouplines = page->height2;
+
+    RGBA*img = (RGBA*)rfx_alloc(sizeof(RGBA)*page->width2*grouplines);
+    gfxcolor_t*out = (gfxcolor_t*)rfx_alloc(sizeof(gfxcolor_t)*page->width*grouplines);
+
+    int y;
+    for(y=0;y<page->height2;y+=grouplines) {
+	int height2 = page->height2 - y;
+	if(height2 > grouplines)
+	    height2 = grouplines;
+	memset(img, page->fillwhite?0xff:0, sizeof(RGBA)*page->width2*height2);
+
+	bandjob_t job;
+	job.dev = &dev;
+	job.page = page;
+	job.recording = ir->recording;
+	job.img = img;
+	job.ystart = y;
+	job.height2 = height2;
+	job.bandheight = striplines;
+	threads_run(threads, (height2 + striplines - 1) / striplines, render_band, &job);
+
+	int rows = downsample(page, img, height2, out);
+	output(ctx, out, page->width, rows);
+    }
+    rfx_free(out);
+    rfx_free(img);
+}
+
+void render_endpage(struct _gfxdevice*dev)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    
+    if(!i->width2 || !i->height2) {
+	fprintf(stderr, "Error: endpage() called without corresponding startpage()\n");
+	exit(1);
+    }
+
+    gfxresult_t*recording = 0;
+    if(i->recorder && i->stripheight > 0) {
+	recording = i->recorder->finish(i->recorder);
+	rfx_free(i->recorder);i->recorder = 0;
+    } else if(i->recorder) {
+	render_bands(dev);
+    } else {
+	int unclosed = free_clipbuffers(dev);
+	if(unclosed) {
+	    fprintf(stderr, "Warning: %d unclosed clip(s) while processing endpage()\n", unclosed);
+	}
+    }
     
     internal_result_t*ir= (internal_result_t*)rfx_calloc(sizeof(internal_result_t));
     ir->palette = i->palette;
+    ir->threads = i->threads;
+    ir->jpegquality = i->jpegquality;
 
     int y,x;
 
-    store_image(i, ir);
+    if(recording) {
+	ir->recording = recording;
+	ir->page = (internal_t*)rfx_calloc(sizeof(internal_t));
+	ir->page->width = i->width;
+	ir->page->height = i->height;
+	ir->page->width2 = i->width2;
+	ir->page->height2 = i->height2;
+	ir->page->bitwidth = i->bitwidth;
+	ir->page->multiply = i->multiply;
+	ir->page->antialize = i->antialize;
+	ir->page->zoom = i->zoom;
+	ir->page->fillwhite = i->fillwhite;
+	ir->page->threads = i->threads;
+	ir->page->stripheight = i->stripheight;
+    } else {
+	store_image(i, ir);
+    }
 
     ir->next = 0;
     if(i->result_next) {
@@ -1027,10 +1372,12 @@ void render_endpage(struct _gfxdevice*dev)
     }
     i->result_next = ir;
 
-    for(y=0;y<i->height2;y++) {
-	rfx_free(i->lines[y].points); i->lines[y].points = 0;
+    if(i->lines) {
+	for(y=0;y<i->height2;y++) {
+	    rfx_free(i->lines[y].points); i->lines[y].points = 0;
+	}
+	rfx_free(i->lines);i->lines=0;
     }
-    rfx_free(i->lines);i->lines=0;
 
     if(i->img) {rfx_free(i->img);i->img = 0;}
 
@@ -1043,6 +1390,24 @@ void render_drawlink(struct _gfxdevice*dev, gfxline_t*line, const char*action, c
     /* not supported for this output device */
 }
 
+static void render_set_functions(gfxdevice_t*dev)
+{
+    dev->setparameter = render_setparameter;
+    dev->startpage = render_startpage;
+    dev->startclip = render_startclip;
+    dev->endclip = render_endclip;
+    dev->stroke = render_stroke;
+    dev->fill = render_fill;
+    dev->fillpath = render_fillpath;
+    dev->fillbitmap = render_fillbitmap;
+    dev->fillgradient = render_fillgradient;
+    dev->addfont = render_addfont;
+    dev->drawchar = render_drawchar;
+    dev->drawlink = render_drawlink;
+    dev->endpage = render_endpage;
+    dev->finish = render_finish;
+}
+
 void gfxdevice_render_init(gfxdevice_t*dev)
 {
     internal_t*i = (internal_t*)rfx_calloc(sizeof(internal_t));
@@ -1060,19 +1425,7 @@ void gfxdevice_render_init(gfxdevice_t*dev)
     i->multiply = 1;
     i->zoom = 1;
 
-    dev->setparameter = render_setparameter;
-    dev->startpage = render_startpage;
-    dev->startclip = render_startclip;
-    dev->endclip = render_endclip;
-    dev->stroke = render_stroke;
-    dev->fill = render_fill;
-    dev->fillbitmap = render_fillbitmap;
-    dev->fillgradient = render_fillgradient;
-    dev->addfont = render_addfont;
-    dev->drawchar = render_drawchar;
-    dev->drawlink = render_drawlink;
-    dev->endpage = render_endpage;
-    dev->finish = render_finish;
+    render_set_functions(dev);
 }
 
 
@@ -32,6 +32,7 @@
 #include "../mem.h"
 #include "../gfxdevice.h"
 #include "../gfxtools.h"
+#include "../gfxpath.h"
 
 typedef struct _internal {
     gfxdevice_t*out;
@@ -43,6 +44,8 @@ typedef struct _internal {
     gfxmatrix_t matrix;
     double zoomwidth;
     int keepratio;
+
+    gfxpath_t*path;
 } internal_t;
 
 static int verbose = 1;
@@ -204,11 +207,25 @@ void rescale_stroke(gfxdevice_t*dev, gfxline_t*line, gfxcoord_t width, gfxcolor_
 void rescale_fill(gfxdevice_t*dev, gfxline_t*line, gfxcolor_t*color)
 {
     internal_t*i = (internal_t*)dev->internal;
+    if(i->out->fillpath) {
+	/* output device takes packed paths- skip the gfxline clone */
+	gfxpath_set_gfxline(i->path, line);
+	gfxpath_transform(i->path, &i->matrix);
+	i->out->fillpath(i->out, i->path, color);
+	return;
+    }
     gfxline_t*line2 = transformgfxline(i, line);
     i->out->fill(i->out, line2, color);
     gfxline_free(line2);
 }
 
+void rescale_fillpath(gfxdevice_t*dev, gfxpath_t*path, gfxcolor_t*color)
+{
+    internal_t*i = (internal_t*)dev->internal;
+    gfxpath_transform_to(i->path, path, &i->matrix);
+    gfxdevice_fillpath(i->out, i->path, color);
+}
+
 void rescale_fillbitmap(gfxdevice_t*dev, gfxline_t*line, gfximage_t*img, gfxmatrix_t*matrix, gfxcxform_t*cxform)
 {
     internal_t*i = (internal_t*)dev->internal;
@@ -259,6 +276,7 @@ gfxresult_t* rescale_finish(gfxdevice_t*dev)
 {
     internal_t*i = (internal_t*)dev->internal;
     gfxdevice_t*out = i->out;
+    gfxpath_free(i->path);
     free(dev->internal);dev->internal = 0;i=0;
     if(out) {
 	return out->finish(out);
@@ -282,6 +300,7 @@ void gfxdevice_rescale_init(gfxdevice_t*dev, gfxdevice_t*out, int width, int hei
     dev->endclip = rescale_endclip;
     dev->stroke = rescale_stroke;
     dev->fill = rescale_fill;
+    dev->fillpath = rescale_fillpath;
     dev->fillbitmap = rescale_fillbitmap;
     dev->fillgradient = rescale_fillgradient;
     dev->addfont = rescale_addfont;
@@ -291,6 +310,7 @@ void gfxdevice_rescale_init(gfxdevice_t*dev, gfxdevice_t*out, int width, int hei
     dev->finish = rescale_finish;
 
     gfxmatrix_unit(&i->matrix);
+    i->path = gfxpath_new();
     i->targetwidth = width;
     i->targetheight = height;
     i->zoomwidth = 1.0;
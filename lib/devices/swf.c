@@ -43,6 +43,8 @@
 #include "swf.h"
 #include "../gfxpoly.h"
 #include "../gfximage.h"
+#include "../q.h"
+#include "../os.h"
 
 #define CHARDATAMAX 1024
 #define CHARMIDX 0
@@ -73,6 +75,7 @@ typedef struct _charbuffer {
 typedef struct _fontlist
 {
     SWFFONT *swffont;
+    char stored; // already written to the output stream
     struct _fontlist*next;
 } fontlist_t;
 
@@ -99,8 +102,11 @@ typedef struct _swfoutput_internal
     int config_frameresets;
     int config_linknameurl;
     int config_jpegquality;
+    gfxrescale_filter_t config_rescalefilter;
+    int config_rescalethreads;
     int config_storeallcharacters;
     int config_enablezlib;
+    int config_enablelzma;
     int config_insertstoptag;
     int config_showimages;
     int config_watermark;
@@ -129,9 +135,15 @@ typedef struct _swfoutput_internal
     char*config_externallinkfunction;
     char config_animate;
     double config_framerate;
+    char* config_stream;
 
     SWF* swf;
 
+    /* if config_stream is set, finished pages are written to
+       this file right away instead of being kept in memory */
+    SWFSTREAM* stream;
+    int streamhandle;
+
     fontlist_t* fontlist;
 
     char storefont;
@@ -165,15 +177,8 @@ typedef struct _swfoutput_internal
     U32 clipdepths[128];
     int clippos;
 
-    /* image cache */
-    /*
-    int pic_xids[1024];
-    int pic_yids[1024];
-    int pic_ids[1024];
-    int pic_width[1024];
-    int pic_height[1024];
-    int picpos;
-    */
+    /* image cache: imagekey_t -> bitmap id */
+    dict_t*imagecache;
 
     int frameno;
     int lastframeno;
@@ -230,6 +235,8 @@ static void swf_endframe(gfxdevice_t*dev);
 static void swfoutput_namedlink(gfxdevice_t*dev, char*name, gfxline_t*points);
 static void swfoutput_linktopage(gfxdevice_t*dev, int page, gfxline_t*points);
 static void swfoutput_linktourl(gfxdevice_t*dev, const char*url, gfxline_t*points);
+static void clearImageCache(gfxdevice_t*dev);
+static void stream_flush(gfxdevice_t*dev, char all);
 
 static gfxresult_t* swf_finish(gfxdevice_t*driver);
 
@@ -275,6 +282,8 @@ static swfoutput_internal* init_internal_struct()
     i->config_ignoredraworder=0;
     i->config_drawonlyshapes=0;
     i->config_jpegquality=85;
+    i->config_rescalefilter=gfxrescale_legacy;
+    i->config_rescalethreads=1;
     i->config_storeallcharacters=0;
     i->config_dots=1;
     i->config_enablezlib=0;
@@ -297,6 +306,7 @@ static swfoutput_internal* init_internal_struct()
     i->config_externallinkfunction=0;
     i->config_reordertags=1;
     i->config_linknameurl=0;
+    i->config_stream=0;
 
     i->config_linkcolor.r = i->config_linkcolor.g = i->config_linkcolor.b = 255;
     i->config_linkcolor.a = 0x40;
@@ -1082,6 +1092,9 @@ void swf_startframe(gfxdevice_t*dev, int width, int height)
     if(!i->firstpage && !i->pagefinished)
         endpage(dev);
 
+    if(i->config_stream && !i->firstpage)
+	stream_flush(dev, 0);
+
     msg("<verbose> Starting new SWF page of size %dx%d", width, height);
 
     swf_GetMatrix(0, &i->page_matrix);
@@ -1140,6 +1153,8 @@ void swf_endframe(gfxdevice_t*dev)
 	    swf_SetU16(i->tag,i->currentswfid);
 	}
 	i->currentswfid = i->startids;
+	/* the bitmaps were freed, too */
+	clearImageCache(dev);
     }
 }
 
@@ -1444,6 +1459,82 @@ void wipeSWF(SWF*swf)
     }
 }
 
+static void set_output_format(swfoutput_internal*i, SWF*swf)
+{
+    swf->fileVersion = i->config_flashversion;
+    swf->frameRate = i->config_framerate*0x100;
+    if(i->config_enablelzma) {
+	/* lzma compressed SWFs are only supported by Flash 11 and up */
+	if(swf->fileVersion < 13)
+	    swf->fileVersion = 13;
+	swf->compressed = 2;
+    } else if(i->config_enablezlib || i->config_flashversion>=6) {
+	swf->compressed = 1;
+    }
+}
+
+static void stream_flush(gfxdevice_t*dev, char all)
+{
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+
+    if(!i->stream) {
+	/* don't touch i->swf's header yet- some tags depend on
+	   fileVersion still being unset until the end */
+	SWF header = *i->swf;
+	set_output_format(i, &header);
+	i->streamhandle = open(i->config_stream, O_BINARY|O_CREAT|O_TRUNC|O_RDWR, 0777);
+	if(i->streamhandle<0) {
+	    msg("<error> Could not create \"%s\", keeping SWF in memory", i->config_stream);
+	    free(i->config_stream);i->config_stream = 0;
+	    return;
+	}
+	i->stream = swf_StreamWriter_Begin(i->streamhandle, &header);
+	if(!i->stream) {
+	    msg("<error> Couldn't write to \"%s\", keeping SWF in memory", i->config_stream);
+	    close(i->streamhandle);
+	    free(i->config_stream);i->config_stream = 0;
+	    return;
+	}
+    }
+
+    TAG*t = i->swf->firstTag;
+    if(t && t->id == ST_SETBACKGROUNDCOLOR && t != i->tag) {
+	TAG*next = t->next;
+	swf_StreamWriter_AddTag(i->stream, t);
+	swf_DeleteTag(0, t);
+	i->swf->firstTag = t = next;
+    }
+
+    /* fonts have to be defined before the first text that uses them. As
+       we don't know yet which characters later pages will need, they
+       are stored with all their glyphs */
+    char use_font3 = i->config_flashversion>=8 && !NO_FONT3;
+    fontlist_t*l = i->fontlist;
+    while(l) {
+	if(l->swffont && !l->stored && l->swffont->use && l->swffont->use->used_glyphs) {
+	    TAG*t = swf_InsertTag(0, use_font3?ST_DEFINEFONT3:ST_DEFINEFONT2);
+	    swf_FontSetDefine2(t, l->swffont);
+	    swf_StreamWriter_AddTag(i->stream, t);
+	    swf_DeleteTag(0, t);
+	    l->stored = 1;
+	}
+	l = l->next;
+    }
+
+    /* write out everything except the last tag, which we need as
+       insertion point for the next page */
+    TAG*end = all?0:i->tag;
+    while(t && t!=end) {
+	TAG*next = t->next;
+	swf_StreamWriter_AddTag(i->stream, t);
+	swf_DeleteTag(0, t);
+	t = next;
+    }
+    i->swf->firstTag = end;
+    if(all)
+	i->tag = 0;
+}
+
 void swfoutput_finalize(gfxdevice_t*dev)
 {
     swfoutput_internal*i = (swfoutput_internal*)dev->internal;
@@ -1454,7 +1545,9 @@ void swfoutput_finalize(gfxdevice_t*dev)
     i->swf->fileVersion = i->config_flashversion;
     i->swf->frameRate = i->config_framerate*0x100;
 
-    if(i->config_bboxvars) {
+    if(i->config_bboxvars && i->config_stream) {
+	msg("<warning> bboxvars are not supported when streaming");
+    } else if(i->config_bboxvars) {
 	TAG* tag = swf_InsertTag(i->swf->firstTag, ST_DOACTION);
 	ActionTAG*a = 0;
 	a = action_PushString(a, "xmin");
@@ -1488,7 +1581,7 @@ void swfoutput_finalize(gfxdevice_t*dev)
     fontlist_t *iterator = i->fontlist;
     char use_font3 = i->config_flashversion>=8 && !NO_FONT3;
 
-    while(iterator) {
+    while(iterator && !i->config_stream) {
 	TAG*mtag = i->swf->firstTag;
 	if(iterator->swffont) {
 	    if(!i->config_storeallcharacters) {
@@ -1513,30 +1606,33 @@ void swfoutput_finalize(gfxdevice_t*dev)
     i->tag = swf_InsertTag(i->tag,ST_END);
     TAG* tag = i->tag->prev;
    
-    if(use_font3 && i->config_storeallcharacters && i->config_alignfonts) {
+    if(use_font3 && i->config_storeallcharacters && i->config_alignfonts && !i->config_stream) {
 	swf_FontPostprocess(i->swf); // generate alignment information
     }
 
     /* remove the removeobject2 tags between the last ST_SHOWFRAME
        and the ST_END- they confuse the flash player  */
-    while(tag->id == ST_REMOVEOBJECT2) {
+    while(tag && tag->id == ST_REMOVEOBJECT2) {
         TAG* prev = tag->prev;
         swf_DeleteTag(i->swf, tag);
         tag = prev;
     }
     
-    if(i->overflow) {
+    if(i->overflow && !i->config_stream) {
+	/* (streamed tags are already on disk, swf_finish() fails instead) */
 	wipeSWF(i->swf);
     }
-    if(i->config_enablezlib || i->config_flashversion>=6) {
-	i->swf->compressed = 1;
-    }
+    set_output_format(i, i->swf);
 
     /* Add AVM2 actionscript */
     if(i->config_flashversion>=9 && 
             (i->config_insertstoptag || i->hasbuttons) && !i->config_linknameurl) {
-        swf_AddButtonLinks(i->swf, i->config_insertstoptag, 
-                i->config_internallinkfunction||i->config_externallinkfunction);
+	if(i->config_stream) {
+	    msg("<warning> Can't add AVM2 code for links and stop tags when streaming");
+	} else {
+	    swf_AddButtonLinks(i->swf, i->config_insertstoptag, 
+		    i->config_internallinkfunction||i->config_externallinkfunction);
+	}
     }
 //    if(i->config_reordertags)
 //	swf_Optimize(i->swf);
@@ -1594,6 +1690,65 @@ void swfresult_destroy(gfxresult_t*gfx)
     free(gfx);
 }
 
+/* result of a streamed conversion: the SWF is already on disk */
+typedef struct _swfstreamresult {
+    SWF swf; // header only
+    char*filename;
+    char failed; // the file was incomplete, and has been removed
+} swfstreamresult_t;
+
+int swfstreamresult_save(gfxresult_t*gfx, const char*filename)
+{
+    swfstreamresult_t*r = (swfstreamresult_t*)gfx->internal;
+    if(r->failed)
+	return -1;
+    if(filename && !strcmp(filename, r->filename))
+	return 0;
+    if(filename) {
+	move_file(r->filename, filename);
+	free(r->filename);
+	r->filename = strdup(filename);
+	return 0;
+    }
+    /* stdout */
+    int fi = open(r->filename, O_BINARY|O_RDONLY);
+    if(fi<0) {
+	msg("<fatal> Could not open \"%s\". ", r->filename);
+	return -1;
+    }
+    char buf[65536];
+    int l;
+    while((l = read(fi, buf, sizeof(buf))) > 0) {
+	if(write(1, buf, l) != l) {
+	    close(fi);
+	    return -1;
+	}
+    }
+    close(fi);
+    return 0;
+}
+void* swfstreamresult_get(gfxresult_t*gfx, const char*name)
+{
+    swfstreamresult_t*r = (swfstreamresult_t*)gfx->internal;
+    if(!strcmp(name, "swf")) {
+	return (void*)swf_OpenSWF(r->filename);
+    }
+    gfxresult_t fake = *gfx;
+    fake.internal = &r->swf;
+    return swfresult_get(&fake, name);
+}
+void swfstreamresult_destroy(gfxresult_t*gfx)
+{
+    swfstreamresult_t*r = (swfstreamresult_t*)gfx->internal;
+    if(r) {
+	free(r->filename);
+	free(r);
+	gfx->internal = 0;
+    }
+    memset(gfx, 0, sizeof(gfxresult_t));
+    free(gfx);
+}
+
 static void swfoutput_destroy(gfxdevice_t* dev);
 
 gfxresult_t* swf_finish(gfxdevice_t* dev)
@@ -1607,6 +1762,37 @@ gfxresult_t* swf_finish(gfxdevice_t* dev)
     }
 
     swfoutput_finalize(dev);
+
+    if(i->config_stream) {
+	stream_flush(dev, 1);
+    }
+    if(i->stream) {
+	swfstreamresult_t*r = (swfstreamresult_t*)rfx_calloc(sizeof(swfstreamresult_t));
+	if(swf_StreamWriter_End(i->stream, i->swf)<0) {
+	    msg("<error> Couldn't finish writing \"%s\"", i->config_stream);
+	    r->failed = 1;
+	}
+	i->stream = 0;
+	close(i->streamhandle);
+	if(i->overflow) {
+	    /* we can't remove the shapes which were already streamed,
+	       like wipeSWF() does for in-memory SWFs */
+	    msg("<error> ID or depth table overflow, \"%s\" would be broken", i->config_stream);
+	    r->failed = 1;
+	}
+	if(r->failed)
+	    unlink(i->config_stream);
+	r->swf = *i->swf;
+	r->filename = i->config_stream;i->config_stream = 0;
+	swfoutput_destroy(dev);
+
+	result = (gfxresult_t*)rfx_calloc(sizeof(gfxresult_t));
+	result->internal = r;
+	result->save = swfstreamresult_save;
+	result->get = swfstreamresult_get;
+	result->destroy = swfstreamresult_destroy;
+	return result;
+    }
     SWF* swf = i->swf;i->swf = 0;
     swfoutput_destroy(dev);
 
@@ -1638,6 +1824,8 @@ static void swfoutput_destroy(gfxdevice_t* dev)
         free(tmp);
     }
     if(i->swf) {swf_FreeTags(i->swf);free(i->swf);i->swf = 0;}
+    if(i->config_stream) {free(i->config_stream);i->config_stream = 0;}
+    clearImageCache(dev);
 
     free(i);i=0;
     memset(dev, 0, sizeof(gfxdevice_t));
@@ -2090,6 +2278,8 @@ int swf_setparameter(gfxdevice_t*dev, const char*name, const char*value)
 	i->config_alignfonts = atoi(value);
     } else if(!strcmp(name, "enablezlib")) {
 	i->config_enablezlib = atoi(value);
+    } else if(!strcmp(name, "enablelzma")) {
+	i->config_enablelzma = atoi(value);
     } else if(!strcmp(name, "bboxvars")) {
 	i->config_bboxvars = atoi(value);
     } else if(!strcmp(name, "dots")) {
@@ -2130,6 +2320,10 @@ int swf_setparameter(gfxdevice_t*dev, const char*name, const char*value)
 	if(i->swf) {
 	    i->swf->frameRate = i->config_framerate*0x100;
 	}
+    } else if(!strcmp(name, "stream")) {
+	if(i->config_stream)
+	    free(i->config_stream);
+	i->config_stream = (value && *value)?strdup(value):0;
     } else if(!strcmp(name, "minlinewidth")) {
 	i->config_minlinewidth = atof(value);
     } else if(!strcmp(name, "remove_small_polygons")) {
@@ -2164,6 +2358,13 @@ int swf_setparameter(gfxdevice_t*dev, const char*name, const char*value)
 	if(val<0) val=0;
 	if(val>101) val=101;
 	i->config_jpegquality = val;
+    } else if(!strcmp(name, "rescalefilter")) {
+	if(!gfxrescale_filter_byname(value, &i->config_rescalefilter)) {
+	    fprintf(stderr, "Unknown rescale filter '%s' (legacy, box, bilinear or lanczos)\n", value);
+	    return 1;
+	}
+    } else if(!strcmp(name, "rescalethreads")) {
+	i->config_rescalethreads = atoi(value);
     } else if(!strcmp(name, "splinequality")) {
 	int v = atoi(value);
 	v = 500-(v*5); // 100% = 0.25 pixel, 0% = 25 pixel
@@ -2197,6 +2398,7 @@ int swf_setparameter(gfxdevice_t*dev, const char*name, const char*value)
         printf("linknameurl		    Link buttons will be named like the URL they refer to (handy for iterating through links with actionscript)\n");
         printf("storeallcharacters          don't reduce the fonts to used characters in the output file\n");
         printf("enablezlib                  switch on zlib compression (also done if flashversion>=6)\n");
+        printf("enablelzma                  switch on lzma compression (implies flashversion>=13)\n");
         printf("bboxvars                    store the bounding box of the SWF file in actionscript variables\n");
         printf("dots                        Take care to handle dots correctly\n");
         printf("reordertags=0/1             (default: 1) perform some tag optimizations\n");
@@ -2208,10 +2410,13 @@ int swf_setparameter(gfxdevice_t*dev, const char*name, const char*value)
         printf("protect                     add a \"protect\" tag to the file, to prevent loading in the Flash editor\n");
         printf("flashversion=<version>      the SWF fileversion (6)\n");
         printf("framerate=<fps>		    SWF framerate\n");
+        printf("stream=<filename>           write each page to <filename> as soon as it's finished (fonts are stored unreduced)\n");
         printf("minlinewidth=<width>        convert horizontal/vertical boxes smaller than this width to lines (0.05) \n");
         printf("simpleviewer                Add next/previous buttons to the SWF\n");
         printf("animate                     insert a showframe tag after each placeobject (animate draw order of PDF files)\n");
         printf("jpegquality=<quality>       set compression quality of jpeg images\n");
+        printf("rescalefilter=<filter>      filter for downscaling images: legacy (default), box, bilinear or lanczos\n");
+        printf("rescalethreads=<n>          downscale images on <n> threads (not for rescalefilter=legacy)\n");
 	printf("splinequality=<value>       Set the quality of spline convertion to value (0-100, default: 100).\n");
 	printf("disablelinks                Disable links.\n");
     } else {
@@ -2245,13 +2450,90 @@ static CXFORM gfxcxform_to_cxform(gfxcxform_t* c)
     return cx;
 }
 
-/* TODO */
-static int imageInCache(gfxdevice_t*dev, void*data, int width, int height)
+/* images are identified by their pixel data, and the size and format
+   they were stored with. The 64 bit hash of the pixels only serves as a
+   quick filter: images are reused only if their pixels are identical. */
+typedef struct _imagekey {
+    U64 hash;
+    int width, height;
+    int newwidth, newheight;
+    int jpeg;
+    gfxcolor_t*data;
+} imagekey_t;
+
+static U64 image_hash(gfximage_t*img)
+{
+    U32*p = (U32*)img->data;
+    int len = img->width*img->height;
+    U64 h = 0xcbf29ce484222325ull;
+    int t;
+    for(t=0;t<len;t++) {
+	h = (h ^ p[t]) * 0x100000001b3ull;
+	h ^= h >> 29;
+    }
+    return h;
+}
+static char imagekey_equals(const void*o1, const void*o2)
+{
+    const imagekey_t*k1 = (const imagekey_t*)o1;
+    const imagekey_t*k2 = (const imagekey_t*)o2;
+    if(k1->hash != k2->hash ||
+       k1->width != k2->width || k1->height != k2->height ||
+       k1->newwidth != k2->newwidth || k1->newheight != k2->newheight ||
+       k1->jpeg != k2->jpeg)
+	return 0;
+    return !memcmp(k1->data, k2->data, sizeof(gfxcolor_t)*k1->width*k1->height);
+}
+static unsigned int imagekey_hash(const void*o)
+{
+    const imagekey_t*k = (const imagekey_t*)o;
+    return (unsigned int)(k->hash ^ (k->hash >> 32));
+}
+static void* imagekey_dup(const void*o)
+{
+    const imagekey_t*key = (const imagekey_t*)o;
+    imagekey_t*k = (imagekey_t*)malloc(sizeof(imagekey_t));
+    memcpy(k, key, sizeof(imagekey_t));
+    int size = sizeof(gfxcolor_t)*key->width*key->height;
+    k->data = (gfxcolor_t*)malloc(size);
+    memcpy(k->data, key->data, size);
+    return k;
+}
+static void imagekey_free(void*o)
+{
+    imagekey_t*k = (imagekey_t*)o;
+    free(k->data);
+    free(k);
+}
+static type_t imagekey_type = {
+    equals: imagekey_equals,
+    hash: imagekey_hash,
+    dup: imagekey_dup,
+    free: imagekey_free,
+};
+
+static int imageInCache(gfxdevice_t*dev, imagekey_t*key)
+{
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+    if(!i->imagecache)
+	return -1;
+    int id = (int)(ptroff_t)dict_lookup(i->imagecache, key);
+    return id>0?id:-1;
+}
+static void addImageToCache(gfxdevice_t*dev, imagekey_t*key, int id)
 {
-    return -1;
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+    if(!i->imagecache)
+	i->imagecache = dict_new2(&imagekey_type);
+    dict_put(i->imagecache, key, (void*)(ptroff_t)id);
 }
-static void addImageToCache(gfxdevice_t*dev, void*data, int width, int height)
+static void clearImageCache(gfxdevice_t*dev)
 {
+    swfoutput_internal*i = (swfoutput_internal*)dev->internal;
+    if(i->imagecache) {
+	dict_destroy(i->imagecache);
+	i->imagecache = 0;
+    }
 }
     
 static int add_image(swfoutput_internal*i, gfximage_t*img, int targetwidth, int targetheight, int* newwidth, int* newheight)
@@ -2284,11 +2566,31 @@ static int add_image(swfoutput_internal*i, gfximage_t*img, int targetwidth, int
     if(newsizey<=0)
 	newsizey = 1;
 
-    /* TODO: cache images */
+    char rescale = newsizex<sizex || newsizey<sizey;
+
+    /* the same bitmap (e.g. a logo on every page) only needs to be
+       stored once */
+    imagekey_t key;
+    memset(&key, 0, sizeof(key));
+    key.hash = image_hash(img);
+    key.width = sizex;
+    key.height = sizey;
+    key.newwidth = rescale?newsizex:sizex;
+    key.newheight = rescale?newsizey:sizey;
+    key.jpeg = is_jpeg?i->config_jpegquality:-1;
+    key.data = img->data;
+
+    int cacheid = imageInCache(dev, &key);
+    if(cacheid>0) {
+	msg("<verbose> Reusing %dx%d image (id %d)", sizex, sizey, cacheid);
+	*newwidth = key.newwidth;
+	*newheight = key.newheight;
+	return cacheid;
+    }
     
-    if(newsizex<sizex || newsizey<sizey) {
+    if(rescale) {
 	msg("<verbose> Scaling %dx%d image to %dx%d", sizex, sizey, newsizex, newsizey);
-	gfximage_t*ni = gfximage_rescale(img, newsizex, newsizey);
+	gfximage_t*ni = gfximage_rescale2(img, newsizex, newsizey, i->config_rescalefilter, i->config_rescalethreads);
 	newpic = (RGBA*)ni->data;
 	free(ni);
 	*newwidth = sizex = newsizex;
@@ -2322,17 +2624,9 @@ static int add_image(swfoutput_internal*i, gfximage_t*img, int targetwidth, int
     }
     printf("\n");*/
 
-    int bitid = -1;
-    int cacheid = imageInCache(dev, mem, sizex, sizey);
-
-    if(cacheid<=0) {
-	bitid = getNewID(dev);
-
-	i->tag = swf_AddImage(i->tag, bitid, mem, sizex, sizey, i->config_jpegquality);
-	addImageToCache(dev, mem, sizex, sizey);
-    } else {
-	bitid = cacheid;
-    }
+    int bitid = getNewID(dev);
+    i->tag = swf_AddImage(i->tag, bitid, mem, sizex, sizey, i->config_jpegquality);
+    addImageToCache(dev, &key, bitid);
 
     if(newpic)
 	free(newpic);
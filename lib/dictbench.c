@@ -0,0 +1,279 @@
+/* dictbench.c
+
+   Micro-benchmark for dict_t: compares the open addressing table in q.c
+   with the chained hash table it replaced (a copy of which is below),
+   for string and pointer keys.
+
+   Usage: dictbench [<number of keys>]
+
+   Part of the swftools package.
+
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/time.h>
+#include "q.h"
+
+/* ---------------- the old (chained) dictionary ---------------- */
+
+typedef struct _olddictentry {
+    void*key;
+    unsigned int hash;
+    void*data;
+    struct _olddictentry*next;
+} olddictentry_t;
+
+typedef struct _olddict {
+    olddictentry_t**slots;
+    type_t*key_type;
+    int hashsize;
+    int num;
+} olddict_t;
+
+static void olddict_init(olddict_t*h, type_t*t)
+{
+    memset(h, 0, sizeof(olddict_t));
+    h->hashsize = 1;
+    h->slots = (olddictentry_t**)rfx_calloc(sizeof(olddictentry_t*)*h->hashsize);
+    h->key_type = t;
+}
+static void olddict_expand(olddict_t*h, int newlen)
+{
+    olddictentry_t**newslots = (olddictentry_t**)rfx_calloc(sizeof(olddictentry_t*)*newlen);
+    int t; 
+    for(t=0;t<h->hashsize;t++) {
+        olddictentry_t*e = h->slots[t];
+        while(e) {
+            olddictentry_t*next = e->next;
+            unsigned int newhash = e->hash%newlen;
+            e->next = newslots[newhash];
+            newslots[newhash] = e;
+            e = next;
+        }
+    }
+    rfx_free(h->slots);
+    h->slots = newslots;
+    h->hashsize = newlen;
+}
+static void olddict_put(olddict_t*h, const void*key, void* data)
+{
+    unsigned int hash = h->key_type->hash(key);
+    olddictentry_t*e = (olddictentry_t*)rfx_alloc(sizeof(olddictentry_t));
+    unsigned int hash2 = hash % h->hashsize;
+    e->key = h->key_type->dup(key);
+    e->hash = hash;
+    e->next = h->slots[hash2];
+    e->data = data;
+    h->slots[hash2] = e;
+    h->num++;
+}
+static void* olddict_lookup(olddict_t*h, const void*key)
+{
+    if(!h->num)
+        return 0;
+    unsigned int ohash = h->key_type->hash(key);
+    unsigned int hash = ohash % h->hashsize;
+    olddictentry_t*e = h->slots[hash];
+    if(e && h->key_type->equals(e->key, key)) {
+        return e->data;
+    } else if(e) {
+        e = e->next;
+    }
+    if(e && h->num*3 >= h->hashsize*2) {
+        int newsize = h->hashsize;
+        while(h->num*3 >= newsize*2) {
+            newsize = newsize<15?15:(newsize+1)*2-1;
+        }
+        olddict_expand(h, newsize);
+        hash = ohash % h->hashsize;
+        e = h->slots[hash];
+        if(e && h->key_type->equals(e->key, key)) {
+            return e->data;
+        } else if(e) {
+            e = e->next;
+        }
+    }
+    olddictentry_t*last = h->slots[hash];
+    while(e) {
+        if(h->key_type->equals(e->key, key)) {
+            last->next = e->next;
+            e->next = h->slots[hash];
+            h->slots[hash] = e;
+            return e->data;
+        }
+        last=e;
+        e = e->next;
+    }
+    return 0;
+}
+static char olddict_del(olddict_t*h, const void*key)
+{
+    if(!h->num)
+        return 0;
+    unsigned int hash = h->key_type->hash(key) % h->hashsize;
+    olddictentry_t*e = h->slots[hash], *prev=0;
+    while(e) {
+        if(h->key_type->equals(e->key, key)) {
+            if(prev) prev->next = e->next;
+            else h->slots[hash] = e->next;
+            h->key_type->free(e->key);
+            rfx_free(e);
+            h->num--;
+            return 1;
+        }
+        prev = e;
+        e = e->next;
+    }
+    return 0;
+}
+static void olddict_clear(olddict_t*h)
+{
+    int t;
+    for(t=0;t<h->hashsize;t++) {
+        olddictentry_t*e = h->slots[t];
+        while(e) {
+            olddictentry_t*next = e->next;
+            h->key_type->free(e->key);
+            rfx_free(e);
+            e = next;
+        }
+    }
+    rfx_free(h->slots);
+    memset(h, 0, sizeof(olddict_t));
+}
+
+/* ---------------- benchmark ---------------- */
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+typedef struct _timings {
+    double insert, hit, miss, del;
+} timings_t;
+
+static void report(const char*name, int n, timings_t*t)
+{
+    printf("%-16s lookup+insert %6.1f  lookup(hit) %6.1f  lookup(miss) %6.1f  delete %6.1f  ns/op\n", name,
+            t->insert*1e9/n, t->hit*1e9/n, t->miss*1e9/n, t->del*1e9/n);
+}
+
+/* report the best of this many runs */
+#define ROUNDS 8
+
+/* keys[0..n-1] are inserted, keys[n..2n-1] are only looked up */
+static void bench_new(type_t*type, void**keys, int n, timings_t*r)
+{
+    int t, round;
+    memset(r, 0, sizeof(timings_t));
+    for(round=0;round<ROUNDS;round++) {
+        dict_t*d = dict_new2(type);
+        double t0 = get_time();
+        /* the typical pattern: add keys we haven't seen yet */
+        for(t=0;t<n;t++)
+            if(!dict_lookup(d, keys[t]))
+                dict_put(d, keys[t], keys[t]);
+        double t1 = get_time();
+        for(t=0;t<n;t++)
+            if(dict_lookup(d, keys[t]) != keys[t]) abort();
+        double t2 = get_time();
+        for(t=n;t<2*n;t++)
+            if(dict_lookup(d, keys[t])) abort();
+        double t3 = get_time();
+        for(t=0;t<n;t++)
+            if(!dict_del(d, keys[t])) abort();
+        double t4 = get_time();
+        assert(!dict_count(d));
+        dict_destroy(d);
+        if(!round || t1-t0 < r->insert) r->insert = t1-t0;
+        if(!round || t2-t1 < r->hit) r->hit = t2-t1;
+        if(!round || t3-t2 < r->miss) r->miss = t3-t2;
+        if(!round || t4-t3 < r->del) r->del = t4-t3;
+    }
+}
+static void bench_old(type_t*type, void**keys, int n, timings_t*r)
+{
+    int t, round;
+    memset(r, 0, sizeof(timings_t));
+    for(round=0;round<ROUNDS;round++) {
+        olddict_t d;
+        olddict_init(&d, type);
+        double t0 = get_time();
+        /* the typical pattern: add keys we haven't seen yet */
+        for(t=0;t<n;t++)
+            if(!olddict_lookup(&d, keys[t]))
+                olddict_put(&d, keys[t], keys[t]);
+        double t1 = get_time();
+        for(t=0;t<n;t++)
+            if(olddict_lookup(&d, keys[t]) != keys[t]) abort();
+        double t2 = get_time();
+        for(t=n;t<2*n;t++)
+            if(olddict_lookup(&d, keys[t])) abort();
+        double t3 = get_time();
+        for(t=0;t<n;t++)
+            if(!olddict_del(&d, keys[t])) abort();
+        double t4 = get_time();
+        olddict_clear(&d);
+        if(!round || t1-t0 < r->insert) r->insert = t1-t0;
+        if(!round || t2-t1 < r->hit) r->hit = t2-t1;
+        if(!round || t3-t2 < r->miss) r->miss = t3-t2;
+        if(!round || t4-t3 < r->del) r->del = t4-t3;
+    }
+}
+
+int main(int argn, char*argv[])
+{
+    int n = argn>1?atoi(argv[1]):200000;
+    int t;
+    void**strings = (void**)rfx_alloc(sizeof(void*)*2*n);
+    void**pointers = (void**)rfx_alloc(sizeof(void*)*2*n);
+    char*mem = (char*)rfx_alloc(2*n*16);
+    srand(1234);
+    for(t=0;t<2*n;t++) {
+        char buf[32];
+        sprintf(buf, "%s_%d_%x", t&1?"flash.display":"x", t, rand());
+        strings[t] = strdup(buf);
+        pointers[t] = &mem[t*16];
+    }
+    /* don't hit the keys in insertion order */
+    for(t=n-1;t>0;t--) {
+        int r = rand()%(t+1);
+        void*tmp;
+        tmp = strings[t];strings[t] = strings[r];strings[r] = tmp;
+        tmp = pointers[t];pointers[t] = pointers[r];pointers[r] = tmp;
+    }
+
+    timings_t r;
+    printf("%d keys\n", n);
+    bench_old(&charptr_type, strings, n, &r); report("chained/string", n, &r);
+    bench_new(&charptr_type, strings, n, &r); report("open/string", n, &r);
+    bench_old(&ptr_type, pointers, n, &r); report("chained/pointer", n, &r);
+    bench_new(&ptr_type, pointers, n, &r); report("open/pointer", n, &r);
+
+    for(t=0;t<2*n;t++)
+        free(strings[t]);
+    rfx_free(strings);
+    rfx_free(pointers);
+    rfx_free(mem);
+    return 0;
+}
@@ -33,6 +33,8 @@
 
 typedef struct _internal {
     double config_subpixels;
+    gfxrescale_filter_t filter;
+    int num_threads;
 } internal_t;
 
 int rescale_images_setparameter(gfxfilter_t*dev, const char*key, const char*value, gfxdevice_t*out)
@@ -70,7 +72,7 @@ void rescale_images_fillbitmap(gfxfilter_t*dev, gfxline_t*line, gfximage_t*img,
 
     if(new_width < img->width || new_height < img->height) {
 	msg("<verbose> Scaling %dx%d image to %dx%d", img->width, img->height, new_width, new_height);
-	gfximage_t*new_image = gfximage_rescale(img, new_width, new_height);
+	gfximage_t*new_image = gfximage_rescale2(img, new_width, new_height, i->filter, i->num_threads);
         gfxmatrix_t m = *matrix;
         m.m00 = (m.m00 * img->width) / new_width;
         m.m01 = (m.m01 * img->width) / new_width;
@@ -90,12 +92,14 @@ gfxresult_t* rescale_images_finish(gfxfilter_t*dev, gfxdevice_t*out)
     return out->finish(out);
 }
 
-void gfxfilter_rescale_images_init(gfxfilter_t*f)
+void gfxfilter_rescale_images_init(gfxfilter_t*f, gfxrescale_filter_t filter, int num_threads)
 {
     memset(f, 0, sizeof(gfxfilter_t));
     internal_t*i = (internal_t*)rfx_calloc(sizeof(internal_t));
 
     i->config_subpixels = 1.0;
+    i->filter = filter;
+    i->num_threads = num_threads;
 
     f->internal = i;
     f->name = "rescale_images";
@@ -99,6 +99,8 @@ typedef struct _gfxresult
     void*internal;
 } gfxresult_t;
 
+struct _gfxpath;
+
 typedef struct _gfxdevice
 {
     const char* name; // gfx device name
@@ -111,6 +113,9 @@ typedef struct _gfxdevice
     void (*endclip)(struct _gfxdevice*dev);
     void (*stroke)(struct _gfxdevice*dev, gfxline_t*line, gfxcoord_t width, gfxcolor_t*color, gfx_capType cap_style, gfx_joinType joint_style, gfxcoord_t miterLimit);
     void (*fill)(struct _gfxdevice*dev, gfxline_t*line, gfxcolor_t*color);
+    /* optional: like fill, but with a packed path (see gfxpath.h).
+       Use gfxdevice_fillpath() to call this. */
+    void (*fillpath)(struct _gfxdevice*dev, struct _gfxpath*path, gfxcolor_t*color);
 
     /* expects alpha channel in image to be non-premultiplied */
     void (*fillbitmap)(struct _gfxdevice*dev, gfxline_t*line, gfximage_t*img, gfxmatrix_t*imgcoord2devcoord, gfxcxform_t*cxform); //cxform? tiling?
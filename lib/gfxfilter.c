@@ -300,7 +300,7 @@ static gfxresult_t* twopass_finish(gfxdevice_t*dev)
     } else {
         // switch to a new tempfile- this only happens for 3 passes or more
 	assert(i->num_passes>2);
-	gfxdevice_record_init(&i->record, /*use tempfile*/1);
+	gfxdevice_record_init2(&i->record, /*use tempfile*/1, GFX_SUBPIXEL);
 	i->out = &i->record;
     }
 
@@ -319,7 +319,7 @@ gfxdevice_t*gfxtwopassfilter_apply(gfxtwopassfilter_t*_twopass, gfxdevice_t*out)
     gfxtwopassfilter_t*twopass = (gfxtwopassfilter_t*)rfx_alloc(sizeof(gfxtwopassfilter_t));
     memcpy(twopass, _twopass, sizeof(gfxtwopassfilter_t));
    
-    gfxdevice_record_init(&i->record, /*use tempfile*/1);
+    gfxdevice_record_init2(&i->record, /*use tempfile*/1, GFX_SUBPIXEL);
 
     i->out = &i->record;
     i->final_out = out;
@@ -349,8 +349,15 @@ static void add_to_chain(char*cmd, dict_t*params, gfxfilterchain_t**chain, gfxfi
         f = malloc(sizeof(gfxfilter_t));
         gfxfilter_flatten_init((gfxfilter_t*)f);
     } else if(!strcmp(cmd, "rescale_images")) {
+        char*filterstr = dict_lookup(params, "filter");
+        char*threadsstr = dict_lookup(params, "threads");
+        gfxrescale_filter_t filter = gfxrescale_legacy;
+        if(filterstr && !gfxrescale_filter_byname(filterstr, &filter))
+            fprintf(stderr, "Unknown rescale filter: %s\n", filterstr);
+        int num_threads = 1;
+        if(threadsstr) num_threads=atoi(threadsstr);
         f = malloc(sizeof(gfxfilter_t));
-        gfxfilter_rescale_images_init((gfxfilter_t*)f);
+        gfxfilter_rescale_images_init((gfxfilter_t*)f, filter, num_threads);
     } else if(!strcmp(cmd, "remove_font_transforms")) {
         f = malloc(sizeof(gfxtwopassfilter_t));
         gfxtwopassfilter_remove_font_transforms_init((gfxtwopassfilter_t*)f);
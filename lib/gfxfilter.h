@@ -23,6 +23,7 @@
 
 #include "gfxdevice.h"
 #include "types.h"
+#include "gfximage.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -96,7 +97,7 @@ void gfxfilterchain_destroy(gfxfilterchain_t*chain);
 /* known filters */
 void gfxfilter_maketransparent_init(gfxfilter_t*f, U8 alpha);
 void gfxfilter_flatten_init(gfxfilter_t*f);
-void gfxfilter_rescale_images_init(gfxfilter_t*f);
+void gfxfilter_rescale_images_init(gfxfilter_t*f, gfxrescale_filter_t filter, int num_threads);
 void gfxtwopassfilter_remove_font_transforms_init(gfxtwopassfilter_t*f);
 void gfxtwopassfilter_one_big_font_init(gfxtwopassfilter_t*f);
 void gfxtwopassfilter_vectors_to_glyphs_init(gfxtwopassfilter_t*f);
@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include <math.h>
 #include <memory.h>
+#include <string.h>
 #include <assert.h>
 #include "../config.h"
 #include "jpeg.h"
@@ -9,6 +10,7 @@
 #include "mem.h"
 #include "gfximage.h"
 #include "types.h"
+#include "threads.h"
 #ifdef HAVE_FFTW3
 #include <fftw3.h>
 #endif
@@ -44,6 +46,11 @@ void gfximage_save_png(gfximage_t*image, const char*filename)
     png_write(filename, (void*)image->data, image->width, image->height);
 }
 
+void gfximage_save_png_threaded(gfximage_t*image, const char*filename, int num_threads)
+{
+    png_write_threaded(filename, (void*)image->data, image->width, image->height, num_threads);
+}
+
 void gfximage_save_png_quick(gfximage_t*image, const char*filename)
 {
     png_write_quick(filename, (void*)image->data, image->width, image->height);
@@ -481,6 +488,555 @@ gfximage_t* gfximage_rescale(gfximage_t*image, int newwidth, int newheight)
 }
 #endif
 
+/* ------------------------- separable resampler ------------------------ */
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define RESAMPLE_X86
+#include <immintrin.h>
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+/* filter weights are fixed point numbers with this many fractional bits */
+#define WEIGHT_BITS 14
+#define WEIGHT_ONE (1<<WEIGHT_BITS)
+
+static int resample_simd = -1;
+
+static int use_simd()
+{
+    if(resample_simd < 0) {
+	resample_simd = 0;
+#ifdef RESAMPLE_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+	    resample_simd = 1;
+#endif
+    }
+    return resample_simd;
+}
+
+void gfximage_disable_simd()
+{
+    resample_simd = 0;
+}
+
+static inline U8 clamp_pixel(int v)
+{
+    v = (v + (WEIGHT_ONE>>1)) >> WEIGHT_BITS;
+    return v<0?0:(v>255?255:v);
+}
+
+static double filter_support(gfxrescale_filter_t filter)
+{
+    switch(filter) {
+	case gfxrescale_box: return 0.5;
+	case gfxrescale_lanczos: return 3.0;
+	default: return 1.0;
+    }
+}
+
+static double filter_weight(gfxrescale_filter_t filter, double x)
+{
+    x = fabs(x);
+    switch(filter) {
+	case gfxrescale_box:
+	    return x<0.5?1.0:(x==0.5?0.5:0.0);
+	case gfxrescale_lanczos:
+	    if(x<1e-8)
+		return 1.0;
+	    if(x>=3.0)
+		return 0.0;
+	    return 3.0*sin(M_PI*x)*sin(M_PI*x/3.0)/(M_PI*M_PI*x*x);
+	default:
+	    return x<1.0?1.0-x:0.0;
+    }
+}
+
+/* For every destination pixel, "taps" consecutive source pixels starting
+   at start[i], multiplied with weights[i*taps...] */
+typedef struct _resample_table {
+    int taps;
+    int*start;
+    int*weights;
+    /* the same weights, each repeated four times (once per color channel),
+       for the SIMD code */
+    int*weights4;
+} resample_table_t;
+
+static resample_table_t* resample_table_new(int size, int newsize, gfxrescale_filter_t filter)
+{
+    resample_table_t*t = (resample_table_t*)rfx_calloc(sizeof(resample_table_t));
+    double scale = (double)size / newsize;
+    double fscale = scale>1.0?scale:1.0;
+    double support = filter_support(filter)*fscale;
+
+    int taps = (int)ceil(support*2)+1;
+    /* an even number of taps lets the SIMD code process two pixels at once */
+    taps = (taps+1)&~1;
+    if(taps > size)
+	taps = size;
+    t->taps = taps;
+    t->start = (int*)rfx_alloc(newsize*sizeof(int));
+    t->weights = (int*)rfx_alloc(newsize*taps*sizeof(int));
+    t->weights4 = (int*)rfx_alloc(newsize*taps*4*sizeof(int));
+
+    double*w = (double*)rfx_alloc(taps*sizeof(double));
+    int i,k;
+    for(i=0;i<newsize;i++) {
+	double center = (i+0.5)*scale;
+	int start = (int)floor(center - support);
+	if(start > size-taps)
+	    start = size-taps;
+	if(start < 0)
+	    start = 0;
+	t->start[i] = start;
+
+	double sum = 0;
+	for(k=0;k<taps;k++) {
+	    w[k] = filter_weight(filter, (start+k+0.5-center)/fscale);
+	    sum += w[k];
+	}
+	if(sum<=0) {
+	    /* can only happen with a box filter and heavy upscaling; fall
+	       back to the nearest pixel */
+	    int nearest = (int)floor(center) - start;
+	    if(nearest<0) nearest=0;
+	    if(nearest>=taps) nearest=taps-1;
+	    w[nearest] = sum = 1.0;
+	}
+
+	int*iw = &t->weights[i*taps];
+	int total = 0, largest = 0;
+	for(k=0;k<taps;k++) {
+	    iw[k] = (int)floor(w[k]*WEIGHT_ONE/sum + 0.5);
+	    total += iw[k];
+	    if(iw[k] > iw[largest])
+		largest = k;
+	}
+	/* make the weights sum up to exactly 1.0, so that flat areas
+	   stay flat */
+	iw[largest] += WEIGHT_ONE - total;
+
+	for(k=0;k<taps*4;k++)
+	    t->weights4[i*taps*4+k] = iw[k>>2];
+    }
+    rfx_free(w);
+    return t;
+}
+
+static void resample_table_free(resample_table_t*t)
+{
+    rfx_free(t->start);
+    rfx_free(t->weights);
+    rfx_free(t->weights4);
+    rfx_free(t);
+}
+
+static void resample_row_c(U8*src, U8*dest, int newwidth, resample_table_t*t)
+{
+    int x,k;
+    for(x=0;x<newwidth;x++) {
+	U8*s = &src[t->start[x]*4];
+	int*w = &t->weights[x*t->taps];
+	int c0=0,c1=0,c2=0,c3=0;
+	for(k=0;k<t->taps;k++) {
+	    c0 += s[0]*w[k];
+	    c1 += s[1]*w[k];
+	    c2 += s[2]*w[k];
+	    c3 += s[3]*w[k];
+	    s+=4;
+	}
+	dest[0] = clamp_pixel(c0);
+	dest[1] = clamp_pixel(c1);
+	dest[2] = clamp_pixel(c2);
+	dest[3] = clamp_pixel(c3);
+	dest+=4;
+    }
+}
+
+static void resample_column_c(U8**rows, int*w, int taps, U8*dest, int start, int end)
+{
+    int x,k;
+    for(x=start;x<end;x++) {
+	int c=0;
+	for(k=0;k<taps;k++)
+	    c += rows[k][x]*w[k];
+	dest[x] = clamp_pixel(c);
+    }
+}
+
+#ifdef RESAMPLE_X86
+static inline AVX2 __m128i pack_pixels(__m128i v)
+{
+    v = _mm_srai_epi32(_mm_add_epi32(v, _mm_set1_epi32(WEIGHT_ONE>>1)), WEIGHT_BITS);
+    v = _mm_packs_epi32(v, v);
+    return _mm_packus_epi16(v, v);
+}
+
+static AVX2 void resample_row_avx2(U8*src, U8*dest, int newwidth, resample_table_t*t)
+{
+    int x,k;
+    int taps = t->taps;
+    if(taps&1) {
+	/* only happens for images less than two pixels wide */
+	resample_row_c(src, dest, newwidth, t);
+	return;
+    }
+    for(x=0;x<newwidth;x++) {
+	U8*s = &src[t->start[x]*4];
+	int*w = &t->weights4[x*taps*4];
+	__m256i acc = _mm256_setzero_si256();
+	for(k=0;k<taps;k+=2) {
+	    __m256i p = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)&s[k*4]));
+	    acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(p, _mm256_loadu_si256((__m256i*)&w[k*4])));
+	}
+	__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	U32 c = _mm_cvtsi128_si32(pack_pixels(sum));
+	memcpy(&dest[x*4], &c, 4);
+    }
+}
+
+static AVX2 void resample_column_avx2(U8**rows, int*w, int taps, U8*dest, int start, int end)
+{
+    int x = start,k;
+    for(;x+8<=end;x+=8) {
+	__m256i acc = _mm256_setzero_si256();
+	for(k=0;k<taps;k++) {
+	    __m256i p = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)&rows[k][x]));
+	    acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(p, _mm256_set1_epi32(w[k])));
+	}
+	U32 lo = _mm_cvtsi128_si32(pack_pixels(_mm256_castsi256_si128(acc)));
+	U32 hi = _mm_cvtsi128_si32(pack_pixels(_mm256_extracti128_si256(acc, 1)));
+	memcpy(&dest[x], &lo, 4);
+	memcpy(&dest[x+4], &hi, 4);
+    }
+    resample_column_c(rows, w, taps, dest, x, end);
+}
+#endif
+
+/* rows are processed in chunks of this size by the worker threads */
+#define RESAMPLE_ROWS_PER_JOB 32
+
+typedef struct _resamplejob {
+    gfxcolor_t*src;
+    gfxcolor_t*tmp;
+    gfxcolor_t*dest;
+    int width, height;
+    int newwidth, newheight;
+    resample_table_t*tx;
+    resample_table_t*ty;
+    U8***rows; /* per thread */
+} resamplejob_t;
+
+static void resample_horizontal_job(void*data, int job, int thread)
+{
+    resamplejob_t*j = (resamplejob_t*)data;
+    int y = job*RESAMPLE_ROWS_PER_JOB;
+    int end = y+RESAMPLE_ROWS_PER_JOB;
+    if(end > j->height)
+	end = j->height;
+    for(;y<end;y++) {
+	U8*s = (U8*)&j->src[y*j->width];
+	U8*d = (U8*)&j->tmp[y*j->newwidth];
+#ifdef RESAMPLE_X86
+	if(use_simd()) {
+	    resample_row_avx2(s, d, j->newwidth, j->tx);
+	    continue;
+	}
+#endif
+	resample_row_c(s, d, j->newwidth, j->tx);
+    }
+}
+
+static void resample_vertical_job(void*data, int job, int thread)
+{
+    resamplejob_t*j = (resamplejob_t*)data;
+    U8**rows = j->rows[thread];
+    int taps = j->ty->taps;
+    int y = job*RESAMPLE_ROWS_PER_JOB;
+    int end = y+RESAMPLE_ROWS_PER_JOB;
+    if(end > j->newheight)
+	end = j->newheight;
+    for(;y<end;y++) {
+	int k;
+	for(k=0;k<taps;k++)
+	    rows[k] = (U8*)&j->tmp[(j->ty->start[y]+k)*j->newwidth];
+	int*w = &j->ty->weights[y*taps];
+	U8*d = (U8*)&j->dest[y*j->newwidth];
+#ifdef RESAMPLE_X86
+	if(use_simd()) {
+	    resample_column_avx2(rows, w, taps, d, 0, j->newwidth*4);
+	    continue;
+	}
+#endif
+	resample_column_c(rows, w, taps, d, 0, j->newwidth*4);
+    }
+}
+
+/* ---------------------------- running sum blur ------------------------ */
+
+typedef struct _blurjob {
+    U8*src;
+    U8*dest;
+    int width, height;
+    int radius;
+    int scale; /* 65536 / (2*radius+1) */
+    int num_jobs;
+} blurjob_t;
+
+static inline U8 box_pixel(int sum, int scale)
+{
+    int v = (sum*scale + 32768) >> 16;
+    return v>255?255:v;
+}
+
+static void blur_row_c(U8*s, U8*d, int width, int r, int scale)
+{
+    int c,x;
+    for(c=0;c<4;c++) {
+	int sum = s[c]*(r+1);
+	for(x=1;x<=r;x++)
+	    sum += s[(x<width?x:width-1)*4+c];
+	for(x=0;x<width;x++) {
+	    d[x*4+c] = box_pixel(sum, scale);
+	    int in = x+r+1, out = x-r;
+	    sum += s[(in<width?in:width-1)*4+c] - s[(out>0?out:0)*4+c];
+	}
+    }
+}
+
+/* blur the bytes start..end of each row, with a running sum per byte */
+static void blur_columns_c(blurjob_t*j, int*sums, int start, int end)
+{
+    int stride = j->width*4;
+    int r = j->radius;
+    int x,y;
+    for(x=start;x<end;x++) {
+	int sum = j->src[x]*(r+1);
+	for(y=1;y<=r;y++)
+	    sum += j->src[(y<j->height?y:j->height-1)*stride+x];
+	sums[x-start] = sum;
+    }
+    for(y=0;y<j->height;y++) {
+	int in = y+r+1, out = y-r;
+	U8*si = &j->src[(in<j->height?in:j->height-1)*stride];
+	U8*so = &j->src[(out>0?out:0)*stride];
+	U8*d = &j->dest[y*stride];
+	for(x=start;x<end;x++) {
+	    int sum = sums[x-start];
+	    d[x] = box_pixel(sum, j->scale);
+	    sums[x-start] = sum + si[x] - so[x];
+	}
+    }
+}
+
+#ifdef RESAMPLE_X86
+static AVX2 void blur_row_avx2(U8*s, U8*d, int width, int r, int scale)
+{
+    /* all four channels of a pixel are processed together */
+    U32*s32 = (U32*)s;
+    __m128i sum = _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(s32[0])), _mm_set1_epi32(r+1));
+    __m128i vscale = _mm_set1_epi32(scale);
+    __m128i round = _mm_set1_epi32(32768);
+    int x;
+    for(x=1;x<=r;x++)
+	sum = _mm_add_epi32(sum, _mm_cvtepu8_epi32(_mm_cvtsi32_si128(s32[x<width?x:width-1])));
+    for(x=0;x<width;x++) {
+	__m128i v = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(sum, vscale), round), 16);
+	v = _mm_packus_epi32(v, v);
+	U32 c = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+	memcpy(&d[x*4], &c, 4);
+	int in = x+r+1, out = x-r;
+	sum = _mm_add_epi32(sum, _mm_cvtepu8_epi32(_mm_cvtsi32_si128(s32[in<width?in:width-1])));
+	sum = _mm_sub_epi32(sum, _mm_cvtepu8_epi32(_mm_cvtsi32_si128(s32[out>0?out:0])));
+    }
+}
+
+static AVX2 void blur_columns_avx2(blurjob_t*j, int*sums, int start, int end)
+{
+    int stride = j->width*4;
+    int simd_end = start + ((end-start)&~7);
+    blur_columns_c(j, sums+(simd_end-start), simd_end, end);
+    if(simd_end == start)
+	return;
+    int r = j->radius;
+    __m256i vscale = _mm256_set1_epi32(j->scale);
+    __m256i round = _mm256_set1_epi32(32768);
+    int x,y;
+    for(x=start;x<simd_end;x+=8) {
+	__m256i sum = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)&j->src[x])), _mm256_set1_epi32(r+1));
+	for(y=1;y<=r;y++)
+	    sum = _mm256_add_epi32(sum, _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)&j->src[(y<j->height?y:j->height-1)*stride+x])));
+	_mm256_storeu_si256((__m256i*)&sums[x-start], sum);
+    }
+    for(y=0;y<j->height;y++) {
+	int in = y+r+1, out = y-r;
+	U8*si = &j->src[(in<j->height?in:j->height-1)*stride];
+	U8*so = &j->src[(out>0?out:0)*stride];
+	U8*d = &j->dest[y*stride];
+	for(x=start;x<simd_end;x+=8) {
+	    __m256i sum = _mm256_loadu_si256((__m256i*)&sums[x-start]);
+	    __m256i v = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(sum, vscale), round), 16);
+	    v = _mm256_packus_epi32(v, v);
+	    v = _mm256_packus_epi16(v, v);
+	    U32 lo = _mm_cvtsi128_si32(_mm256_castsi256_si128(v));
+	    U32 hi = _mm_cvtsi128_si32(_mm256_extracti128_si256(v, 1));
+	    memcpy(&d[x], &lo, 4);
+	    memcpy(&d[x+4], &hi, 4);
+	    sum = _mm256_add_epi32(sum, _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)&si[x])));
+	    sum = _mm256_sub_epi32(sum, _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)&so[x])));
+	    _mm256_storeu_si256((__m256i*)&sums[x-start], sum);
+	}
+    }
+}
+#endif
+
+static void blur_rows_job(void*data, int job, int thread)
+{
+    blurjob_t*j = (blurjob_t*)data;
+    int y = job*j->height/j->num_jobs;
+    int end = (job+1)*j->height/j->num_jobs;
+    int stride = j->width*4;
+    for(;y<end;y++) {
+#ifdef RESAMPLE_X86
+	if(use_simd()) {
+	    blur_row_avx2(&j->src[y*stride], &j->dest[y*stride], j->width, j->radius, j->scale);
+	    continue;
+	}
+#endif
+	blur_row_c(&j->src[y*stride], &j->dest[y*stride], j->width, j->radius, j->scale);
+    }
+}
+
+static void blur_columns_job(void*data, int job, int thread)
+{
+    blurjob_t*j = (blurjob_t*)data;
+    /* split at pixel boundaries */
+    int start = (job*j->width/j->num_jobs)*4;
+    int end = ((job+1)*j->width/j->num_jobs)*4;
+    if(start>=end)
+	return;
+    int*sums = (int*)rfx_alloc((end-start)*sizeof(int));
+#ifdef RESAMPLE_X86
+    if(use_simd())
+	blur_columns_avx2(j, sums, start, end);
+    else
+#endif
+    blur_columns_c(j, sums, start, end);
+    rfx_free(sums);
+}
+
+void gfximage_blur(gfximage_t*image, int radius, int num_threads)
+{
+    if(radius<1 || image->width<1 || image->height<1)
+	return;
+    if(num_threads<1)
+	num_threads=1;
+    blurjob_t j;
+    j.width = image->width;
+    j.height = image->height;
+    j.radius = radius;
+    j.scale = (65536 + radius) / (2*radius+1);
+    U8*data = (U8*)image->data;
+    U8*tmp = (U8*)rfx_alloc(j.width*j.height*4);
+
+    /* three box blurs in a row are a good approximation of a gaussian */
+    int pass;
+    for(pass=0;pass<3;pass++) {
+	j.src = data;
+	j.dest = tmp;
+	j.num_jobs = num_threads>1?(j.height+RESAMPLE_ROWS_PER_JOB-1)/RESAMPLE_ROWS_PER_JOB:1;
+	threads_run(num_threads, j.num_jobs, blur_rows_job, &j);
+	j.src = tmp;
+	j.dest = data;
+	j.num_jobs = num_threads<j.width?num_threads:j.width;
+	threads_run(num_threads, j.num_jobs, blur_columns_job, &j);
+    }
+    rfx_free(tmp);
+}
+
+char gfxrescale_filter_byname(const char*name, gfxrescale_filter_t*filter)
+{
+    if(!strcmp(name, "legacy")) *filter = gfxrescale_legacy;
+    else if(!strcmp(name, "box")) *filter = gfxrescale_box;
+    else if(!strcmp(name, "bilinear")) *filter = gfxrescale_bilinear;
+    else if(!strcmp(name, "lanczos")) *filter = gfxrescale_lanczos;
+    else return 0;
+    return 1;
+}
+
+gfximage_t* gfximage_rescale2(gfximage_t*image, int newwidth, int newheight, gfxrescale_filter_t filter, int num_threads)
+{
+    if(filter == gfxrescale_legacy)
+	return gfximage_rescale(image, newwidth, newheight);
+    if(newwidth<1)
+	newwidth=1;
+    if(newheight<1)
+	newheight=1;
+    if(num_threads<1)
+	num_threads=1;
+
+    int width = image->width;
+    int height = image->height;
+    gfxcolor_t*data = image->data;
+    gfxcolor_t monochrome_colors[2];
+    int monochrome = 0;
+
+    if(gfximage_getNumberOfPaletteEntries(image) == 2) {
+	monochrome = 1;
+	gfximage_t copy;
+	copy.width = width;
+	copy.height = height;
+	copy.data = data = (gfxcolor_t*)rfx_alloc(width*height*sizeof(gfxcolor_t));
+	memcpy(data, image->data, width*height*sizeof(gfxcolor_t));
+	encodeMonochromeImage(data, width, height, monochrome_colors);
+	int r1 = width / newwidth;
+	int r2 = height / newheight;
+	int r = r1<r2?r1:r2;
+	if(r>4) {
+	    /* see gfximage_rescale_old() */
+	    gfximage_blur(&copy, (r+1)/2, num_threads);
+	}
+    }
+
+    resamplejob_t j;
+    j.src = data;
+    j.width = width;
+    j.height = height;
+    j.newwidth = newwidth;
+    j.newheight = newheight;
+    j.tx = resample_table_new(width, newwidth, filter);
+    j.ty = resample_table_new(height, newheight, filter);
+    j.tmp = (gfxcolor_t*)rfx_alloc(newwidth*height*sizeof(gfxcolor_t));
+    j.dest = (gfxcolor_t*)rfx_alloc(newwidth*newheight*sizeof(gfxcolor_t));
+    j.rows = (U8***)rfx_alloc(num_threads*sizeof(U8**));
+    int t;
+    for(t=0;t<num_threads;t++)
+	j.rows[t] = (U8**)rfx_alloc(j.ty->taps*sizeof(U8*));
+
+    threads_run(num_threads, (height+RESAMPLE_ROWS_PER_JOB-1)/RESAMPLE_ROWS_PER_JOB, resample_horizontal_job, &j);
+    threads_run(num_threads, (newheight+RESAMPLE_ROWS_PER_JOB-1)/RESAMPLE_ROWS_PER_JOB, resample_vertical_job, &j);
+
+    if(monochrome) {
+	decodeMonochromeImage(j.dest, newwidth, newheight, monochrome_colors);
+	rfx_free(data);
+    }
+
+    for(t=0;t<num_threads;t++)
+	rfx_free(j.rows[t]);
+    rfx_free(j.rows);
+    rfx_free(j.tmp);
+    resample_table_free(j.tx);
+    resample_table_free(j.ty);
+
+    gfximage_t*image2 = (gfximage_t*)malloc(sizeof(gfximage_t));
+    image2->data = j.dest;
+    image2->width = newwidth;
+    image2->height = newheight;
+    return image2;
+}
+
 bool gfximage_has_alpha(gfximage_t*img)
 {
     int size = img->width*img->height;
@@ -7,8 +7,22 @@
 gfximage_t*gfximage_new(int width, int height);
 void gfximage_save_jpeg(gfximage_t*image, const char*filename, int quality);
 void gfximage_save_png(gfximage_t*image, const char*filename);
+void gfximage_save_png_threaded(gfximage_t*image, const char*filename, int num_threads);
 void gfximage_save_png_quick(gfximage_t*image, const char*filename);
 gfximage_t* gfximage_rescale(gfximage_t*image, int newwidth, int newheight);
+
+typedef enum {gfxrescale_legacy=0, gfxrescale_box, gfxrescale_bilinear, gfxrescale_lanczos} gfxrescale_filter_t;
+
+/* separable resampling with the given filter kernel, spread over num_threads
+   threads. gfxrescale_legacy is the same as gfximage_rescale() */
+gfximage_t* gfximage_rescale2(gfximage_t*image, int newwidth, int newheight, gfxrescale_filter_t filter, int num_threads);
+/* look up a filter by name ("legacy", "box", "bilinear" or "lanczos").
+   Returns 0 if there's no such filter */
+char gfxrescale_filter_byname(const char*name, gfxrescale_filter_t*filter);
+/* approximate gaussian blur (three passes of a box filter of the given radius) */
+void gfximage_blur(gfximage_t*image, int radius, int num_threads);
+/* use only the plain C versions of the above (for testing) */
+void gfximage_disable_simd();
 bool gfximage_has_alpha(gfximage_t*image);
 void gfximage_free(gfximage_t*b);
 
@@ -0,0 +1,448 @@
+/* gfxpath.c
+   Paths stored as arrays (instead of gfxline_t lists), with SIMD kernels
+   for transforming them and computing their bounding box.
+
+   Part of the swftools package.
+
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../config.h"
+#include "mem.h"
+#include "gfxpath.h"
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define GFXPATH_X86
+#include <immintrin.h>
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+/* paths shorter than this are always done with the plain C code */
+#define MIN_SIMD_PATH 8
+
+static int simd_level = -1; /* 0 = none, 2 = avx2 */
+
+static int get_simd_level()
+{
+    if(simd_level < 0) {
+	int level = 0;
+#ifdef GFXPATH_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+	    level = 2;
+#endif
+	simd_level = level;
+    }
+    return simd_level;
+}
+
+void gfxpath_disable_simd()
+{
+    simd_level = 0;
+}
+
+/* ------------------------------ paths ------------------------------ */
+
+gfxpath_t* gfxpath_new()
+{
+    return (gfxpath_t*)rfx_calloc(sizeof(gfxpath_t));
+}
+
+void gfxpath_free(gfxpath_t*path)
+{
+    if(path->size) {
+	rfx_free(path->type);
+	rfx_free(path->x);
+	rfx_free(path->y);
+	rfx_free(path->sx);
+	rfx_free(path->sy);
+    }
+    rfx_free(path);
+}
+
+void gfxpath_clear(gfxpath_t*path)
+{
+    path->num = 0;
+}
+
+static void gfxpath_grow(gfxpath_t*path, int num)
+{
+    if(num <= path->size)
+	return;
+    int size = path->size?path->size:16;
+    while(size < num)
+	size *= 2;
+    /* the type array always has room for 4 more entries, which the bbox
+       kernel looks at (as moveTos) when it reads past the last segment */
+    path->type = (U8*)rfx_realloc(path->type, size+4);
+    path->x = (gfxcoord_t*)rfx_realloc(path->x, size*sizeof(gfxcoord_t));
+    path->y = (gfxcoord_t*)rfx_realloc(path->y, size*sizeof(gfxcoord_t));
+    path->sx = (gfxcoord_t*)rfx_realloc(path->sx, size*sizeof(gfxcoord_t));
+    path->sy = (gfxcoord_t*)rfx_realloc(path->sy, size*sizeof(gfxcoord_t));
+    path->size = size;
+}
+
+void gfxpath_add(gfxpath_t*path, gfx_linetype type, gfxcoord_t x, gfxcoord_t y, gfxcoord_t sx, gfxcoord_t sy)
+{
+    if(path->num == path->size)
+	gfxpath_grow(path, path->num+1);
+    int t = path->num++;
+    path->type[t] = type;
+    path->x[t] = x;
+    path->y[t] = y;
+    path->sx[t] = sx;
+    path->sy[t] = sy;
+}
+
+void gfxpath_set_gfxline(gfxpath_t*path, gfxline_t*line)
+{
+    int num = 0;
+    gfxline_t*l;
+    for(l=line;l;l=l->next)
+	num++;
+    gfxpath_grow(path, num);
+    path->num = num;
+    int t = 0;
+    for(l=line;l;l=l->next,t++) {
+	path->type[t] = l->type;
+	path->x[t] = l->x;
+	path->y[t] = l->y;
+	if(l->type == gfx_splineTo) {
+	    path->sx[t] = l->sx;
+	    path->sy[t] = l->sy;
+	} else {
+	    path->sx[t] = 0;
+	    path->sy[t] = 0;
+	}
+    }
+}
+
+gfxpath_t* gfxpath_from_gfxline(gfxline_t*line)
+{
+    gfxpath_t*path = gfxpath_new();
+    gfxpath_set_gfxline(path, line);
+    return path;
+}
+
+gfxline_t* gfxpath_to_gfxline(gfxpath_t*path)
+{
+    if(!path->num)
+	return 0;
+    gfxline_t*line = (gfxline_t*)rfx_calloc(sizeof(gfxline_t)*path->num);
+    int t;
+    for(t=0;t<path->num;t++) {
+	line[t].type = (gfx_linetype)path->type[t];
+	line[t].x = path->x[t];
+	line[t].y = path->y[t];
+	if(path->type[t] == gfx_splineTo) {
+	    line[t].sx = path->sx[t];
+	    line[t].sy = path->sy[t];
+	}
+	line[t].next = t<path->num-1?&line[t+1]:0;
+    }
+    /* this is a "flattened" gfxline, which gfxline_free() releases in one go */
+    return line;
+}
+
+/* ------------------------------ kernels ------------------------------ */
+
+static void transform_c(const gfxcoord_t*x, const gfxcoord_t*y, gfxcoord_t*dx, gfxcoord_t*dy, int num, gfxmatrix_t*m)
+{
+    int t;
+    for(t=0;t<num;t++) {
+	double nx = m->m00*x[t] + m->m10*y[t] + m->tx;
+	double ny = m->m01*x[t] + m->m11*y[t] + m->ty;
+	dx[t] = nx;
+	dy[t] = ny;
+    }
+}
+
+/* the points which gfxline_getbbox() looks at: segment ends, except for
+   moveTos which aren't followed by a line or spline, and spline control
+   points */
+#define END_COUNTS(type,t) ((type)[t] != gfx_moveTo || (type)[(t)+1] != gfx_moveTo)
+#define CONTROL_COUNTS(type,t) ((type)[t] == gfx_splineTo)
+
+/* gfxline_getbbox() starts with an empty (all zero) bbox, and initializes
+   it with the first point. If that point is (0,0), xmax is set to a tiny
+   value, so that the bbox doesn't look empty anymore. */
+static gfxbbox_t finish_bbox(gfxpath_t*path, double xmin, double ymin, double xmax, double ymax)
+{
+    gfxbbox_t bbox = {0,0,0,0};
+    int t;
+    for(t=0;t<path->num;t++) {
+	if(path->type[t] != gfx_moveTo)
+	    break;
+    }
+    if(t == path->num)
+	return bbox;
+    double x,y;
+    if(t) {
+	x = path->x[t-1];
+	y = path->y[t-1];
+    } else if(path->type[0] == gfx_splineTo) {
+	x = path->sx[0];
+	y = path->sy[0];
+    } else {
+	x = path->x[0];
+	y = path->y[0];
+    }
+    if(x==0 && y==0 && xmax < 0.0000001)
+	xmax = 0.0000001;
+    bbox.xmin = xmin;
+    bbox.ymin = ymin;
+    bbox.xmax = xmax;
+    bbox.ymax = ymax;
+    return bbox;
+}
+
+static gfxbbox_t getbbox_c(gfxpath_t*path)
+{
+    gfxbbox_t bbox = {0,0,0,0};
+    char last = 0;
+    int t;
+    double x=0, y=0;
+    for(t=0;t<path->num;t++) {
+	if(path->type[t] == gfx_moveTo) {
+	    last = 1;
+	} else if(path->type[t] == gfx_lineTo) {
+	    if(last) bbox = gfxbbox_expand_to_point(bbox, x, y);
+	    bbox = gfxbbox_expand_to_point(bbox, path->x[t], path->y[t]);
+	    last = 0;
+	} else if(path->type[t] == gfx_splineTo) {
+	    if(last) bbox = gfxbbox_expand_to_point(bbox, x, y);
+	    bbox = gfxbbox_expand_to_point(bbox, path->sx[t], path->sy[t]);
+	    bbox = gfxbbox_expand_to_point(bbox, path->x[t], path->y[t]);
+	    last = 0;
+	}
+	x = path->x[t];
+	y = path->y[t];
+    }
+    return bbox;
+}
+
+#ifdef GFXPATH_X86
+
+static AVX2 void transform_avx2(const gfxcoord_t*x, const gfxcoord_t*y, gfxcoord_t*dx, gfxcoord_t*dy, int num, gfxmatrix_t*m)
+{
+    __m256d m00 = _mm256_set1_pd(m->m00);
+    __m256d m10 = _mm256_set1_pd(m->m10);
+    __m256d m01 = _mm256_set1_pd(m->m01);
+    __m256d m11 = _mm256_set1_pd(m->m11);
+    __m256d tx = _mm256_set1_pd(m->tx);
+    __m256d ty = _mm256_set1_pd(m->ty);
+    int t;
+    for(t=0;t+4<=num;t+=4) {
+	__m256d vx = _mm256_loadu_pd(&x[t]);
+	__m256d vy = _mm256_loadu_pd(&y[t]);
+	/* same order of operations as the C code, so the results are identical */
+	__m256d nx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m00, vx), _mm256_mul_pd(m10, vy)), tx);
+	__m256d ny = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m01, vx), _mm256_mul_pd(m11, vy)), ty);
+	_mm256_storeu_pd(&dx[t], nx);
+	_mm256_storeu_pd(&dy[t], ny);
+    }
+    transform_c(&x[t], &y[t], &dx[t], &dy[t], num-t, m);
+}
+
+/* expand four U8 segment types to 64 bit lanes */
+static inline AVX2 __m256i types_avx2(const U8*type)
+{
+    int v;
+    memcpy(&v, type, 4);
+    return _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(v));
+}
+
+static AVX2 gfxbbox_t getbbox_avx2(gfxpath_t*path)
+{
+    const U8*type = path->type;
+    int num = path->num;
+    __m256d pinf = _mm256_set1_pd(HUGE_VAL);
+    __m256d ninf = _mm256_set1_pd(-HUGE_VAL);
+    __m256d xmin = pinf, ymin = pinf, xmax = ninf, ymax = ninf;
+    __m256i move = _mm256_set1_epi64x(gfx_moveTo);
+    __m256i spline = _mm256_set1_epi64x(gfx_splineTo);
+    int t;
+    for(t=0;t+4<=num;t+=4) {
+	__m256i ty = types_avx2(&type[t]);
+	__m256i tnext = types_avx2(&type[t+1]);
+	/* END_COUNTS: not (type==move && next==move) */
+	__m256d skip_end = _mm256_castsi256_pd(_mm256_and_si256(_mm256_cmpeq_epi64(ty, move), _mm256_cmpeq_epi64(tnext, move)));
+	__m256d use_control = _mm256_castsi256_pd(_mm256_cmpeq_epi64(ty, spline));
+
+	__m256d vx = _mm256_loadu_pd(&path->x[t]);
+	__m256d vy = _mm256_loadu_pd(&path->y[t]);
+	xmin = _mm256_min_pd(xmin, _mm256_blendv_pd(vx, pinf, skip_end));
+	ymin = _mm256_min_pd(ymin, _mm256_blendv_pd(vy, pinf, skip_end));
+	xmax = _mm256_max_pd(xmax, _mm256_blendv_pd(vx, ninf, skip_end));
+	ymax = _mm256_max_pd(ymax, _mm256_blendv_pd(vy, ninf, skip_end));
+
+	__m256d sx = _mm256_loadu_pd(&path->sx[t]);
+	__m256d sy = _mm256_loadu_pd(&path->sy[t]);
+	xmin = _mm256_min_pd(xmin, _mm256_blendv_pd(pinf, sx, use_control));
+	ymin = _mm256_min_pd(ymin, _mm256_blendv_pd(pinf, sy, use_control));
+	xmax = _mm256_max_pd(xmax, _mm256_blendv_pd(ninf, sx, use_control));
+	ymax = _mm256_max_pd(ymax, _mm256_blendv_pd(ninf, sy, use_control));
+    }
+    double r[4][4];
+    _mm256_storeu_pd(r[0], xmin);
+    _mm256_storeu_pd(r[1], ymin);
+    _mm256_storeu_pd(r[2], xmax);
+    _mm256_storeu_pd(r[3], ymax);
+    int s;
+    for(s=1;s<4;s++) {
+	if(r[0][s] < r[0][0]) r[0][0] = r[0][s];
+	if(r[1][s] < r[1][0]) r[1][0] = r[1][s];
+	if(r[2][s] > r[2][0]) r[2][0] = r[2][s];
+	if(r[3][s] > r[3][0]) r[3][0] = r[3][s];
+    }
+    for(;t<num;t++) {
+	if(END_COUNTS(type,t)) {
+	    if(path->x[t] < r[0][0]) r[0][0] = path->x[t];
+	    if(path->y[t] < r[1][0]) r[1][0] = path->y[t];
+	    if(path->x[t] > r[2][0]) r[2][0] = path->x[t];
+	    if(path->y[t] > r[3][0]) r[3][0] = path->y[t];
+	}
+	if(CONTROL_COUNTS(type,t)) {
+	    if(path->sx[t] < r[0][0]) r[0][0] = path->sx[t];
+	    if(path->sy[t] < r[1][0]) r[1][0] = path->sy[t];
+	    if(path->sx[t] > r[2][0]) r[2][0] = path->sx[t];
+	    if(path->sy[t] > r[3][0]) r[3][0] = path->sy[t];
+	}
+    }
+    return finish_bbox(path, r[0][0], r[1][0], r[2][0], r[3][0]);
+}
+
+#endif
+
+/* ------------------------------ dispatch ------------------------------ */
+
+void gfxpath_transform_to(gfxpath_t*dest, gfxpath_t*src, gfxmatrix_t*matrix)
+{
+    if(dest != src) {
+	gfxpath_grow(dest, src->num);
+	dest->num = src->num;
+	memcpy(dest->type, src->type, src->num);
+    }
+#ifdef GFXPATH_X86
+    if(src->num >= MIN_SIMD_PATH && get_simd_level() == 2) {
+	transform_avx2(src->x, src->y, dest->x, dest->y, src->num, matrix);
+	transform_avx2(src->sx, src->sy, dest->sx, dest->sy, src->num, matrix);
+	return;
+    }
+#endif
+    transform_c(src->x, src->y, dest->x, dest->y, src->num, matrix);
+    transform_c(src->sx, src->sy, dest->sx, dest->sy, src->num, matrix);
+}
+
+void gfxpath_transform(gfxpath_t*path, gfxmatrix_t*matrix)
+{
+    gfxpath_transform_to(path, path, matrix);
+}
+
+gfxbbox_t gfxpath_getbbox(gfxpath_t*path)
+{
+#ifdef GFXPATH_X86
+    if(path->num >= MIN_SIMD_PATH && get_simd_level() == 2) {
+	/* the kernel reads the types of the following segments */
+	memset(&path->type[path->num], gfx_moveTo, 4);
+	return getbbox_avx2(path);
+    }
+#endif
+    return getbbox_c(path);
+}
+
+/* ------------------------------ devices ------------------------------ */
+
+void gfxdevice_fillpath(gfxdevice_t*dev, gfxpath_t*path, gfxcolor_t*color)
+{
+    if(dev->fillpath) {
+	dev->fillpath(dev, path, color);
+    } else {
+	gfxline_t*line = gfxpath_to_gfxline(path);
+	dev->fill(dev, line, color);
+	gfxline_free(line);
+    }
+}
+
+/* ------------------------------ glyph cache ------------------------------ */
+
+typedef struct _pathcache_font
+{
+    char*id;
+    int num_glyphs;
+    gfxpath_t**glyphs;
+    struct _pathcache_font*next;
+} pathcache_font_t;
+
+struct _gfxpathcache
+{
+    pathcache_font_t*fonts;
+    pathcache_font_t*last;
+};
+
+gfxpathcache_t* gfxpathcache_new()
+{
+    return (gfxpathcache_t*)rfx_calloc(sizeof(gfxpathcache_t));
+}
+
+gfxpath_t* gfxpathcache_getglyph(gfxpathcache_t*cache, gfxfont_t*font, int glyphnr)
+{
+    pathcache_font_t*f = cache->last;
+    if(!f || strcmp(f->id, font->id)) {
+	for(f=cache->fonts;f;f=f->next) {
+	    if(!strcmp(f->id, font->id))
+		break;
+	}
+	if(!f) {
+	    f = (pathcache_font_t*)rfx_calloc(sizeof(pathcache_font_t));
+	    f->id = strdup(font->id);
+	    f->next = cache->fonts;
+	    cache->fonts = f;
+	}
+	cache->last = f;
+    }
+    if(glyphnr >= f->num_glyphs) {
+	int num = font->num_glyphs > glyphnr ? font->num_glyphs : glyphnr+1;
+	f->glyphs = (gfxpath_t**)rfx_realloc(f->glyphs, num*sizeof(gfxpath_t*));
+	memset(&f->glyphs[f->num_glyphs], 0, (num - f->num_glyphs)*sizeof(gfxpath_t*));
+	f->num_glyphs = num;
+    }
+    if(!f->glyphs[glyphnr])
+	f->glyphs[glyphnr] = gfxpath_from_gfxline(font->glyphs[glyphnr].line);
+    return f->glyphs[glyphnr];
+}
+
+void gfxpathcache_destroy(gfxpathcache_t*cache)
+{
+    pathcache_font_t*f = cache->fonts;
+    while(f) {
+	pathcache_font_t*next = f->next;
+	int t;
+	for(t=0;t<f->num_glyphs;t++) {
+	    if(f->glyphs[t])
+		gfxpath_free(f->glyphs[t]);
+	}
+	free(f->glyphs);
+	free(f->id);
+	free(f);
+	f = next;
+    }
+    rfx_free(cache);
+}
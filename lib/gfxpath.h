@@ -0,0 +1,83 @@
+/* gfxpath.h
+   Paths stored as arrays (instead of gfxline_t lists), with SIMD kernels
+   for transforming them and computing their bounding box.
+
+   Part of the swftools package.
+
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __gfxpath_h__
+#define __gfxpath_h__
+
+#include "types.h"
+#include "gfxdevice.h"
+#include "gfxtools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Segment t of a path is type[t] (gfx_moveTo, gfx_lineTo, gfx_splineTo) to
+   x[t],y[t], with control point sx[t],sy[t] if it's a spline. (For other
+   segment types, sx[t],sy[t] are undefined) */
+typedef struct _gfxpath
+{
+    int num;
+    int size;
+    U8*type;
+    gfxcoord_t*x;
+    gfxcoord_t*y;
+    gfxcoord_t*sx;
+    gfxcoord_t*sy;
+} gfxpath_t;
+
+gfxpath_t* gfxpath_new();
+void gfxpath_free(gfxpath_t*path);
+void gfxpath_clear(gfxpath_t*path);
+void gfxpath_add(gfxpath_t*path, gfx_linetype type, gfxcoord_t x, gfxcoord_t y, gfxcoord_t sx, gfxcoord_t sy);
+
+gfxpath_t* gfxpath_from_gfxline(gfxline_t*line);
+/* like gfxpath_from_gfxline, but reuses the memory of an existing path */
+void gfxpath_set_gfxline(gfxpath_t*path, gfxline_t*line);
+gfxline_t* gfxpath_to_gfxline(gfxpath_t*path);
+
+/* These compute exactly the same values as gfxline_transform() and
+   gfxline_getbbox() on the corresponding gfxline. */
+void gfxpath_transform(gfxpath_t*path, gfxmatrix_t*matrix);
+/* transform src and store the result in dest */
+void gfxpath_transform_to(gfxpath_t*dest, gfxpath_t*src, gfxmatrix_t*matrix);
+gfxbbox_t gfxpath_getbbox(gfxpath_t*path);
+
+/* use only the plain C versions (for testing) */
+void gfxpath_disable_simd();
+
+/* Calls dev->fillpath(), or, for devices which don't support packed paths,
+   dev->fill() with the path converted to a gfxline. */
+void gfxdevice_fillpath(gfxdevice_t*dev, gfxpath_t*path, gfxcolor_t*color);
+
+/* A cache of glyph outlines as packed paths, for devices which draw or
+   measure characters themselves. Fonts are identified by their id. */
+typedef struct _gfxpathcache gfxpathcache_t;
+gfxpathcache_t* gfxpathcache_new();
+gfxpath_t* gfxpathcache_getglyph(gfxpathcache_t*cache, gfxfont_t*font, int glyphnr);
+void gfxpathcache_destroy(gfxpathcache_t*cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__gfxpath_h__
@@ -50,6 +50,11 @@ gfxpoly_t* gfxpoly_from_stroke(gfxline_t*line, gfxcoord_t width, gfx_capType cap
 gfxpoly_t* gfxpoly_intersect(gfxpoly_t*p1, gfxpoly_t*p2);
 gfxpoly_t* gfxpoly_union(gfxpoly_t*p1, gfxpoly_t*p2);
 
+/* the same, but for big polygons, split the work into horizontal bands
+   and process them on up to num_threads threads */
+gfxpoly_t* gfxpoly_intersect_tiled(gfxpoly_t*p1, gfxpoly_t*p2, int num_threads);
+gfxpoly_t* gfxpoly_union_tiled(gfxpoly_t*p1, gfxpoly_t*p2, int num_threads);
+
 /* area functions */
 double gfxpoly_area(gfxpoly_t*p);
 double gfxpoly_intersection_area(gfxpoly_t*p1, gfxpoly_t*p2);
@@ -224,6 +224,7 @@ static inline segment_t*rotate_right(actlist_t*a, segment_t*s)
 	    l             l
     */
     assert(s->leftchild);
+    GFXPOLY_STAT(a->stats, rotations);
     segment_t*p = s->parent;
     segment_t*n = s->leftchild;
     segment_t*l = n->rightchild;
@@ -250,6 +251,7 @@ static inline segment_t*rotate_left(actlist_t*a, segment_t*s)
 	    r             r
     */
     assert(s->rightchild);
+    GFXPOLY_STAT(a->stats, rotations);
     segment_t*p = s->parent;
     segment_t*n = s->rightchild;
     segment_t*r = n->leftchild;
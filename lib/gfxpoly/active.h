@@ -10,6 +10,9 @@ typedef struct _actlist
 #ifdef SPLAY
     segment_t*root;
 #endif
+#ifdef GFXPOLY_STATS
+    gfxpoly_stats_t*stats;
+#endif
 } actlist_t;
 
 #define actlist_left(a,s) ((s)->left)
@@ -0,0 +1,559 @@
+/* bench.c
+
+   Benchmark and regression harness for the polygon intersector.
+
+   Runs gfxpoly_process() over a fixed corpus of generated polygons (stars,
+   random shapes, chessboards, circles) and of fills, clip paths and glyph
+   outlines extracted from PDF files (via the record device), and prints
+   the results as JSON.
+
+   Usage: bench [-c] [-r <iterations>] [-t <threads>] [file.pdf ...]
+
+   -c  also render every polygon before and after processing, and
+       compare the bitmaps (slow)
+   -r  run every case this many times (default: as often as fits into
+       a quarter of a second)
+   -t  use gfxpoly_process_tiled() with this many threads
+
+   Part of the swftools package.
+
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../gfxdevice.h"
+#include "../gfxtools.h"
+#include "../devices/record.h"
+#include "../pdf/pdf.h"
+#include "poly.h"
+#include "convert.h"
+#include "renderpoly.h"
+
+#ifndef GFXPOLY_STATS
+#error "bench must be compiled with -DGFXPOLY_STATS"
+#endif
+
+#ifdef CHECKS
+#error "bench must be compiled without CHECKS"
+#endif
+
+#define GRIDSIZE 0.05
+#define MIN_TIME 0.25
+
+static windcontext_t onepolygon = {1};
+static int num_threads = 0;
+
+static gfxpoly_t* process(gfxpoly_t*poly)
+{
+    if(num_threads)
+        return gfxpoly_process_tiled(poly, 0, &windrule_evenodd, &onepolygon, num_threads);
+    else
+        return gfxpoly_process(poly, 0, &windrule_evenodd, &onepolygon, 0);
+}
+
+typedef struct _polylist {
+    gfxpoly_t**polys;
+    int num;
+    int size;
+} polylist_t;
+
+static void polylist_add(polylist_t*l, gfxline_t*line)
+{
+    gfxpoly_t*poly = gfxpoly_from_fill(line, GRIDSIZE);
+    int size = gfxpoly_size(poly);
+    if(size <= 4 || !gfxpoly_check(poly, 0)) {
+        /* rectangles are boring, and broken polygons won't tell us anything */
+        gfxpoly_destroy(poly);
+        return;
+    }
+    if(l->num == l->size) {
+        l->size = l->size?l->size*2:64;
+        l->polys = (gfxpoly_t**)realloc(l->polys, sizeof(gfxpoly_t*)*l->size);
+    }
+    l->polys[l->num++] = poly;
+}
+
+/* ------------------------- generated polygons -------------------------- */
+
+/* a closed zigzag between the top and bottom edge, every edge
+   crossing most of the others */
+static gfxline_t* mkstar(int x1, int y1, int x2, int y2, int step)
+{
+    gfxline_t*l=0,*line = 0;
+    int x;
+    for(x=x1;x<=x2;x+=step) {
+        l = (gfxline_t*)rfx_calloc(sizeof(gfxline_t));
+        l->type = line?gfx_lineTo:gfx_moveTo;
+        l->x = x;l->y = y1;
+        line = gfxline_append(line, l);
+
+        l = (gfxline_t*)rfx_calloc(sizeof(gfxline_t));
+        l->type = gfx_lineTo;
+        l->x = x2-x;l->y = y2;
+        line = gfxline_append(line, l);
+    }
+    l = (gfxline_t*)rfx_calloc(sizeof(gfxline_t));
+    l->type = gfx_lineTo;
+    l->x = x1;l->y = y1;
+    line = gfxline_append(line, l);
+    return line;
+}
+
+static gfxline_t* mkrandomshape(int range, int n)
+{
+    int i;
+    gfxline_t* line = (gfxline_t*)rfx_calloc(sizeof(gfxline_t)*n);
+    for(i=0;i<n;i++) {
+        line[i].type = i?gfx_lineTo:gfx_moveTo;
+        line[i].x = lrand48()%range - range/2;
+        line[i].y = lrand48()%range - range/2;
+        line[i].next = &line[i+1];
+    }
+    line[n-1].x = line[0].x;
+    line[n-1].y = line[0].y;
+    line[n-1].next = 0;
+    return line;
+}
+
+static gfxline_t* mkchessboard()
+{
+    gfxline_t*b = 0;
+    int x,y;
+    unsigned int r = 0;
+    int spacing = 20;
+    int num_caros = 40;
+    int l = 5;
+
+    for(x=-l;x<=l;x++)
+    for(y=-l;y<=l;y++) {
+        /* pseudo random */
+        r = crc32_add_byte(r, x);r = crc32_add_byte(r, y);
+        if(r&1) {
+            gfxline_t*box;
+            if(r&2) {
+                box = gfxline_makerectangle(x*spacing,y*spacing,(x+1)*spacing,(y+1)*spacing);
+            } else {
+                box = gfxline_makerectangle((x+1)*spacing,y*spacing,x*spacing,(y+1)*spacing);
+            }
+            b = gfxline_append(b, box);
+        }
+    }
+
+    int t;
+    for(t=0;t<num_caros;t++) {
+        r = crc32_add_byte(r, t);
+        int x=(r%10-5)*spacing;
+        int y=((r>>4)%10-5)*spacing;
+        int sizex = ((r>>8)%4)*spacing;
+        int sizey = sizex;
+        if(r&65536)
+            sizex = -sizex;
+        gfxline_t*l = (gfxline_t*)rfx_calloc(sizeof(gfxline_t)*5);
+        l[0].type = gfx_moveTo;l[0].next = &l[1];
+        l[1].type = gfx_lineTo;l[1].next = &l[2];
+        l[2].type = gfx_lineTo;l[2].next = &l[3];
+        l[3].type = gfx_lineTo;l[3].next = &l[4];
+        l[4].type = gfx_lineTo;l[4].next = 0;
+        l[0].x = x;
+        l[0].y = y-sizey;
+        l[1].x = x+sizex;
+        l[1].y = y;
+        l[2].x = x;
+        l[2].y = y+sizey;
+        l[3].x = x-sizex;
+        l[3].y = y;
+        l[4].x = x;
+        l[4].y = y-sizey;
+        gfxline_append(b, l);
+    }
+    for(t=0;t<5;t++) {
+        gfxline_t*l = gfxline_makerectangle(-9*spacing,-10,9*spacing,10);
+        gfxmatrix_t matrix;
+        memset(&matrix, 0, sizeof(gfxmatrix_t));
+        double ua=t*0.43;
+        matrix.m00=cos(ua);matrix.m10=sin(ua);
+        matrix.m01=-sin(ua);matrix.m11=cos(ua);
+        gfxline_transform(l, &matrix);
+        gfxline_append(b, l);
+    }
+    gfxline_append(b, gfxline_makecircle(100,100,100,100));
+    return b;
+}
+
+static gfxline_t* mkcircles(int n)
+{
+    gfxline_t*b = 0;
+    unsigned int c = 0;
+    int t;
+    for(t=0;t<n;t++) {
+        c = crc32_add_byte(c, t);
+        int x = c%200;
+        c = crc32_add_byte(c, t);
+        int y = c%200;;
+        c = crc32_add_byte(c, t^0x55);
+        int r = c%100;
+        b = gfxline_append(b, gfxline_makecircle(x,y,r,r));
+    }
+    return b;
+}
+
+/* add a shape in a number of rotations, so that we don't
+   only measure axis-aligned edges */
+static void add_rotated(polylist_t*l, gfxline_t*line, int num)
+{
+    int t;
+    for(t=0;t<num;t++) {
+        gfxmatrix_t m;
+        memset(&m, 0, sizeof(gfxmatrix_t));
+        double a = t*M_PI/num;
+        m.m00 = cos(a);m.m10 = sin(a);
+        m.m01 = -sin(a);m.m11 = cos(a);
+        gfxline_t*l2 = gfxline_clone(line);
+        gfxline_transform(l2, &m);
+        polylist_add(l, l2);
+        gfxline_free(l2);
+    }
+}
+
+/* ----------------------- polygons from PDF files ----------------------- */
+
+typedef struct _extract {
+    polylist_t*fills;
+    polylist_t*clips;
+    polylist_t*glyphs;
+    dict_t*seen_glyphs;
+} extract_t;
+
+static int extract_setparameter(gfxdevice_t*dev, const char*key, const char*value) {return 0;}
+static void extract_startpage(gfxdevice_t*dev, int width, int height) {}
+static void extract_endpage(gfxdevice_t*dev) {}
+static void extract_startclip(gfxdevice_t*dev, gfxline_t*line)
+{
+    polylist_add(((extract_t*)dev->internal)->clips, line);
+}
+static void extract_endclip(gfxdevice_t*dev) {}
+static void extract_stroke(gfxdevice_t*dev, gfxline_t*line, gfxcoord_t width, gfxcolor_t*color, gfx_capType cap_style, gfx_joinType joint_style, gfxcoord_t miterLimit) {}
+static void extract_fill(gfxdevice_t*dev, gfxline_t*line, gfxcolor_t*color)
+{
+    polylist_add(((extract_t*)dev->internal)->fills, line);
+}
+static void extract_fillbitmap(gfxdevice_t*dev, gfxline_t*line, gfximage_t*img, gfxmatrix_t*matrix, gfxcxform_t*cxform)
+{
+    polylist_add(((extract_t*)dev->internal)->fills, line);
+}
+static void extract_fillgradient(gfxdevice_t*dev, gfxline_t*line, gfxgradient_t*gradient, gfxgradienttype_t type, gfxmatrix_t*matrix)
+{
+    polylist_add(((extract_t*)dev->internal)->fills, line);
+}
+static void extract_addfont(gfxdevice_t*dev, gfxfont_t*font) {}
+static void extract_drawchar(gfxdevice_t*dev, gfxfont_t*font, int glyph, gfxcolor_t*color, gfxmatrix_t*matrix)
+{
+    extract_t*e = (extract_t*)dev->internal;
+    if(!font || glyph<0 || glyph>=font->num_glyphs || !font->glyphs[glyph].line)
+        return;
+    /* text pages draw the same glyph over and over again- only keep
+       one instance of every glyph per font and size */
+    char key[256];
+    snprintf(key, sizeof(key), "%s/%d/%.2f/%.2f/%.2f/%.2f", font->id?font->id:"", glyph,
+             matrix->m00, matrix->m01, matrix->m10, matrix->m11);
+    if(dict_contains(e->seen_glyphs, key))
+        return;
+    dict_put(e->seen_glyphs, key, 0);
+    gfxline_t*line = gfxline_clone(font->glyphs[glyph].line);
+    gfxline_transform(line, matrix);
+    polylist_add(e->glyphs, line);
+    gfxline_free(line);
+}
+static void extract_drawlink(gfxdevice_t*dev, gfxline_t*line, const char*action, const char*text) {}
+static gfxresult_t* extract_finish(gfxdevice_t*dev) {return 0;}
+
+static void extract_pdf(gfxsource_t*driver, const char*filename, extract_t*e)
+{
+    gfxdocument_t*doc = driver->open(driver, filename);
+    if(!doc) {
+        fprintf(stderr, "Couldn't open %s\n", filename);
+        exit(1);
+    }
+    gfxdevice_t extract;
+    memset(&extract, 0, sizeof(extract));
+    extract.name = "extract";
+    extract.setparameter = extract_setparameter;
+    extract.startpage = extract_startpage;
+    extract.endpage = extract_endpage;
+    extract.startclip = extract_startclip;
+    extract.endclip = extract_endclip;
+    extract.stroke = extract_stroke;
+    extract.fill = extract_fill;
+    extract.fillbitmap = extract_fillbitmap;
+    extract.fillgradient = extract_fillgradient;
+    extract.addfont = extract_addfont;
+    extract.drawchar = extract_drawchar;
+    extract.drawlink = extract_drawlink;
+    extract.finish = extract_finish;
+    extract.internal = e;
+
+    int t;
+    for(t=1;t<=doc->num_pages;t++) {
+        gfxpage_t*page = doc->getpage(doc, t);
+        gfxdevice_t rec;
+        gfxdevice_record_init(&rec, 0);
+        rec.startpage(&rec, page->width, page->height);
+        page->render(page, &rec);
+        rec.endpage(&rec);
+        gfxresult_t*r = rec.finish(&rec);
+        gfxresult_record_replay(r, &extract, 0);
+        r->destroy(r);
+        page->destroy(page);
+    }
+    doc->destroy(doc);
+}
+
+/* ------------------------------ benchmark ------------------------------ */
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+static double run_once(polylist_t*l, int*out_segments)
+{
+    int t;
+    int segments = 0;
+    double start = now();
+    for(t=0;t<l->num;t++) {
+        gfxpoly_t*poly = process(l->polys[t]);
+        segments += gfxpoly_num_segments(poly);
+        gfxpoly_destroy(poly);
+    }
+    if(out_segments)
+        *out_segments = segments;
+    return now() - start;
+}
+
+static int check(polylist_t*l)
+{
+    int t;
+    int errors = 0;
+    for(t=0;t<l->num;t++) {
+        gfxpoly_t*poly1 = l->polys[t];
+        intbbox_t bbox = intbbox_from_polygon(poly1, 1.0);
+        unsigned char*bitmap1 = render_polygon(poly1, &bbox, 1.0, &windrule_evenodd, &onepolygon);
+        gfxpoly_t*poly2 = process(poly1);
+        unsigned char*bitmap2 = render_polygon(poly2, &bbox, 1.0, &windrule_evenodd, &onepolygon);
+        if(!bitmap_ok(&bbox, bitmap2) || !compare_bitmaps(&bbox, bitmap1, bitmap2))
+            errors++;
+        free(bitmap1);
+        free(bitmap2);
+        gfxpoly_destroy(poly2);
+    }
+    return errors;
+}
+
+/* Returns the peak resident set size since the last reset, in kilobytes.
+   Uses /proc on Linux (where the peak can be reset), getrusage() otherwise. */
+static long peak_rss(char reset)
+{
+    if(reset) {
+        FILE*fi = fopen("/proc/self/clear_refs", "wb");
+        if(fi) {
+            fprintf(fi, "5");
+            fclose(fi);
+        }
+    }
+    FILE*fi = fopen("/proc/self/status", "rb");
+    if(fi) {
+        char line[256];
+        long kb = -1;
+        while(fgets(line, sizeof(line), fi)) {
+            if(!strncmp(line, "VmHWM:", 6))
+                kb = atol(line+6);
+        }
+        fclose(fi);
+        if(kb >= 0)
+            return kb;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static int run_case(const char*name, polylist_t*l, int iterations, char do_check, char first)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if(pid) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status)?WEXITSTATUS(status):1;
+    }
+
+    /* child: we run every case in a process of its own, so that
+       the peak memory usage is that of this case only */
+    long rss_before = peak_rss(1);
+
+    int t, in_segments = 0, out_segments = 0;
+    for(t=0;t<l->num;t++) {
+        in_segments += gfxpoly_num_segments(l->polys[t]);
+    }
+
+    memset(&gfxpoly_stats, 0, sizeof(gfxpoly_stats));
+    double time = run_once(l, &out_segments);
+    gfxpoly_stats_t stats = gfxpoly_stats;
+
+    if(!iterations) {
+        iterations = time>0 ? (int)ceil(MIN_TIME / time) : 1000;
+        if(iterations > 1000) iterations = 1000;
+        if(iterations < 1) iterations = 1;
+    }
+    if(iterations > 1) {
+        time = 0;
+        for(t=0;t<iterations;t++) {
+            time += run_once(l, 0);
+        }
+    }
+    time /= iterations;
+
+    int errors = do_check?check(l):0;
+
+    long rss_after = peak_rss(0);
+
+    printf("%s    {\"name\": \"%s\", \"polygons\": %d, \"segments\": %d, \"output_segments\": %d, "
+           "\"iterations\": %d, \"seconds\": %.6f, \"segments_per_sec\": %.0f, "
+           "\"events\": %llu, \"crossings\": %llu, \"rotations\": %llu, "
+           "\"peak_rss_kb\": %ld, \"peak_rss_delta_kb\": %ld",
+           first?"":",\n", name, l->num, in_segments, out_segments,
+           iterations, time, time>0?in_segments/time:0.0,
+           (unsigned long long)stats.events, (unsigned long long)stats.crossings, (unsigned long long)stats.rotations,
+           rss_after, rss_after - rss_before);
+    if(do_check)
+        printf(", \"errors\": %d", errors);
+    printf("}");
+    fflush(stdout);
+    exit(errors?1:0);
+}
+
+static void print_string(const char*s)
+{
+    putchar('"');
+    while(*s) {
+        if(*s == '"' || *s == '\\')
+            putchar('\\');
+        if((unsigned char)*s >= 32)
+            putchar(*s);
+        s++;
+    }
+    putchar('"');
+}
+
+int main(int argn, char*argv[])
+{
+    int iterations = 0;
+    char do_check = 0;
+    int t;
+    int pdfs_start = argn;
+    for(t=1;t<argn;t++) {
+        if(!strcmp(argv[t], "-c")) {
+            do_check = 1;
+        } else if(!strcmp(argv[t], "-r") && t+1<argn) {
+            iterations = atoi(argv[++t]);
+        } else if(!strcmp(argv[t], "-t") && t+1<argn) {
+            num_threads = atoi(argv[++t]);
+        } else if(argv[t][0] == '-') {
+            fprintf(stderr, "Usage: %s [-c] [-r <iterations>] [-t <threads>] [file.pdf ...]\n", argv[0]);
+            return 1;
+        } else {
+            pdfs_start = t;
+            break;
+        }
+    }
+
+    polylist_t stars, random, chessboard, circles, fills, clips, glyphs;
+    memset(&stars, 0, sizeof(polylist_t));
+    memset(&random, 0, sizeof(polylist_t));
+    memset(&chessboard, 0, sizeof(polylist_t));
+    memset(&circles, 0, sizeof(polylist_t));
+    memset(&fills, 0, sizeof(polylist_t));
+    memset(&clips, 0, sizeof(polylist_t));
+    memset(&glyphs, 0, sizeof(polylist_t));
+
+    gfxline_t*line;
+    line = mkstar(-1000,-1000,1000,1000, 50);
+    add_rotated(&stars, line, 8);
+    gfxline_free(line);
+    line = mkstar(-1000,-1000,1000,1000, 25);
+    polylist_add(&stars, line);
+    gfxline_free(line);
+
+    srand48(0x5357);
+    for(t=0;t<32;t++) {
+        line = mkrandomshape(1000, 100);
+        polylist_add(&random, line);
+        free(line);
+    }
+
+    line = mkchessboard();
+    add_rotated(&chessboard, line, 36);
+    gfxline_free(line);
+
+    line = mkcircles(30);
+    add_rotated(&circles, line, 36);
+    gfxline_free(line);
+
+    extract_t e = {&fills, &clips, &glyphs, dict_new()};
+    if(pdfs_start < argn) {
+        gfxsource_t*driver = gfxsource_pdf_create();
+        for(t=pdfs_start;t<argn;t++) {
+            extract_pdf(driver, argv[t], &e);
+        }
+        driver->destroy(driver);
+    }
+    dict_destroy(e.seen_glyphs);
+
+    printf("{\n  \"benchmark\": \"%s\",\n  \"threads\": %d,\n  \"gridsize\": %.2f,\n  \"pdfs\": [", 
+           num_threads?"gfxpoly_process_tiled":"gfxpoly_process", num_threads?num_threads:1, GRIDSIZE);
+    for(t=pdfs_start;t<argn;t++) {
+        if(t>pdfs_start) printf(", ");
+        print_string(argv[t]);
+    }
+    printf("],\n  \"cases\": [\n");
+
+    int failed = 0;
+    failed |= run_case("stars", &stars, iterations, do_check, 1);
+    failed |= run_case("random", &random, iterations, do_check, 0);
+    failed |= run_case("chessboard", &chessboard, iterations, do_check, 0);
+    failed |= run_case("circles", &circles, iterations, do_check, 0);
+    if(pdfs_start < argn) {
+        failed |= run_case("pdf_fills", &fills, iterations, do_check, 0);
+        failed |= run_case("pdf_clips", &clips, iterations, do_check, 0);
+        failed |= run_case("pdf_glyphs", &glyphs, iterations, do_check, 0);
+    }
+    printf("\n  ]\n}\n");
+    return failed;
+}
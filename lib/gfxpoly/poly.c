@@ -12,12 +12,28 @@
 #include "convert.h"
 #include "heap.h"
 #include "moments.h"
+#include "../threads.h"
 
 #ifdef HAVE_MD5
 #include "MD5.h"
 #endif
 
-static gfxpoly_t*current_polygon = 0;
+#if defined(HAVE_THREADS) && defined(__GNUC__)
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
+/* input polygon of the sweep running on this thread, saved by gfxpoly_fail() */
+static THREAD_LOCAL gfxpoly_t*current_polygon = 0;
+
+#ifdef GFXPOLY_STATS
+gfxpoly_stats_t gfxpoly_stats;
+#define GLOBAL_STATS (&gfxpoly_stats)
+#else
+#define GLOBAL_STATS 0
+#endif
+
 void gfxpoly_fail(char*expr, char*file, int line, const char*function)
 {
     if(!current_polygon) {
@@ -166,6 +182,8 @@ typedef struct _status {
     horizdata_t horiz;
 
     gfxpolystroke_t*strokes;
+    int segment_count;
+    gfxpoly_stats_t*stats;
 #ifdef CHECKS
     dict_t*seen_crossings; //list of crossing we saw so far
     dict_t*intersecting_segs; //list of segments intersecting in this scanline
@@ -408,10 +426,9 @@ static void segment_dump(segment_t*s)
             (double)s->delta.x / s->delta.y, s->fs);
 }
 
-static void segment_init(segment_t*s, int32_t x1, int32_t y1, int32_t x2, int32_t y2, int polygon_nr, segment_dir_t dir)
+static void segment_init(segment_t*s, int nr, int32_t x1, int32_t y1, int32_t x2, int32_t y2, int polygon_nr, segment_dir_t dir)
 {
-    static int segment_count=0;
-    s->nr = segment_count++;
+    s->nr = nr;
     s->dir = dir;
     if(y1!=y2) {
 	assert(y1<y2);
@@ -429,7 +446,7 @@ static void segment_init(segment_t*s, int32_t x1, int32_t y1, int32_t x2, int32_
         }
 #ifdef DEBUG
 	fprintf(stderr, "Scheduling horizontal segment [%d] (%.2f,%.2f) -> (%.2f,%.2f) %s\n",
-		segment_count,
+		nr,
 		x1 * 0.05, y1 * 0.05, x2 * 0.05, y2 * 0.05, s->dir==DIR_UP?"up":"down");
 #endif
     }
@@ -475,10 +492,11 @@ static void segment_init(segment_t*s, int32_t x1, int32_t y1, int32_t x2, int32_
 #endif
 }
 
-static segment_t* segment_new(point_t a, point_t b, int polygon_nr, segment_dir_t dir)
+static segment_t* segment_new(status_t*status, point_t a, point_t b, int polygon_nr, segment_dir_t dir)
 {
     segment_t*s = (segment_t*)rfx_calloc(sizeof(segment_t));
-    segment_init(s, a.x, a.y, b.x, b.y, polygon_nr, dir);
+    segment_init(s, status->segment_count++, a.x, a.y, b.x, b.y, polygon_nr, dir);
+    GFXPOLY_STAT(status->stats, segments);
     return s;
 }
 
@@ -494,7 +512,7 @@ static void segment_destroy(segment_t*s)
     free(s);
 }
 
-static void advance_stroke(queue_t*queue, hqueue_t*hqueue, gfxpolystroke_t*stroke, int polygon_nr, int pos, double gridsize)
+static void advance_stroke(status_t*status, hqueue_t*hqueue, gfxpolystroke_t*stroke, int polygon_nr, int pos)
 {
     if(!stroke) 
 	return;
@@ -503,7 +521,7 @@ static void advance_stroke(queue_t*queue, hqueue_t*hqueue, gfxpolystroke_t*strok
        before horizontal events */
     while(pos < stroke->num_points-1) {
 	assert(stroke->points[pos].y <= stroke->points[pos+1].y);
-	s = segment_new(stroke->points[pos], stroke->points[pos+1], polygon_nr, stroke->dir);
+	s = segment_new(status, stroke->points[pos], stroke->points[pos+1], polygon_nr, stroke->dir);
 	s->fs = stroke->fs;
 	pos++;
 	s->stroke = 0;
@@ -512,8 +530,8 @@ static void advance_stroke(queue_t*queue, hqueue_t*hqueue, gfxpolystroke_t*strok
 	/*if(l->tmp)
 	    s->nr = l->tmp;*/
 	fprintf(stderr, "[%d] (%.2f,%.2f) -> (%.2f,%.2f) %s (stroke %p, %d more to come)\n",
-		s->nr, s->a.x * gridsize, s->a.y * gridsize, 
-		s->b.x * gridsize, s->b.y * gridsize,
+		s->nr, s->a.x * status->gridsize, s->a.y * status->gridsize, 
+		s->b.x * status->gridsize, s->b.y * status->gridsize,
 		s->dir==DIR_UP?"up":"down", stroke, stroke->num_points - 1 - pos);
 #endif
 	event_t* e = event_new();
@@ -522,7 +540,7 @@ static void advance_stroke(queue_t*queue, hqueue_t*hqueue, gfxpolystroke_t*strok
 	e->s1 = s;
 	e->s2 = 0;
 	
-	if(queue) queue_put(queue, e);
+	if(!hqueue) queue_put(&status->queue, e);
 	else hqueue_put(hqueue, e);
 
 	if(e->type != EVENT_HORIZONTAL) {
@@ -535,7 +553,7 @@ static void advance_stroke(queue_t*queue, hqueue_t*hqueue, gfxpolystroke_t*strok
     }
 }
 
-static void gfxpoly_enqueue(gfxpoly_t*p, queue_t*queue, hqueue_t*hqueue, int polygon_nr)
+static void gfxpoly_enqueue(gfxpoly_t*p, status_t*status, hqueue_t*hqueue, int polygon_nr)
 {
     int t;
     gfxpolystroke_t*stroke = p->strokes;
@@ -548,7 +566,7 @@ static void gfxpoly_enqueue(gfxpoly_t*p, queue_t*queue, hqueue_t*hqueue, int pol
 	    assert(stroke->points[s].y <= stroke->points[s+1].y);
 	}
 #endif
-	advance_stroke(queue, hqueue, stroke, polygon_nr, 0, p->gridsize);
+	advance_stroke(status, hqueue, stroke, polygon_nr, 0);
     }
 }
 
@@ -1408,13 +1426,14 @@ static void event_apply(status_t*status, event_t*e)
 #ifdef DEBUG
     event_dump(status, e);
 #endif
+    GFXPOLY_STAT(status->stats, events);
 
     switch(e->type) {
         case EVENT_HORIZONTAL: {
             segment_t*s = e->s1;
             intersect_with_horizontal(status, s);
 	    store_horizontal(status, s->a, s->b, s->fs, s->dir, s->polygon_nr);
-	    advance_stroke(&status->queue, 0, s->stroke, s->polygon_nr, s->stroke_pos, status->gridsize);
+	    advance_stroke(status, 0, s->stroke, s->polygon_nr, s->stroke_pos);
             segment_destroy(s);e->s1=0;
             break;
         }
@@ -1436,7 +1455,7 @@ static void event_apply(status_t*status, event_t*e)
 	    /* schedule segment for xrow handling */
             s->left = 0; s->right = status->ending_segments;
             status->ending_segments = s;
-	    advance_stroke(&status->queue, 0, s->stroke, s->polygon_nr, s->stroke_pos, status->gridsize);
+	    advance_stroke(status, 0, s->stroke, s->polygon_nr, s->stroke_pos);
             break;
         }
         case EVENT_START: {
@@ -1457,6 +1476,7 @@ static void event_apply(status_t*status, event_t*e)
             // exchange two segments
             if(e->s1->right == e->s2) {
 		assert(e->s2->left == e->s1);
+		GFXPOLY_STAT(status->stats, crossings);
                 exchange_two(status, e);
             } else {
 		assert(e->s2->left != e->s1);
@@ -1501,7 +1521,9 @@ static void check_status(status_t*status)
 }
 #endif
 
-gfxpoly_t* gfxpoly_process(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule, windcontext_t*context, moments_t*moments)
+/* run the sweep over all scanlines up to (and including) stop_y.
+   Operation counts go to stats (if compiled with GFXPOLY_STATS). */
+static gfxpoly_t* sweep(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule, windcontext_t*context, moments_t*moments, int32_t stop_y, gfxpoly_stats_t*stats)
 {
     current_polygon = poly1;
 
@@ -1510,13 +1532,17 @@ gfxpoly_t* gfxpoly_process(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule
     status.gridsize = poly1->gridsize;
     status.windrule = windrule;
     status.context = context;
+    status.stats = stats;
     status.actlist = actlist_new();
+#ifdef GFXPOLY_STATS
+    status.actlist->stats = stats;
+#endif
 
     queue_init(&status.queue);
-    gfxpoly_enqueue(poly1, &status.queue, 0, /*polygon nr*/0);
+    gfxpoly_enqueue(poly1, &status, 0, /*polygon nr*/0);
     if(poly2) {
 	assert(poly1->gridsize == poly2->gridsize);
-	gfxpoly_enqueue(poly2, &status.queue, 0, /*polygon nr*/1);
+	gfxpoly_enqueue(poly2, &status, 0, /*polygon nr*/1);
     }
 
 #ifdef CHECKS
@@ -1581,6 +1607,21 @@ gfxpoly_t* gfxpoly_process(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule
         dict_destroy(status.segs_with_point);
 #endif
 	lasty = status.y;
+	if(status.y >= stop_y)
+	    break;
+    }
+    /* if we stopped early, there might still be segments left */
+    segment_t*s = status.actlist->list;
+    while(s) {
+	segment_t*next = s->right;
+	segment_destroy(s);
+	s = next;
+    }
+    while(e) {
+	if(e->type == EVENT_START || e->type == EVENT_HORIZONTAL)
+	    segment_destroy(e->s1);
+	event_free(e);
+	e = queue_get(&status.queue);
     }
 #ifdef CHECKS
     dict_destroy(status.seen_crossings);
@@ -1606,6 +1647,364 @@ gfxpoly_t* gfxpoly_process(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule
     return p;
 }
 
+gfxpoly_t* gfxpoly_process(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule, windcontext_t*context, moments_t*moments)
+{
+    return sweep(poly1, poly2, windrule, context, moments, INT_MAX, GLOBAL_STATS);
+}
+
+/* ------------------------------ tiled mode ------------------------------ */
+
+/* For big polygons, gfxpoly_process_tiled() cuts the input into horizontal
+   bands and runs an independent sweep over every band, on several threads.
+
+   Bands are separated by seams at scanlines which don't contain any input
+   point. Segments crossing a seam are split there, at the grid point closest
+   to the actual intersection, and both halves use that same point. (Rounding
+   is monotonic, so split segments keep their left-to-right order.)
+   The result is exactly what a single sweep over the split segments would
+   produce: Scanlines below a seam only ever see segments of the lower band.
+   The seam scanline itself, however, also needs to know about the segments
+   starting there (for snapping and for horizontal fragments), so the upper
+   band also gets the first segment below the seam of every split stroke, and
+   stops sweeping right after the seam.
+   The output strokes are joined again at the seams afterwards. Compared to
+   gfxpoly_process(), there may be a few more points, where segments crossed
+   a seam. */
+
+/* don't bother splitting polygons smaller than this (in segments) */
+#define TILED_MIN_SEGMENTS_PER_BAND 256
+
+typedef struct _band {
+    int32_t y1, y2;
+    gfxpoly_t*in[2];
+    gfxpoly_t*out;
+    gfxpoly_stats_t stats;
+} band_t;
+
+typedef struct _tiledjob {
+    band_t*bands;
+    windrule_t*windrule;
+    windcontext_t*context;
+} tiledjob_t;
+
+static int compare_int32(const void*_a, const void*_b)
+{
+    int32_t a = *(const int32_t*)_a;
+    int32_t b = *(const int32_t*)_b;
+    return a<b?-1:(a>b?1:0);
+}
+
+static int gfxpoly_num_points(gfxpoly_t*poly)
+{
+    int num = 0;
+    gfxpolystroke_t*stroke = poly->strokes;
+    for(;stroke;stroke=stroke->next) {
+	num += stroke->num_points;
+    }
+    return num;
+}
+
+static int collect_y(gfxpoly_t*poly, int32_t*ys)
+{
+    int num = 0;
+    int t;
+    gfxpolystroke_t*stroke = poly->strokes;
+    for(;stroke;stroke=stroke->next) {
+	for(t=0;t<stroke->num_points;t++) {
+	    ys[num++] = stroke->points[t].y;
+	}
+    }
+    return num;
+}
+
+/* the grid point on the segment a-b at scanline y (a.y < y < b.y) */
+static point_t cut_segment(point_t a, point_t b, int32_t y)
+{
+    int64_t dy = (int64_t)b.y - a.y;
+    int64_t num = (int64_t)a.x*dy + ((int64_t)b.x - a.x)*((int64_t)y - a.y);
+    /* round(num/dy), with dy>0 */
+    int64_t n2 = 2*num + dy, d2 = 2*dy;
+    int64_t x = n2>=0 ? n2/d2 : -((-n2+d2-1)/d2);
+    point_t p;
+    p.x = (int32_t)x;
+    p.y = y;
+    return p;
+}
+
+static gfxpolystroke_t* band_add_stroke(band_t*band, int nr, gfxpolystroke_t*from, int size)
+{
+    gfxpolystroke_t*stroke = rfx_calloc(sizeof(gfxpolystroke_t));
+    stroke->dir = from->dir;
+    stroke->fs = from->fs;
+    stroke->points_size = size;
+    stroke->points = rfx_alloc(sizeof(point_t)*size);
+    stroke->next = band->in[nr]->strokes;
+    band->in[nr]->strokes = stroke;
+    return stroke;
+}
+
+static void band_add_point(band_t*bands, int b, int nr, gfxpolystroke_t*from, gfxpolystroke_t*s, point_t p)
+{
+    if(s->num_points == 1 && b>0 && s->points[0].y == bands[b].y1) {
+	/* first segment below a seam, also needed by the band above */
+	gfxpolystroke_t*stub = band_add_stroke(&bands[b-1], nr, from, 2);
+	stub->points[0] = s->points[0];
+	stub->points[1] = p;
+	stub->num_points = 2;
+    }
+    s->points[s->num_points++] = p;
+}
+
+static void split_into_bands(gfxpoly_t*poly, int nr, band_t*bands, int num_bands)
+{
+    gfxpolystroke_t*stroke = poly->strokes;
+    for(;stroke;stroke=stroke->next) {
+	int b = 0;
+	while(stroke->points[0].y > bands[b].y2)
+	    b++;
+	gfxpolystroke_t*s = 0;
+	int t;
+	for(t=1;t<stroke->num_points;t++) {
+	    point_t p1 = stroke->points[t-1];
+	    point_t p2 = stroke->points[t];
+	    while(p2.y > bands[b].y2) {
+		/* this segment crosses the seam at the end of the current band */
+		point_t cut = cut_segment(p1, p2, bands[b].y2);
+		if(!s) {
+		    s = band_add_stroke(&bands[b], nr, stroke, t+1);
+		    memcpy(s->points, stroke->points, sizeof(point_t)*t);
+		    s->num_points = t;
+		} 
+		band_add_point(bands, b, nr, stroke, s, cut);
+		b++;
+		s = band_add_stroke(&bands[b], nr, stroke, stroke->num_points-t+1);
+		s->points[0] = cut;
+		s->num_points = 1;
+	    }
+	    if(s)
+		band_add_point(bands, b, nr, stroke, s, p2);
+	}
+	if(!s) {
+	    /* completely inside one band */
+	    s = band_add_stroke(&bands[b], nr, stroke, stroke->num_points);
+	    memcpy(s->points, stroke->points, sizeof(point_t)*stroke->num_points);
+	    s->num_points = stroke->num_points;
+	}
+    }
+}
+
+static void process_band(void*data, int job, int thread)
+{
+    tiledjob_t*j = (tiledjob_t*)data;
+    band_t*band = &j->bands[job];
+    band->out = sweep(band->in[0], band->in[1], j->windrule, j->context, 0, band->y2, &band->stats);
+    gfxpoly_destroy(band->in[0]);band->in[0] = 0;
+    if(band->in[1]) {
+	gfxpoly_destroy(band->in[1]);band->in[1] = 0;
+    }
+}
+
+static int compare_stroke_ends(const void*_a, const void*_b)
+{
+    gfxpolystroke_t*a = *(gfxpolystroke_t**)_a;
+    gfxpolystroke_t*b = *(gfxpolystroke_t**)_b;
+    int32_t xa = a->points[a->num_points-1].x;
+    int32_t xb = b->points[b->num_points-1].x;
+    if(xa != xb) return xa<xb?-1:1;
+    if(a->fs != b->fs) return (ptroff_t)a->fs<(ptroff_t)b->fs?-1:1;
+    if(a->dir != b->dir) return a->dir<b->dir?-1:1;
+    return 0;
+}
+
+/* find (and remove) a stroke ending at point p, with the given edgestyle and direction */
+static gfxpolystroke_t* find_stroke_end(gfxpolystroke_t**ends, int num, point_t p, edgestyle_t*fs, segment_dir_t dir)
+{
+    gfxpolystroke_t key;
+    key.points = &p;
+    key.num_points = 1;
+    key.fs = fs;
+    key.dir = dir;
+    gfxpolystroke_t*k = &key;
+    int lo = 0, hi = num;
+    while(lo < hi) {
+	int mid = (lo+hi)/2;
+	if(!ends[mid] || compare_stroke_ends(&ends[mid], &k) < 0)
+	    lo = mid+1;
+	else
+	    hi = mid;
+    }
+    /* strokes which were already used are set to NULL, skip them */
+    for(;lo<num;lo++) {
+	if(!ends[lo]) 
+	    continue;
+	if(compare_stroke_ends(&ends[lo], &k))
+	    break;
+	gfxpolystroke_t*found = ends[lo];
+	ends[lo] = 0;
+	return found;
+    }
+    return 0;
+}
+
+/* join the output of all bands into one polygon, gluing together
+   strokes which meet at a seam */
+static gfxpolystroke_t* join_bands(band_t*bands, int num_bands)
+{
+    gfxpolystroke_t*result = bands[0].out->strokes;
+    bands[0].out->strokes = 0;
+    gfxpolystroke_t**ends = 0;
+    int num_ends = 0;
+    int ends_size = 0;
+    gfxpolystroke_t*stroke;
+
+    /* strokes reaching the bottom of the previous band */
+    for(stroke=result;stroke;stroke=stroke->next) {
+	if(stroke->points[stroke->num_points-1].y == bands[0].y2) {
+	    if(num_ends == ends_size) {
+		ends_size = ends_size?ends_size*2:64;
+		ends = rfx_realloc(ends, sizeof(gfxpolystroke_t*)*ends_size);
+	    }
+	    ends[num_ends++] = stroke;
+	}
+    }
+
+    int b;
+    for(b=1;b<num_bands;b++) {
+	int32_t seam = bands[b-1].y2;
+	/* NULL entries (already continued strokes) may be left over from the
+	   previous seam, sorting only has to handle valid ones */
+	int t, n = 0;
+	for(t=0;t<num_ends;t++) {
+	    if(ends[t]) ends[n++] = ends[t];
+	}
+	num_ends = n;
+	qsort(ends, num_ends, sizeof(gfxpolystroke_t*), compare_stroke_ends);
+
+	gfxpolystroke_t**next_ends = 0;
+	int num_next_ends = 0;
+	int next_ends_size = 0;
+
+	stroke = bands[b].out->strokes;
+	bands[b].out->strokes = 0;
+	while(stroke) {
+	    gfxpolystroke_t*next = stroke->next;
+	    gfxpolystroke_t*joined = 0;
+	    if(stroke->points[0].y == seam) {
+		joined = find_stroke_end(ends, num_ends, stroke->points[0], stroke->fs, stroke->dir);
+	    }
+	    if(joined) {
+		int num = joined->num_points + stroke->num_points - 1;
+		if(num > joined->points_size) {
+		    joined->points_size = num;
+		    joined->points = rfx_realloc(joined->points, sizeof(point_t)*num);
+		}
+		memcpy(&joined->points[joined->num_points], &stroke->points[1], sizeof(point_t)*(stroke->num_points-1));
+		joined->num_points = num;
+		free(stroke->points);
+		free(stroke);
+		stroke = joined;
+	    } else {
+		stroke->next = result;
+		result = stroke;
+	    }
+	    if(b<num_bands-1 && stroke->points[stroke->num_points-1].y == bands[b].y2) {
+		if(num_next_ends == next_ends_size) {
+		    next_ends_size = next_ends_size?next_ends_size*2:64;
+		    next_ends = rfx_realloc(next_ends, sizeof(gfxpolystroke_t*)*next_ends_size);
+		}
+		next_ends[num_next_ends++] = stroke;
+	    }
+	    stroke = next;
+	}
+	free(ends);
+	ends = next_ends;
+	num_ends = num_next_ends;
+	ends_size = next_ends_size;
+    }
+    free(ends);
+    return result;
+}
+
+gfxpoly_t* gfxpoly_process_tiled(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule, windcontext_t*context, int num_threads)
+{
+    int num_points = gfxpoly_num_points(poly1) + (poly2?gfxpoly_num_points(poly2):0);
+    int num_bands = num_threads;
+    if(num_bands > num_points / TILED_MIN_SEGMENTS_PER_BAND)
+	num_bands = num_points / TILED_MIN_SEGMENTS_PER_BAND;
+    if(num_bands <= 1)
+	return gfxpoly_process(poly1, poly2, windrule, context, 0);
+    assert(!poly2 || poly1->gridsize == poly2->gridsize);
+
+    /* choose seams such that every band gets roughly the same
+       number of points */
+    int32_t*ys = rfx_alloc(sizeof(int32_t)*num_points);
+    int n = collect_y(poly1, ys);
+    if(poly2)
+	n += collect_y(poly2, &ys[n]);
+    qsort(ys, num_points, sizeof(int32_t), compare_int32);
+
+    band_t*bands = rfx_calloc(sizeof(band_t)*num_bands);
+    int b = 0, pos = 0;
+    bands[0].y1 = INT_MIN;
+    while(b < num_bands-1) {
+	int t = (int)((int64_t)num_points*(b+1)/num_bands);
+	if(t < pos) t = pos;
+	/* search for a scanline without points */
+	while(t<num_points-1 && ys[t+1]-ys[t] <= 1)
+	    t++;
+	if(t>=num_points-1)
+	    break;
+	bands[b].y2 = ys[t]+1;
+	bands[b+1].y1 = ys[t]+1;
+	b++;
+	pos = t+1;
+    }
+    num_bands = b+1;
+    bands[num_bands-1].y2 = INT_MAX;
+    free(ys);
+
+    if(num_bands <= 1) {
+	free(bands);
+	return gfxpoly_process(poly1, poly2, windrule, context, 0);
+    }
+
+    for(b=0;b<num_bands;b++) {
+	bands[b].in[0] = rfx_calloc(sizeof(gfxpoly_t));
+	bands[b].in[0]->gridsize = poly1->gridsize;
+	if(poly2) {
+	    bands[b].in[1] = rfx_calloc(sizeof(gfxpoly_t));
+	    bands[b].in[1]->gridsize = poly1->gridsize;
+	}
+    }
+    split_into_bands(poly1, 0, bands, num_bands);
+    if(poly2)
+	split_into_bands(poly2, 1, bands, num_bands);
+
+    tiledjob_t job;
+    job.bands = bands;
+    job.windrule = windrule;
+    job.context = context;
+    threads_run(num_threads, num_bands, process_band, &job);
+
+#ifdef GFXPOLY_STATS
+    for(b=0;b<num_bands;b++) {
+	gfxpoly_stats.segments += bands[b].stats.segments;
+	gfxpoly_stats.events += bands[b].stats.events;
+	gfxpoly_stats.crossings += bands[b].stats.crossings;
+	gfxpoly_stats.rotations += bands[b].stats.rotations;
+    }
+#endif
+
+    gfxpoly_t*p = (gfxpoly_t*)rfx_alloc(sizeof(gfxpoly_t));
+    p->gridsize = poly1->gridsize;
+    p->strokes = join_bands(bands, num_bands);
+    for(b=0;b<num_bands;b++) {
+	gfxpoly_destroy(bands[b].out);
+    }
+    free(bands);
+    return p;
+}
+
 static windcontext_t onepolygon = {1};
 static windcontext_t twopolygons = {2};
 gfxpoly_t* gfxpoly_intersect(gfxpoly_t*p1, gfxpoly_t*p2)
@@ -1616,6 +2015,14 @@ gfxpoly_t* gfxpoly_union(gfxpoly_t*p1, gfxpoly_t*p2)
 {
     return gfxpoly_process(p1, p2, &windrule_union, &twopolygons, 0);
 }
+gfxpoly_t* gfxpoly_intersect_tiled(gfxpoly_t*p1, gfxpoly_t*p2, int num_threads)
+{
+    return gfxpoly_process_tiled(p1, p2, &windrule_intersect, &twopolygons, num_threads);
+}
+gfxpoly_t* gfxpoly_union_tiled(gfxpoly_t*p1, gfxpoly_t*p2, int num_threads)
+{
+    return gfxpoly_process_tiled(p1, p2, &windrule_union, &twopolygons, num_threads);
+}
 double gfxpoly_area(gfxpoly_t*p)
 {
     moments_t moments;
@@ -93,6 +93,22 @@ typedef struct _moments {
 #define XDIFF(s1,s2,ypos) (((s1)->k + (double)(s1)->delta.x*ypos)*(s2)->delta.y - \
                            ((s2)->k + (double)(s2)->delta.x*ypos)*(s1)->delta.y)
 
+/* operation counts, for benchmarking (see bench.c). Every sweep counts
+   into its own struct, so that the bands of a tiled operation don't
+   race on the counters. */
+typedef struct _gfxpoly_stats {
+    uint64_t segments;  // segments read from the input polygon(s)
+    uint64_t events;    // events taken from the queue
+    uint64_t crossings; // segment exchanges
+    uint64_t rotations; // rotations in the active list splay tree
+} gfxpoly_stats_t;
+#ifdef GFXPOLY_STATS
+extern gfxpoly_stats_t gfxpoly_stats;
+#define GFXPOLY_STAT(stats,x) ((stats)->x++)
+#else
+#define GFXPOLY_STAT(stats,x)
+#endif
+
 void gfxpoly_fail(char*expr, char*file, int line, const char*function);
 
 char gfxpoly_check(gfxpoly_t*poly, char updown);
@@ -102,9 +118,14 @@ void gfxpoly_dump(gfxpoly_t*poly);
 void gfxpoly_save(gfxpoly_t*poly, const char*filename);
 void gfxpoly_save_arrows(gfxpoly_t*poly, const char*filename);
 gfxpoly_t* gfxpoly_process(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule, windcontext_t*context, moments_t*moments);
+/* like gfxpoly_process, but splits the polygon(s) into horizontal bands
+   which are processed on (up to) num_threads threads */
+gfxpoly_t* gfxpoly_process_tiled(gfxpoly_t*poly1, gfxpoly_t*poly2, windrule_t*windrule, windcontext_t*context, int num_threads);
 
 gfxpoly_t* gfxpoly_intersect(gfxpoly_t*p1, gfxpoly_t*p2);
 gfxpoly_t* gfxpoly_union(gfxpoly_t*p1, gfxpoly_t*p2);
+gfxpoly_t* gfxpoly_intersect_tiled(gfxpoly_t*p1, gfxpoly_t*p2, int num_threads);
+gfxpoly_t* gfxpoly_union_tiled(gfxpoly_t*p1, gfxpoly_t*p2, int num_threads);
 double gfxpoly_area(gfxpoly_t*p);
 double gfxpoly_intersection_area(gfxpoly_t*p1, gfxpoly_t*p2);
 
@@ -0,0 +1,290 @@
+/* test_simd.c
+
+   Checks that the SIMD kernels produce exactly the same results as the
+   plain C versions they replace.
+
+   Every test runs a fixed set of randomly generated cases twice: first
+   with whatever SIMD level the CPU supports, then again after switching
+   the SIMD code off (the *_disable_simd() functions can't be undone, so
+   the inputs are regenerated from the same seed). Returns nonzero if any
+   result differs.
+
+   Usage: test_simd
+
+   Part of the swftools package.
+
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+#include "../gfxdevice.h"
+#include "../spanfill.h"
+#include "../gfxtools.h"
+#include "../gfxpath.h"
+#include "../gfximage.h"
+
+static U32 seed;
+
+static U32 rnd()
+{
+    seed = seed*1103515245+12345;
+    return seed>>8;
+}
+
+static gfxcolor_t rnd_color()
+{
+    gfxcolor_t c;
+    c.r = rnd();c.g = rnd();c.b = rnd();c.a = rnd();
+    /* fully opaque and fully transparent colors take separate code paths */
+    switch(rnd()%4) {
+	case 0: c.a = 255;break;
+	case 1: c.a = 0;break;
+    }
+    return c;
+}
+
+static gfxcolor_t rnd_premultiplied()
+{
+    gfxcolor_t c = rnd_color();
+    c.r = c.r*c.a/255;
+    c.g = c.g*c.a/255;
+    c.b = c.b*c.a/255;
+    return c;
+}
+
+static int report(const char*test, int nr, int errors)
+{
+    if(errors < 10)
+	fprintf(stderr, "%s: case %d differs\n", test, nr);
+    return errors+1;
+}
+
+/* ------------------------------ spanfill ------------------------------ */
+
+#define SPAN_CASES 4000
+#define SPAN_WIDTH 200
+
+static int test_spanfill()
+{
+    gfxcolor_t*lines = malloc(sizeof(gfxcolor_t)*SPAN_WIDTH*SPAN_CASES);
+    int*zs = malloc(sizeof(int)*SPAN_WIDTH*SPAN_CASES);
+    gfxcolor_t line[SPAN_WIDTH], src[SPAN_WIDTH];
+    int z[SPAN_WIDTH];
+    U32 mask[(SPAN_WIDTH+31)/32];
+    int errors = 0;
+    int pass, t, x;
+    for(pass=0;pass<2;pass++) {
+	if(pass)
+	    spanfill_disable_simd();
+	seed = 1;
+	for(t=0;t<SPAN_CASES;t++) {
+	    for(x=0;x<SPAN_WIDTH;x++) {
+		line[x] = rnd_color();
+		src[x] = rnd_premultiplied();
+		z[x] = rnd()%4;
+	    }
+	    for(x=0;x<(SPAN_WIDTH+31)/32;x++) {
+		/* mix of empty, full and partial mask words */
+		int type = rnd()%3;
+		mask[x] = type==0?0:(type==1?0xffffffff:(rnd()^(rnd()<<16)));
+	    }
+	    int x1 = rnd()%SPAN_WIDTH;
+	    int x2 = x1 + rnd()%(SPAN_WIDTH-x1+1);
+	    U32 depth = rnd()%4;
+	    gfxcolor_t col = rnd_color();
+	    switch(t%4) {
+		case 0: spanfill_solid_bitmask(line, mask, x1, x2, col);break;
+		case 1: spanfill_blend_bitmask(line, mask, x1, x2, src);break;
+		case 2: spanfill_solid_depth(line, z, depth, x1, x2, col);break;
+		case 3: spanfill_blend_depth(line, z, depth, x1, x2, src);break;
+	    }
+	    gfxcolor_t*l = &lines[t*SPAN_WIDTH];
+	    int*zz = &zs[t*SPAN_WIDTH];
+	    if(!pass) {
+		memcpy(l, line, sizeof(line));
+		memcpy(zz, z, sizeof(z));
+	    } else if(memcmp(l, line, sizeof(line)) || memcmp(zz, z, sizeof(z))) {
+		errors = report("spanfill", t, errors);
+	    }
+	}
+    }
+    free(lines);
+    free(zs);
+    return errors;
+}
+
+/* ------------------------------- gfxpath ------------------------------ */
+
+#define PATH_CASES 2000
+#define PATH_MAX 64
+/* two bboxes, and x,y,sx,sy of every segment after both transforms */
+#define PATH_RESULT (8+PATH_MAX*8)
+
+static double rnd_coord()
+{
+    /* exact zeros and small integers hit the special cases of the bbox code */
+    switch(rnd()%4) {
+	case 0: return 0;
+	case 1: return (int)(rnd()%16)-8;
+	default: return ((int)(rnd()%200000)-100000)/64.0;
+    }
+}
+
+static void store_bbox(double*r, gfxbbox_t b)
+{
+    r[0] = b.xmin;r[1] = b.ymin;r[2] = b.xmax;r[3] = b.ymax;
+}
+
+static void store_path(double*r, gfxpath_t*path)
+{
+    int t;
+    for(t=0;t<path->num;t++) {
+	r[t*4+0] = path->x[t];
+	r[t*4+1] = path->y[t];
+	/* control points of non-splines are undefined */
+	r[t*4+2] = path->type[t]==gfx_splineTo?path->sx[t]:0;
+	r[t*4+3] = path->type[t]==gfx_splineTo?path->sy[t]:0;
+    }
+}
+
+static int same_bbox(gfxbbox_t b1, gfxbbox_t b2)
+{
+    return b1.xmin==b2.xmin && b1.ymin==b2.ymin && b1.xmax==b2.xmax && b1.ymax==b2.ymax;
+}
+
+static int test_gfxpath()
+{
+    double*results = malloc(sizeof(double)*PATH_RESULT*PATH_CASES);
+    double r[PATH_RESULT];
+    gfxpath_t*path = gfxpath_new();
+    gfxpath_t*dest = gfxpath_new();
+    int errors = 0;
+    int pass, t, i;
+    for(pass=0;pass<2;pass++) {
+	if(pass)
+	    gfxpath_disable_simd();
+	seed = 2;
+	for(t=0;t<PATH_CASES;t++) {
+	    int num = rnd()%(PATH_MAX+1);
+	    gfxpath_clear(path);
+	    for(i=0;i<num;i++) {
+		int type = rnd()%4;
+		gfx_linetype lt = type==0?gfx_moveTo:(type==1?gfx_splineTo:gfx_lineTo);
+		double x = rnd_coord(), y = rnd_coord();
+		double sx = lt==gfx_splineTo?rnd_coord():0;
+		double sy = lt==gfx_splineTo?rnd_coord():0;
+		gfxpath_add(path, lt, x, y, sx, sy);
+	    }
+	    gfxmatrix_t m;
+	    m.m00 = rnd_coord();m.m10 = rnd_coord();m.tx = rnd_coord();
+	    m.m01 = rnd_coord();m.m11 = rnd_coord();m.ty = rnd_coord();
+
+	    memset(r, 0, sizeof(r));
+	    gfxbbox_t b1 = gfxpath_getbbox(path);
+	    store_bbox(&r[0], b1);
+	    gfxpath_transform_to(dest, path, &m);
+	    gfxbbox_t b2 = gfxpath_getbbox(dest);
+	    store_bbox(&r[4], b2);
+	    store_path(&r[8], dest);
+	    gfxpath_transform(path, &m);
+	    store_path(&r[8+PATH_MAX*4], path);
+
+	    /* the packed path functions also have to agree with their
+	       gfxline counterparts */
+	    gfxline_t*line = gfxpath_to_gfxline(path);
+	    gfxbbox_t b3 = gfxline_getbbox(line);
+	    gfxline_free(line);
+	    if(!same_bbox(b2, b3))
+		errors = report("gfxpath_getbbox vs gfxline_getbbox", t, errors);
+
+	    double*res = &results[t*PATH_RESULT];
+	    if(!pass)
+		memcpy(res, r, sizeof(r));
+	    else if(memcmp(res, r, sizeof(r)))
+		errors = report("gfxpath", t, errors);
+	}
+    }
+    gfxpath_free(path);
+    gfxpath_free(dest);
+    free(results);
+    return errors;
+}
+
+/* ------------------------------ gfximage ------------------------------ */
+
+#define IMAGE_CASES 400
+#define IMAGE_MAX 100
+
+static int test_gfximage()
+{
+    gfximage_t**results = calloc(IMAGE_CASES, sizeof(gfximage_t*));
+    int errors = 0;
+    int pass, t, i;
+    for(pass=0;pass<2;pass++) {
+	if(pass)
+	    gfximage_disable_simd();
+	seed = 3;
+	for(t=0;t<IMAGE_CASES;t++) {
+	    int width = 1+rnd()%IMAGE_MAX;
+	    int height = 1+rnd()%IMAGE_MAX;
+	    gfximage_t*img = gfximage_new(width, height);
+	    for(i=0;i<width*height;i++)
+		img->data[i] = rnd_premultiplied();
+	    int newwidth = 1+rnd()%(IMAGE_MAX*2);
+	    int newheight = 1+rnd()%(IMAGE_MAX*2);
+	    int radius = 1+rnd()%16;
+	    int threads = 1+rnd()%3;
+	    gfximage_t*result;
+	    switch(t%4) {
+		case 0: result = gfximage_rescale2(img, newwidth, newheight, gfxrescale_box, threads);break;
+		case 1: result = gfximage_rescale2(img, newwidth, newheight, gfxrescale_bilinear, threads);break;
+		case 2: result = gfximage_rescale2(img, newwidth, newheight, gfxrescale_lanczos, threads);break;
+		default: gfximage_blur(img, radius, threads);result = img;img = 0;break;
+	    }
+	    if(img)
+		gfximage_free(img);
+	    if(!pass) {
+		results[t] = result;
+	    } else {
+		gfximage_t*r = results[t];
+		if(r->width != result->width || r->height != result->height ||
+		   memcmp(r->data, result->data, sizeof(gfxcolor_t)*r->width*r->height))
+		    errors = report("gfximage", t, errors);
+		gfximage_free(r);
+		gfximage_free(result);
+	    }
+	}
+    }
+    free(results);
+    return errors;
+}
+
+int main(int argn, char*argv[])
+{
+    int errors = 0;
+    errors += test_spanfill();
+    errors += test_gfxpath();
+    errors += test_gfximage();
+    if(errors) {
+	printf("%d errors\n", errors);
+	return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
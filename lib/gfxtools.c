@@ -32,18 +32,87 @@
 #include "jpeg.h"
 #include "q.h"
 
+#define LINEARENA_BLOCKSIZE 1024
+
+typedef struct _linearena_block
+{
+    struct _linearena_block*next;
+    gfxline_t nodes[LINEARENA_BLOCKSIZE];
+} linearena_block_t;
+
+struct _gfxlinearena
+{
+    linearena_block_t*blocks;
+    int used; // nodes used in the first block
+    gfxline_t*free;
+};
+
+gfxlinearena_t* gfxlinearena_new()
+{
+    return (gfxlinearena_t*)rfx_calloc(sizeof(gfxlinearena_t));
+}
+gfxline_t* gfxlinearena_alloc(gfxlinearena_t*arena)
+{
+    gfxline_t*l;
+    if(arena->free) {
+	l = arena->free;
+	arena->free = l->next;
+    } else {
+	if(!arena->blocks || arena->used == LINEARENA_BLOCKSIZE) {
+	    linearena_block_t*b = (linearena_block_t*)rfx_alloc(sizeof(linearena_block_t));
+	    b->next = arena->blocks;
+	    arena->blocks = b;
+	    arena->used = 0;
+	}
+	l = &arena->blocks->nodes[arena->used++];
+    }
+    memset(l, 0, sizeof(gfxline_t));
+    return l;
+}
+void gfxlinearena_reset(gfxlinearena_t*arena)
+{
+    /* keep one block around for the next page */
+    linearena_block_t*b = arena->blocks;
+    if(b) {
+	linearena_block_t*next = b->next;
+	b->next = 0;
+	while(next) {
+	    b = next->next;
+	    rfx_free(next);
+	    next = b;
+	}
+    }
+    arena->used = 0;
+    arena->free = 0;
+}
+void gfxlinearena_destroy(gfxlinearena_t*arena)
+{
+    gfxlinearena_reset(arena);
+    if(arena->blocks)
+	rfx_free(arena->blocks);
+    rfx_free(arena);
+}
+
 typedef struct _linedraw_internal
 {
     gfxline_t*start;
     gfxline_t*next;
     gfxcoord_t x0,y0;
     char has_moveto;
+    gfxlinearena_t*arena;
 } linedraw_internal_t;
 
+static gfxline_t* linedraw_newnode(linedraw_internal_t*i)
+{
+    if(i->arena)
+	return gfxlinearena_alloc(i->arena);
+    return (gfxline_t*)rfx_alloc(sizeof(gfxline_t));
+}
+
 static void linedraw_moveTo(gfxdrawer_t*d, gfxcoord_t x, gfxcoord_t y)
 {
     linedraw_internal_t*i = (linedraw_internal_t*)d->internal;
-    gfxline_t*l = (gfxline_t*)rfx_alloc(sizeof(gfxline_t));
+    gfxline_t*l = linedraw_newnode(i);
     l->type = gfx_moveTo;
     i->has_moveto = 1;
     i->x0 = x;
@@ -68,7 +137,7 @@ static void linedraw_lineTo(gfxdrawer_t*d, gfxcoord_t x, gfxcoord_t y)
 	return;
     }
     
-    gfxline_t*l = (gfxline_t*)rfx_alloc(sizeof(gfxline_t));
+    gfxline_t*l = linedraw_newnode(i);
     l->type = gfx_lineTo;
     d->x = l->x = x;
     d->y = l->y = y;
@@ -88,7 +157,7 @@ static void linedraw_splineTo(gfxdrawer_t*d, gfxcoord_t sx, gfxcoord_t sy, gfxco
 	return;
     }
 
-    gfxline_t*l = (gfxline_t*)rfx_alloc(sizeof(gfxline_t));
+    gfxline_t*l = linedraw_newnode(i);
     l->type = gfx_splineTo;
     d->x = l->x = x;
     d->y = l->y = y;
@@ -133,6 +202,12 @@ void gfxdrawer_target_gfxline(gfxdrawer_t*d)
     d->result = linedraw_result;
 }
 
+void gfxdrawer_target_gfxline_arena(gfxdrawer_t*d, gfxlinearena_t*arena)
+{
+    gfxdrawer_target_gfxline(d);
+    ((linedraw_internal_t*)d->internal)->arena = arena;
+}
+
 typedef struct _qspline_abc
 {
     double ax,bx,cx;
@@ -406,11 +481,15 @@ gfxline_t*gfxline_fromstring(const char*string)
 
 
 gfxline_t * gfxline_clone(gfxline_t*line)
+{
+    return gfxline_clone_arena(line, 0);
+}
+gfxline_t * gfxline_clone_arena(gfxline_t*line, gfxlinearena_t*arena)
 {
     gfxline_t*dest = 0;
     gfxline_t*pos = 0;
     while(line) {
-	gfxline_t*n = (gfxline_t*)rfx_calloc(sizeof(gfxline_t));
+	gfxline_t*n = arena?gfxlinearena_alloc(arena):(gfxline_t*)rfx_calloc(sizeof(gfxline_t));
 	*n = *line;
 	n->next = 0;
 	if(!pos) {
@@ -441,6 +520,10 @@ static char splineIsStraight(double x, double y, gfxline_t*l)
 }
 
 void gfxline_optimize(gfxline_t*line)
+{
+    gfxline_optimize_arena(line, 0);
+}
+void gfxline_optimize_arena(gfxline_t*line, gfxlinearena_t*arena)
 {
     gfxline_t*l = line;
     /* step 1: convert splines to lines, where possible */
@@ -477,7 +560,12 @@ void gfxline_optimize(gfxline_t*line)
 	    l->y = next->y;
 	    l->sx = sx;
 	    l->sy = sy;
-	    rfx_free(next);
+	    if(arena) {
+		next->next = arena->free;
+		arena->free = next;
+	    } else {
+		rfx_free(next);
+	    }
 	} else {
 	    x = l->x;
 	    y = l->y;
@@ -512,6 +600,21 @@ void gfxline_show(gfxline_t*l, FILE*fi)
     }
 }
 
+void gfxline_free_arena(gfxline_t*l, gfxlinearena_t*arena)
+{
+    if(!arena) {
+	gfxline_free(l);
+	return;
+    }
+    if(!l)
+	return;
+    gfxline_t*last = l;
+    while(last->next)
+	last = last->next;
+    last->next = arena->free;
+    arena->free = l;
+}
+
 void gfxline_free(gfxline_t*l)
 {
     if(l && (l+1) == l->next) {
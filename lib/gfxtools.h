@@ -54,7 +54,11 @@ typedef struct _gfxfontlist
     struct _gfxfontlist*next;
 } gfxfontlist_t;
 
+typedef struct _gfxlinearena gfxlinearena_t;
+
 void gfxdrawer_target_gfxline(gfxdrawer_t*d);
+/* like gfxdrawer_target_gfxline, but allocates the nodes from an arena */
+void gfxdrawer_target_gfxline_arena(gfxdrawer_t*d, gfxlinearena_t*arena);
 
 void gfxtool_draw_dashed_line(gfxdrawer_t*d, gfxline_t*line, float*dashes, float phase);
 gfxline_t* gfxtool_dash_line(gfxline_t*line, float*dashes, float phase);
@@ -65,6 +69,21 @@ void gfxline_free(gfxline_t*l);
 gfxline_t* gfxline_clone(gfxline_t*line);
 void gfxline_optimize(gfxline_t*line);
 
+/* An arena for gfxline_t nodes, for code which creates and frees a lot of
+   short lived lines (e.g. one for every path on a page). Nodes are handed out
+   from big blocks, and nodes returned with gfxline_free_arena() are reused.
+   gfxlinearena_reset() releases all nodes at once, e.g. at the end of a page.
+   Lines from an arena must never be passed to gfxline_free() (or anything
+   else which frees nodes, like gfxline_optimize()). */
+gfxlinearena_t* gfxlinearena_new();
+gfxline_t* gfxlinearena_alloc(gfxlinearena_t*arena);
+void gfxlinearena_reset(gfxlinearena_t*arena);
+void gfxlinearena_destroy(gfxlinearena_t*arena);
+/* these behave like their non-arena counterparts if arena is NULL */
+gfxline_t* gfxline_clone_arena(gfxline_t*line, gfxlinearena_t*arena);
+void gfxline_free_arena(gfxline_t*line, gfxlinearena_t*arena);
+void gfxline_optimize_arena(gfxline_t*line, gfxlinearena_t*arena);
+
 void gfxdraw_cubicTo(gfxdrawer_t*draw, double c1x, double c1y, double c2x, double c2y, double x, double y, double quality);
 void gfxdraw_conicTo(gfxdrawer_t*draw, double cx, double cy, double tox, double toy, double quality);
 
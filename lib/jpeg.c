@@ -206,6 +206,83 @@ int jpeg_save_to_file(unsigned char*data, unsigned width, unsigned height, int q
   return 1;
 }
 
+struct _jpegwriter {
+  /* must be the first entry- the destination callbacks get passed
+     a pointer to it */
+  struct jpeg_destination_mgr mgr;
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  FILE*fi;
+  JOCTET buffer[OUTBUFFER_SIZE];
+};
+
+static void writer_init_destination(j_compress_ptr cinfo) 
+{ 
+  jpegwriter_t*w = (jpegwriter_t*)(cinfo->dest);
+  w->mgr.next_output_byte = w->buffer;
+  w->mgr.free_in_buffer = OUTBUFFER_SIZE;
+}
+
+static boolean writer_empty_output_buffer(j_compress_ptr cinfo)
+{ 
+  jpegwriter_t*w = (jpegwriter_t*)(cinfo->dest);
+  fwrite(w->buffer, OUTBUFFER_SIZE, 1, w->fi);
+  w->mgr.next_output_byte = w->buffer;
+  w->mgr.free_in_buffer = OUTBUFFER_SIZE;
+  return 1;
+}
+
+static void writer_term_destination(j_compress_ptr cinfo) 
+{
+  jpegwriter_t*w = (jpegwriter_t*)(cinfo->dest);
+  fwrite(w->buffer, OUTBUFFER_SIZE-w->mgr.free_in_buffer, 1, w->fi);
+  w->mgr.free_in_buffer = 0;
+}
+
+jpegwriter_t* jpeg_writer_start(const char*filename, unsigned width, unsigned height, int quality)
+{
+  FILE*fi = fopen(filename, "wb");
+  if(!fi) {
+    perror(filename);
+    return 0;
+  }
+  jpegwriter_t*w = (jpegwriter_t*)calloc(1, sizeof(jpegwriter_t));
+  w->fi = fi;
+  w->cinfo.err = jpeg_std_error(&w->jerr);
+  jpeg_create_compress(&w->cinfo);
+
+  w->mgr.init_destination = writer_init_destination;
+  w->mgr.empty_output_buffer = writer_empty_output_buffer;
+  w->mgr.term_destination = writer_term_destination;
+  w->cinfo.dest = &w->mgr;
+
+  w->cinfo.image_width  = width;
+  w->cinfo.image_height = height;
+  w->cinfo.input_components = 3;
+  w->cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&w->cinfo);
+  jpeg_set_quality(&w->cinfo,quality,TRUE);
+  jpeg_start_compress(&w->cinfo, TRUE);
+  return w;
+}
+
+void jpeg_writer_add_rows(jpegwriter_t*w, unsigned char*data, int num_rows)
+{
+  int t;
+  for(t=0;t<num_rows;t++) {
+    unsigned char*data2 = &data[w->cinfo.image_width*3*t];
+    jpeg_write_scanlines(&w->cinfo, &data2, 1);
+  }
+}
+
+void jpeg_writer_finish(jpegwriter_t*w)
+{
+  jpeg_finish_compress(&w->cinfo);
+  jpeg_destroy_compress(&w->cinfo);
+  fclose(w->fi);
+  free(w);
+}
+
 int jpeg_save_to_mem(unsigned char*data, unsigned width, unsigned height, int quality, unsigned char*_dest, int _destlen, int components)
 {
     struct jpeg_destination_mgr mgr;
@@ -478,6 +555,17 @@ int jpeg_save_to_file(unsigned char*data, unsigned width, unsigned height, int q
     fprintf(stderr, "jpeg_save_to_file: No JPEG support compiled in\n");
     return 0;
 }
+jpegwriter_t* jpeg_writer_start(const char*filename, unsigned width, unsigned height, int quality)
+{
+    fprintf(stderr, "jpeg_writer_start: No JPEG support compiled in\n");
+    return 0;
+}
+void jpeg_writer_add_rows(jpegwriter_t*w, unsigned char*data, int num_rows)
+{
+}
+void jpeg_writer_finish(jpegwriter_t*w)
+{
+}
 int jpeg_save_to_mem(unsigned char*data, unsigned width, unsigned height, int quality, unsigned char*_dest, int _destlen, int components)
 {
     fprintf(stderr, "jpeg_save_tomem: No JPEG support compiled in\n");
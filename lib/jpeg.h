@@ -15,6 +15,12 @@ int jpeg_load(const char*filename, unsigned char**dest, unsigned int*width, unsi
 int jpeg_load_from_mem(unsigned char*_data, int _size, unsigned char**dest, unsigned int*width, unsigned int*height);
 void jpeg_get_size(const char *fname, unsigned int *width, unsigned int *height);
 
+/* write a jpeg incrementally, a couple of (RGB) rows at a time */
+typedef struct _jpegwriter jpegwriter_t;
+jpegwriter_t* jpeg_writer_start(const char*filename, unsigned width, unsigned height, int quality);
+void jpeg_writer_add_rows(jpegwriter_t*w, unsigned char*data, int num_rows);
+void jpeg_writer_finish(jpegwriter_t*w);
+
 #ifdef __cplusplus
 }
 #endif
@@ -896,7 +896,7 @@ void swf_SetLosslessImage(TAG*tag, RGBA*data, int width, int height)
     if(num>1 && num<=256) {
 	RGBA*palette = (RGBA*)malloc(sizeof(RGBA)*num);
 	int width2 = BYTES_PER_SCANLINE(width);
-	U8*data2 = (U8*)malloc(width2*height);
+	U8*data2 = (U8*)rfx_calloc(width2*height);
 	int len = width*height;
 	int x,y;
 	int r;
@@ -572,7 +572,7 @@ static int isSWF(const char*filename)
     fread(a, 4, 1, fi);
     fclose(fi);
 
-    if(!strncmp(a, "FWS", 3) || !strncmp(a, "CWS", 3)) {
+    if(!strncmp(a, "FWS", 3) || !strncmp(a, "CWS", 3) || !strncmp(a, "ZWS", 3)) {
 	return 1;
     }
     return 0;
@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "../rfxswf.h"
+#include "../spanfill.h"
 
 /* one bit flag: */
 #define clip_type 0
@@ -542,38 +543,12 @@ static void fill_clip(RGBA*line, int*z, int y, int x1, int x2, U32 depth)
 
 static void fill_solid(RGBA*line, int*z, int y, int x1, int x2, RGBA col, U32 depth)
 {
-    int x = x1;
-
-    if(col.a!=255) {
-        int ainv = 255-col.a;
-        col.r = (col.r*col.a)>>8;
-        col.g = (col.g*col.a)>>8;
-        col.b = (col.b*col.a)>>8;
-        col.a = 255;
-        do {
-	    if(depth >= z[x]) {
-		line[x].r = ((line[x].r*ainv)>>8)+col.r;
-		line[x].g = ((line[x].g*ainv)>>8)+col.g;
-		line[x].b = ((line[x].b*ainv)>>8)+col.b;
-		line[x].a = 255;
-		z[x] = depth;
-	    }
-        } while(++x<x2);
-    } else {
-        do {
-	    if(depth >= z[x]) {
-		line[x] = col;
-		z[x] = depth;
-	    }
-        } while(++x<x2);
-    }
+    spanfill_solid_depth((gfxcolor_t*)line, z, depth, x1, x2, *(gfxcolor_t*)&col);
 }
 
-static int inline clamp(int v)
-{
-    if(v>255) return 255;
-    else return v;
-}
+/* bitmap and gradient pixels are computed for up to this many
+   pixels at a time, and then blended in one go */
+#define SPAN_BUFFER 256
 
 static void fill_bitmap(RGBA*line, int*z, int y, int x1, int x2, MATRIX*m, bitmap_t*b, int clipbitmap, U32 depth, double fmultiply)
 {
@@ -596,12 +571,15 @@ static void fill_bitmap(RGBA*line, int*z, int y, int x1, int x2, MATRIX*m, bitma
         return;
     }
 
-    do {
-	if(depth >= z[x]) {
-	    RGBA col;
+    RGBA buf[SPAN_BUFFER];
+    while(x<x2) {
+	int start = x;
+	int end = x2 < start+SPAN_BUFFER ? x2 : start+SPAN_BUFFER;
+	for(;x<end;x++) {
+	    if(depth < z[x])
+		continue;
 	    int xx = (int)((  (x - rx) * m22 - (y - ry) * m21)*det);
 	    int yy = (int)((- (x - rx) * m12 + (y - ry) * m11)*det);
-	    int ainv;
 
 	    if(clipbitmap) {
 		if(xx<0) xx=0;
@@ -615,17 +593,10 @@ static void fill_bitmap(RGBA*line, int*z, int y, int x1, int x2, MATRIX*m, bitma
 		if(yy<0) yy += b->height;
 	    }
 
-	    col = b->data[yy*b->width+xx];
-	    ainv = 255-col.a;
-
-	    line[x].r = clamp(((line[x].r*ainv)>>8)+col.r);
-	    line[x].g = clamp(((line[x].g*ainv)>>8)+col.g);
-	    line[x].b = clamp(((line[x].b*ainv)>>8)+col.b);
-	    line[x].a = 255;
-	    
-	    z[x] = depth;
+	    buf[x-start] = b->data[yy*b->width+xx];
 	}
-    } while(++x<x2);
+	spanfill_blend_depth((gfxcolor_t*)line, z, depth, start, end, (gfxcolor_t*)buf);
+    }
 }
 
 static void fill_gradient(RGBA*line, int*z, int y, int x1, int x2, MATRIX*m, GRADIENT*g, int type, U32 depth, double fmultiply)
@@ -675,8 +646,13 @@ static void fill_gradient(RGBA*line, int*z, int y, int x1, int x2, MATRIX*m, GRA
     for(t=r0;t<512;t++) 
 	palette[t] = oldcol;
 
-    do {
-	if(depth >= z[x]) {
+    RGBA buf[SPAN_BUFFER];
+    while(x<x2) {
+	int start = x;
+	int end = x2 < start+SPAN_BUFFER ? x2 : start+SPAN_BUFFER;
+	for(;x<end;x++) {
+	    if(depth < z[x])
+		continue;
 	    RGBA col;
 	    double xx = (  (x - rx) * m22 - (y - ry) * m21)*det;
 	    double yy = (- (x - rx) * m12 + (y - ry) * m11)*det;
@@ -696,16 +672,10 @@ static void fill_gradient(RGBA*line, int*z, int y, int x1, int x2, MATRIX*m, GRA
 		    xr = 511;
 		col = palette[xr];
 	    }
-	    int ainv;
-	    ainv = 255-col.a;
-	    line[x].r = clamp(((line[x].r*ainv)>>8)+col.r);
-	    line[x].g = clamp(((line[x].g*ainv)>>8)+col.g);
-	    line[x].b = clamp(((line[x].b*ainv)>>8)+col.b);
-	    line[x].a = 255;
-	    
-	    z[x] = depth;
+	    buf[x-start] = col;
 	}
-    } while(++x<x2);
+	spanfill_blend_depth((gfxcolor_t*)line, z, depth, start, end, (gfxcolor_t*)buf);
+    }
 }
 
 typedef struct _layer {
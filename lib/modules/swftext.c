@@ -2156,7 +2156,7 @@ char*data =
 
     tag = swf_InsertTag(tag, ST_END);
 
-    swf.compressed = -1;
+    swf.compressed = 0xff;
     swf_SaveSWF(&swf, filename);
     swf_FreeTags(&swf);
 }
@@ -24,6 +24,7 @@
 // Matrix & Math tools for SWF files
 
 #include "../rfxswf.h"
+#include "../q.h"
 
 #define S64 long long
 SFIXED RFXSWF_SP(SFIXED a1,SFIXED a2,SFIXED b1,SFIXED b2)
@@ -1229,31 +1230,109 @@ TAG* swf_Concatenate (TAG*list1,TAG*list2)
     return swf1.firstTag;
 }
 
-static int tagHash(TAG*tag)
+/* hash of a defining tag, leaving out the id at pos 0 and 1 */
+static U64 tagHash(TAG*tag)
 {
-    int t, h=0;
-    unsigned int a = 0x6b973e5a;
-    /* start at pos 2, as 0 and 1 are the id */
-    for(t=2;t<tag->len;t++) {
-        unsigned int b = a;
-        a >>= 8;
-        a += tag->data[t]*0xefbc35a5*b*(t+1);
+    if(tag->len <= 2)
+        return 0;
+    return hash_block64(&tag->data[2], tag->len-2);
+}
+
+typedef struct _tagentry {
+    U64 hash;
+    TAG*tag;
+} tagentry_t;
+
+typedef struct _tagset {
+    tagentry_t*entries;
+    int size; // always a power of two
+    int num;
+} tagset_t;
+
+static void tagset_init(tagset_t*set)
+{
+    set->size = 1024;
+    set->num = 0;
+    set->entries = (tagentry_t*)rfx_calloc(sizeof(tagentry_t)*set->size);
+}
+static void tagset_put(tagset_t*set, U64 hash, TAG*tag);
+static void tagset_grow(tagset_t*set)
+{
+    tagentry_t*old = set->entries;
+    int oldsize = set->size, t;
+    set->size *= 2;
+    set->num = 0;
+    set->entries = (tagentry_t*)rfx_calloc(sizeof(tagentry_t)*set->size);
+    for(t=0;t<oldsize;t++) {
+        if(old[t].tag)
+            tagset_put(set, old[t].hash, old[t].tag);
+    }
+    rfx_free(old);
+}
+static void tagset_put(tagset_t*set, U64 hash, TAG*tag)
+{
+    if(set->num*2 >= set->size)
+        tagset_grow(set);
+    int pos = hash & (set->size-1);
+    while(set->entries[pos].tag)
+        pos = (pos+1) & (set->size-1);
+    set->entries[pos].hash = hash;
+    set->entries[pos].tag = tag;
+    set->num++;
+}
+/* find a tag with the same content as tag (apart from the id) */
+static TAG* tagset_find(tagset_t*set, U64 hash, TAG*tag)
+{
+    int pos = hash & (set->size-1);
+    while(set->entries[pos].tag) {
+        TAG*tag2 = set->entries[pos].tag;
+        if(set->entries[pos].hash == hash && tag2->len == tag->len &&
+           (tag->len <= 2 || !memcmp(&tag->data[2], &tag2->data[2], tag->len-2)))
+            return tag2;
+        pos = (pos+1) & (set->size-1);
+    }
+    return 0;
+}
+static void tagset_destroy(tagset_t*set)
+{
+    rfx_free(set->entries);
+    memset(set, 0, sizeof(tagset_t));
+}
+
+typedef struct _positions {
+    int*pos;
+    int num;
+    int size;
+} positions_t;
+
+static void callbackCollect(TAG*t, int pos, void*ptr)
+{
+    positions_t*p = (positions_t*)ptr;
+    if(p->num == p->size) {
+        p->size = p->size?p->size*2:64;
+        p->pos = (int*)rfx_realloc(p->pos, sizeof(int)*p->size);
     }
-    return a&0x7fffffff; //always return positive number
+    p->pos[p->num++] = pos;
 }
 
+/* Removes duplicate definitions (e.g. the same glyph shapes in
+   several merged files) and makes their users refer to the first one.
+   Sprites are processed in their folded form, so the ids used inside
+   of them are remapped too, and sprites which become identical that
+   way are merged as well. */
 void swf_Optimize(SWF*swf)
 {
-    const int hash_size = 131072;
     char* dontremap = (char*)rfx_calloc(sizeof(char)*65536);
     U16* remap = (U16*)rfx_alloc(sizeof(U16)*65536);
-    TAG* id2tag = (TAG*)rfx_calloc(sizeof(TAG*)*65536);
-    TAG** hashmap = (TAG**)rfx_calloc(sizeof(TAG*)*hash_size);
+    tagset_t set;
+    positions_t positions;
     TAG* tag;
     int t;
     for(t=0;t<65536;t++) {
         remap[t] = t;
     }
+    tagset_init(&set);
+    memset(&positions, 0, sizeof(positions));
 
     swf_FoldAll(swf);
 
@@ -1275,37 +1354,24 @@ void swf_Optimize(SWF*swf)
         TAG*next = tag->next;
 
         /* remap the tag */
-        int num = swf_GetNumUsedIDs(tag);
-        int*positions = (int*)rfx_alloc(sizeof(int)*num);
-        int t;
-        swf_GetUsedIDs(tag, positions);
-        for(t=0;t<num;t++) {
-            int id = GET16(&tag->data[positions[t]]);
+        positions.num = 0;
+        enumerateUsedIDs(tag, 0, callbackCollect, &positions);
+        for(t=0;t<positions.num;t++) {
+            int id = GET16(&tag->data[positions.pos[t]]);
             id = remap[id];
-            PUT16(&tag->data[positions[t]], id);
+            PUT16(&tag->data[positions.pos[t]], id);
         }
-        rfx_free(positions);
 
         /* now look for previous tags with the same
            content */
         if(swf_isDefiningTag(tag)) {
-            TAG*tag2;
+            TAG*tag2 = 0;
             int id = swf_GetDefineID(tag);
-            int hash = tagHash(tag);
-            int match=0;
+            U64 hash = tagHash(tag);
             if(!dontremap[id]) 
-            while((tag2 = hashmap[hash%hash_size])) {
-                if(tag2 != (TAG*)0 && tag->len == tag2->len) {
-		    if(memcmp(&tag->data[2],&tag2->data[2],tag->len-2) == 0) {
-			match = 1;
-			break;
-		    }
-                }
-                hash++;
-            }
-            if(!match) {
-                while(hashmap[hash%hash_size]) hash++;
-                hashmap[hash%hash_size] = tag;
+                tag2 = tagset_find(&set, hash, tag);
+            if(!tag2) {
+                tagset_put(&set, hash, tag);
             } else {
 		/* we found two identical tags- remap one
 		   of them */
@@ -1325,10 +1391,10 @@ void swf_Optimize(SWF*swf)
         tag = next;
     }
     
+    tagset_destroy(&set);
+    rfx_free(positions.pos);
     rfx_free(dontremap);
     rfx_free(remap);
-    rfx_free(id2tag);
-    rfx_free(hashmap);
 }
 
 void swf_SetDefineBBox(TAG * tag, SRECT newbbox)
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <limits.h>
+#include <math.h>
 #include <memory.h>
 #include <assert.h>
 #include "BitmapOutputDev.h"
@@ -45,9 +46,55 @@
 
 #define UNKNOWN_BOUNDING_BOX 0,0,0,0
 
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define BITMAP_X86
+#include <immintrin.h>
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+static int have_avx2 = -1;
+
+static int use_avx2()
+{
+    if(have_avx2 < 0) {
+	have_avx2 = 0;
+#ifdef BITMAP_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+	    have_avx2 = 1;
+#endif
+    }
+    return have_avx2;
+}
+
 static SplashColor splash_white = {255,255,255};
 static SplashColor splash_black = {0,0,0};
-    
+
+static void ibbox_reset(ibbox_t*b)
+{
+    b->xmin = b->ymin = b->xmax = b->ymax = 0;
+    b->next = 0;
+}
+
+static inline GBool ibbox_is_empty(ibbox_t*b)
+{
+    return b->xmin >= b->xmax || b->ymin >= b->ymax;
+}
+
+static void ibbox_extend(ibbox_t*b, int x1, int y1, int x2, int y2)
+{
+    if(ibbox_is_empty(b)) {
+	b->xmin = x1; b->ymin = y1;
+	b->xmax = x2; b->ymax = y2;
+    } else {
+	if(x1 < b->xmin) b->xmin = x1;
+	if(y1 < b->ymin) b->ymin = y1;
+	if(x2 > b->xmax) b->xmax = x2;
+	if(y2 > b->ymax) b->ymax = y2;
+    }
+}
+
 ClipState::ClipState()
 {
     this->next = 0;
@@ -58,7 +105,9 @@ ClipState::ClipState()
 static gfxdevice_t* device_new_record()
 {
     gfxdevice_t*dev = (gfxdevice_t*)malloc(sizeof(gfxdevice_t));
-    gfxdevice_record_init(dev, 0);
+    /* the recorded text and vector parts are only replayed into the
+       output device, so a 1/GFX_SUBPIXEL pixel grid is precise enough */
+    gfxdevice_record_init2(dev, 0, GFX_SUBPIXEL);
     return dev;
 }
 
@@ -96,6 +145,7 @@ BitmapOutputDev::BitmapOutputDev(InfoOutputDev*info, PDFDoc*doc, int*page2page,
     this->gfxoutput_string = device_new_record();
     this->gfxoutput = device_new_record();
     this->gfxdev->setDevice(this->gfxoutput);
+    this->output_font_list = gfxfontlist_create();
     
     this->config_extrafontdata = 0;
     this->config_transparent = 0;
@@ -103,6 +153,12 @@ BitmapOutputDev::BitmapOutputDev(InfoOutputDev*info, PDFDoc*doc, int*page2page,
     this->config_skewedtobitmap = 0;
     this->config_alphatobitmap = 0;
     this->bboxpath = 0;
+    ibbox_reset(&this->stalepolydirty);
+    ibbox_reset(&this->staletextdirty);
+    ibbox_reset(&this->rgbdirty);
+    this->rgbcleared = 0;
+    this->stalepolyrows = 0;
+    this->staletextrows = 0;
     //this->clipdev = 0;
     //this->clipstates = 0;
 }
@@ -118,6 +174,10 @@ BitmapOutputDev::~BitmapOutputDev()
 	r->destroy(r);
 	free(this->gfxoutput_string);this->gfxoutput_string = 0;
     }
+    if(this->output_font_list) {
+	gfxfontlist_free(this->output_font_list, 0);
+	this->output_font_list = 0;
+    }
     if(this->bboxpath) {
 	delete this->bboxpath;this->bboxpath = 0;
     }
@@ -136,6 +196,8 @@ BitmapOutputDev::~BitmapOutputDev()
     if(this->staletextbitmap) {
 	delete this->staletextbitmap;this->staletextbitmap = 0;
     }
+    free(this->stalepolyrows);this->stalepolyrows = 0;
+    free(this->staletextrows);this->staletextrows = 0;
     if(this->booltextdev) {
 	delete this->booltextdev;this->booltextdev = 0;
     }
@@ -223,10 +285,31 @@ void BitmapOutputDev::flushBitmap()
     ibbox_t pagebox = {-movex, -movey, -movex + this->width, -movey + this->height, 0};
     ibbox_t bitmapbox = {0, 0, bitmap_width, bitmap_height, 0};
     ibbox_t c = ibbox_clip(&bitmapbox, &pagebox);
-    ibbox_t* boxes = get_bitmap_bboxes((unsigned char*)(alpha+c.ymin*bitmap_width+c.xmin), c.xmax - c.xmin, c.ymax - c.ymin, bitmap_width);
+
+#ifdef DEBUG
+    int dx,dy;
+    for(dy=0;dy<bitmap_height;dy++)
+    for(dx=0;dx<bitmap_width;dx++) {
+	if(alpha[dy*bitmap_width+dx] && (dx<rgbdirty.xmin || dy<rgbdirty.ymin || dx>=rgbdirty.xmax || dy>=rgbdirty.ymax)) {
+	    msg("<fatal> Bitmap pixel %d,%d was drawn outside of the dirty area %d,%d,%d,%d", dx, dy,
+		    rgbdirty.xmin, rgbdirty.ymin, rgbdirty.xmax, rgbdirty.ymax);
+	    exit(1);
+	}
+    }
+#endif
+
+    /* only look at the part of the bitmap we drew to since the last flush.
+       Box coordinates are relative to c, so shift them accordingly. */
+    ibbox_t d = ibbox_clip(&c, &rgbdirty);
+    ibbox_t* boxes = 0;
+    if(!ibbox_is_empty(&d)) {
+	boxes = get_bitmap_bboxes((unsigned char*)(alpha+d.ymin*bitmap_width+d.xmin), d.xmax - d.xmin, d.ymax - d.ymin, bitmap_width);
+    }
 
     ibbox_t*b;
     for(b=boxes;b;b=b->next) {
+	b->xmin += d.xmin - c.xmin; b->xmax += d.xmin - c.xmin;
+	b->ymin += d.ymin - c.ymin; b->ymax += d.ymin - c.ymin;
 	int xmin = b->xmin - this->movex;
 	int ymin = b->ymin - this->movey;
 	int xmax = b->xmax - this->movex;
@@ -324,8 +407,19 @@ void BitmapOutputDev::flushBitmap()
     }
     ibbox_destroy(boxes);
 
-    memset(rgbbitmap->getAlphaPtr(), 0, rgbbitmap->getWidth()*rgbbitmap->getHeight());
-    memset(rgbbitmap->getDataPtr(), 0, rgbbitmap->getRowSize()*rgbbitmap->getHeight());
+    if(!this->rgbcleared) {
+	memset(rgbbitmap->getAlphaPtr(), 0, rgbbitmap->getWidth()*rgbbitmap->getHeight());
+	memset(rgbbitmap->getDataPtr(), 0, rgbbitmap->getRowSize()*rgbbitmap->getHeight());
+	this->rgbcleared = 1;
+    } else if(!ibbox_is_empty(&rgbdirty)) {
+	int y;
+	int xspan = rgbdirty.xmax - rgbdirty.xmin;
+	for(y=rgbdirty.ymin;y<rgbdirty.ymax;y++) {
+	    memset(alpha + y*bitmap_width + rgbdirty.xmin, 0, xspan);
+	    memset(rgbbitmap->getDataPtr() + y*rgbbitmap->getRowSize() + rgbdirty.xmin*sizeof(SplashColor), 0, xspan*sizeof(SplashColor));
+	}
+    }
+    ibbox_reset(&rgbdirty);
 
     this->emptypage = 0;
 }
@@ -334,15 +428,9 @@ void BitmapOutputDev::flushText()
 {
     msg("<verbose> Flushing text");
 
-    static gfxfontlist_t*output_font_list = 0;
-    static gfxdevice_t*last = 0;
-    if(last != this->dev) {
-	if(output_font_list)
-	    gfxfontlist_free(output_font_list, 0);
-	output_font_list = gfxfontlist_create();
-    }
-    gfxdevice_record_flush(this->gfxoutput, this->dev, &output_font_list);
-    last = this->dev;
+    /* the font list is kept per instance (not globally) so that
+       pages can be converted concurrently */
+    gfxdevice_record_flush(this->gfxoutput, this->dev, &this->output_font_list);
     
     this->emptypage = 0;
 }
@@ -485,7 +573,22 @@ static inline GBool fixBBox(int*x1, int*y1, int*x2, int*y2, int width, int heigh
     return gTrue;
 }
 
-static void update_bitmap(SplashBitmap*bitmap, SplashBitmap*update, int x1, int y1, int x2, int y2, char overwrite)
+/* restrict an area (which might be UNKNOWN_BOUNDING_BOX) to the dirty
+   part of a bitmap. Returns false if there's no overlap. */
+static GBool clipToDirty(ibbox_t*dirty, int*x1, int*y1, int*x2, int*y2, int width, int height)
+{
+    if(ibbox_is_empty(dirty))
+	return gFalse;
+    if(!fixBBox(x1, y1, x2, y2, width, height))
+	return gFalse;
+    if(*x1 < dirty->xmin) *x1 = dirty->xmin;
+    if(*y1 < dirty->ymin) *y1 = dirty->ymin;
+    if(*x2 > dirty->xmax) *x2 = dirty->xmax;
+    if(*y2 > dirty->ymax) *y2 = dirty->ymax;
+    return *x1 < *x2 && *y1 < *y2;
+}
+
+static void update_bitmap(SplashBitmap*bitmap, ibbox_t*dirty, Guchar*rows, SplashBitmap*update, int x1, int y1, int x2, int y2, char overwrite)
 {
     assert(bitmap->getMode()==splashModeMono1);
     assert(update->getMode()==splashModeMono1);
@@ -498,6 +601,9 @@ static void update_bitmap(SplashBitmap*bitmap, SplashBitmap*update, int x1, int
 
     if(!fixBBox(&x1, &y1, &x2, &y2, bitmap->getWidth(), bitmap->getHeight()))
 	return;
+
+    /* we copy whole bytes */
+    ibbox_extend(dirty, x1&~7, y1, (x2+7)&~7, y2);
     
     Guchar*b = bitmap->getDataPtr() + y1*width8 + x1/8;
     Guchar*u = update->getDataPtr() + y1*width8 + x1/8;
@@ -505,6 +611,7 @@ static void update_bitmap(SplashBitmap*bitmap, SplashBitmap*update, int x1, int
     int xspan = (x2+7)/8 - x1/8;
     int size = (y2-y1)*width8;
 
+    /* rows[] marks the rows of the bitmap which might contain set bits */
     if(overwrite) {
 	int y;
 	for(y=0;y<yspan;y++) {
@@ -512,33 +619,44 @@ static void update_bitmap(SplashBitmap*bitmap, SplashBitmap*update, int x1, int
 	    b += width8;
 	    u += width8;
 	}
+	memset(rows+y1, 1, yspan);
     } else {
 	if(((ptroff_t)b&7)==((ptroff_t)u&7)) {
 	    int x,y;
 	    for(y=0;y<yspan;y++) {
 		Guchar*e1 = b+xspan-8;
 		Guchar*e2 = b+xspan;
+		unsigned long long any = 0;
 		while(((ptroff_t)b&7) && b<e1) {
+		    any |= *u;
 		    *b |= *u;
 		    b++;u++;
 		}
 		while(b<e1) {
+		    any |= *(unsigned long long*)u;
 		    *(long long*)b |= *(long long*)u;
 		    b+=8;u+=8;
 		}
 		while(b<e2) {
+		    any |= *u;
 		    *b |= *u;
 		    b++;u++;
 		}
+		if(any)
+		    rows[y1+y] = 1;
 		b += width8-xspan;
 		u += width8-xspan;
 	    }
 	} else {
 	    int x,y;
 	    for(y=0;y<yspan;y++) {
+		Guchar any = 0;
 		for(x=0;x<xspan;x++) {
+		    any |= u[x];
 		    b[x] |= u[x];
 		}
+		if(any)
+		    rows[y1+y] = 1;
 		b += width8;
 		u += width8;
 	    }
@@ -650,12 +768,14 @@ GBool BitmapOutputDev::checkNewText(int x1, int y1, int x2, int y2)
     msg("<trace> Testing new text data against current bitmap data, state=%s, counter=%d\n", STATE_NAME[layerstate], dbg_btm_counter);
     
     GBool ret = false;
-    if(intersection(booltextbitmap, stalepolybitmap, x1,y1,x2,y2)) {
+    int cx1=x1,cy1=y1,cx2=x2,cy2=y2;
+    if(clipToDirty(&stalepolydirty, &cx1, &cy1, &cx2, &cy2, stalepolybitmap->getWidth(), stalepolybitmap->getHeight()) &&
+       intersection(booltextbitmap, stalepolybitmap, stalepolyrows, cx1,cy1,cx2,cy2)) {
 	if(layerstate==STATE_PARALLEL) {
 	    /* the new text is above the bitmap. So record that fact. */
 	    msg("<verbose> Text is above current bitmap/polygon data");
 	    layerstate=STATE_TEXT_IS_ABOVE;
-	    update_bitmap(staletextbitmap, booltextbitmap, x1, y1, x2, y2, 0);
+	    update_bitmap(staletextbitmap, &staletextdirty, staletextrows, booltextbitmap, x1, y1, x2, y2, 0);
 	} else if(layerstate==STATE_BITMAP_IS_ABOVE) {
 	    /* there's a bitmap above the (old) text. So we need
 	       to flush out that text, and record that the *new*
@@ -668,7 +788,7 @@ GBool BitmapOutputDev::checkNewText(int x1, int y1, int x2, int y2)
 	   
 	    clearBoolTextDev();
 	    /* re-apply the update (which we would otherwise lose) */
-	    update_bitmap(staletextbitmap, booltextbitmap, x1, y1, x2, y2, 1);
+	    update_bitmap(staletextbitmap, &staletextdirty, staletextrows, booltextbitmap, x1, y1, x2, y2, 1);
             ret = true;
 	} else {
 	    /* we already know that the current text section is
@@ -676,18 +796,18 @@ GBool BitmapOutputDev::checkNewText(int x1, int y1, int x2, int y2)
 	       bitmap data *and* new text data was drawn, and
 	       *again* it's above the current bitmap. */
 	    msg("<verbose> Text is still above current bitmap/polygon data");
-	    update_bitmap(staletextbitmap, booltextbitmap, x1, y1, x2, y2, 0);
+	    update_bitmap(staletextbitmap, &staletextdirty, staletextrows, booltextbitmap, x1, y1, x2, y2, 0);
 	}
     }  else {
         msg("<verbose> no intersection");
-	update_bitmap(staletextbitmap, booltextbitmap, x1, y1, x2, y2, 0);
+	update_bitmap(staletextbitmap, &staletextdirty, staletextrows, booltextbitmap, x1, y1, x2, y2, 0);
     }
     
     /* clear the thing we just drew from our temporary drawing bitmap */
     clearBooleanBitmap(booltextbitmap, x1, y1, x2, y2);
 
 #ifdef DEBUG
-    if(intersection(booltextbitmap, booltextbitmap, UNKNOWN_BOUNDING_BOX)) {
+    if(intersection(booltextbitmap, booltextbitmap, 0, UNKNOWN_BOUNDING_BOX)) {
         msg("<fatal> Text bitmap is not empty after clear. Bad bounding box?");
         exit(1);
     }
@@ -701,32 +821,37 @@ GBool BitmapOutputDev::checkNewBitmap(int x1, int y1, int x2, int y2)
     msg("<trace> Testing new graphics data against current text data, state=%s, counter=%d\n", STATE_NAME[layerstate], dbg_btm_counter);
 
     GBool ret = false;
-    if(intersection(boolpolybitmap, staletextbitmap, x1,y1,x2,y2)) {
+    int cx1=x1,cy1=y1,cx2=x2,cy2=y2;
+    if(clipToDirty(&staletextdirty, &cx1, &cy1, &cx2, &cy2, staletextbitmap->getWidth(), staletextbitmap->getHeight()) &&
+       intersection(boolpolybitmap, staletextbitmap, staletextrows, cx1,cy1,cx2,cy2)) {
 	if(layerstate==STATE_PARALLEL) {
 	    msg("<verbose> Bitmap is above current text data");
 	    layerstate=STATE_BITMAP_IS_ABOVE;
-	    update_bitmap(stalepolybitmap, boolpolybitmap, x1, y1, x2, y2, 0);
+	    update_bitmap(stalepolybitmap, &stalepolydirty, stalepolyrows, boolpolybitmap, x1, y1, x2, y2, 0);
 	} else if(layerstate==STATE_TEXT_IS_ABOVE) {
 	    msg("<verbose> Bitmap is above current text data (which is above some bitmap)");
 	    flushBitmap();
 	    layerstate=STATE_BITMAP_IS_ABOVE;
 	    clearBoolPolyDev();
-	    update_bitmap(stalepolybitmap, boolpolybitmap, x1, y1, x2, y2, 1);
+	    update_bitmap(stalepolybitmap, &stalepolydirty, stalepolyrows, boolpolybitmap, x1, y1, x2, y2, 1);
             ret = true;
 	} else {
 	    msg("<verbose> Bitmap is still above current text data");
-	    update_bitmap(stalepolybitmap, boolpolybitmap, x1, y1, x2, y2, 0);
+	    update_bitmap(stalepolybitmap, &stalepolydirty, stalepolyrows, boolpolybitmap, x1, y1, x2, y2, 0);
 	}
     }  else {
         msg("<verbose> no intersection");
-	update_bitmap(stalepolybitmap, boolpolybitmap, x1, y1, x2, y2, 0);
+	update_bitmap(stalepolybitmap, &stalepolydirty, stalepolyrows, boolpolybitmap, x1, y1, x2, y2, 0);
     }
     
     /* clear the thing we just drew from our temporary drawing bitmap */
     clearBooleanBitmap(boolpolybitmap, x1, y1, x2, y2);
 
+    /* the caller is about to draw the same thing to rgbdev */
+    markBitmapDirty(x1, y1, x2, y2);
+
 #ifdef DEBUG
-    if(intersection(boolpolybitmap, boolpolybitmap, UNKNOWN_BOUNDING_BOX)) {
+    if(intersection(boolpolybitmap, boolpolybitmap, 0, UNKNOWN_BOUNDING_BOX)) {
 	writeAlpha(boolpolybitmap, "notempty.png");
         msg("<fatal> Polygon bitmap is not empty after clear. Bad bounding box?");
         int _x1, _y1, _x2, _y2;
@@ -863,7 +988,7 @@ GBool BitmapOutputDev::clip0and1differ(int x1,int y1,int x2,int y2)
     }
 }
 
-GBool compare8(unsigned char*data1, unsigned char*data2, int len)
+static GBool compare8_c(unsigned char*data1, unsigned char*data2, int len)
 {
     if(!len)
         return 0;
@@ -882,13 +1007,11 @@ GBool compare8(unsigned char*data1, unsigned char*data2, int len)
     int l8 = len/8;
     long long unsigned int*d1 = (long long unsigned int*)data1;
     long long unsigned int*d2 = (long long unsigned int*)data2;
-    long long unsigned int x = 0;
     int t;
     for(t=0;t<l8;t++) {
-        x |= d1[t]&d2[t];
+        if(d1[t]&d2[t])
+            return 1;
     }
-    if(x)
-        return 1;
 
     data1+=l8*8;
     data2+=l8*8;
@@ -901,7 +1024,31 @@ GBool compare8(unsigned char*data1, unsigned char*data2, int len)
     return 0;
 }
 
-GBool BitmapOutputDev::intersection(SplashBitmap*boolpoly, SplashBitmap*booltext, int x1, int y1, int x2, int y2)
+#ifdef BITMAP_X86
+static AVX2 GBool compare8_avx2(unsigned char*data1, unsigned char*data2, int len)
+{
+    int t;
+    for(t=0;t+32<=len;t+=32) {
+        __m256i a = _mm256_loadu_si256((__m256i*)&data1[t]);
+        __m256i b = _mm256_loadu_si256((__m256i*)&data2[t]);
+        if(!_mm256_testz_si256(a, b))
+            return 1;
+    }
+    return compare8_c(data1+t, data2+t, len-t);
+}
+#endif
+
+/* returns true if any bit is set in both data1 and data2 */
+GBool compare8(unsigned char*data1, unsigned char*data2, int len)
+{
+#ifdef BITMAP_X86
+    if(len >= 32 && use_avx2())
+        return compare8_avx2(data1, data2, len);
+#endif
+    return compare8_c(data1, data2, len);
+}
+
+GBool BitmapOutputDev::intersection(SplashBitmap*boolpoly, SplashBitmap*booltext, Guchar*textrows, int x1, int y1, int x2, int y2)
 {
     if(boolpoly->getMode()==splashModeMono1) {
 	/* alternative implementation, using one bit per pixel-
@@ -920,8 +1067,10 @@ GBool BitmapOutputDev::intersection(SplashBitmap*boolpoly, SplashBitmap*booltext
         int width8 = (width+7)/8;
         int runx = width8;
         int runy = height;
+        int firsty = 0;
 	
 	if(x1|y1|x2|y2) {
+            firsty = y1;
             polypixels+=y1*width8+x1/8;
             textpixels+=y1*width8+x1/8;
             runx=(x2+7)/8 - x1/8;
@@ -941,6 +1090,12 @@ GBool BitmapOutputDev::intersection(SplashBitmap*boolpoly, SplashBitmap*booltext
         unsigned char*data2 = (unsigned char*)textpixels;
         msg("<verbose> Testing area (%d,%d,%d,%d), runx=%d,runy=%d,state=%d", x1,y1,x2,y2, runx, runy, dbg_btm_counter);
         for(y=0;y<runy;y++) {
+            /* skip rows which we know to be empty */
+            if(textrows && !textrows[firsty+y]) {
+                data1+=width8;
+                data2+=width8;
+                continue;
+            }
             if(compare8(data1,data2,runx)) {
                 return gTrue;
             }
@@ -1041,10 +1196,21 @@ void BitmapOutputDev::beginPage(GfxState *state, int pageNum)
     }
     gfxline_free(clippath);
 
-    /* just in case any device did draw a white background rectangle 
-       into the device */
+    /* the stale bitmaps are freshly allocated (and not initialized), and
+       any device might have drawn a white background rectangle into the
+       bool devices */
+    free(stalepolyrows);
+    stalepolyrows = (Guchar*)malloc(stalepolybitmap->getHeight());
+    free(staletextrows);
+    staletextrows = (Guchar*)malloc(staletextbitmap->getHeight());
+    ibbox_reset(&stalepolydirty);
+    ibbox_extend(&stalepolydirty, 0, 0, stalepolybitmap->getWidth(), stalepolybitmap->getHeight());
+    ibbox_reset(&staletextdirty);
+    ibbox_extend(&staletextdirty, 0, 0, staletextbitmap->getWidth(), staletextbitmap->getHeight());
     clearBoolTextDev();
     clearBoolPolyDev();
+    ibbox_reset(&rgbdirty);
+    this->rgbcleared = 0;
 
     this->layerstate = STATE_PARALLEL;
     this->emptypage = 1;
@@ -1457,15 +1623,33 @@ gfxbbox_t BitmapOutputDev::getBBox(GfxState*state)
     return bbox;
 }
 
+/* how far the outline of a stroke can reach beyond the points of its
+   path: half the line width (splash draws thinner lines one pixel wide),
+   stretched by the transformation matrix, and times the miter limit
+   for miter joins, or sqrt(2) for the corners of square caps */
+static double stroke_extent(GfxState*state)
+{
+    double*m = state->getCTM();
+    /* the largest singular value of the matrix */
+    double f = m[0]*m[0] + m[1]*m[1] + m[2]*m[2] + m[3]*m[3];
+    double det = m[0]*m[3] - m[1]*m[2];
+    double stretch = sqrt((f + sqrt(fmax(f*f - 4*det*det, 0))) / 2);
+    double half = fmax(state->getLineWidth() * stretch, 1.0) / 2;
+    double factor = M_SQRT2;
+    if(state->getLineJoin() == 0 && state->getMiterLimit() > factor)
+	factor = state->getMiterLimit();
+    return half * factor;
+}
+
 void BitmapOutputDev::stroke(GfxState *state)
 {
     msg("<debug> stroke");
     boolpolydev->stroke(state);
     gfxbbox_t bbox = getBBox(state);
-    double width = ceil(state->getTransformedLineWidth());
+    double width = fmax(ceil(state->getTransformedLineWidth()), stroke_extent(state));
     bbox.xmin -= width; bbox.ymin -= width;
     bbox.xmax += width; bbox.ymax += width;
-    checkNewBitmap(bbox.xmin, bbox.ymin, ceil(bbox.xmax), ceil(bbox.ymax));
+    checkNewBitmap(bbox);
     rgbdev->stroke(state);
     dbg_newdata("stroke");
 }
@@ -1508,7 +1692,7 @@ void BitmapOutputDev::fill(GfxState *state)
 	    return;
 	}
     }
-    checkNewBitmap(bbox.xmin, bbox.ymin, ceil(bbox.xmax), ceil(bbox.ymax));
+    checkNewBitmap(bbox);
     rgbdev->fill(state);
     dbg_newdata("fill");
 }
@@ -1517,7 +1701,7 @@ void BitmapOutputDev::eoFill(GfxState *state)
     msg("<debug> eoFill");
     boolpolydev->eoFill(state);
     gfxbbox_t bbox = getBBox(state);
-    checkNewBitmap(bbox.xmin, bbox.ymin, ceil(bbox.xmax), ceil(bbox.ymax));
+    checkNewBitmap(bbox);
     rgbdev->eoFill(state);
     dbg_newdata("eofill");
 }
@@ -1614,6 +1798,9 @@ void BitmapOutputDev::beginString(GfxState *state, GString *s)
     this->gfxdev->setDevice(this->gfxoutput_string);
 }
 
+/* every character clears, draws and compares just its own bounding box
+   in clip0 and clip1, and nothing else reads them. So unlike the stale
+   bitmaps, they don't need a dirty area. */
 void BitmapOutputDev::clearClips(int x1, int y1, int x2, int y2)
 {
     clearBooleanBitmap(clip0bitmap, x1,y1,x2,y2);
@@ -1621,11 +1808,53 @@ void BitmapOutputDev::clearClips(int x1, int y1, int x2, int y2)
 }
 void BitmapOutputDev::clearBoolPolyDev()
 {
-    clearBooleanBitmap(stalepolybitmap, 0, 0, stalepolybitmap->getWidth(), stalepolybitmap->getHeight());
+    if(!ibbox_is_empty(&stalepolydirty)) {
+	clearBooleanBitmap(stalepolybitmap, stalepolydirty.xmin, stalepolydirty.ymin, stalepolydirty.xmax, stalepolydirty.ymax);
+	memset(stalepolyrows+stalepolydirty.ymin, 0, stalepolydirty.ymax-stalepolydirty.ymin);
+    }
+    ibbox_reset(&stalepolydirty);
 }
 void BitmapOutputDev::clearBoolTextDev()
 {
-    clearBooleanBitmap(staletextbitmap, 0, 0, staletextbitmap->getWidth(), staletextbitmap->getHeight());
+    if(!ibbox_is_empty(&staletextdirty)) {
+	clearBooleanBitmap(staletextbitmap, staletextdirty.xmin, staletextdirty.ymin, staletextdirty.xmax, staletextdirty.ymax);
+	memset(staletextrows+staletextdirty.ymin, 0, staletextdirty.ymax-staletextdirty.ymin);
+    }
+    ibbox_reset(&staletextdirty);
+}
+
+/* Pixels drawn by splash can extend a little beyond the bounding box
+   we're given: antialiasing colors every pixel a shape touches, which
+   stays within the floor()/ceil() of its bbox, but stroke adjustment
+   (paths) can move an edge to the next pixel boundary, and image scaling
+   (images) rounds the image rectangle outwards, by at most one pixel.
+   Strokes are expected to pass their full extent, see stroke_extent().
+   (Anything outside the dirty area is neither flushed nor cleared, see
+   the DEBUG check in flushBitmap()) */
+#define DIRTY_MARGIN 1
+
+/* bboxes beyond this (in pixels) are treated as unknown */
+#define MAX_BBOX_COORD 1e7
+
+GBool BitmapOutputDev::checkNewBitmap(gfxbbox_t bbox)
+{
+    /* fall back to the whole bitmap if we can't trust the bbox */
+    if(!(fabs(bbox.xmin) < MAX_BBOX_COORD && fabs(bbox.ymin) < MAX_BBOX_COORD &&
+	 fabs(bbox.xmax) < MAX_BBOX_COORD && fabs(bbox.ymax) < MAX_BBOX_COORD))
+	return checkNewBitmap(UNKNOWN_BOUNDING_BOX);
+    return checkNewBitmap((int)floor(bbox.xmin), (int)floor(bbox.ymin),
+	                  (int)ceil(bbox.xmax), (int)ceil(bbox.ymax));
+}
+
+void BitmapOutputDev::markBitmapDirty(int x1, int y1, int x2, int y2)
+{
+    if(x1|y1|x2|y2) {
+	x1 -= DIRTY_MARGIN; y1 -= DIRTY_MARGIN;
+	x2 += DIRTY_MARGIN; y2 += DIRTY_MARGIN;
+    }
+    if(!fixBBox(&x1, &y1, &x2, &y2, rgbbitmap->getWidth(), rgbbitmap->getHeight()))
+	return;
+    ibbox_extend(&rgbdirty, x1, y1, x2, y2);
 }
 
 #define USE_GETGLYPH_BBOX
@@ -1718,6 +1947,7 @@ void BitmapOutputDev::drawChar(GfxState *state, double x, double y,
 
     if(state->getRender()&RENDER_CLIP) {
 	//char is, amongst others, a clipping boundary
+	markBitmapDirty(UNKNOWN_BOUNDING_BOX);
 	rgbdev->drawChar(state, x, y, dx, dy, originX, originY, code, nBytes, u, uLen);
         boolpolydev->drawChar(state, x, y, dx, dy, originX, originY, code, nBytes, u, uLen);
         booltextdev->drawChar(state, x, y, dx, dy, originX, originY, code, nBytes, u, uLen);
@@ -1922,7 +2152,7 @@ void BitmapOutputDev::drawImageMask(GfxState *state, Object *ref, Stream *str,
     
     boolpolydev->drawImageMask(state, ref, str, width, height, invert, POPPLER_INTERPOLATE_ARG inlineImg);
     gfxbbox_t bbox = getImageBBox(state);
-    checkNewBitmap(bbox.xmin, bbox.ymin, ceil(bbox.xmax), ceil(bbox.ymax));
+    checkNewBitmap(bbox);
     rgbdev->drawImageMask(state, ref, str, width, height, invert, POPPLER_INTERPOLATE_ARG inlineImg);
     delete cpystr;
     dbg_newdata("imagemask");
@@ -1940,7 +2170,7 @@ void BitmapOutputDev::drawImage(GfxState *state, Object *ref, Stream *str,
 
     boolpolydev->drawImage(state, ref, str, width, height, colorMap, POPPLER_INTERPOLATE_ARG maskColors, inlineImg);
     gfxbbox_t bbox=getImageBBox(state);
-    checkNewBitmap(bbox.xmin, bbox.ymin, ceil(bbox.xmax), ceil(bbox.ymax));
+    checkNewBitmap(bbox);
     rgbdev->drawImage(state, ref, str, width, height, colorMap, POPPLER_INTERPOLATE_ARG maskColors, inlineImg);
     delete cpystr;
     dbg_newdata("image");
@@ -1960,7 +2190,7 @@ void BitmapOutputDev::drawMaskedImage(GfxState *state, Object *ref, Stream *str,
 
     boolpolydev->drawMaskedImage(state, ref, str, width, height, colorMap, POPPLER_INTERPOLATE_ARG maskStr, maskWidth, maskHeight, maskInvert POPPLER_MASK_INTERPOLATE_ARG);
     gfxbbox_t bbox=getImageBBox(state);
-    checkNewBitmap(bbox.xmin, bbox.ymin, ceil(bbox.xmax), ceil(bbox.ymax));
+    checkNewBitmap(bbox);
     rgbdev->drawMaskedImage(state, ref, str, width, height, colorMap, POPPLER_INTERPOLATE_ARG maskStr, maskWidth, maskHeight, maskInvert POPPLER_MASK_INTERPOLATE_ARG);
     delete cpystr;
     dbg_newdata("maskedimage");
@@ -1981,7 +2211,7 @@ void BitmapOutputDev::drawSoftMaskedImage(GfxState *state, Object *ref, Stream *
 
     boolpolydev->drawSoftMaskedImage(state, ref, str, width, height, colorMap, POPPLER_INTERPOLATE_ARG maskStr, maskWidth, maskHeight, maskColorMap POPPLER_MASK_INTERPOLATE_ARG);
     gfxbbox_t bbox=getImageBBox(state);
-    checkNewBitmap(bbox.xmin, bbox.ymin, ceil(bbox.xmax), ceil(bbox.ymax));
+    checkNewBitmap(bbox);
     rgbdev->drawSoftMaskedImage(state, ref, str, width, height, colorMap, POPPLER_INTERPOLATE_ARG maskStr, maskWidth, maskHeight, maskColorMap POPPLER_MASK_INTERPOLATE_ARG);
     delete cpystr;
     dbg_newdata("softmaskimage");
@@ -30,6 +30,7 @@
 #include "PDFDoc.h"
 #include "CommonOutputDev.h"
 #include "popplercompat.h"
+#include "bbox.h"
 
 struct ClipState
 {
@@ -193,8 +194,10 @@ private:
     void flushBitmap();
     GBool checkNewText(int x1, int y1, int x2, int y2);
     GBool checkNewBitmap(int x1, int y1, int x2, int y2);
+    GBool checkNewBitmap(gfxbbox_t bbox);
     GBool clip0and1differ(int x1,int y1,int x2,int y2);
-    GBool intersection(SplashBitmap*boolpoly, SplashBitmap*booltext, int x1, int y1, int x2, int y2);
+    GBool intersection(SplashBitmap*boolpoly, SplashBitmap*booltext, Guchar*textrows, int x1, int y1, int x2, int y2);
+    void markBitmapDirty(int x1, int y1, int x2, int y2);
     
     virtual gfxbbox_t getImageBBox(GfxState*state);
     virtual gfxbbox_t getBBox(GfxState*state);
@@ -226,8 +229,22 @@ private:
     SplashBitmap*booltextbitmap;
     SplashBitmap*staletextbitmap;
 
+    /* areas of the above bitmaps which may contain set pixels. Everything
+       outside of these is known to be empty, so intersection tests, clears
+       and flushes don't need to look at the whole page. */
+    ibbox_t stalepolydirty;
+    ibbox_t staletextdirty;
+    ibbox_t rgbdirty;
+    /* one byte per row of the stale bitmaps, nonzero if the row might have
+       any pixels set */
+    Guchar*stalepolyrows;
+    Guchar*staletextrows;
+    /* whether rgbbitmap was completely cleared since the page started */
+    GBool rgbcleared;
+
     gfxdevice_t* gfxoutput;
     gfxdevice_t* gfxoutput_string;
+    gfxfontlist_t* output_font_list;
     CharOutputDev*gfxdev;
     gfxdevice_t*dev;
 
@@ -575,8 +575,6 @@ static char*getFontName(GfxFont*font)
 }
 
 static void dumpFontInfo(const char*loglevel, GfxFont*font);
-static int lastdumps[1024];
-static int lastdumppos = 0;
 /* nr = 0  unknown
    nr = 1  substituting
    nr = 2  type 3
@@ -584,14 +582,22 @@ static int lastdumppos = 0;
 static void showFontError(GfxFont*font, int nr) 
 {  
     Ref*r=font->getID();
+    GFXOutputGlobals*g = getGfxGlobals();
+#ifdef GFXGLOBALS_MUTEX
+    gLockMutex(&g->mutex);
+#endif
     int t;
-    for(t=0;t<lastdumppos;t++)
-	if(lastdumps[t] == r->num)
+    for(t=0;t<g->num_fontwarnings;t++)
+	if(g->fontwarnings[t] == r->num)
 	    break;
-    if(t < lastdumppos)
+    char seen = t < g->num_fontwarnings;
+    if(!seen && g->num_fontwarnings<sizeof(g->fontwarnings)/sizeof(int))
+	g->fontwarnings[g->num_fontwarnings++] = r->num;
+#ifdef GFXGLOBALS_MUTEX
+    gUnlockMutex(&g->mutex);
+#endif
+    if(seen)
       return;
-    if(lastdumppos<sizeof(lastdumps)/sizeof(int))
-    lastdumps[lastdumppos++] = r->num;
     if(nr == 0)
       msg("<warning> The following font caused problems:");
     else if(nr == 1)
@@ -756,6 +762,19 @@ static gfxline_t* mkEmptyGfxShape(double x, double y)
     return line;
 }
 
+/* the font (version) holding the glyph for charid, which is passed to
+   the device the first time it's used */
+gfxfont_t* CharOutputDev::getGlyphFont(FontInfo*fontinfo, int charid)
+{
+    gfxfont_t*font = fontinfo->getGlyphFont(charid);
+    int version = fontinfo->glyphs[charid]->version;
+    if(version>0 && !fontinfo->versions_seen[version-1]) {
+	device->addfont(device, font);
+	fontinfo->versions_seen[version-1] = 1;
+    }
+    return font;
+}
+
 void CharOutputDev::drawChar(GfxState *state, double x, double y,
 			double dx, double dy,
 			double originX, double originY,
@@ -768,12 +787,15 @@ void CharOutputDev::drawChar(GfxState *state, double x, double y,
 	return;
     }
 
+    /* FontInfos are shared between concurrently rendered pages, see
+       InfoOutputDev.h for why this needs no locking */
     gfxfont_t*current_gfxfont = current_fontinfo->getGfxFont();
     if(!current_fontinfo->seen) {
 	dumpFontInfo("<verbose>", state->getFont());
 	device->addfont(device, current_gfxfont);
         current_fontinfo->seen = 1;
     }
+    gfxfont_t*glyph_gfxfont = getGlyphFont(current_fontinfo, charid);
 
     CharCode glyphid = current_fontinfo->glyphs[charid]->glyphid;
 
@@ -830,7 +852,7 @@ void CharOutputDev::drawChar(GfxState *state, double x, double y,
             font->isCIDFont(), render, glyphid, current_gfxfont,
             m.m00);
 
-    gfxglyph_t* gfxglyph = &current_gfxfont->glyphs[glyphid];
+    gfxglyph_t* gfxglyph = &glyph_gfxfont->glyphs[glyphid];
 
     int space = current_fontinfo->space_char;
     if(config_extrafontdata && config_detectspaces && space>=0 && m.m00 && !m.m01) {
@@ -888,10 +910,10 @@ void CharOutputDev::drawChar(GfxState *state, double x, double y,
         }
 
     }
-    device->drawchar(device, current_gfxfont, glyphid, &col, &m);
+    device->drawchar(device, glyph_gfxfont, glyphid, &col, &m);
     
     if(link) {
-	link->addchar(current_gfxfont->glyphs[glyphid].unicode);
+	link->addchar(glyph_gfxfont->glyphs[glyphid].unicode);
     }
 }
 
@@ -943,7 +965,7 @@ GBool CharOutputDev::beginType3Char(GfxState *state, double x, double y, double
 	CharCode glyphid = current_fontinfo->glyphs[charid]->glyphid;
 	gfxmatrix_t m = current_fontinfo->get_gfxmatrix(state);
 	this->transformXY(state, 0, 0, &m.tx, &m.ty);
-	device->drawchar(device, current_gfxfont, glyphid, &col, &m);
+	device->drawchar(device, getGlyphFont(current_fontinfo, charid), glyphid, &col, &m);
     }
 
 
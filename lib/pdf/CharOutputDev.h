@@ -60,6 +60,8 @@ public:
   virtual GBool needNonText();
 
   private:
+
+  gfxfont_t* getGlyphFont(FontInfo*fontinfo, int charid);
   
   int currentpage;
   int type3active; // are we between beginType3()/endType3()?
@@ -69,6 +69,10 @@ GFXOutputGlobals::GFXOutputGlobals()
     this->textmodeinfo = 0;
     this->linkinfo = 0;
     this->pbminfo = 0;
+    this->num_fontwarnings = 0;
+#ifdef GFXGLOBALS_MUTEX
+    gInitMutex(&this->mutex);
+#endif
 }
 GFXOutputGlobals::~GFXOutputGlobals()
 {
@@ -83,25 +87,37 @@ GFXOutputGlobals::~GFXOutputGlobals()
 	f = next;
     }
     this->featurewarnings = 0;
+#ifdef GFXGLOBALS_MUTEX
+    gDestroyMutex(&this->mutex);
+#endif
 }
 
 static GFXOutputGlobals*gfxglobals=0;
 
 static void showfeature(const char*feature, char fully, char warn)
 {
-    if(!gfxglobals)
-	gfxglobals = new GFXOutputGlobals();
-
-    feature_t*f = gfxglobals->featurewarnings;
+    GFXOutputGlobals*g = getGfxGlobals();
+#ifdef GFXGLOBALS_MUTEX
+    gLockMutex(&g->mutex);
+#endif
+    feature_t*f = g->featurewarnings;
     while(f) {
 	if(!strcmp(feature, f->string))
-	    return;
+	    break;
 	f = f->next;
     }
-    f = (feature_t*)malloc(sizeof(feature_t));
-    f->string = strdup(feature);
-    f->next = gfxglobals->featurewarnings;
-    gfxglobals->featurewarnings = f;
+    char seen = f!=0;
+    if(!seen) {
+	f = (feature_t*)malloc(sizeof(feature_t));
+	f->string = strdup(feature);
+	f->next = g->featurewarnings;
+	g->featurewarnings = f;
+    }
+#ifdef GFXGLOBALS_MUTEX
+    gUnlockMutex(&g->mutex);
+#endif
+    if(seen)
+	return;
     if(warn) {
 	msg("<warning> %s not yet %ssupported!",feature,fully?"fully ":"");
     } else {
@@ -120,6 +136,8 @@ void infofeature(const char*feature)
 {
     showfeature(feature,0,0);
 }
+/* Created on first use. In threadsafe mode, pdf.cc calls this before any
+   page is rendered, so that the workers never race to create it. */
 GFXOutputGlobals* getGfxGlobals()
 {
     if(!gfxglobals)
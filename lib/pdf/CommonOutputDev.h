@@ -23,6 +23,10 @@
 #include "OutputDev.h"
 #include "InfoOutputDev.h"
 #include "../gfxdevice.h"
+#if MULTITHREADED && !defined(HAVE_POPPLER)
+#include "GMutex.h"
+#define GFXGLOBALS_MUTEX
+#endif
 
 #define RENDER_FILL 0
 #define RENDER_STROKE 1
@@ -45,6 +49,15 @@ public:
   int pbminfo; // did we write "File contains jpegs" yet?
   int linkinfo; // did we write "File contains links" yet?
 
+  int fontwarnings[1024]; // ids of the fonts we already printed a warning for
+  int num_fontwarnings;
+
+#ifdef GFXGLOBALS_MUTEX
+  /* protects featurewarnings and fontwarnings. Pages may be rendered on
+     several threads (see the "threadsafe" option in pdf.cc). */
+  GMutex mutex;
+#endif
+
   GFXOutputGlobals();
   ~GFXOutputGlobals();
 };
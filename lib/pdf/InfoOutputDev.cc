@@ -9,6 +9,7 @@
 #include "../q.h"
 #include "../gfxdevice.h"
 #include "../gfxfont.h"
+#include "../devices/record.h"
 #include <math.h>
 #include <assert.h>
 
@@ -108,6 +109,9 @@ InfoOutputDev::InfoOutputDev(XRef*xref)
     last_font = 0;
     current_type3_font = 0;
     fontcache = dict_new2(&fontclass_type);
+#ifdef INFO_FONTCACHE_MUTEX
+    gInitMutex(&fontcache_mutex);
+#endif
 }
 InfoOutputDev::~InfoOutputDev() 
 {
@@ -117,6 +121,9 @@ InfoOutputDev::~InfoOutputDev()
 	delete fd;
     }
     dict_destroy(this->fontcache);this->fontcache=0;
+#ifdef INFO_FONTCACHE_MUTEX
+    gDestroyMutex(&fontcache_mutex);
+#endif
 
     delete splash;splash=0;
 }
@@ -145,6 +152,11 @@ FontInfo::FontInfo(fontclass_t*fontclass)
     this->num_glyphs = 0;
     this->glyphs = 0;
     this->gfxfont = 0;
+    this->gfxfont_num_collected = 0;
+    this->num_collected = 0;
+    this->num_versions = 0;
+    this->versions = 0;
+    this->versions_seen = 0;
     this->space_char = -1;
     this->ascender = 0;
     this->descender = 0;
@@ -168,6 +180,11 @@ FontInfo::~FontInfo()
     free(glyphs);glyphs=0;
     if(this->gfxfont)
         gfxfont_free(this->gfxfont);
+    for(t=0;t<num_versions;t++) {
+	gfxfont_free(versions[t]);
+    }
+    free(versions);versions=0;
+    free(versions_seen);versions_seen=0;
 
     if(this->fontclass) {
 	fontclass_type.free(this->fontclass);
@@ -274,7 +291,7 @@ gfxbbox_t gfxfont_bbox(gfxfont_t*font)
     return tmp;
 }
 
-gfxfont_t* FontInfo::createGfxFont()
+gfxfont_t* FontInfo::createGfxFont(int version)
 {
     gfxfont_t*font = (gfxfont_t*)rfx_calloc(sizeof(gfxfont_t));
 
@@ -290,12 +307,13 @@ gfxfont_t* FontInfo::createGfxFont()
     font->descent = fabs(this->descender);
 
     for(t=0;t<this->num_glyphs;t++) {
-	if(this->glyphs[t]) {
+	if(this->glyphs[t] && this->glyphs[t]->version<0) {
 	    SplashPath*path = this->glyphs[t]->path;
 	    int len = path?path->getLength():0;
 	    //printf("glyph %d) %08x (%d line segments)\n", t, path, len);
 	    gfxglyph_t*glyph = &font->glyphs[font->num_glyphs];
 	    this->glyphs[t]->glyphid = font->num_glyphs;
+	    this->glyphs[t]->version = version;
 	    glyph->unicode = this->glyphs[t]->unicode;
 	    gfxdrawer_t drawer;
 	    gfxdrawer_target_gfxline(&drawer);
@@ -364,13 +382,18 @@ gfxfont_t* FontInfo::createGfxFont()
 
     if(config_normalize_fonts) {
 	/* make all chars 1024 high */
-	gfxbbox_t bbox = gfxfont_bbox(font);
-	double height = bbox.ymax - bbox.ymin;
 	double scale = 1.0;
-	if(height>1e-5) {
-	    scale = 1024.0 / height;
+	if(!version) {
+	    gfxbbox_t bbox = gfxfont_bbox(font);
+	    double height = bbox.ymax - bbox.ymin;
+	    if(height>1e-5) {
+		scale = 1024.0 / height;
+	    }
+	    this->scale = 1.0 / scale;
+	} else {
+	    /* later versions need to match the scale of the first one */
+	    scale = 1.0 / this->scale;
 	}
-	this->scale = 1.0 / scale;
 	gfxmatrix_t scale_matrix = {scale,0,0,
 	                            0,scale,0};
 	gfxfont_transform(font, &scale_matrix);
@@ -411,10 +434,30 @@ static float find_average_glyph_advance(gfxfont_t*f)
     return m;
 }
 
+/* Not synchronized, see the seen flag in InfoOutputDev.h */
 gfxfont_t* FontInfo::getGfxFont()
 {
+    if(this->gfxfont && this->gfxfont_num_collected != this->num_collected) {
+	/* The info pass of a later page added glyphs to this font. The font
+	   was already handed out, so store the new glyphs in a font of their
+	   own. */
+	gfxfont_t*font = this->createGfxFont(this->num_versions+1);
+	char*id = (char*)malloc(strlen(this->id)+16);
+	sprintf(id, "%s_%d", this->id, this->num_versions+1);
+	font->id = id;
+	gfxfont_fix_unicode(font, config_unique_unicode);
+	msg("<verbose> Font %s: %d more glyphs, stored in %s", this->id, font->num_glyphs, font->id);
+
+	this->versions = (gfxfont_t**)realloc(this->versions, sizeof(gfxfont_t*)*(this->num_versions+1));
+	this->versions_seen = (char*)realloc(this->versions_seen, this->num_versions+1);
+	this->versions[this->num_versions] = font;
+	this->versions_seen[this->num_versions] = 0;
+	this->num_versions++;
+	this->gfxfont_num_collected = this->num_collected;
+    }
     if(!this->gfxfont) {
-        this->gfxfont = this->createGfxFont();
+        this->gfxfont = this->createGfxFont(0);
+	this->gfxfont_num_collected = this->num_collected;
         this->gfxfont->id = strdup(this->id);
 	this->space_char = findSpace(this->gfxfont);
 	this->average_advance = find_average_glyph_advance(this->gfxfont);
@@ -444,6 +487,180 @@ gfxfont_t* FontInfo::getGfxFont()
     return this->gfxfont;
 }
 
+/* the font containing the glyph for charid (at glyphs[charid]->glyphid) */
+gfxfont_t* FontInfo::getGlyphFont(int charid)
+{
+    gfxfont_t*font = this->getGfxFont();
+    int version = this->glyphs[charid]->version;
+    if(version>0)
+	font = this->versions[version-1];
+    return font;
+}
+
+void FontInfo::save(writer_t*w)
+{
+    gfxfont_t*font = this->getGfxFont();
+    writer_writeString(w, this->id);
+    writer_writeDouble(w, this->max_size);
+    writer_writeDouble(w, this->ascender);
+    writer_writeDouble(w, this->descender);
+    writer_writeDouble(w, this->scale);
+    writer_writeU32(w, this->space_char);
+    writer_writeFloat(w, this->average_advance);
+    writer_writeU32(w, this->num_chars);
+    writer_writeU32(w, this->num_spaces);
+    writer_writeU32(w, this->num_glyphs);
+    int t;
+    for(t=0;t<this->num_glyphs;t++) {
+	GlyphInfo*g = this->glyphs[t];
+	if(!g) {
+	    writer_writeU8(w, 0);
+	    continue;
+	}
+	writer_writeU8(w, 1);
+	writer_writeU32(w, g->unicode);
+	writer_writeU32(w, g->glyphid);
+	writer_writeU32(w, g->version);
+	writer_writeDouble(w, g->advance);
+	writer_writeDouble(w, g->advance_max);
+    }
+    gfxfont_record_write(w, font);
+    writer_writeU32(w, this->num_versions);
+    for(t=0;t<this->num_versions;t++) {
+	gfxfont_record_write(w, this->versions[t]);
+    }
+}
+
+/* every item takes at least one byte, so a count larger than the rest
+   of the data can only come from a corrupt file */
+static char count_ok(reader_t*r, int size, U32 count)
+{
+    return count <= (U32)(size - r->pos);
+}
+
+char FontInfo::load(reader_t*r, int size)
+{
+    free(this->id);
+    this->id = reader_readString(r);
+    this->max_size = reader_readDouble(r);
+    this->ascender = reader_readDouble(r);
+    this->descender = reader_readDouble(r);
+    this->scale = reader_readDouble(r);
+    this->space_char = (int)reader_readU32(r);
+    this->average_advance = reader_readFloat(r);
+    this->num_chars = reader_readU32(r);
+    this->num_spaces = reader_readU32(r);
+    U32 count = reader_readU32(r);
+    if(!count_ok(r, size, count))
+	return 0;
+    this->grow(count);
+    int t;
+    for(t=0;t<this->num_glyphs;t++) {
+	if(!reader_readU8(r))
+	    continue;
+	GlyphInfo*g = this->glyphs[t] = new GlyphInfo();
+	g->path = 0;
+	g->unicode = reader_readU32(r);
+	g->glyphid = reader_readU32(r);
+	g->version = reader_readU32(r);
+	g->advance = reader_readDouble(r);
+	g->advance_max = reader_readDouble(r);
+	this->num_collected++;
+    }
+    this->gfxfont = gfxfont_record_read(r, size);
+    if(!this->gfxfont)
+	return 0;
+    count = reader_readU32(r);
+    if(!count_ok(r, size, count))
+	return 0;
+    if(count) {
+	this->versions = (gfxfont_t**)malloc(sizeof(gfxfont_t*)*count);
+	this->versions_seen = (char*)rfx_calloc(count);
+	for(t=0;t<(int)count;t++) {
+	    gfxfont_t*font = gfxfont_record_read(r, size);
+	    if(!font)
+		return 0;
+	    this->versions[t] = font;
+	    this->num_versions++;
+	}
+    }
+    for(t=0;t<this->num_glyphs;t++) {
+	GlyphInfo*g = this->glyphs[t];
+	if(!g)
+	    continue;
+	if(g->version < 0 || g->version > this->num_versions)
+	    return 0;
+	gfxfont_t*font = g->version ? this->versions[g->version-1] : this->gfxfont;
+	if(g->glyphid < 0 || g->glyphid >= font->num_glyphs)
+	    return 0;
+    }
+    this->gfxfont_num_collected = this->num_collected;
+    return 1;
+}
+
+void InfoOutputDev::save(writer_t*w)
+{
+    dict_t*d = this->fontcache;
+    writer_writeU32(w, d->num);
+    /* write the fonts in probing order, starting after an empty slot (like
+       dict_expand() does). Inserting them in that order in load() then
+       results in the same slots, and hence the same font order in
+       dumpfonts(). */
+    int start = 0;
+    while(d->num && d->slots[start].dist)
+	start++;
+    int t;
+    for(t=0;t<d->hashsize;t++) {
+	dictentry_t*e = &d->slots[(start+t)&(d->hashsize-1)];
+	if(!e->dist)
+	    continue;
+	FontInfo*info = (FontInfo*)e->data;
+	fontclass_t*c = info->fontclass;
+	writer_writeFloat(w, c->m00);
+	writer_writeFloat(w, c->m01);
+	writer_writeFloat(w, c->m10);
+	writer_writeFloat(w, c->m11);
+	writer_writeString(w, c->id);
+	writer_writeU8(w, c->alpha);
+	info->save(w);
+    }
+}
+
+char InfoOutputDev::load(reader_t*r, int size)
+{
+    U32 count = reader_readU32(r);
+    if(!count_ok(r, size, count))
+	return 0;
+    int num = count;
+    FontInfo**infos = (FontInfo**)malloc(sizeof(FontInfo*)*num);
+    int t;
+    for(t=0;t<num;t++) {
+	fontclass_t c;
+	c.m00 = reader_readFloat(r);
+	c.m01 = reader_readFloat(r);
+	c.m10 = reader_readFloat(r);
+	c.m11 = reader_readFloat(r);
+	c.id = reader_readString(r);
+	c.alpha = reader_readU8(r);
+	infos[t] = new FontInfo(&c);
+	free(c.id);
+	if(!infos[t]->load(r, size)) {
+	    for(;t>=0;t--) {
+		delete infos[t];
+	    }
+	    free(infos);
+	    return 0;
+	}
+    }
+    /* see save() */
+    for(t=0;t<num;t++) {
+	dict_put(this->fontcache, infos[t]->fontclass, infos[t]);
+	num_fonts++;
+    }
+    free(infos);
+    return 1;
+}
+
 GBool InfoOutputDev::upsideDown() {return gTrue;}
 GBool InfoOutputDev::useDrawChar() {return gTrue;}
 GBool InfoOutputDev::interpretType3Chars() {return gTrue;}
@@ -713,7 +930,13 @@ FontInfo* InfoOutputDev::getOrCreateFontInfo(GfxState*state)
 FontInfo* InfoOutputDev::getFontInfo(GfxState*state)
 {
     fontclass_t fontclass = fontclass_from_state(state);
+#ifdef INFO_FONTCACHE_MUTEX
+    gLockMutex(&fontcache_mutex);
+#endif
     FontInfo*result = (FontInfo*)dict_lookup(this->fontcache, &fontclass);
+#ifdef INFO_FONTCACHE_MUTEX
+    gUnlockMutex(&fontcache_mutex);
+#endif
     if(!result) {
 	printf("NOT FOUND: ");
 	fontclass_print(&fontclass);
@@ -777,6 +1000,8 @@ void InfoOutputDev::drawChar(GfxState *state, double x, double y,
     GlyphInfo*g = fontinfo->glyphs[code];
     if(!g) {
 	g = fontinfo->glyphs[code] = new GlyphInfo();
+	g->version = -1;
+	fontinfo->num_collected++;
 	g->advance_max = 0;
 	current_splash_font->last_advance = -1;
 	g->path = current_splash_font->getGlyphPath(code);
@@ -861,6 +1086,8 @@ GBool InfoOutputDev::beginType3Char(GfxState *state, double x, double y, double
     fontinfo->grow(code+1);
     if(!fontinfo->glyphs[code]) {
 	currentglyph = fontinfo->glyphs[code] = new GlyphInfo();
+	currentglyph->version = -1;
+	fontinfo->num_collected++;
 	currentglyph->unicode = uLen?u[0]:0;
 	currentglyph->path = new SplashPath();
 	currentglyph->x1=0;
@@ -975,5 +1202,9 @@ void InfoOutputDev::dumpfonts(gfxdevice_t*dev)
 
     DICT_ITERATE_DATA(fontcache, FontInfo*, info) {
         dev->addfont(dev, info->getGfxFont());
+	int t;
+	for(t=0;t<info->num_versions;t++) {
+	    dev->addfont(dev, info->versions[t]);
+	}
     }
 }
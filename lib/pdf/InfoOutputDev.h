@@ -44,10 +44,15 @@
 #include <goo/GooHash.h>
 #else
 #include "GHash.h"
+#if MULTITHREADED
+#include "GMutex.h"
+#define INFO_FONTCACHE_MUTEX
+#endif
 #endif
 #include "../gfxdevice.h"
 #include "../gfxtools.h"
 #include "../gfxfont.h"
+#include "../bitio.h"
 #include "../q.h"
 
 #define INTERNAL_FONT_SIZE 1024.0
@@ -57,7 +62,9 @@ struct GlyphInfo
 {
     SplashPath*path;
     int unicode;
+    /* index of this glyph in the font (version) it was stored in */
     int glyphid;
+    int version;
     double advance;
     double x1,y1,x2,y2;
 
@@ -73,11 +80,13 @@ typedef struct _fontclass {
 class FontInfo
 {
     gfxfont_t*gfxfont;
+    /* number of glyphs collected when the font (or the last version) was created */
+    int gfxfont_num_collected;
 
     char*id;
     double scale;
     
-    gfxfont_t* createGfxFont();
+    gfxfont_t* createGfxFont(int version);
 public:
     fontclass_t*fontclass;
     FontInfo(fontclass_t*fontclass);
@@ -85,6 +94,7 @@ public:
 
     gfxmatrix_t get_gfxmatrix(GfxState*state);
     gfxfont_t* getGfxFont();
+    gfxfont_t* getGlyphFont(int charid);
 
     char usesSpaces();
 
@@ -97,11 +107,28 @@ public:
     void grow(int size);
     void resetPositioning();
 
+    void save(writer_t*w);
+    char load(reader_t*r, int size);
+
     GfxFont*font;
     double max_size;
     int num_glyphs;
     GlyphInfo**glyphs;
-
+    int num_collected;
+
+    /* glyphs collected after getGfxFont() was first called (i.e., on
+       pages processed later) are stored in additional fonts */
+    int num_versions;
+    gfxfont_t**versions;
+    char*versions_seen;
+
+    /* gfxfont, the versions and the seen flags are updated without locking
+       while rendering. With several pages rendering at once (pdf2swf -N,
+       i.e. threadsafe) that's only safe because pdf_open() then always
+       collects all glyphs up front, and pdf_doc_prepare() creates the
+       gfxfonts and passes them to the output device before any page
+       starts: no versions are created, and seen merely goes from 0 to 1,
+       with the per-page addfont() being redundant. */
     char seen;
     int space_char;
     float average_advance;
@@ -121,6 +148,11 @@ class InfoOutputDev: public OutputDev
     Page *page;
 
     dict_t*fontcache;
+#ifdef INFO_FONTCACHE_MUTEX
+    /* dict_lookup() reorders the hash chains, so lookups from
+       concurrently rendering pages need to be serialized */
+    GMutex fontcache_mutex;
+#endif
     FontInfo*last_font;
     FontInfo*current_type3_font;
     SplashFont*current_splash_font;
@@ -140,6 +172,10 @@ class InfoOutputDev: public OutputDev
     void dumpfonts(gfxdevice_t*dev);
     FontInfo* getFontInfo(GfxState*state);
 
+    /* store/restore the collected fonts, for the info cache in pdf.cc */
+    void save(writer_t*w);
+    char load(reader_t*r, int size);
+
     InfoOutputDev(XRef*xref);
     virtual ~InfoOutputDev(); 
     virtual GBool useTilingPatternFill();
@@ -133,6 +133,8 @@ VectorGraphicOutputDev::VectorGraphicOutputDev(InfoOutputDev*info, PDFDoc*doc, i
     this->config_disable_polygon_conversion = 0;
     this->config_multiply = 1;
     this->config_textonly = 0;
+    this->config_polythreads = 0;
+    this->linearena = gfxlinearena_new();
 
     /* for processing drawChar events */
     this->charDev = new CharOutputDev(info, doc, page2page, num_pages, x, y, x1, y1, x2, y2);
@@ -160,6 +162,8 @@ void VectorGraphicOutputDev::setParameter(const char*key, const char*value)
         this->config_disable_polygon_conversion = atoi(value);
     } else if(!strcmp(key,"disable_tiling_pattern_fills")) {
         this->config_disable_tiling_pattern_fills = atoi(value);
+    } else if(!strcmp(key,"polythreads")) {
+        this->config_polythreads = atoi(value);
     }
     this->charDev->setParameter(key, value);
 }
@@ -231,7 +235,7 @@ gfxline_t* VectorGraphicOutputDev::gfxPath_to_gfxline(GfxState*state, GfxPath*pa
 	return 0;
     }
     gfxdrawer_t draw;
-    gfxdrawer_target_gfxline(&draw);
+    gfxdrawer_target_gfxline_arena(&draw, linearena);
 
     for(t = 0; t < num; t++) {
 	GfxSubpath *subpath = path->getSubpath(t);
@@ -279,7 +283,7 @@ gfxline_t* VectorGraphicOutputDev::gfxPath_to_gfxline(GfxState*state, GfxPath*pa
     }
     gfxline_t*result = (gfxline_t*)draw.result(&draw);
 
-    gfxline_optimize(result);
+    gfxline_optimize_arena(result, linearena);
 
     return result;
 }
@@ -483,6 +487,7 @@ void VectorGraphicOutputDev::endPage()
 	device->endclip(device);
 	outer_clip_box = 0;
     }
+    gfxlinearena_reset(linearena);
 }
 void VectorGraphicOutputDev::setDefaultCTM(double *ctm)
 {
@@ -647,11 +652,13 @@ void VectorGraphicOutputDev::clip(GfxState *state)
     gfxline_t*line = gfxPath_to_gfxline(state, path, 1);
     if(!config_disable_polygon_conversion) {
 	gfxline_t*line2 = gfxpoly_circular_to_evenodd(line, DEFAULT_GRID);
-	gfxline_free(line);
-	line = line2;
+	gfxline_free_arena(line, linearena);
+	clipToGfxLine(state, line2, 0);
+	gfxline_free(line2);
+    } else {
+	clipToGfxLine(state, line, 0);
+	gfxline_free_arena(line, linearena);
     }
-    clipToGfxLine(state, line, 0);
-    gfxline_free(line);
 }
 
 void VectorGraphicOutputDev::eoClip(GfxState *state) 
@@ -659,7 +666,7 @@ void VectorGraphicOutputDev::eoClip(GfxState *state)
     GfxPath * path = state->getPath();
     gfxline_t*line = gfxPath_to_gfxline(state, path, 1);
     clipToGfxLine(state, line, 1);
-    gfxline_free(line);
+    gfxline_free_arena(line, linearena);
 }
 void VectorGraphicOutputDev::clipToStrokePath(GfxState *state)
 {
@@ -673,7 +680,7 @@ void VectorGraphicOutputDev::clipToStrokePath(GfxState *state)
     }
 
     strokeGfxline(state, line, STROKE_FILL|STROKE_CLIP);
-    gfxline_free(line);
+    gfxline_free_arena(line, linearena);
 }
 
 void VectorGraphicOutputDev::finish()
@@ -690,6 +697,7 @@ VectorGraphicOutputDev::~VectorGraphicOutputDev()
 {
     finish();
     delete charDev;charDev=0;
+    gfxlinearena_destroy(linearena);linearena=0;
 };
 GBool VectorGraphicOutputDev::upsideDown() 
 {
@@ -1485,7 +1493,7 @@ void VectorGraphicOutputDev::stroke(GfxState *state)
     GfxPath * path = state->getPath();
     gfxline_t*line= gfxPath_to_gfxline(state, path, 0);
     strokeGfxline(state, line, 0);
-    gfxline_free(line);
+    gfxline_free_arena(line, linearena);
 }
 
 void VectorGraphicOutputDev::fill(GfxState *state) 
@@ -1499,11 +1507,13 @@ void VectorGraphicOutputDev::fill(GfxState *state)
     gfxline_t*line= gfxPath_to_gfxline(state, path, 1);
     if(!config_disable_polygon_conversion) {
         gfxline_t*line2 = gfxpoly_circular_to_evenodd(line, DEFAULT_GRID);
-        gfxline_free(line);
-        line = line2;
+        gfxline_free_arena(line, linearena);
+        fillGfxLine(state, line2, 0);
+        gfxline_free(line2);
+    } else {
+        fillGfxLine(state, line, 0);
+        gfxline_free_arena(line, linearena);
     }
-    fillGfxLine(state, line, 0);
-    gfxline_free(line);
 }
 
 void VectorGraphicOutputDev::eoFill(GfxState *state) 
@@ -1516,7 +1526,7 @@ void VectorGraphicOutputDev::eoFill(GfxState *state)
     GfxPath * path = state->getPath();
     gfxline_t*line= gfxPath_to_gfxline(state, path, 1);
     fillGfxLine(state, line, 1);
-    gfxline_free(line);
+    gfxline_free_arena(line, linearena);
 }
 
 
@@ -1678,6 +1688,11 @@ void VectorGraphicOutputDev::clearSoftMask(GfxState *state)
     /* get outline of all objects below the soft mask */
     gfxdevice_t uniondev;
     gfxdevice_union_init(&uniondev, 0);
+    if(this->config_polythreads>1) {
+	char buf[16];
+	sprintf(buf, "%d", this->config_polythreads);
+	uniondev.setparameter(&uniondev, "polythreads", buf);
+    }
     gfxresult_record_replay(below, &uniondev, 0);
     gfxline_t*belowoutline = gfxdevice_union_getunion(&uniondev);
     uniondev.finish(&uniondev);
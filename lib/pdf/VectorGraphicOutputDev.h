@@ -192,6 +192,9 @@ virtual POPPLER_TILING_PATERN_RETURN tilingPatternFill(GfxState *state,
 
   gfxline_t* current_text_stroke;
   gfxline_t* current_text_clip;
+
+  /* nodes of the lines created by gfxPath_to_gfxline, released in endPage() */
+  gfxlinearena_t* linearena;
   gfxfont_t* current_gfxfont;
   FontInfo*current_fontinfo;
   gfxmatrix_t current_font_matrix;
@@ -206,6 +209,7 @@ virtual POPPLER_TILING_PATERN_RETURN tilingPatternFill(GfxState *state,
   int config_drawonlyshapes;
   int config_textonly;
   int config_disable_tiling_pattern_fills;
+  int config_polythreads;
 
   gfxdevice_t char_output_dev;
   CharOutputDev*charDev;
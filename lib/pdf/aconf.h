@@ -15,6 +15,10 @@
 
 #define TEXTOUT_WORD_LIST 1
 
+#ifdef HAVE_THREADS
+#define MULTITHREADED 1
+#endif
+
 // todo:
 //
 // HAVE_STRINGS_H
@@ -1,22 +1,32 @@
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
+#include <limits.h>
 #include "../gfxdevice.h"
 #include "../gfxsource.h"
 #include "../devices/rescale.h"
 #include "../log.h"
 #include "../../config.h"
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 #ifdef HAVE_POPPLER
   #include <poppler-config.h>
 #else
   #include "xpdf/config.h"
 #endif
 #include "GlobalParams.h"
+#if MULTITHREADED && !defined(HAVE_POPPLER)
+#include "GMutex.h"
+#define PDF_DOCPOOL_MUTEX
+#endif
 #include "InfoOutputDev.h"
 #include "CharOutputDev.h"
 #include "FullBitmapOutputDev.h"
 #include "BitmapOutputDev.h"
 #include "VectorGraphicOutputDev.h"
 #include "../mem.h"
+#include "../bitio.h"
 #include "pdf.h"
 #define NO_ARGPARSER
 #include "../args.h"
@@ -27,6 +37,10 @@ static int zoomtowidth = 0;
 static double multiply = 1.0;
 static char* global_page_range = 0;
 static int threadsafe = 0;
+static int infoprepass = 1;
+static int storeallcharacters = 0;
+static char* infocache = 0;
+static char* font_sources = 0;
 
 static int globalparams_count=0;
 
@@ -37,6 +51,7 @@ typedef struct _pdf_page_info
     int number_of_images;
     int number_of_links;
     int number_of_fonts;
+    char in_range;
     char has_info;
 } pdf_page_info_t;
 
@@ -62,6 +77,15 @@ typedef struct _pdf_doc_internal
     pdf_page_info_t*pages;
     char*filename;
 
+    /* in threadsafe mode, every concurrently rendered page needs its own
+       PDFDoc. Idle instances are kept here for reuse. */
+    PDFDoc**docpool;
+    int docpool_size;
+    int docpool_num;
+#ifdef PDF_DOCPOOL_MUTEX
+    GMutex docpool_mutex;
+#endif
+
     /* page map */
     int*pagemap;
     int pagemap_size;
@@ -102,6 +126,77 @@ void pdfpage_destroy(gfxpage_t*pdf_page)
     free(pdf_page);pdf_page=0;
 }
 
+static PDFDoc* docpool_acquire(pdf_doc_internal_t*pi)
+{
+    if(!threadsafe)
+	return pi->doc;
+    PDFDoc*doc = 0;
+#ifdef PDF_DOCPOOL_MUTEX
+    gLockMutex(&pi->docpool_mutex);
+#endif
+    if(pi->docpool_num) {
+	doc = pi->docpool[--pi->docpool_num];
+    }
+#ifdef PDF_DOCPOOL_MUTEX
+    gUnlockMutex(&pi->docpool_mutex);
+#endif
+    if(!doc) {
+	/* PDFDoc takes ownership of the filename string */
+	doc = new PDFDoc(new GString(pi->fileName), pi->userPW);
+    }
+    return doc;
+}
+
+static void docpool_release(pdf_doc_internal_t*pi, PDFDoc*doc)
+{
+    if(doc == pi->doc)
+	return;
+#ifdef PDF_DOCPOOL_MUTEX
+    gLockMutex(&pi->docpool_mutex);
+#endif
+    if(pi->docpool_num == pi->docpool_size) {
+	pi->docpool_size = pi->docpool_size ? pi->docpool_size*2 : 8;
+	pi->docpool = (PDFDoc**)rfx_realloc(pi->docpool, sizeof(PDFDoc*)*pi->docpool_size);
+    }
+    pi->docpool[pi->docpool_num++] = doc;
+#ifdef PDF_DOCPOOL_MUTEX
+    gUnlockMutex(&pi->docpool_mutex);
+#endif
+}
+
+/* page geometry, as InfoOutputDev::startPage() would compute it, but
+   taken directly from the page's crop box */
+static void page_geometry(pdf_doc_internal_t*i, int nr)
+{
+    Page*page = i->doc->getCatalog()->getPage(nr);
+    GfxState state(zoom, zoom, page->getMediaBox(), page->getRotate(), gTrue);
+    PDFRectangle *r = page->getCropBox();
+    double x1,y1,x2,y2;
+    state.transform(r->x1,r->y1,&x1,&y1);
+    state.transform(r->x2,r->y2,&x2,&y2);
+    if(x2<x1) {double x3=x1;x1=x2;x2=x3;}
+    if(y2<y1) {double y3=y1;y1=y2;y2=y3;}
+    pdf_page_info_t*p = &i->pages[nr-1];
+    p->xMin = (int)x1;
+    p->yMin = (int)y1;
+    p->xMax = (int)x2;
+    p->yMax = (int)y2;
+    p->width = p->xMax - p->xMin;
+    p->height = p->yMax - p->yMin;
+}
+
+/* run the InfoOutputDev over a page, collecting its fonts and glyphs */
+static void page_info(pdf_doc_internal_t*i, int nr)
+{
+    i->doc->displayPage((OutputDev*)i->info, nr, zoom, zoom, /*rotate*/0, /*usemediabox*/true, /*crop*/true, i->config_print);
+    i->doc->processLinks((OutputDev*)i->info, nr);
+    pdf_page_info_t*p = &i->pages[nr-1];
+    p->number_of_images = i->info->num_ppm_images + i->info->num_jpeg_images;
+    p->number_of_links = i->info->num_links;
+    p->number_of_fonts = i->info->num_fonts;
+    p->has_info = 1;
+}
+
 static void render2(gfxpage_t*page, gfxdevice_t*dev, int x,int y, int x1,int y1,int x2,int y2)
 {
     pdf_doc_internal_t*pi = (pdf_doc_internal_t*)page->parent->internal;
@@ -110,18 +205,32 @@ static void render2(gfxpage_t*page, gfxdevice_t*dev, int x,int y, int x1,int y1,
     if(!pi->config_print && pi->nocopy) {msg("<fatal> PDF disallows copying");exit(0);}
     if(pi->config_print && pi->noprint) {msg("<fatal> PDF disallows printing");exit(0);}
 
+    if(!pi->pages[page->nr-1].in_range) {
+	msg("<fatal> pdf_page_render: page %d was previously set as not-to-render via the \"pages\" option", page->nr);
+	return;
+    }
+    if(!pi->pages[page->nr-1].has_info) {
+	/* not collected in pdf_open(), see there. This modifies the shared
+	   FontInfos, and is hence never done when pages are rendered
+	   concurrently (threadsafe forces the info pass in pdf_open()) */
+	assert(!threadsafe);
+	page_info(pi, page->nr);
+    }
+
+    PDFDoc*doc = docpool_acquire(pi);
+
     CommonOutputDev*outputDev = 0;
     if(pi->config_full_bitmap_optimizing) {
-	FullBitmapOutputDev*d = new FullBitmapOutputDev(pi->info, pi->doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
+	FullBitmapOutputDev*d = new FullBitmapOutputDev(pi->info, doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
 	outputDev = (CommonOutputDev*)d;
     } else if(pi->config_bitmap_optimizing) {
-	BitmapOutputDev*d = new BitmapOutputDev(pi->info, pi->doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
+	BitmapOutputDev*d = new BitmapOutputDev(pi->info, doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
 	outputDev = (CommonOutputDev*)d;
     } else if(pi->config_only_text) {
-	CharOutputDev*d = new CharOutputDev(pi->info, pi->doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
+	CharOutputDev*d = new CharOutputDev(pi->info, doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
 	outputDev = (CommonOutputDev*)d;
     } else {
-	VectorGraphicOutputDev*d = new VectorGraphicOutputDev(pi->info, pi->doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
+	VectorGraphicOutputDev*d = new VectorGraphicOutputDev(pi->info, doc, pi->pagemap, pi->pagemap_pos, x, y, x1, y1, x2, y2);
 	outputDev = (CommonOutputDev*)d;
     }
 
@@ -150,22 +259,19 @@ static void render2(gfxpage_t*page, gfxdevice_t*dev, int x,int y, int x1,int y1,
 	return;
     }
 
-    if(!pi->pages[page->nr-1].has_info) {
-	msg("<fatal> pdf_page_render: page %d was previously set as not-to-render via the \"pages\" option", page->nr);
-	return;
-    }
-
     if(pi->protect) {
         dev->setparameter(dev, "protect", "1");
     }
 
     outputDev->setDevice(dev);
-    pi->doc->processLinks((OutputDev*)outputDev, page->nr);
-    pi->doc->displayPage((OutputDev*)outputDev, page->nr, zoom*multiply, zoom*multiply, /*rotate*/0, true, true, pi->config_print);
+    doc->processLinks((OutputDev*)outputDev, page->nr);
+    doc->displayPage((OutputDev*)outputDev, page->nr, zoom*multiply, zoom*multiply, /*rotate*/0, true, true, pi->config_print);
     outputDev->finishPage();
     outputDev->setDevice(0);
     delete outputDev;
 
+    docpool_release(pi, doc);
+
     if(middev) {
 	gfxdevice_rescale_setdevice(middev, 0x00000000);
 	middev->finish(middev);
@@ -206,6 +312,16 @@ void pdf_doc_destroy(gfxdocument_t*gfx)
     if(i->doc) {
 	delete i->doc; i->doc=0;
     }
+    int t;
+    for(t=0;t<i->docpool_num;t++) {
+	delete i->docpool[t];
+    }
+    if(i->docpool) {
+	free(i->docpool);i->docpool = 0;
+    }
+#ifdef PDF_DOCPOOL_MUTEX
+    gDestroyMutex(&i->docpool_mutex);
+#endif
     free(i->pages); i->pages = 0;
     
     if(i->pagemap) {
@@ -288,14 +404,8 @@ void pdf_doc_setparameter(gfxdocument_t*gfx, const char*name, const char*value)
 gfxpage_t* pdf_doc_getpage(gfxdocument_t*doc, int page)
 {
     pdf_doc_internal_t*di= (pdf_doc_internal_t*)doc->internal;
-    if(threadsafe) {
-	/* for multi-thread operation, we need to create a new PDFDoc instance
-	   for each thread */
-	di->doc = 0;
-    }
-    if(!di->doc) {
-	di->doc = new PDFDoc(di->fileName, di->userPW);
-    }
+    /* for multi-thread operation, every rendering thread draws its own
+       PDFDoc instance from the document's pool, see docpool_acquire() */
 
     if(page < 1 || page > doc->num_pages)
         return 0;
@@ -406,6 +516,14 @@ extern int config_remove_font_transforms;
 extern int config_remove_invisible_outlines;
 extern int config_break_on_warning;
 
+/* remember the font and language directories, for the info cache fingerprint */
+static void add_font_source(const char*name, const char*value)
+{
+    char*s = allocprintf("%s %s=%s", font_sources?font_sources:"", name, value);
+    free(font_sources);
+    font_sources = s;
+}
+
 static void pdf_setparameter(gfxsource_t*src, const char*name, const char*value)
 {
     gfxsource_internal_t*i = (gfxsource_internal_t*)src->internal;
@@ -415,6 +533,7 @@ static void pdf_setparameter(gfxsource_t*src, const char*name, const char*value)
     msg("<verbose> setting parameter %s to \"%s\"", name, value);
     if(!strncmp(name, "fontdir", strlen("fontdir"))) {
         addGlobalFontDir(value);
+	add_font_source("fontdir", value);
     } else if(!strcmp(name, "addspacechars")) {
 	config_addspace = atoi(value);
 	gfxparams_store(i->parameters, "detectspaces", "0");
@@ -444,10 +563,20 @@ static void pdf_setparameter(gfxsource_t*src, const char*name, const char*value)
 	global_page_range = strdup(value);
     } else if(!strncmp(name, "font", strlen("font")) && name[4]!='q') {
 	addGlobalFont(value);
+	add_font_source("font", value);
     } else if(!strncmp(name, "languagedir", strlen("languagedir"))) {
         addGlobalLanguageDir(value);
+	add_font_source("languagedir", value);
     } else if(!strcmp(name, "threadsafe")) {
 	threadsafe = atoi(value);
+	if(threadsafe)
+	    getGfxGlobals(); // create it now, before pages run in parallel
+    } else if(!strcmp(name, "infoprepass")) {
+	infoprepass = atoi(value);
+    } else if(!strcmp(name, "storeallcharacters")) {
+	storeallcharacters = atoi(value);
+    } else if(!strcmp(name, "infocache")) {
+	infocache = strdup(value);
     } else if(!strcmp(name, "zoomtowidth")) {
 	zoomtowidth = atoi(value);
     } else if(!strcmp(name, "zoom")) {
@@ -467,9 +596,165 @@ static void pdf_setparameter(gfxsource_t*src, const char*name, const char*value)
 	printf("multiply=<times>  Render everything at <times> the resolution\n");
 	printf("poly2bitmap       Convert graphics to bitmaps\n");
 	printf("bitmap            Convert everything to bitmaps\n");
+	printf("polythreads=<n>   Intersect/unite large polygons (soft masks, --flatten) in <n> parallel bands\n");
+	printf("infoprepass=0     Scan each page for fonts when it is rendered instead of when opening the document\n");
+	printf("                  (faster start, but glyphs first seen on later pages go into extra fonts)\n");
+	printf("infocache=<dir>   Keep the results of the font scan in <dir>, for reuse (implies infoprepass)\n");
     }	
 }
 
+/* The info cache stores the page and font information which the
+   InfoOutputDev collects in a prepass over the pages in range, keyed by
+   the document's contents and the parameters which influence the font
+   extraction (including the page range: with fewer pages, the fonts
+   contain fewer glyphs). */
+
+#define INFOCACHE_MAGIC "swftools pdf info 2"
+
+static char* infocache_fingerprint()
+{
+    return allocprintf("zoom=%f fontquality=%d addspace=%d unique_unicode=%d bigchar=%d marker_glyph=%d "
+	               "normalize_fonts=%d remove_font_transforms=%d remove_invisible_outlines=%d "
+		       "poly2bitmap=%d skewedtobitmap=%d pages=%s%s",
+		       zoom, config_fontquality, config_addspace, config_unique_unicode, config_bigchar, config_marker_glyph,
+		       config_normalize_fonts, config_remove_font_transforms, config_remove_invisible_outlines,
+		       config_poly2bitmap_pass1, config_skewedtobitmap_pass1,
+		       global_page_range?global_page_range:"all", font_sources?font_sources:"");
+}
+
+static char* infocache_filename(const char*filename)
+{
+    FILE*fi = fopen(filename, "rb");
+    if(!fi) {
+	return 0;
+    }
+    uint64_t crc = 0;
+    char buf[65536];
+    size_t len;
+    while((len = fread(buf, 1, sizeof(buf), fi)) > 0) {
+	crc = crc64_add_bytes(crc, buf, len);
+    }
+    fclose(fi);
+
+    char*fingerprint = infocache_fingerprint();
+    char*cachefile = allocprintf("%s%s%016llx-%08x.info", infocache, dirseparator(), 
+	                         (unsigned long long)crc, crc32_add_string(0, fingerprint));
+    free(fingerprint);
+    return cachefile;
+}
+
+static char infocache_load(pdf_doc_internal_t*i, int num_pages, const char*cachefile)
+{
+    FILE*fi = fopen(cachefile, "rb");
+    if(!fi) {
+	return 0;
+    }
+    fseek(fi, 0, SEEK_END);
+    long size = ftell(fi);
+    fseek(fi, 0, SEEK_SET);
+    if(size < 0 || size > INT_MAX) {
+	fclose(fi);
+	return 0;
+    }
+    void*data = malloc(size);
+    if(fread(data, 1, size, fi) != (size_t)size) {
+	fclose(fi);
+	free(data);
+	return 0;
+    }
+    fclose(fi);
+    reader_t r;
+    reader_init_memreader(&r, data, size);
+
+    char*magic = reader_readString(&r);
+    char*fingerprint = reader_readString(&r);
+    char*expected = infocache_fingerprint();
+    char ok = !strcmp(magic, INFOCACHE_MAGIC) && !strcmp(fingerprint, expected) &&
+	      (int)reader_readU32(&r) == num_pages;
+    free(magic);
+    free(fingerprint);
+    free(expected);
+
+    if(ok) {
+	/* read into a copy, so that a corrupt file doesn't leave garbage behind */
+	pdf_page_info_t*pages = (pdf_page_info_t*)malloc(sizeof(pdf_page_info_t)*num_pages);
+	memcpy(pages, i->pages, sizeof(pdf_page_info_t)*num_pages);
+	int t;
+	for(t=0;t<num_pages;t++) {
+	    pdf_page_info_t*p = &pages[t];
+	    p->xMin = reader_readU32(&r);
+	    p->yMin = reader_readU32(&r);
+	    p->xMax = reader_readU32(&r);
+	    p->yMax = reader_readU32(&r);
+	    p->width = reader_readU32(&r);
+	    p->height = reader_readU32(&r);
+	    p->number_of_images = reader_readU32(&r);
+	    p->number_of_links = reader_readU32(&r);
+	    p->number_of_fonts = reader_readU32(&r);
+	    p->has_info = reader_readU8(&r);
+	}
+	InfoOutputDev*info = new InfoOutputDev(i->doc->getXRef());
+	if(info->load(&r, size) && (int)reader_readU32(&r) == num_pages) {
+	    memcpy(i->pages, pages, sizeof(pdf_page_info_t)*num_pages);
+	    delete i->info;
+	    i->info = info;
+	} else {
+	    msg("<warning> Ignoring corrupt info cache file %s", cachefile);
+	    delete info;
+	    ok = 0;
+	}
+	free(pages);
+    }
+    r.dealloc(&r);
+    free(data);
+    return ok;
+}
+
+static void infocache_save(pdf_doc_internal_t*i, int num_pages, const char*cachefile)
+{
+    /* write to a temporary file first, so that concurrent runs never see
+       a partially written cache file */
+    char*tmpfile = allocprintf("%s.%d", cachefile, (int)getpid());
+    writer_t w;
+    writer_init_growingmemwriter(&w, 65536);
+
+    writer_writeString(&w, INFOCACHE_MAGIC);
+    char*fingerprint = infocache_fingerprint();
+    writer_writeString(&w, fingerprint);
+    free(fingerprint);
+    writer_writeU32(&w, num_pages);
+    int t;
+    for(t=0;t<num_pages;t++) {
+	pdf_page_info_t*p = &i->pages[t];
+	writer_writeU32(&w, p->xMin);
+	writer_writeU32(&w, p->yMin);
+	writer_writeU32(&w, p->xMax);
+	writer_writeU32(&w, p->yMax);
+	writer_writeU32(&w, p->width);
+	writer_writeU32(&w, p->height);
+	writer_writeU32(&w, p->number_of_images);
+	writer_writeU32(&w, p->number_of_links);
+	writer_writeU32(&w, p->number_of_fonts);
+	writer_writeU8(&w, p->has_info);
+    }
+    i->info->save(&w);
+    writer_writeU32(&w, num_pages);
+
+    int len = 0;
+    void*data = writer_growmemwrite_memptr(&w, &len);
+    FILE*fo = fopen(tmpfile, "wb");
+    char ok = fo && fwrite(data, 1, len, fo) == (size_t)len;
+    if(fo && fclose(fo))
+	ok = 0;
+    w.finish(&w);
+
+    if(!ok || rename(tmpfile, cachefile)) {
+	msg("<warning> Couldn't write info cache file %s", cachefile);
+	unlink(tmpfile);
+    }
+    free(tmpfile);
+}
+
 void pdf_doc_prepare(gfxdocument_t*doc, gfxdevice_t*dev)
 {
     pdf_doc_internal_t*i= (pdf_doc_internal_t*)doc->internal;
@@ -485,6 +770,9 @@ static gfxdocument_t*pdf_open(gfxsource_t*src, const char*filename)
     memset(i, 0, sizeof(pdf_doc_internal_t));
     i->parent = src;
     i->parameters = gfxparams_new();
+#ifdef PDF_DOCPOOL_MUTEX
+    gInitMutex(&i->docpool_mutex);
+#endif
     pdf_doc->internal = i;
     char*userPassword=0;
     
@@ -538,21 +826,36 @@ static gfxdocument_t*pdf_open(gfxsource_t*src, const char*filename)
     i->pages = (pdf_page_info_t*)malloc(sizeof(pdf_page_info_t)*pdf_doc->num_pages);
     memset(i->pages,0,sizeof(pdf_page_info_t)*pdf_doc->num_pages);
     for(t=1;t<=pdf_doc->num_pages;t++) {
+	page_geometry(i, t);
 	if(!global_page_range || is_in_range(t, global_page_range)) {
-	    i->doc->displayPage((OutputDev*)i->info, t, zoom, zoom, /*rotate*/0, /*usemediabox*/true, /*crop*/true, i->config_print);
-	    i->doc->processLinks((OutputDev*)i->info, t);
-	    i->pages[t-1].xMin = i->info->x1;
-	    i->pages[t-1].yMin = i->info->y1;
-	    i->pages[t-1].xMax = i->info->x2;
-	    i->pages[t-1].yMax = i->info->y2;
-	    i->pages[t-1].width = i->info->x2 - i->info->x1;
-	    i->pages[t-1].height = i->info->y2 - i->info->y1;
-	    i->pages[t-1].number_of_images = i->info->num_ppm_images + i->info->num_jpeg_images;
-	    i->pages[t-1].number_of_links = i->info->num_links;
-	    i->pages[t-1].number_of_fonts = i->info->num_fonts;
-	    i->pages[t-1].has_info = 1;
+	    i->pages[t-1].in_range = 1;
+	}
+    }
+
+    /* Normally, the font information of all pages is collected up front.
+       With infoprepass=0, the font information of a page is only collected
+       the first time the page is rendered, and glyphs that only show up on
+       later pages are stored in additional fonts. That's not possible if
+       the fonts are needed in full (storeallcharacters), or if pages are
+       rendered concurrently (the FontInfos are shared between threads). */
+    char*cachefile = infocache ? infocache_filename(i->fileName->getCString()) : 0;
+    if(cachefile && infocache_load(i, pdf_doc->num_pages, cachefile)) {
+	msg("<verbose> Using page and font information from %s", cachefile);
+    } else if(cachefile) {
+	/* same scan as with infoprepass, so that the output doesn't depend
+	   on whether the cache was hit */
+	for(t=1;t<=pdf_doc->num_pages;t++) {
+	    if(i->pages[t-1].in_range)
+		page_info(i, t);
+	}
+	infocache_save(i, pdf_doc->num_pages, cachefile);
+    } else if(infoprepass || storeallcharacters || threadsafe) {
+	for(t=1;t<=pdf_doc->num_pages;t++) {
+	    if(i->pages[t-1].in_range)
+		page_info(i, t);
 	}
     }
+    free(cachefile);
 
     pdf_doc->get = 0;
     pdf_doc->destroy = pdf_doc_destroy;
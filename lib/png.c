@@ -24,6 +24,7 @@
 #include <fcntl.h>
 #include <zlib.h>
 #include <limits.h>
+#include "threads.h"
 
 #ifdef EXPORT
 #undef EXPORT
@@ -31,6 +32,7 @@
 
 #ifdef PNG_INLINE_EXPORTS
 #define EXPORT static
+typedef struct _pngwriter pngwriter_t;
 #else
 #define EXPORT
 #include "png.h"
@@ -1103,9 +1105,10 @@ static void png_patch_len(FILE*fi, int pos, int len)
 }
 static void png_write_bytes(FILE*fi, unsigned char*bytes, int len)
 {
-    int t;
-    for(t=0;t<len;t++)
-	png_write_byte(fi,bytes[t]);
+    /* zlib's crc32() uses the same polynomial, but works on the
+       final (inverted) checksum */
+    fwrite(bytes, len, 1, fi);
+    mycrc32 = crc32(mycrc32^0xffffffff, bytes, len)^0xffffffff;
 }
 static void png_write_dword(FILE*fi, u32 dword)
 {
@@ -1279,7 +1282,7 @@ static int png_get_number_of_palette_entries(COL*img, unsigned width, unsigned h
 		palette_overflow = 1;
 		break;
 	    }
-	    count[size[hash]] = 1;
+	    ccount[size[hash]] = 1;
 	    cpal[size[hash]++] = col32;
 	    palsize++;
 	}
@@ -1287,6 +1290,7 @@ static int png_get_number_of_palette_entries(COL*img, unsigned width, unsigned h
     }
     if(palette_overflow) {
 	free(pal);
+	free(count);
 	*has_alpha=1;
 	return width*height;
     }
@@ -1462,27 +1466,11 @@ static int png_apply_specific_filter_32(int filtermode, unsigned char*dest, unsi
     return filtermode;
 }
 
-static int*num_bits_table = 0;
-
-static void make_num_bits_table()
-{
-    if(num_bits_table) return;
-    num_bits_table = malloc(sizeof(num_bits_table[0])*256);
-    int t;
-    for(t=0;t<256;t++) {
-	int bits=0;
-	int v = t;
-	while(v) {
-	    bits++;
-	    v&=v-1;
-	}
-	num_bits_table[t]=bits;
-    }
-}
+/* scratch memory needed by png_find_best_filter() */
+#define PNG_FILTER_SCRATCH_SIZE (5*8192)
 
-static int png_find_best_filter(unsigned char*src, unsigned width, int bpp, int y)
+static int png_find_best_filter(unsigned char*src, unsigned width, int bpp, int y, unsigned char*scratch)
 {
-    make_num_bits_table();
     
     int num_filters = y>0?5:2; //don't apply y-direction filter in first line
     
@@ -1492,11 +1480,12 @@ static int png_find_best_filter(unsigned char*src, unsigned width, int bpp, int
     int back_y = y?width*bytes_per_pixel:0;
 
     unsigned char*pairs[5];
-    pairs[0] = calloc(1, 8192);
-    pairs[1] = calloc(1, 8192);
-    pairs[2] = calloc(1, 8192);
-    pairs[3] = calloc(1, 8192);
-    pairs[4] = calloc(1, 8192);
+    memset(scratch, 0, PNG_FILTER_SCRATCH_SIZE);
+    pairs[0] = scratch;
+    pairs[1] = scratch+8192;
+    pairs[2] = scratch+8192*2;
+    pairs[3] = scratch+8192*3;
+    pairs[4] = scratch+8192*4;
     
     unsigned char old[5];
     int l = bytes_per_pixel - 1;
@@ -1539,20 +1528,14 @@ static int png_find_best_filter(unsigned char*src, unsigned width, int bpp, int
 	    best_energy = energy;
 	}
     }
-    free(pairs[0]);
-    free(pairs[1]);
-    free(pairs[2]);
-    free(pairs[3]);
-    free(pairs[4]);
     return best_nr;
 }
     
     
-static int png_apply_filter(unsigned char*dest, unsigned char*src, unsigned width, int y, int bpp)
+static int png_apply_filter(unsigned char*dest, unsigned char*src, unsigned width, int y, int bpp, unsigned char*scratch)
 {
     int best_nr = 0;
 #if 0
-    make_num_bits_table();
     int num_filters = y>0?5:2; //don't apply y-direction filter in first line
     int f;
     int best_energy = INT_MAX;
@@ -1587,7 +1570,7 @@ static int png_apply_filter(unsigned char*dest, unsigned char*src, unsigned widt
     }
     free(pairs);
 #else
-    best_nr = png_find_best_filter(src, width, bpp, y);
+    best_nr = png_find_best_filter(src, width, bpp, y, scratch);
 #endif
     if(bpp==8)
 	png_apply_specific_filter_8(best_nr, dest, src, width);
@@ -1598,14 +1581,171 @@ static int png_apply_filter(unsigned char*dest, unsigned char*src, unsigned widt
 
 int png_apply_filter_8(unsigned char*dest, unsigned char*src, unsigned width, int y)
 {
-    return png_apply_filter(dest, src, width, y, 8);
+    unsigned char*scratch = malloc(PNG_FILTER_SCRATCH_SIZE);
+    int mode = png_apply_filter(dest, src, width, y, 8, scratch);
+    free(scratch);
+    return mode;
 }
 int png_apply_filter_32(unsigned char*dest, unsigned char*src, unsigned width, int y)
 {
-    return png_apply_filter(dest, src, width, y, 32);
+    unsigned char*scratch = malloc(PNG_FILTER_SCRATCH_SIZE);
+    int mode = png_apply_filter(dest, src, width, y, 32, scratch);
+    free(scratch);
+    return mode;
 }
 
-static void png_write_palette_based2(const char*filename, unsigned char*data, unsigned width, unsigned height, int numcolors, int compression)
+/* Parallel IDAT encoding, the way pigz does it: the image is cut into
+   chunks of rows, and each chunk is filtered and deflated as a raw deflate
+   stream on its own, ending with a sync flush (so that the next chunk
+   starts at a byte boundary). Every chunk gets the last 32k of filtered
+   data before it as preset dictionary, so compression is nearly as good as
+   with a single stream. The chunks are then concatenated and wrapped with
+   a zlib header and the combined adler32 checksum. */
+
+#define PNG_JOB_SIZE (512*1024)
+#define PNG_WINDOW_SIZE 32768
+
+typedef struct _pngchunk {
+    unsigned char*data;
+    int len;
+    uLong adler;
+    uLong rawlen;
+} pngchunk_t;
+
+typedef struct _pngjobs {
+    unsigned char*data;
+    unsigned width;
+    unsigned height;
+    int bpp;
+    unsigned srcwidth;
+    unsigned linelen;
+    int compression;
+    int rows_per_job;
+    int num_jobs;
+    pngchunk_t*chunks;
+    unsigned char**scratch;
+} pngjobs_t;
+
+static void png_filter_rows(pngjobs_t*w, unsigned char*dest, int y1, int y2, unsigned char*scratch)
+{
+    int y;
+    for(y=y1;y<y2;y++) {
+	unsigned char*line = dest + (y-y1)*w->linelen;
+	memset(line, 0, w->linelen);
+	line[0] = png_apply_filter(line+1, &w->data[y*w->srcwidth], w->width, y, w->bpp, scratch);
+    }
+}
+
+static void png_compress_job(void*data, int job, int thread)
+{
+    pngjobs_t*w = (pngjobs_t*)data;
+    pngchunk_t*chunk = &w->chunks[job];
+    unsigned char*scratch = w->scratch[thread];
+    int y1 = job*w->rows_per_job;
+    int y2 = y1+w->rows_per_job;
+    if(y2 > w->height)
+	y2 = w->height;
+    
+    z_stream zs;
+    memset(&zs,0,sizeof(z_stream));
+    if(deflateInit2(&zs, w->compression, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+	fprintf(stderr, "error in deflateInit2(): %s\n", zs.msg?zs.msg:"unknown");
+	return;
+    }
+
+    if(y1 > 0) {
+	/* recreate the filtered data preceding this chunk, for the dictionary */
+	int dictrows = (PNG_WINDOW_SIZE + w->linelen - 1) / w->linelen;
+	int d1 = y1 - dictrows;
+	if(d1 < 0)
+	    d1 = 0;
+	int dictlen = (y1-d1)*w->linelen;
+	unsigned char*dict = malloc(dictlen);
+	png_filter_rows(w, dict, d1, y1, scratch);
+	if(dictlen > PNG_WINDOW_SIZE) {
+	    deflateSetDictionary(&zs, dict+dictlen-PNG_WINDOW_SIZE, PNG_WINDOW_SIZE);
+	} else {
+	    deflateSetDictionary(&zs, dict, dictlen);
+	}
+	free(dict);
+    }
+
+    int len = (y2-y1)*w->linelen;
+    unsigned char*buf = malloc(len);
+    png_filter_rows(w, buf, y1, y2, scratch);
+    chunk->adler = adler32(adler32(0,0,0), buf, len);
+    chunk->rawlen = len;
+
+    /* room for the stream, plus the empty stored block of the sync flush */
+    int size = deflateBound(&zs, len) + 16;
+    chunk->data = malloc(size);
+    zs.next_in = buf;
+    zs.avail_in = len;
+    zs.next_out = chunk->data;
+    zs.avail_out = size;
+    int last = job == w->num_jobs-1;
+    int ret = deflate(&zs, last?Z_FINISH:Z_SYNC_FLUSH);
+    if(ret != (last?Z_STREAM_END:Z_OK) || zs.avail_in) {
+	fprintf(stderr, "error in deflate(): %s\n", zs.msg?zs.msg:"unknown");
+    }
+    chunk->len = size - zs.avail_out;
+    deflateEnd(&zs);
+    free(buf);
+}
+
+static long png_write_idat_threaded(FILE*fi, unsigned char*data, unsigned width, unsigned height, int bpp, unsigned linelen, int compression, int num_threads)
+{
+    pngjobs_t w;
+    int t;
+    memset(&w, 0, sizeof(w));
+    w.data = data;
+    w.width = width;
+    w.height = height;
+    w.bpp = bpp;
+    w.srcwidth = width*(bpp/8);
+    w.linelen = linelen;
+    w.compression = compression;
+    w.rows_per_job = PNG_JOB_SIZE / linelen;
+    if(w.rows_per_job < 1)
+	w.rows_per_job = 1;
+    w.num_jobs = (height + w.rows_per_job - 1) / w.rows_per_job;
+    w.chunks = (pngchunk_t*)calloc(w.num_jobs, sizeof(pngchunk_t));
+    w.scratch = (unsigned char**)malloc(sizeof(unsigned char*)*num_threads);
+    for(t=0;t<num_threads;t++) {
+	w.scratch[t] = malloc(PNG_FILTER_SCRATCH_SIZE);
+    }
+
+    threads_run(num_threads, w.num_jobs, png_compress_job, &w);
+
+    /* zlib header: deflate with 32k window, and the compression level
+       (as deflateInit() would write it) */
+    int level = compression==Z_DEFAULT_COMPRESSION?6:compression;
+    int flevel = level<2?0:(level<6?1:(level==6?2:3));
+    int header = 0x7800 | flevel<<6;
+    header += 31 - header%31;
+    png_write_byte(fi, header>>8);
+    png_write_byte(fi, header);
+    long size = 2;
+
+    uLong adler = adler32(0,0,0);
+    for(t=0;t<w.num_jobs;t++) {
+	png_write_bytes(fi, w.chunks[t].data, w.chunks[t].len);
+	size += w.chunks[t].len;
+	adler = adler32_combine(adler, w.chunks[t].adler, w.chunks[t].rawlen);
+	free(w.chunks[t].data);
+    }
+    png_write_dword(fi, adler);
+    size += 4;
+
+    for(t=0;t<num_threads;t++) {
+	free(w.scratch[t]);
+    }
+    free(w.scratch);
+    free(w.chunks);
+    return size;
+}
+
+static void png_write_palette_based2(const char*filename, unsigned char*data, unsigned width, unsigned height, int numcolors, int compression, int num_threads)
 {
     FILE*fi;
     int crc;
@@ -1696,6 +1836,14 @@ static void png_write_palette_based2(const char*filename, unsigned char*data, un
     }
 
     long idatpos = png_start_chunk(fi, "IDAT", 0);
+    long idatsize = 0;
+
+    if(num_threads > 1) {
+        int bypp = bpp/8;
+	unsigned linelen = 1 + width*bypp;
+	idatsize = png_write_idat_threaded(fi, data, width, height, bpp, linelen, compression, num_threads);
+	goto end_idat;
+    }
     
     memset(&zs,0,sizeof(z_stream));
     Bytef*writebuf = (Bytef*)malloc(ZLIB_BUFFER_SIZE);
@@ -1710,7 +1858,6 @@ static void png_write_palette_based2(const char*filename, unsigned char*data, un
 	return;
     }
 
-    long idatsize = 0;
     {
 	int x,y;
         int bypp = bpp/8;
@@ -1723,6 +1870,7 @@ static void png_write_palette_based2(const char*filename, unsigned char*data, un
         else if(bypp==4) 
             linelen = 1 + ((srcwidth+3)&~3);
 	unsigned char* line = (unsigned char*)malloc(linelen);
+	unsigned char* scratch = (unsigned char*)malloc(PNG_FILTER_SCRATCH_SIZE);
 	memset(line, 0, linelen);
 #if 0
 	unsigned char* bestline = (unsigned char*)malloc(linelen);
@@ -1752,42 +1900,169 @@ static void png_write_palette_based2(const char*filename, unsigned char*data, un
 	free(bestline);
 #else
 	for(y=0;y<height;y++) {
-            if(bpp==8)
-		line[0] = png_apply_filter_8(line+1, &data[y*srcwidth], width, y);
-            else
-		line[0] = png_apply_filter_32(line+1, &data[y*srcwidth], width, y);
+	    line[0] = png_apply_filter(line+1, &data[y*srcwidth], width, y, bpp, scratch);
 
 	    idatsize += compress_line(&zs, line, linelen, fi);
 	}
 #endif
+	free(scratch);
 	free(line);
     }
     idatsize += finishzlib(&zs, fi);
+    free(writebuf);
+end_idat:
     png_patch_len(fi, idatpos, idatsize);
     png_end_chunk(fi);
 
     png_start_chunk(fi, "IEND", 0);
     png_end_chunk(fi);
 
-    free(writebuf);
     if(data2)
 	free(data2);
     fclose(fi);
 }
 
+/* Writing a truecolor png a few rows at a time. Compressed data is written
+   out as soon as it's available (as a sequence of IDAT chunks), so only
+   the current and the previous row need to be kept in memory. */
+
+struct _pngwriter {
+    FILE*fi;
+    unsigned width;
+    unsigned height;
+    unsigned y;
+    z_stream zs;
+    unsigned char*zbuf;
+    unsigned char*rows;
+    unsigned char*line;
+    unsigned char*scratch;
+};
+
+static void png_writer_flush(pngwriter_t*w)
+{
+    int len = ZLIB_BUFFER_SIZE - w->zs.avail_out;
+    if(len) {
+	png_start_chunk(w->fi, "IDAT", len);
+	png_write_bytes(w->fi, w->zbuf, len);
+	png_end_chunk(w->fi);
+    }
+    w->zs.next_out = w->zbuf;
+    w->zs.avail_out = ZLIB_BUFFER_SIZE;
+}
+
+EXPORT pngwriter_t* png_writer_start(const char*filename, unsigned width, unsigned height)
+{
+    unsigned char head[] = {137,80,78,71,13,10,26,10}; // PNG header
+    make_crc32_table();
+
+    FILE*fi = fopen(filename, "wb");
+    if(!fi) {
+	perror(filename);
+	return 0;
+    }
+    pngwriter_t*w = (pngwriter_t*)calloc(1, sizeof(pngwriter_t));
+    w->fi = fi;
+    w->width = width;
+    w->height = height;
+
+    fwrite(head,sizeof(head),1,fi);
+    png_start_chunk(fi, "IHDR", 13);
+     png_write_dword(fi,width);
+     png_write_dword(fi,height);
+     png_write_byte(fi,8);
+     png_write_byte(fi,6); //rgba
+     png_write_byte(fi,0); //compression mode
+     png_write_byte(fi,0); //filter mode
+     png_write_byte(fi,0); //interlace mode
+    png_end_chunk(fi);
+
+    w->zbuf = (unsigned char*)malloc(ZLIB_BUFFER_SIZE);
+    w->zs.next_out = w->zbuf;
+    w->zs.avail_out = ZLIB_BUFFER_SIZE;
+    if(deflateInit(&w->zs, Z_BEST_COMPRESSION) != Z_OK) {
+	fprintf(stderr, "error in deflateInit(): %s", w->zs.msg?w->zs.msg:"unknown");
+    }
+
+    /* the filters look at the previous row, so keep two rows in one buffer */
+    w->rows = (unsigned char*)calloc(2, width*4);
+    w->line = (unsigned char*)calloc(1, 1+width*4);
+    w->scratch = (unsigned char*)malloc(PNG_FILTER_SCRATCH_SIZE);
+    return w;
+}
+
+EXPORT void png_writer_add_rows(pngwriter_t*w, unsigned char*data, int num_rows)
+{
+    unsigned stride = w->width*4;
+    int t;
+    for(t=0;t<num_rows && w->y<w->height;t++) {
+	unsigned char*row = w->rows+stride;
+	memcpy(row, data+t*stride, stride);
+	w->line[0] = png_apply_filter(w->line+1, row, w->width, w->y, 32, w->scratch);
+	w->zs.next_in = w->line;
+	w->zs.avail_in = 1+stride;
+	while(w->zs.avail_in) {
+	    if(deflate(&w->zs, Z_NO_FLUSH) != Z_OK) {
+		fprintf(stderr, "error in deflate(): %s\n", w->zs.msg?w->zs.msg:"unknown");
+		break;
+	    }
+	    if(!w->zs.avail_out)
+		png_writer_flush(w);
+	}
+	memcpy(w->rows, row, stride);
+	w->y++;
+    }
+}
+
+EXPORT void png_writer_finish(pngwriter_t*w)
+{
+    if(w->y != w->height) {
+	fprintf(stderr, "png_writer_finish: only %d of %d rows written\n", w->y, w->height);
+    }
+    while(1) {
+	int ret = deflate(&w->zs, Z_FINISH);
+	if(ret != Z_OK && ret != Z_STREAM_END) {
+	    fprintf(stderr, "error in deflate(finish): %s\n", w->zs.msg?w->zs.msg:"unknown");
+	    break;
+	}
+	if(ret == Z_STREAM_END || !w->zs.avail_out)
+	    png_writer_flush(w);
+	if(ret == Z_STREAM_END)
+	    break;
+    }
+    deflateEnd(&w->zs);
+
+    png_start_chunk(w->fi, "IEND", 0);
+    png_end_chunk(w->fi);
+    fclose(w->fi);
+
+    free(w->zbuf);
+    free(w->rows);
+    free(w->line);
+    free(w->scratch);
+    free(w);
+}
+
 EXPORT void png_write_palette_based(const char*filename, unsigned char*data, unsigned width, unsigned height, int numcolors)
 {
-    png_write_palette_based2(filename, data, width, height, numcolors, Z_BEST_COMPRESSION);
+    png_write_palette_based2(filename, data, width, height, numcolors, Z_BEST_COMPRESSION, 1);
 }
 EXPORT void png_write(const char*filename, unsigned char*data, unsigned width, unsigned height)
 {
-    png_write_palette_based2(filename, data, width, height, 0, Z_BEST_COMPRESSION);
+    png_write_palette_based2(filename, data, width, height, 0, Z_BEST_COMPRESSION, 1);
+}
+EXPORT void png_write_threaded(const char*filename, unsigned char*data, unsigned width, unsigned height, int num_threads)
+{
+    png_write_palette_based2(filename, data, width, height, 0, Z_BEST_COMPRESSION, num_threads);
 }
 EXPORT void png_write_quick(const char*filename, unsigned char*data, unsigned width, unsigned height)
 {
-    png_write_palette_based2(filename, data, width, height, 257, Z_NO_COMPRESSION);
+    png_write_palette_based2(filename, data, width, height, 257, Z_NO_COMPRESSION, 1);
 }
 EXPORT void png_write_palette_based_2(const char*filename, unsigned char*data, unsigned width, unsigned height)
 {
-    png_write_palette_based2(filename, data, width, height, 256, Z_BEST_COMPRESSION);
+    png_write_palette_based2(filename, data, width, height, 256, Z_BEST_COMPRESSION, 1);
+}
+EXPORT void png_write_palette_based_2_threaded(const char*filename, unsigned char*data, unsigned width, unsigned height, int num_threads)
+{
+    png_write_palette_based2(filename, data, width, height, 256, Z_BEST_COMPRESSION, num_threads);
 }
@@ -35,6 +35,18 @@ void png_write(const char*filename, unsigned char*data, unsigned width, unsigned
 void png_write_quick(const char*filename, unsigned char*data, unsigned width, unsigned height);
 void png_write_palette_based_2(const char*filename, unsigned char*data, unsigned width, unsigned height);
 
+/* like png_write and png_write_palette_based_2, but filter and compress the
+   image data on num_threads threads. (For num_threads>1, the compressed
+   data is not quite the same as with a single thread) */
+void png_write_threaded(const char*filename, unsigned char*data, unsigned width, unsigned height, int num_threads);
+void png_write_palette_based_2_threaded(const char*filename, unsigned char*data, unsigned width, unsigned height, int num_threads);
+
+/* write a (32 bit) png incrementally, a couple of rows at a time */
+typedef struct _pngwriter pngwriter_t;
+pngwriter_t* png_writer_start(const char*filename, unsigned width, unsigned height);
+void png_writer_add_rows(pngwriter_t*w, unsigned char*data, int num_rows);
+void png_writer_finish(pngwriter_t*w);
+
 #ifdef __cplusplus
 }
 #endif
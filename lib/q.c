@@ -580,10 +580,10 @@ static void crc64_init(void)
         return;
     crc64_initialized = 1;
     for(t=0; t<256; t++) {
-        unsigned int c = t;
+        uint64_t c = t;
         int s;
         for (s = 0; s < 8; s++) {
-          c = ((c&1)?0xC96C5795D7870F42ll:0) ^ (c >> 1);
+          c = ((c&1)?0xC96C5795D7870F42ull:0) ^ (c >> 1);
         }
         crc64[t] = c;
     }
@@ -717,6 +717,18 @@ unsigned int crc32_add_bytes(unsigned int checksum, const void*_s, int len)
     } while(--len);
     return checksum;
 }
+uint64_t crc64_add_bytes(uint64_t checksum, const void*_s, int len)
+{
+    unsigned char*s = (unsigned char*)_s;
+    crc64_init();
+    if(!s || !len)
+        return checksum;
+    do {
+        checksum = checksum>>8 ^ crc64[(*s^checksum)&0xff];
+        s++;
+    } while(--len);
+    return checksum;
+}
 
 unsigned int string_hash(const string_t*str)
 {
@@ -750,6 +762,89 @@ uint64_t string_hash64(const char*str)
     }
     return checksum;
 }
+
+/* xxHash64 (Yann Collet's algorithm), for hashing larger blocks of data.
+   Words are read in little endian byte order, so the result is the same
+   on all machines, and can be stored in files. */
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+#define XXH_ROTL(x,r) (((x) << (r)) | ((x) >> (64 - (r))))
+static inline uint64_t xxh_read64(const unsigned char*p)
+{
+    uint64_t v;memcpy(&v, p, 8);
+#ifdef WORDS_BIGENDIAN
+    v = (uint64_t)SWAP32((uint32_t)v)<<32 | SWAP32((uint32_t)(v>>32));
+#endif
+    return v;
+}
+static inline uint32_t xxh_read32(const unsigned char*p)
+{
+    uint32_t v;memcpy(&v, p, 4);return LE_32_TO_NATIVE(v);
+}
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_P2;
+    acc = XXH_ROTL(acc, 31);
+    return acc * XXH_P1;
+}
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+uint64_t hash_block64(const void*data, int len)
+{
+    const unsigned char*p = (const unsigned char*)data;
+    const unsigned char*end = p + len;
+    uint64_t h;
+    if(len >= 32) {
+        uint64_t v1 = XXH_P1 + XXH_P2;
+        uint64_t v2 = XXH_P2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -XXH_P1;
+        const unsigned char*limit = end - 32;
+        do {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p+8));
+            v3 = xxh_round(v3, xxh_read64(p+16));
+            v4 = xxh_round(v4, xxh_read64(p+24));
+            p += 32;
+        } while(p <= limit);
+        h = XXH_ROTL(v1, 1) + XXH_ROTL(v2, 7) + XXH_ROTL(v3, 12) + XXH_ROTL(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = XXH_P5;
+    }
+    h += (uint64_t)len;
+    while(p + 8 <= end) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = XXH_ROTL(h, 27) * XXH_P1 + XXH_P4;
+        p += 8;
+    }
+    if(p + 4 <= end) {
+        h ^= (uint64_t)xxh_read32(p) * XXH_P1;
+        h = XXH_ROTL(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    while(p < end) {
+        h ^= (*p) * XXH_P5;
+        h = XXH_ROTL(h, 11) * XXH_P1;
+        p++;
+    }
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
 unsigned int string_hash3(const char*str, int len)
 {
     string_t s;
@@ -1063,10 +1158,39 @@ type_t stringstruct_type = {
 
 // ------------------------------- dictionary_t -------------------------------
 
+/* The dictionary is an open addressing hash table with Robin Hood probing:
+   All entries live in one array of hashsize (a power of two) slots. Every
+   entry stores its (full) hash and its probe distance, i.e. its offset+1
+   from the slot its hash maps to (0 marks an empty slot). On insertion, an
+   entry takes the place of any entry closer to its own home slot. This keeps
+   probe sequences short, and allows lookups to stop as soon as they find an
+   entry with a smaller probe distance than their own.
+
+   Several entries may have the same key. They are stored newest-first (in
+   probing order), so that dict_lookup() and dict_del() see the one that was
+   added last.
+*/
+
 #define INITIAL_SIZE 1
+#define MIN_SIZE 8
 
-static int max(int x, int y) {
-    return x>y?x:y;
+/* The home slot is given by the top bits of the (scrambled) hash. That
+   way, growing the table maps slot i to slots 2i and 2i+1, and rehashing
+   writes the new table front to back. */
+static inline unsigned int dict_home(dict_t*h, unsigned int hash)
+{
+    return (hash * 0x9e3779b1u) >> h->shift;
+}
+
+static void dict_setsize(dict_t*h, int size)
+{
+    int s = 2, shift = 31;
+    while(s < size) {
+        s <<= 1;
+        shift--;
+    }
+    h->hashsize = s;
+    h->shift = shift;
 }
 
 dict_t*dict_new()
@@ -1084,17 +1208,17 @@ dict_t*dict_new2(type_t*t)
 }
 void dict_init(dict_t*h, int size) 
 {
-    memset(h, 0, sizeof(dict_t));
-    h->hashsize = size;
-    h->slots = h->hashsize?(dictentry_t**)rfx_calloc(sizeof(dictentry_t*)*h->hashsize):0;
-    h->num = 0;
-    h->key_type = &charptr_type;
+    dict_init2(h, &charptr_type, size);
 }
 void dict_init2(dict_t*h, type_t*t, int size) 
 {
     memset(h, 0, sizeof(dict_t));
-    h->hashsize = size;
-    h->slots = h->hashsize?(dictentry_t**)rfx_calloc(sizeof(dictentry_t*)*h->hashsize):0;
+    /* tables are allocated on first insert, unless we're given
+       a size hint */
+    if(size>1) {
+        dict_setsize(h, size);
+        h->slots = (dictentry_t*)rfx_calloc(sizeof(dictentry_t)*h->hashsize);
+    }
     h->num = 0;
     h->key_type = t;
 }
@@ -1103,61 +1227,82 @@ dict_t*dict_clone(dict_t*o)
 {
     dict_t*h = rfx_alloc(sizeof(dict_t));
     memcpy(h, o, sizeof(dict_t));
-    h->slots = h->hashsize?(dictentry_t**)rfx_calloc(sizeof(dictentry_t*)*h->hashsize):0;
+    h->slots = h->hashsize?(dictentry_t*)rfx_alloc(sizeof(dictentry_t)*h->hashsize):0;
+    if(h->hashsize)
+        memcpy(h->slots, o->slots, sizeof(dictentry_t)*h->hashsize);
     int t;
-    for(t=0;t<o->hashsize;t++) {
-        dictentry_t*e = o->slots[t];
-        while(e) {
-            dictentry_t*n = (dictentry_t*)rfx_alloc(sizeof(dictentry_t));
-            memcpy(n, e, sizeof(dictentry_t));
-            n->key = h->key_type->dup(e->key);
-            n->data = e->data;
-            n->next = h->slots[t];
-            h->slots[t] = n;
-            e = e->next;
-        }
+    for(t=0;t<h->hashsize;t++) {
+        if(h->slots[t].dist)
+            h->slots[t].key = h->key_type->dup(o->slots[t].key);
     }
     return h;
 }
 
+/* insert an entry. If newest is set, it goes in front of entries with the same key.
+   Entries with the same home slot stay in the order they were inserted in: An
+   entry that was displaced (and hence was in front of every following entry
+   with the same home slot) also displaces those. */
+static dictentry_t* dict_insert(dict_t*h, dictentry_t*e, char newest)
+{
+    int mask = h->hashsize - 1;
+    int pos = dict_home(h, e->hash);
+    dictentry_t*result = 0;
+    dictentry_t tmp;
+    e->dist = 1;
+    while(1) {
+        dictentry_t*s = &h->slots[pos];
+        if(!s->dist) {
+            *s = *e;
+            return result?result:s;
+        }
+        if(s->dist < e->dist || (result && s->dist == e->dist) ||
+           (newest && s->dist == e->dist && s->hash == e->hash && h->key_type->equals(s->key, e->key))) {
+            tmp = *s;*s = *e;*e = tmp;
+            if(!result) 
+                result = s;
+        }
+        pos = (pos+1)&mask;
+        e->dist++;
+    }
+}
+
 static void dict_expand(dict_t*h, int newlen)
 {
     assert(h->hashsize < newlen);
-    dictentry_t**newslots = (dictentry_t**)rfx_calloc(sizeof(dictentry_t*)*newlen);
-    int t; 
-    for(t=0;t<h->hashsize;t++) {
-        dictentry_t*e = h->slots[t];
-        while(e) {
-            dictentry_t*next = e->next;
-            unsigned int newhash = e->hash%newlen;
-            e->next = newslots[newhash];
-            newslots[newhash] = e;
-            e = next;
-        }
+    dictentry_t*oldslots = h->slots;
+    int oldsize = h->hashsize;
+    dict_setsize(h, newlen);
+    h->slots = (dictentry_t*)rfx_calloc(sizeof(dictentry_t)*h->hashsize);
+    if(!oldslots)
+        return;
+
+    /* Start at an empty slot, so that no run of entries wraps around
+       while we re-insert. That way, entries with identical keys are
+       visited (and reinserted) newest-first. */
+    int start = 0;
+    while(oldslots[start].dist)
+        start++;
+    int t;
+    for(t=0;t<oldsize;t++) {
+        dictentry_t*e = &oldslots[(start+t)&(oldsize-1)];
+        if(e->dist)
+            dict_insert(h, e, 0);
     }
-    if(h->slots)
-        rfx_free(h->slots);
-    h->slots = newslots;
-    h->hashsize = newlen;
+    rfx_free(oldslots);
 }
 
 dictentry_t* dict_put(dict_t*h, const void*key, void* data)
 {
-    unsigned int hash = h->key_type->hash(key);
-    dictentry_t*e = (dictentry_t*)rfx_alloc(sizeof(dictentry_t));
-    
-    if(!h->hashsize)
-        dict_expand(h, 1);
-
-    unsigned int hash2 = hash % h->hashsize;
-    
-    e->key = h->key_type->dup(key);
-    e->hash = hash; //for resizing
-    e->next = h->slots[hash2];
-    e->data = data;
-    h->slots[hash2] = e;
+    /* keep the table at most 3/4 full */
+    if((h->num+1)*4 > h->hashsize*3) {
+        dict_expand(h, h->hashsize<MIN_SIZE?MIN_SIZE:h->hashsize*2);
+    }
+    dictentry_t e;
+    e.key = h->key_type->dup(key);
+    e.hash = h->key_type->hash(key);
+    e.data = data;
     h->num++;
-    return e;
+    return dict_insert(h, &e, 1);
 }
 void dict_put2(dict_t*h, const char*s, void*data) 
 {
@@ -1168,14 +1313,13 @@ void dict_dump(dict_t*h, FILE*fi, const char*prefix)
 {
     int t;
     for(t=0;t<h->hashsize;t++) {
-        dictentry_t*e = h->slots[t];
-        while(e) {
-            if(h->key_type!=&charptr_type) {
-                fprintf(fi, "%s%p=%p\n", prefix, e->key, e->data);
-            } else {
-                fprintf(fi, "%s%s=%p\n", prefix, (char*)e->key, e->data);
-            }
-            e = e->next;
+        dictentry_t*e = &h->slots[t];
+        if(!e->dist)
+            continue;
+        if(h->key_type!=&charptr_type) {
+            fprintf(fi, "%s%p=%p\n", prefix, e->key, e->data);
+        } else {
+            fprintf(fi, "%s%s=%p\n", prefix, (char*)e->key, e->data);
         }
     }
 }
@@ -1185,56 +1329,28 @@ int dict_count(dict_t*h)
     return h->num;
 }
 
-static inline dictentry_t* dict_do_lookup(dict_t*h, const void*key)
+/* find the first entry with the given key, starting at slot pos with probe distance dist */
+static inline dictentry_t* dict_find_from(dict_t*h, const void*key, unsigned int hash, int pos, unsigned int dist)
 {
-    if(!h->num) {
-        return 0;
-    }
-    
-    unsigned int ohash = h->key_type->hash(key);
-    unsigned int hash = ohash % h->hashsize;
-
-    /* check first entry for match */
-    dictentry_t*e = h->slots[hash];
-    if(e && h->key_type->equals(e->key, key)) {
-        return e;
-    } else if(e) {
-        e = e->next;
-    }
-
-    /* if dict is 2/3 filled, double the size. Do
-       this the first time we have to actually iterate
-       through a slot to find our data */
-    if(e && h->num*3 >= h->hashsize*2) {
-        int newsize = h->hashsize;
-        while(h->num*3 >= newsize*2) {
-            newsize = newsize<15?15:(newsize+1)*2-1;
-        }
-        dict_expand(h, newsize);
-        hash = ohash % h->hashsize;
-        e = h->slots[hash];
-        if(e && h->key_type->equals(e->key, key)) {
-            // omit move to front
+    int mask = h->hashsize - 1;
+    while(1) {
+        dictentry_t*e = &h->slots[pos];
+        if(e->dist < dist)
+            return 0;
+        if(e->hash == hash && h->key_type->equals(e->key, key))
             return e;
-        } else if(e) {
-            e = e->next;
-        }
+        pos = (pos+1)&mask;
+        dist++;
     }
+}
 
-    /* check subsequent entries for a match */
-    dictentry_t*last = h->slots[hash];
-    while(e) {
-        if(h->key_type->equals(e->key, key)) {
-            /* move to front- makes a difference of about 10% in most applications */
-            last->next = e->next;
-            e->next = h->slots[hash];
-            h->slots[hash] = e;
-            return e;
-        }
-        last=e;
-        e = e->next;
+static inline dictentry_t* dict_do_lookup(dict_t*h, const void*key)
+{
+    if(!h->num) {
+        return 0;
     }
-    return 0;
+    unsigned int hash = h->key_type->hash(key);
+    return dict_find_from(h, key, hash, dict_home(h, hash), 1);
 }
 void* dict_lookup(dict_t*h, const void*key)
 {
@@ -1249,82 +1365,65 @@ char dict_contains(dict_t*h, const void*key)
     return !!e;
 }
 
+static void dict_remove(dict_t*h, dictentry_t*e)
+{
+    int mask = h->hashsize - 1;
+    int pos = e - h->slots;
+    h->key_type->free(e->key);
+
+    /* shift the following entries back, until we find one
+       which is already at its home position */
+    while(1) {
+        dictentry_t*next = &h->slots[(pos+1)&mask];
+        if(next->dist <= 1)
+            break;
+        h->slots[pos] = *next;
+        h->slots[pos].dist--;
+        pos = (pos+1)&mask;
+    }
+    memset(&h->slots[pos], 0, sizeof(dictentry_t));
+    h->num--;
+}
+
 char dict_del(dict_t*h, const void*key)
 {
-    if(!h->num)
+    dictentry_t*e = dict_do_lookup(h, key);
+    if(!e)
         return 0;
-    unsigned int hash = h->key_type->hash(key) % h->hashsize;
-    dictentry_t*head = h->slots[hash];
-    dictentry_t*e = head, *prev=0;
-    while(e) {
-        if(h->key_type->equals(e->key, key)) {
-            dictentry_t*next = e->next;
-            h->key_type->free(e->key);
-            memset(e, 0, sizeof(dictentry_t));
-            rfx_free(e);
-            if(e == head) {
-                h->slots[hash] = next;
-            } else {
-                assert(prev);
-                prev->next = next;
-            }
-            h->num--;
-            return 1;
-        }
-        prev = e;
-        e = e->next;
-    }
-    return 0;
+    dict_remove(h, e);
+    return 1;
 }
 
 char dict_del2(dict_t*h, const void*key, void*data)
 {
-    if(!h->num)
-        return 0;
-    unsigned int hash = h->key_type->hash(key) % h->hashsize;
-    dictentry_t*head = h->slots[hash];
-    dictentry_t*e = head, *prev=0;
+    dictentry_t*e = dict_do_lookup(h, key);
     while(e) {
-        if(h->key_type->equals(e->key, key) && e->data == data) {
-            dictentry_t*next = e->next;
-            h->key_type->free(e->key);
-            memset(e, 0, sizeof(dictentry_t));
-            rfx_free(e);
-            if(e == head) {
-                h->slots[hash] = next;
-            } else {
-                assert(prev);
-                prev->next = next;
-            }
-            h->num--;
+        if(e->data == data) {
+            dict_remove(h, e);
             return 1;
         }
-        prev = e;
-        e = e->next;
+        e = dict_get_next(h, e);
     }
     return 0;
 }
 
 dictentry_t* dict_get_slot(dict_t*h, const void*key)
 {
-    if(!h->num)
-        return 0;
-    unsigned int ohash = h->key_type->hash(key);
-    unsigned int hash = ohash % h->hashsize;
-    return h->slots[hash];
+    return dict_do_lookup(h, key);
+}
+dictentry_t* dict_get_next(dict_t*h, dictentry_t*e)
+{
+    int pos = ((e - h->slots) + 1) & (h->hashsize - 1);
+    return dict_find_from(h, e->key, e->hash, pos, e->dist + 1);
 }
 
 void dict_foreach_keyvalue(dict_t*h, void (*runFunction)(void*data, const void*key, void*val), void*data)
 {
     int t;
     for(t=0;t<h->hashsize;t++) {
-        dictentry_t*e = h->slots[t];
-        while(e) {
-            dictentry_t*next = e->next;
-            if(runFunction) {
-                runFunction(data, e->key, e->data);
-            }
-            e = e->next;
+        dictentry_t*e = &h->slots[t];
+        if(e->dist && runFunction) {
+            runFunction(data, e->key, e->data);
         }
     }
 }
@@ -1332,13 +1431,9 @@ void dict_foreach_value(dict_t*h, void (*runFunction)(void*))
 {
     int t;
     for(t=0;t<h->hashsize;t++) {
-        dictentry_t*e = h->slots[t];
-        while(e) {
-            dictentry_t*next = e->next;
-            if(runFunction) {
-                runFunction(e->data);
-            }
-            e = e->next;
+        dictentry_t*e = &h->slots[t];
+        if(e->dist && runFunction) {
+            runFunction(e->data);
         }
     }
 }
@@ -1347,22 +1442,18 @@ void dict_free_all(dict_t*h, char free_keys, void (*free_data_function)(void*))
 {
     int t;
     for(t=0;t<h->hashsize;t++) {
-        dictentry_t*e = h->slots[t];
-        while(e) {
-            dictentry_t*next = e->next;
-            if(free_keys) {
-                h->key_type->free(e->key);
-            }
-            if(free_data_function) {
-                free_data_function(e->data);
-            }
-            memset(e, 0, sizeof(dictentry_t));
-            rfx_free(e);
-            e = next;
+        dictentry_t*e = &h->slots[t];
+        if(!e->dist)
+            continue;
+        if(free_keys) {
+            h->key_type->free(e->key);
+        }
+        if(free_data_function) {
+            free_data_function(e->data);
         }
-        h->slots[t]=0;
     }
-    rfx_free(h->slots);
+    if(h->slots)
+        rfx_free(h->slots);
     memset(h, 0, sizeof(dict_t));
 }
 
@@ -1528,7 +1619,16 @@ int array_append(array_t*array, const void*name, void*data) {
 	}
     }
 
-    dictentry_t*e = dict_put(array->entry2pos, name, (void*)(ptroff_t)(array->num+1));
+    /* only the newest entry of a given name is indexed. Most arrays (e.g.
+       the ones in abc_file_t) append everything under the same name, and
+       keeping all those duplicates in an open addressing table makes each
+       append linear in the number of entries */
+    dictentry_t*e = dict_get_slot(array->entry2pos, name);
+    if(e) {
+        e->data = (void*)(ptroff_t)(array->num+1);
+    } else {
+        e = dict_put(array->entry2pos, name, (void*)(ptroff_t)(array->num+1));
+    }
 
     if(name) {
 	array->d[array->num].name = e->key;
@@ -1545,15 +1645,12 @@ int array_find(array_t*array, const void*name)
 }
 int array_find2(array_t*array, const void*name, void*data)
 {
-    dict_t*h= array->entry2pos;
-    dictentry_t*e = dict_get_slot(array->entry2pos, name);
-
-    while(e) {
-        int index = ((int)(ptroff_t)e->data) - 1;
-        if(h->key_type->equals(e->key, name) && array->d[index].data == data) {
-            return index;
+    type_t*key_type = array->entry2pos->key_type;
+    int t;
+    for(t=array->num-1;t>=0;t--) {
+        if(array->d[t].data == data && key_type->equals(array->d[t].name, name)) {
+            return t;
         }
-        e = e->next;
     }
     return -1;
 }
@@ -80,16 +80,17 @@ extern type_t int_type;
 
 typedef struct _dictentry {
     void*key;
-    unsigned int hash;
     void*data;
-    struct _dictentry*next;
+    unsigned int hash;
+    unsigned int dist; // distance from the home slot, plus one (0 = slot is empty)
 } dictentry_t;
 
 /* (void*) pointers referenced by strings */
 typedef struct _dict {
-    dictentry_t**slots;
+    dictentry_t*slots;
     type_t*key_type;
     int hashsize;
+    int shift; // 32 - log2(hashsize)
     int num;
 } dict_t;
 
@@ -156,6 +157,7 @@ float medianf(float*values, int n);
 unsigned int crc32_add_byte(unsigned int crc32, unsigned char b);
 unsigned int crc32_add_string(unsigned int crc32, const char*s);
 unsigned int crc32_add_bytes(unsigned int checksum, const void*s, int len);
+uint64_t crc64_add_bytes(uint64_t checksum, const void*s, int len);
 
 void mem_init(mem_t*mem);
 int mem_put(mem_t*m, void*data, int length);
@@ -184,6 +186,7 @@ unsigned int string_hash(const string_t*str);
 unsigned int string_hash2(const char*str);
 unsigned int string_hash3(const char*str, int len);
 uint64_t string_hash64(const char*str);
+uint64_t hash_block64(const void*data, int len);
 void string_set(string_t*str, const char*text);
 void string_set2(string_t*str, const char*text, int len);
 string_t*string_dup3(string_t*s);
@@ -209,7 +212,11 @@ dictentry_t*dict_put(dict_t*h, const void*key, void* data);
 void dict_put2(dict_t*h, const char*s, void*data);
 int dict_count(dict_t*h);
 void dict_dump(dict_t*h, FILE*fi, const char*prefix);
+/* entries returned by dict_put(), dict_get_slot() and dict_get_next() are only
+   valid until the dictionary is modified */
 dictentry_t* dict_get_slot(dict_t*h, const void*key);
+/* next (older) entry with the same key as e */
+dictentry_t* dict_get_next(dict_t*h, dictentry_t*e);
 char dict_contains(dict_t*h, const void*s);
 void* dict_lookup(dict_t*h, const void*s);
 char dict_del(dict_t*h, const void*s);
@@ -225,15 +232,15 @@ void dict_destroy(dict_t*dict);
 #define DICT_ITERATE_DATA(d,t,v) \
     int v##_i;dictentry_t*v##_e;t v;\
     for(v##_i=0;v##_i<(d)->hashsize;v##_i++) \
-        for(v##_e=(d)->slots[v##_i]; v##_e && ((v=(t)v##_e->data)||1); v##_e=v##_e->next)
+        if(!((v##_e=&(d)->slots[v##_i])->dist && ((v=(t)v##_e->data)||1))) {} else
 #define DICT_ITERATE_KEY(d,t,v)  \
     int v##_i;dictentry_t*v##_e;t v;\
     for(v##_i=0;v##_i<(d)->hashsize;v##_i++) \
-        for(v##_e=(d)->slots[v##_i];v##_e && ((v=(t)v##_e->key)||1);v##_e=v##_e->next)
+        if(!((v##_e=&(d)->slots[v##_i])->dist && ((v=(t)v##_e->key)||1))) {} else
 #define DICT_ITERATE_ITEMS(d,t1,v1,t2,v2) \
     int v1##_i;dictentry_t*v1##_e;t1 v1;t2 v2; \
     for(v1##_i=0;v1##_i<(d)->hashsize;v1##_i++) \
-        for(v1##_e=(d)->slots[v1##_i]; v1##_e && (((v1=(t1)v1##_e->key)||1)&&((v2=(t2)v1##_e->data)||1)); v1##_e=v1##_e->next)
+        if(!((v1##_e=&(d)->slots[v1##_i])->dist && ((v1=(t1)v1##_e->key)||1) && ((v2=(t2)v1##_e->data)||1))) {} else
 
 void map_init(map_t*map);
 void map_put(map_t*map, string_t t1, string_t t2);
@@ -420,8 +420,7 @@ void swf_FreeTaglist(TAG*tag)
     while(tag)
     { 
 	TAG * tnew = tag->next;
-	if (tag->data) 
-	    rfx_free(tag->data);
+	swf_ClearTag(tag);
 	rfx_free(tag);
 	tag = tnew;
     }
@@ -39,11 +39,24 @@
 #ifdef HAVE_TIME_H
 #include <time.h>
 #endif
+#include <errno.h>
 
 #ifdef HAVE_IO_H
 #include <io.h>
 #endif
 
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#else
+#undef HAVE_STAT
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#else
+#undef HAVE_MMAP
+#endif
+
 #include "./bitio.h"
 #include "./os.h"
 
@@ -54,6 +67,58 @@
 
 #define MEMSIZE(l) (((l/MALLOC_SIZE)+1)*MALLOC_SIZE)
 
+#if defined(HAVE_MMAP) && defined(HAVE_STAT)
+#define USE_MMAP
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* Tags read by swf_MapSWF() don't own their data, it points into a
+   (private, writable) mapping of the file instead. Such tags have
+   data!=0 but memsize==0. A mapping is released once the last tag
+   pointing into it has been freed or has copied its data. */
+typedef struct _swfmapping {
+    U8*start;
+    size_t size;
+    int refs;
+    struct _swfmapping*next;
+} swfmapping_t;
+
+static swfmapping_t*mappings = 0;
+
+static swfmapping_t** find_mapping(U8*data)
+{
+    swfmapping_t**m = &mappings;
+    while(*m) {
+	if(data >= (*m)->start && data < (*m)->start + (*m)->size)
+	    return m;
+	m = &(*m)->next;
+    }
+    return 0;
+}
+#endif
+
+static void tag_freedata(TAG*t)
+{
+  if(!t->data)
+    return;
+#ifdef USE_MMAP
+  swfmapping_t**m;
+  if(!t->memsize && (m = find_mapping(t->data))) {
+    swfmapping_t*mapping = *m;
+    if(!--mapping->refs) {
+      munmap(mapping->start, mapping->size);
+      *m = mapping->next;
+      rfx_free(mapping);
+    }
+    t->data = 0;
+    return;
+  }
+#endif
+  rfx_free(t->data);
+  t->data = 0;
+}
+
 // inline wrapper functions
 
 TAG * swf_NextTag(TAG * t) { return t->next; }
@@ -79,7 +144,7 @@ char* swf_GetString(TAG*t)
     while(t->pos < t->len && swf_GetU8(t));
     /* make sure we always have a trailing zero byte */
     if(t->pos == t->len) {
-      if(t->len == t->memsize) {
+      if(t->len >= t->memsize) {
 	swf_ResetWriteBits(t);
 	swf_SetU8(t, 0);
 	t->len = t->pos;
@@ -145,7 +210,15 @@ int swf_SetBlock(TAG * t,const U8 * b,int l)
   swf_ResetWriteBits(t);
   if (newlen>t->memsize)
   { U32  newmem  = MEMSIZE(newlen);  
-    U8 * newdata = (U8*)(rfx_realloc(t->data,newmem));
+    U8 * newdata;
+    if (t->data && !t->memsize) {
+      // data is borrowed (e.g. from a mapped file)- copy on first write
+      newdata = (U8*)rfx_alloc(newmem);
+      memcpy(newdata, t->data, t->len);
+      tag_freedata(t);
+    } else {
+      newdata = (U8*)(rfx_realloc(t->data,newmem));
+    }
     t->memsize = newmem;
     t->data    = newdata;
   }
@@ -1162,8 +1235,7 @@ TAG * swf_InsertTagBefore(SWF* swf, TAG * before,U16 id)
 
 void swf_ClearTag(TAG * t)
 {
-  if (t->data) rfx_free(t->data);
-  t->data = 0;
+  tag_freedata(t);
   t->pos = 0;
   t->len = 0;
   t->readBit = 0;
@@ -1173,6 +1245,8 @@ void swf_ClearTag(TAG * t)
 
 void swf_ResetTag(TAG*tag, U16 id)
 {
+    if(!tag->memsize)
+	tag_freedata(tag);
     tag->len = tag->pos = tag->readBit = tag->writeBit = 0;
     tag->id = id;
 }
@@ -1193,7 +1267,7 @@ TAG* swf_DeleteTag(SWF*swf, TAG * t)
   if (t->prev) t->prev->next = t->next;
   if (t->next) t->next->prev = t->prev;
 
-  if (t->data) rfx_free(t->data);
+  tag_freedata(t);
   rfx_free(t);
   return next;
 }
@@ -1386,7 +1460,7 @@ void swf_UnFoldSprite(TAG * t)
 	break;
   }
   
-  rfx_free(t->data); t->data = 0;
+  tag_freedata(t);
   t->memsize = t->len = t->pos = 0;
 
   swf_SetU16(t, spriteid);
@@ -1413,9 +1487,8 @@ void swf_FoldSprite(TAG * t)
 
   t->pos = 0;
   id = swf_GetU16(t);
-  rfx_free(t->data);
+  tag_freedata(t);
   t->len = t->pos = t->memsize = 0;
-  t->data = 0;
 
   frames = 0;
 
@@ -1570,16 +1643,19 @@ int swf_ReadSWF2(reader_t*reader, SWF * swf)   // Reads SWF to memory (malloc'ed
     
     if ((len = reader->read(reader ,b,8))<8) return -1;
 
-    if (b[0]!='F' && b[0]!='C') return -1;
+    if (b[0]!='F' && b[0]!='C' && b[0]!='Z') return -1;
     if (b[1]!='W') return -1;
     if (b[2]!='S') return -1;
     swf->fileVersion = b[3];
-    swf->compressed  = (b[0]=='C')?1:0;
+    swf->compressed  = (b[0]=='C')?1:((b[0]=='Z')?2:0);
     swf->fileSize    = GET32(&b[4]);
     
-    if(swf->compressed) {
+    if(swf->compressed==1) {
 	reader_init_zlibinflate(&zreader, reader);
 	reader = &zreader;
+    } else if(swf->compressed==2) {
+	reader_init_lzmainflate(&zreader, reader);
+	reader = &zreader;
     }
     swf->compressed = 0; // derive from version number from now on
 
@@ -1627,6 +1703,133 @@ int swf_ReadSWF(int handle, SWF * swf)
   return swf_ReadSWF2(&reader, swf);
 }
 
+int swf_MapSWF(int handle, SWF * swf)
+{
+#ifdef USE_MMAP
+  struct stat sb;
+  off_t start;
+  U8*file, *data;
+  size_t filesize, size;
+  int pos, end;
+  reader_t reader;
+  swfmapping_t*mapping;
+  TAG t1, *t;
+
+  if (!swf) return -1;
+
+  start = lseek(handle, 0, SEEK_CUR);
+  if (start != 0 || fstat(handle, &sb)<0 || sb.st_size < 8)
+    return swf_ReadSWF(handle, swf);
+
+  filesize = sb.st_size;
+  file = (U8*)mmap(0, filesize, PROT_READ|PROT_WRITE, MAP_PRIVATE, handle, 0);
+  if (file == MAP_FAILED)
+    return swf_ReadSWF(handle, swf);
+
+  memset(swf,0x00,sizeof(SWF));
+  if ((file[0]!='F' && file[0]!='C' && file[0]!='Z') || file[1]!='W' || file[2]!='S') {
+    munmap(file, filesize);
+    return -1;
+  }
+  swf->fileVersion = file[3];
+  swf->fileSize    = GET32(&file[4]);
+
+  if (file[0]=='C' || file[0]=='Z') {
+    /* inflate the whole file once, into anonymous memory */
+    reader_t zreader;
+    size = swf->fileSize>8?swf->fileSize-8:0;
+    data = size?(U8*)mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0):(U8*)MAP_FAILED;
+    if (data == MAP_FAILED) {
+      munmap(file, filesize);
+      lseek(handle, start, SEEK_SET);
+      return swf_ReadSWF(handle, swf);
+    }
+    reader_init_memreader(&reader, &file[8], filesize-8);
+    if (file[0]=='C')
+      reader_init_zlibinflate(&zreader, &reader);
+    else
+      reader_init_lzmainflate(&zreader, &reader);
+    end = zreader.read(&zreader, data, size);
+    zreader.dealloc(&zreader);
+    reader.dealloc(&reader);
+    munmap(file, filesize);
+    pos = 0;
+  } else {
+    data = file;
+    size = filesize;
+    end = filesize;
+    pos = 8;
+  }
+
+  reader_init_memreader(&reader, &data[pos], end-pos);
+  reader_GetRect(&reader, &swf->movieSize);
+  reader.read(&reader, &swf->frameRate, 2);
+  swf->frameRate = LE_16_TO_NATIVE(swf->frameRate);
+  reader.read(&reader, &swf->frameCount, 2);
+  swf->frameCount = LE_16_TO_NATIVE(swf->frameCount);
+  pos += reader.pos;
+  reader.dealloc(&reader);
+
+  mapping = (swfmapping_t*)rfx_calloc(sizeof(swfmapping_t));
+  mapping->start = data;
+  mapping->size = size;
+
+  /* tags point directly into the mapping */
+  t1.next = 0;
+  t = &t1;
+  while (pos+2 <= end) {
+    U16 raw = GET16(&data[pos]);
+    U32 len = raw&0x3f;
+    int id = raw>>6;
+    pos += 2;
+    if (len==0x3f) {
+      if (pos+4 > end) break;
+      len = GET32(&data[pos]);
+      pos += 4;
+    }
+    // Sprite handling fix: Flatten sprite tree
+    if (id==ST_DEFINESPRITE) len = 2*sizeof(U16);
+    if (len > end-pos) {
+      #ifdef DEBUG_RFXSWF
+      fprintf(stderr, "rfxswf: Warning: Short read (tagid %d). File truncated?\n", id);
+      #endif
+      break;
+    }
+
+    TAG*n = (TAG *)rfx_calloc(sizeof(TAG));
+    n->id = id;
+    n->len = len;
+    if (len) {
+      n->data = &data[pos];
+      mapping->refs++;
+    }
+    pos += len;
+
+    n->prev = t;
+    t->next = n;
+    t = n;
+    if (t->id == ST_FILEATTRIBUTES) {
+      swf->fileAttributes = swf_GetU32(t);
+      swf_ResetReadBits(t);
+    }
+  }
+  swf->firstTag = t1.next;
+  if (t1.next)
+    t1.next->prev = NULL;
+
+  if (mapping->refs) {
+    mapping->next = mappings;
+    mappings = mapping;
+  } else {
+    munmap(mapping->start, mapping->size);
+    rfx_free(mapping);
+  }
+  return pos;
+#else
+  return swf_ReadSWF(handle, swf);
+#endif
+}
+
 void swf_ReadABCfile(char*filename, SWF*swf)
 {
     memset(swf, 0, sizeof(SWF));
@@ -1785,7 +1988,10 @@ int  swf_WriteSWF2(writer_t*writer, SWF * swf)     // Writes SWF to file, return
        It also means that we don't initialize our own zlib
        writer, but assume the caller provided one.
      */
-      if(swf->compressed==1 || (swf->compressed==0 && swf->fileVersion>=6)) {
+      if(swf->compressed==2) {
+	char*id = "ZWS";
+	writer->write(writer, id, 3);
+      } else if(swf->compressed==1 || (swf->compressed==0 && swf->fileVersion>=6)) {
 	char*id = "CWS";
 	writer->write(writer, id, 3);
       } else {
@@ -1797,7 +2003,10 @@ int  swf_WriteSWF2(writer_t*writer, SWF * swf)     // Writes SWF to file, return
       PUT32(b4, swf->fileSize);
       writer->write(writer, b4, 4);
       
-      if(swf->compressed==1 || (swf->compressed==0 && swf->fileVersion>=6)) {
+      if(swf->compressed==2) {
+	writer_init_lzmadeflate(&zwriter, writer);
+	writer = &zwriter;
+      } else if(swf->compressed==1 || (swf->compressed==0 && swf->fileVersion>=6)) {
 	writer_init_zlibdeflate(&zwriter, writer);
 	writer = &zwriter;
       }
@@ -1830,7 +2039,7 @@ int  swf_WriteSWF2(writer_t*writer, SWF * swf)     // Writes SWF to file, return
         }
         t = t->next;
     }
-    if(swf->compressed==1 || (swf->compressed==0 && swf->fileVersion>=6) || swf->compressed==8) {
+    if(swf->compressed==1 || swf->compressed==2 || (swf->compressed==0 && swf->fileVersion>=6) || swf->compressed==8) {
       if(swf->compressed != 8) {
 	zwriter.finish(&zwriter);
 	return original_writer->pos - writer_lastpos;
@@ -1873,6 +2082,221 @@ int  swf_WriteSWF(int handle, SWF * swf)     // Writes SWF to file, returns leng
   return len;
 }
 
+/* ------------------------------ streaming ------------------------------ */
+
+/* The movie size is always stored with 31 bits per coordinate, so that the
+   header has a fixed size and can be overwritten once the real size is known. */
+#define STREAM_RECT_BITS 31
+
+struct _SWFSTREAM
+{
+  SWF swf;             // header values (firstTag is always 0)
+  int handle;          // output file
+  char compress;       // write compressed SWF?
+  int bodyhandle;      // where everything after the first 8 bytes goes
+  char bodyname[256];  // temp file, if compressing
+  writer_t writer;     // writes to bodyhandle
+  int fileattributespos;
+  char has_as2;        // seen AVM1 actions?
+  char has_as3;        // seen ABC code?
+  char has_fileattributes; // caller passed a FILEATTRIBUTES tag
+  int frameCount;
+  int inSprite;
+  U16 lastid;
+};
+
+static void stream_setrect(TAG*t, SRECT*r)
+{
+  swf_ResetWriteBits(t);
+  swf_SetBits(t, STREAM_RECT_BITS, 5);
+  swf_SetBits(t, r->xmin, STREAM_RECT_BITS);
+  swf_SetBits(t, r->xmax, STREAM_RECT_BITS);
+  swf_SetBits(t, r->ymin, STREAM_RECT_BITS);
+  swf_SetBits(t, r->ymax, STREAM_RECT_BITS);
+  swf_ResetWriteBits(t);
+}
+
+static int stream_patch(int handle, int pos, void*data, int len)
+{
+  if(lseek(handle, pos, SEEK_SET) < 0 ||
+     write(handle, data, len) != len) {
+    #ifdef DEBUG_RFXSWF
+      perror("stream_patch");
+    #endif
+    return -1;
+  }
+  return 0;
+}
+
+SWFSTREAM* swf_StreamWriter_Begin(int handle, SWF*swf)
+{
+  SWFSTREAM*s = (SWFSTREAM*)rfx_calloc(sizeof(SWFSTREAM));
+  memcpy(&s->swf, swf, sizeof(SWF));
+  s->swf.firstTag = 0;
+  s->handle = handle;
+  s->compress = swf->compressed==1 || swf->compressed==2 || (swf->compressed==0 && swf->fileVersion>=6);
+  s->fileattributespos = -1;
+
+  if(s->compress) {
+    /* the compressed data can only be written once the header
+       is complete, so buffer the body in a temporary file */
+    int tries = 0;
+    do {
+      /* O_EXCL: never follow a link somebody else placed at that name */
+      mktempname(s->bodyname, "swf");
+      s->bodyhandle = open(s->bodyname, O_BINARY|O_RDWR|O_CREAT|O_EXCL, 0600);
+    } while(s->bodyhandle<0 && errno==EEXIST && ++tries<16);
+    if(s->bodyhandle<0) {
+      perror(s->bodyname);
+      free(s);
+      return 0;
+    }
+  } else {
+    U8 b8[8];
+    memcpy(b8, "FWS", 3);
+    b8[3] = s->swf.fileVersion;
+    PUT32(&b8[4], 0); // file length, filled in by swf_StreamWriter_End()
+    if(write(handle, b8, 8) != 8) {
+      free(s);
+      return 0;
+    }
+    s->bodyhandle = handle;
+  }
+  writer_init_filewriter(&s->writer, s->bodyhandle);
+
+  TAG t;
+  U8 b[64];
+  memset(&t, 0, sizeof(TAG));
+  t.data = b;
+  t.memsize = sizeof(b);
+  stream_setrect(&t, &s->swf.movieSize);
+  swf_SetU16(&t, s->swf.frameRate);
+  swf_SetU16(&t, 0); // frame count, filled in by swf_StreamWriter_End()
+  s->writer.write(&s->writer, t.data, t.len);
+
+  if(s->swf.fileVersion >= 9 && !no_extra_tags) {
+    /* the flags are patched at the end, in case the caller passes
+       a FILEATTRIBUTES tag of its own */
+    TAG*fileattrib = swf_InsertTag(0, ST_FILEATTRIBUTES);
+    swf_SetU32(fileattrib, s->swf.fileAttributes|FILEATTRIBUTE_AS3);
+    s->fileattributespos = s->writer.pos + 2;
+    swf_WriteTag2(&s->writer, fileattrib);
+    swf_DeleteTag(0, fileattrib);
+  }
+  return s;
+}
+
+int swf_StreamWriter_AddTag(SWFSTREAM*s, TAG*t)
+{
+  if(t->id == ST_FILEATTRIBUTES && s->fileattributespos>=0) {
+    swf_SetTagPos(t, 0);
+    s->swf.fileAttributes |= swf_GetU32(t);
+    s->has_fileattributes = 1;
+    return 0;
+  }
+  /* same heuristics as WriteExtraTags() */
+  if(t->id == ST_DOABC)
+    s->has_as3 = 1;
+  if(t->id == ST_DOACTION || t->id == ST_DOINITACTION ||
+     (t->id == ST_PLACEOBJECT2 && t->len && (t->data[0]&0x80)))
+    s->has_as2 = 1;
+
+  if(t->id == ST_DEFINESPRITE && !swf_IsFolded(t)) s->inSprite++;
+  else if(t->id == ST_END && s->inSprite) s->inSprite--;
+  else if(t->id == ST_END && !s->inSprite) {
+    if(s->lastid != ST_SHOWFRAME)
+      s->frameCount++;
+  }
+  else if(t->id == ST_SHOWFRAME && !s->inSprite) s->frameCount++;
+  s->lastid = t->id;
+
+  return swf_WriteTag2(&s->writer, t);
+}
+
+int swf_StreamWriter_End(SWFSTREAM*s, SWF*swf)
+{
+  int ret = 0;
+  U8 b4[4];
+  TAG t;
+  U8 b[64];
+
+  if(swf) {
+    s->swf.fileVersion = swf->fileVersion;
+    s->swf.frameRate = swf->frameRate;
+    s->swf.movieSize = swf->movieSize;
+    s->swf.fileAttributes |= swf->fileAttributes;
+  }
+  if(s->lastid != ST_END || s->inSprite) {
+    TAG*end = swf_InsertTag(0, ST_END);
+    swf_StreamWriter_AddTag(s, end);
+    swf_DeleteTag(0, end);
+  }
+
+  /* in the uncompressed case, the body starts after the first 8 bytes of the file */
+  int offset = s->compress?0:8;
+  s->swf.fileSize = s->writer.pos + 8;
+  s->swf.frameCount = s->frameCount;
+  s->writer.finish(&s->writer);
+
+  memset(&t, 0, sizeof(TAG));
+  t.data = b;
+  t.memsize = sizeof(b);
+  stream_setrect(&t, &s->swf.movieSize);
+  swf_SetU16(&t, s->swf.frameRate);
+  swf_SetU16(&t, s->swf.frameCount);
+  if(stream_patch(s->bodyhandle, offset, t.data, t.len)<0)
+    ret = -1;
+  if(s->fileattributespos>=0) {
+    U32 flags = s->swf.fileAttributes;
+    if(!s->has_fileattributes)
+      flags |= FILEATTRIBUTE_AS3;
+    if(!s->has_fileattributes && s->has_as2 && !s->has_as3)
+      flags &= ~FILEATTRIBUTE_AS3;
+    PUT32(b4, flags);
+    if(stream_patch(s->bodyhandle, offset + s->fileattributespos, b4, 4)<0)
+      ret = -1;
+  }
+
+  if(!s->compress) {
+    U8 v = s->swf.fileVersion;
+    PUT32(b4, s->swf.fileSize);
+    if(stream_patch(s->handle, 3, &v, 1)<0 || stream_patch(s->handle, 4, b4, 4)<0)
+      ret = -1;
+    lseek(s->handle, 0, SEEK_END);
+  } else {
+    writer_t filewriter, zwriter;
+    U8 b8[8];
+    memcpy(b8, s->swf.compressed==2?"ZWS":"CWS", 3);
+    b8[3] = s->swf.fileVersion;
+    PUT32(&b8[4], s->swf.fileSize);
+    writer_init_filewriter(&filewriter, s->handle);
+    filewriter.write(&filewriter, b8, 8);
+    if(s->swf.compressed==2) {
+      writer_init_lzmadeflate(&zwriter, &filewriter);
+    } else {
+      writer_init_zlibdeflate(&zwriter, &filewriter);
+    }
+    U8 buf[65536];
+    int l;
+    lseek(s->bodyhandle, 0, SEEK_SET);
+    while((l = read(s->bodyhandle, buf, sizeof(buf))) > 0) {
+      zwriter.write(&zwriter, buf, l);
+    }
+    zwriter.finish(&zwriter);
+    filewriter.finish(&filewriter);
+    close(s->bodyhandle);
+    unlink(s->bodyname);
+  }
+  if(swf) {
+    swf->frameCount = s->swf.frameCount;
+    swf->fileSize = s->swf.fileSize;
+  }
+  if(!ret)
+    ret = s->swf.fileSize;
+  free(s);
+  return ret;
+}
+
 int swf_WriteHeader2(writer_t*writer,SWF * swf)
 {
   SWF myswf;
@@ -1929,7 +2353,7 @@ void swf_FreeTags(SWF * swf)                 // Frees all malloc'ed memory for t
 
   while (t)
   { TAG * tnew = t->next;
-    if (t->data) rfx_free(t->data);
+    tag_freedata(t);
     rfx_free(t);
     t = tnew;
   }
@@ -156,7 +156,7 @@ typedef struct _SOUNDINFO
 
 typedef struct _SWF
 { U8            fileVersion;
-  U8		compressed;     // SWF or SWC?
+  U8		compressed;     // SWF or SWC? (0: depending on version, 1: zlib, 2: lzma, 0xff: uncompressed)
   U32           fileSize;       // valid after load and save
   SRECT         movieSize;
   U16           frameRate;
@@ -170,9 +170,18 @@ typedef struct _SWF
 SWF* swf_OpenSWF(char*filename);
 int  swf_ReadSWF2(reader_t*reader, SWF * swf);   // Reads SWF via callback
 int  swf_ReadSWF(int handle,SWF * swf);     // Reads SWF to memory (malloc'ed), returns length or <0 if fails
+int  swf_MapSWF(int handle,SWF * swf);      // Like swf_ReadSWF, but tag data points into a mapping of the file
 int  swf_WriteSWF2(writer_t*writer, SWF * swf);     // Writes SWF via callback, returns length or <0 if fails
 int  swf_WriteSWF(int handle,SWF * swf);    // Writes SWF to file, returns length or <0 if fails
 int  swf_SaveSWF(SWF * swf, char*filename);
+
+// Streaming output: tags are written to the (seekable) file right away, and the
+// header (file length, frame count, movie size) is fixed up by swf_StreamWriter_End().
+// Compression is determined by the header passed to swf_StreamWriter_Begin().
+typedef struct _SWFSTREAM SWFSTREAM;
+SWFSTREAM* swf_StreamWriter_Begin(int handle, SWF*swf);
+int  swf_StreamWriter_AddTag(SWFSTREAM*s, TAG*t);  // returns tag length or <0 if fails
+int  swf_StreamWriter_End(SWFSTREAM*s, SWF*swf);  // takes final header values from swf (may be 0), returns length or <0 if fails
 int  swf_WriteCGI(SWF * swf);               // Outputs SWF with valid CGI header to stdout
 void swf_FreeTags(SWF * swf);               // Frees all malloc'ed memory for swf
 SWF* swf_CopySWF(SWF*swf);
@@ -212,17 +212,25 @@ static VALUE image_height(VALUE cls)
     Get_Image(image,cls)
     return INT2FIX(image->image->height);
 }
-static VALUE image_rescale(VALUE cls, VALUE _width, VALUE _height)
+static VALUE image_rescale(int argc, VALUE*argv, VALUE cls)
 {
     Get_Image(image,cls)
+    VALUE _width, _height, _filter;
+    rb_scan_args(argc, argv, "21", &_width, &_height, &_filter);
     Check_Type(_width, T_FIXNUM);
     Check_Type(_height, T_FIXNUM);
     int width = FIX2INT(_width);
     int height = FIX2INT(_height);
+    gfxrescale_filter_t filter = gfxrescale_legacy;
+    if(!NIL_P(_filter)) {
+	Check_Type(_filter, T_STRING);
+	if(!gfxrescale_filter_byname(StringValuePtr(_filter), &filter))
+	    rb_raise(rb_eArgError, "Unknown rescale filter %s", StringValuePtr(_filter));
+    }
     volatile VALUE v_image2 = image_allocate(Bitmap);
     Get_Image(image2,v_image2)
     image2->doc = image->doc;
-    image2->image = gfximage_rescale(image->image, width, height);
+    image2->image = gfximage_rescale2(image->image, width, height, filter, 1);
     if(!image2->image) {
 	rb_raise(rb_eArgError, "Can't rescale to size %dx%d", width, height);
     }
@@ -636,6 +644,7 @@ gfxresult_t* rb_finish(gfxdevice_t*dev)
 #define make_device(dev, idoc, device) \
     gfxdevice_t dev; \
     device_internal_t i; \
+    memset(&dev, 0, sizeof(dev)); \
     i.v = device; \
     i.doc = idoc; \
     dev.internal = &i; \
@@ -785,7 +794,7 @@ void Init_gfx()
     rb_define_method(Bitmap, "save_png", image_save_png, 1);
     rb_define_method(Bitmap, "width", image_width, 0);
     rb_define_method(Bitmap, "height", image_height, 0);
-    rb_define_method(Bitmap, "rescale", image_rescale, 2);
+    rb_define_method(Bitmap, "rescale", image_rescale, -1);
     rb_define_method(Bitmap, "has_alpha", image_has_alpha, 0);
     
     Glyph = rb_define_class_under(GFX, "Glyph", rb_cObject);
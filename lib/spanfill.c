@@ -0,0 +1,555 @@
+/* spanfill.c
+   Span fill kernels for the scanline renderers, with SSE2/AVX2 versions
+   selected at runtime.
+
+   Part of the swftools package.
+
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <string.h>
+#include "../config.h"
+#include "spanfill.h"
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define SPANFILL_X86
+#include <immintrin.h>
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+/* spans shorter than this are always done with the plain C code */
+#define MIN_SIMD_SPAN 8
+
+static int simd_level = -1; /* 0 = none, 1 = sse2, 2 = avx2 */
+
+static int get_simd_level()
+{
+    if(simd_level < 0) {
+	int level = 0;
+#ifdef SPANFILL_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+	    level = 2;
+	else if(__builtin_cpu_supports("sse2"))
+	    level = 1;
+#endif
+	simd_level = level;
+    }
+    return simd_level;
+}
+
+void spanfill_disable_simd()
+{
+    simd_level = 0;
+}
+
+static inline U32 color2u32(gfxcolor_t col)
+{
+    U32 c;
+    memcpy(&c, &col, sizeof(c));
+    return c;
+}
+
+/* ------------------------------ plain C ------------------------------- */
+
+#define MASKBIT(mask,x) ((mask)[(x)>>5]&(1u<<((x)&31)))
+
+static inline void solid_bitmask_pixel(gfxcolor_t*p, gfxcolor_t col, int ainv)
+{
+    p->r = ((p->r*ainv)/255)+col.r;
+    p->g = ((p->g*ainv)/255)+col.g;
+    p->b = ((p->b*ainv)/255)+col.b;
+    p->a = ((p->a*ainv)/255)+col.a;
+}
+
+static inline void blend_bitmask_pixel(gfxcolor_t*p, gfxcolor_t col)
+{
+    int ainv = 255-col.a;
+    p->r = ((p->r*ainv)/255)+col.r;
+    p->g = ((p->g*ainv)/255)+col.g;
+    p->b = ((p->b*ainv)/255)+col.b;
+    p->a = 255;
+}
+
+static inline void solid_depth_pixel(gfxcolor_t*p, gfxcolor_t col, int ainv)
+{
+    p->r = ((p->r*ainv)>>8)+col.r;
+    p->g = ((p->g*ainv)>>8)+col.g;
+    p->b = ((p->b*ainv)>>8)+col.b;
+    p->a = 255;
+}
+
+static inline int clamp(int v)
+{
+    return v>255?255:v;
+}
+
+static inline void blend_depth_pixel(gfxcolor_t*p, gfxcolor_t col)
+{
+    int ainv = 255-col.a;
+    p->r = clamp(((p->r*ainv)>>8)+col.r);
+    p->g = clamp(((p->g*ainv)>>8)+col.g);
+    p->b = clamp(((p->b*ainv)>>8)+col.b);
+    p->a = 255;
+}
+
+static void solid_bitmask_c(gfxcolor_t*line, const U32*mask, int x1, int x2, gfxcolor_t col, int ainv)
+{
+    int x;
+    if(!ainv) {
+	for(x=x1;x<x2;x++) {
+	    if(MASKBIT(mask,x))
+		line[x] = col;
+	}
+    } else {
+	for(x=x1;x<x2;x++) {
+	    if(MASKBIT(mask,x))
+		solid_bitmask_pixel(&line[x], col, ainv);
+	}
+    }
+}
+
+static void blend_bitmask_c(gfxcolor_t*line, const U32*mask, int x1, int x2, const gfxcolor_t*src)
+{
+    int x;
+    for(x=x1;x<x2;x++) {
+	if(MASKBIT(mask,x))
+	    blend_bitmask_pixel(&line[x], src[x-x1]);
+    }
+}
+
+static void solid_depth_c(gfxcolor_t*line, int*z, U32 depth, int x1, int x2, gfxcolor_t col, int ainv)
+{
+    int x;
+    for(x=x1;x<x2;x++) {
+	if(depth >= z[x]) {
+	    if(!ainv)
+		line[x] = col;
+	    else
+		solid_depth_pixel(&line[x], col, ainv);
+	    z[x] = depth;
+	}
+    }
+}
+
+static void blend_depth_c(gfxcolor_t*line, int*z, U32 depth, int x1, int x2, const gfxcolor_t*src)
+{
+    int x;
+    for(x=x1;x<x2;x++) {
+	if(depth >= z[x]) {
+	    blend_depth_pixel(&line[x], src[x-x1]);
+	    z[x] = depth;
+	}
+    }
+}
+
+#ifdef SPANFILL_X86
+
+/* ------------------------------- SSE2 --------------------------------- */
+
+/* v/255 for 16 bit lanes, exact for 0 <= v <= 255*255 */
+static inline SSE2 __m128i div255_sse2(__m128i v)
+{
+    v = _mm_add_epi16(v, _mm_add_epi16(_mm_srli_epi16(v, 8), _mm_set1_epi16(1)));
+    return _mm_srli_epi16(v, 8);
+}
+
+/* 4 bits of the clip bitmask -> 4 lane mask */
+static inline SSE2 __m128i bits2mask_sse2(int bits)
+{
+    __m128i b = _mm_set_epi32(8,4,2,1);
+    return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), b), b);
+}
+
+/* depth >= z, as unsigned comparison */
+static inline SSE2 __m128i depthmask_sse2(__m128i z, __m128i depth)
+{
+    __m128i sign = _mm_set1_epi32(0x80000000);
+    return _mm_xor_si128(_mm_cmpgt_epi32(_mm_xor_si128(z, sign), _mm_xor_si128(depth, sign)),
+			 _mm_set1_epi32(-1));
+}
+
+static inline SSE2 __m128i select_sse2(__m128i m, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+/* 255-alpha of four pixels, spread over the 16 bit lanes of pixels 0,1 (lo) and 2,3 (hi) */
+static inline SSE2 void ainv_sse2(__m128i s, __m128i*lo, __m128i*hi)
+{
+    __m128i ainv = _mm_sub_epi32(_mm_set1_epi32(255), _mm_and_si128(s, _mm_set1_epi32(255)));
+    ainv = _mm_or_si128(ainv, _mm_slli_epi32(ainv, 16));
+    *lo = _mm_unpacklo_epi32(ainv, ainv);
+    *hi = _mm_unpackhi_epi32(ainv, ainv);
+}
+
+static SSE2 void solid_bitmask_sse2(gfxcolor_t*line, const U32*mask, int x1, int x2, gfxcolor_t col, int ainv)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowbyte = _mm_set1_epi16(0xff);
+    __m128i c = _mm_set1_epi32(color2u32(col));
+    __m128i c16 = _mm_unpacklo_epi8(c, zero);
+    __m128i a16 = _mm_set1_epi16(ainv);
+    int x = x1;
+    while(x<x2 && (x&3)) {
+	if(MASKBIT(mask,x)) {
+	    if(!ainv) line[x] = col;
+	    else solid_bitmask_pixel(&line[x], col, ainv);
+	}
+	x++;
+    }
+    for(;x+4<=x2;x+=4) {
+	int bits = (mask[x>>5] >> (x&31)) & 15;
+	if(!bits)
+	    continue;
+	__m128i*p = (__m128i*)&line[x];
+	__m128i res;
+	__m128i d = _mm_loadu_si128(p);
+	if(!ainv) {
+	    res = c;
+	} else {
+	    __m128i lo = div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), a16));
+	    __m128i hi = div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), a16));
+	    lo = _mm_and_si128(_mm_add_epi16(lo, c16), lowbyte);
+	    hi = _mm_and_si128(_mm_add_epi16(hi, c16), lowbyte);
+	    res = _mm_packus_epi16(lo, hi);
+	}
+	if(bits != 15)
+	    res = select_sse2(bits2mask_sse2(bits), res, d);
+	_mm_storeu_si128(p, res);
+    }
+    solid_bitmask_c(line, mask, x, x2, col, ainv);
+}
+
+static SSE2 void blend_bitmask_sse2(gfxcolor_t*line, const U32*mask, int x1, int x2, const gfxcolor_t*src)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowbyte = _mm_set1_epi16(0xff);
+    const __m128i alpha = _mm_set1_epi32(0xff);
+    int x = x1;
+    while(x<x2 && (x&3)) {
+	if(MASKBIT(mask,x))
+	    blend_bitmask_pixel(&line[x], src[x-x1]);
+	x++;
+    }
+    for(;x+4<=x2;x+=4) {
+	int bits = (mask[x>>5] >> (x&31)) & 15;
+	if(!bits)
+	    continue;
+	__m128i*p = (__m128i*)&line[x];
+	__m128i d = _mm_loadu_si128(p);
+	__m128i s = _mm_loadu_si128((const __m128i*)&src[x-x1]);
+	__m128i alo, ahi;
+	ainv_sse2(s, &alo, &ahi);
+	__m128i lo = div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), alo));
+	__m128i hi = div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ahi));
+	lo = _mm_and_si128(_mm_add_epi16(lo, _mm_unpacklo_epi8(s, zero)), lowbyte);
+	hi = _mm_and_si128(_mm_add_epi16(hi, _mm_unpackhi_epi8(s, zero)), lowbyte);
+	__m128i res = _mm_or_si128(_mm_packus_epi16(lo, hi), alpha);
+	if(bits != 15)
+	    res = select_sse2(bits2mask_sse2(bits), res, d);
+	_mm_storeu_si128(p, res);
+    }
+    blend_bitmask_c(line, mask, x, x2, src+(x-x1));
+}
+
+static SSE2 void solid_depth_sse2(gfxcolor_t*line, int*z, U32 depth, int x1, int x2, gfxcolor_t col, int ainv)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(0xff);
+    __m128i c = _mm_set1_epi32(color2u32(col));
+    __m128i c16 = _mm_unpacklo_epi8(c, zero);
+    __m128i a16 = _mm_set1_epi16(ainv);
+    __m128i dv = _mm_set1_epi32(depth);
+    int x;
+    for(x=x1;x+4<=x2;x+=4) {
+	__m128i*zp = (__m128i*)&z[x];
+	__m128i m = depthmask_sse2(_mm_loadu_si128(zp), dv);
+	if(!_mm_movemask_epi8(m))
+	    continue;
+	__m128i*p = (__m128i*)&line[x];
+	__m128i d = _mm_loadu_si128(p);
+	__m128i res;
+	if(!ainv) {
+	    res = c;
+	} else {
+	    __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), a16), 8);
+	    __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), a16), 8);
+	    res = _mm_packus_epi16(_mm_add_epi16(lo, c16), _mm_add_epi16(hi, c16));
+	    res = _mm_or_si128(res, alpha);
+	}
+	_mm_storeu_si128(p, select_sse2(m, res, d));
+	_mm_storeu_si128(zp, select_sse2(m, dv, _mm_loadu_si128(zp)));
+    }
+    solid_depth_c(line, z, depth, x, x2, col, ainv);
+}
+
+static SSE2 void blend_depth_sse2(gfxcolor_t*line, int*z, U32 depth, int x1, int x2, const gfxcolor_t*src)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(0xff);
+    __m128i dv = _mm_set1_epi32(depth);
+    int x;
+    for(x=x1;x+4<=x2;x+=4) {
+	__m128i*zp = (__m128i*)&z[x];
+	__m128i m = depthmask_sse2(_mm_loadu_si128(zp), dv);
+	if(!_mm_movemask_epi8(m))
+	    continue;
+	__m128i*p = (__m128i*)&line[x];
+	__m128i d = _mm_loadu_si128(p);
+	__m128i s = _mm_loadu_si128((const __m128i*)&src[x-x1]);
+	__m128i alo, ahi;
+	ainv_sse2(s, &alo, &ahi);
+	__m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), alo), 8);
+	__m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ahi), 8);
+	lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(s, zero));
+	hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(s, zero));
+	/* packus saturates, like clamp() */
+	__m128i res = _mm_or_si128(_mm_packus_epi16(lo, hi), alpha);
+	_mm_storeu_si128(p, select_sse2(m, res, d));
+	_mm_storeu_si128(zp, select_sse2(m, dv, _mm_loadu_si128(zp)));
+    }
+    blend_depth_c(line, z, depth, x, x2, src+(x-x1));
+}
+
+/* ------------------------------- AVX2 --------------------------------- */
+
+static inline AVX2 __m256i div255_avx2(__m256i v)
+{
+    v = _mm256_add_epi16(v, _mm256_add_epi16(_mm256_srli_epi16(v, 8), _mm256_set1_epi16(1)));
+    return _mm256_srli_epi16(v, 8);
+}
+
+static inline AVX2 __m256i bits2mask_avx2(int bits)
+{
+    __m256i b = _mm256_set_epi32(128,64,32,16,8,4,2,1);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), b), b);
+}
+
+static inline AVX2 __m256i depthmask_avx2(__m256i z, __m256i depth)
+{
+    __m256i sign = _mm256_set1_epi32(0x80000000);
+    return _mm256_xor_si256(_mm256_cmpgt_epi32(_mm256_xor_si256(z, sign), _mm256_xor_si256(depth, sign)),
+			    _mm256_set1_epi32(-1));
+}
+
+static inline AVX2 void ainv_avx2(__m256i s, __m256i*lo, __m256i*hi)
+{
+    __m256i ainv = _mm256_sub_epi32(_mm256_set1_epi32(255), _mm256_and_si256(s, _mm256_set1_epi32(255)));
+    ainv = _mm256_or_si256(ainv, _mm256_slli_epi32(ainv, 16));
+    *lo = _mm256_unpacklo_epi32(ainv, ainv);
+    *hi = _mm256_unpackhi_epi32(ainv, ainv);
+}
+
+/* (the unpack and pack instructions work on the two 128 bit halves separately,
+    which cancels out, so pixels stay in order) */
+
+static AVX2 void solid_bitmask_avx2(gfxcolor_t*line, const U32*mask, int x1, int x2, gfxcolor_t col, int ainv)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lowbyte = _mm256_set1_epi16(0xff);
+    __m256i c = _mm256_set1_epi32(color2u32(col));
+    __m256i c16 = _mm256_unpacklo_epi8(c, zero);
+    __m256i a16 = _mm256_set1_epi16(ainv);
+    int x = x1;
+    while(x<x2 && (x&7)) {
+	if(MASKBIT(mask,x)) {
+	    if(!ainv) line[x] = col;
+	    else solid_bitmask_pixel(&line[x], col, ainv);
+	}
+	x++;
+    }
+    for(;x+8<=x2;x+=8) {
+	int bits = (mask[x>>5] >> (x&31)) & 255;
+	if(!bits)
+	    continue;
+	__m256i*p = (__m256i*)&line[x];
+	__m256i res;
+	__m256i d = _mm256_loadu_si256(p);
+	if(!ainv) {
+	    res = c;
+	} else {
+	    __m256i lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), a16));
+	    __m256i hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), a16));
+	    lo = _mm256_and_si256(_mm256_add_epi16(lo, c16), lowbyte);
+	    hi = _mm256_and_si256(_mm256_add_epi16(hi, c16), lowbyte);
+	    res = _mm256_packus_epi16(lo, hi);
+	}
+	if(bits != 255)
+	    res = _mm256_blendv_epi8(d, res, bits2mask_avx2(bits));
+	_mm256_storeu_si256(p, res);
+    }
+    solid_bitmask_c(line, mask, x, x2, col, ainv);
+}
+
+static AVX2 void blend_bitmask_avx2(gfxcolor_t*line, const U32*mask, int x1, int x2, const gfxcolor_t*src)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lowbyte = _mm256_set1_epi16(0xff);
+    const __m256i alpha = _mm256_set1_epi32(0xff);
+    int x = x1;
+    while(x<x2 && (x&7)) {
+	if(MASKBIT(mask,x))
+	    blend_bitmask_pixel(&line[x], src[x-x1]);
+	x++;
+    }
+    for(;x+8<=x2;x+=8) {
+	int bits = (mask[x>>5] >> (x&31)) & 255;
+	if(!bits)
+	    continue;
+	__m256i*p = (__m256i*)&line[x];
+	__m256i d = _mm256_loadu_si256(p);
+	__m256i s = _mm256_loadu_si256((const __m256i*)&src[x-x1]);
+	__m256i alo, ahi;
+	ainv_avx2(s, &alo, &ahi);
+	__m256i lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), alo));
+	__m256i hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ahi));
+	lo = _mm256_and_si256(_mm256_add_epi16(lo, _mm256_unpacklo_epi8(s, zero)), lowbyte);
+	hi = _mm256_and_si256(_mm256_add_epi16(hi, _mm256_unpackhi_epi8(s, zero)), lowbyte);
+	__m256i res = _mm256_or_si256(_mm256_packus_epi16(lo, hi), alpha);
+	if(bits != 255)
+	    res = _mm256_blendv_epi8(d, res, bits2mask_avx2(bits));
+	_mm256_storeu_si256(p, res);
+    }
+    blend_bitmask_c(line, mask, x, x2, src+(x-x1));
+}
+
+static AVX2 void solid_depth_avx2(gfxcolor_t*line, int*z, U32 depth, int x1, int x2, gfxcolor_t col, int ainv)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi32(0xff);
+    __m256i c = _mm256_set1_epi32(color2u32(col));
+    __m256i c16 = _mm256_unpacklo_epi8(c, zero);
+    __m256i a16 = _mm256_set1_epi16(ainv);
+    __m256i dv = _mm256_set1_epi32(depth);
+    int x;
+    for(x=x1;x+8<=x2;x+=8) {
+	__m256i*zp = (__m256i*)&z[x];
+	__m256i zv = _mm256_loadu_si256(zp);
+	__m256i m = depthmask_avx2(zv, dv);
+	if(_mm256_testz_si256(m, m))
+	    continue;
+	__m256i*p = (__m256i*)&line[x];
+	__m256i d = _mm256_loadu_si256(p);
+	__m256i res;
+	if(!ainv) {
+	    res = c;
+	} else {
+	    __m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), a16), 8);
+	    __m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), a16), 8);
+	    res = _mm256_packus_epi16(_mm256_add_epi16(lo, c16), _mm256_add_epi16(hi, c16));
+	    res = _mm256_or_si256(res, alpha);
+	}
+	_mm256_storeu_si256(p, _mm256_blendv_epi8(d, res, m));
+	_mm256_storeu_si256(zp, _mm256_blendv_epi8(zv, dv, m));
+    }
+    solid_depth_c(line, z, depth, x, x2, col, ainv);
+}
+
+static AVX2 void blend_depth_avx2(gfxcolor_t*line, int*z, U32 depth, int x1, int x2, const gfxcolor_t*src)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi32(0xff);
+    __m256i dv = _mm256_set1_epi32(depth);
+    int x;
+    for(x=x1;x+8<=x2;x+=8) {
+	__m256i*zp = (__m256i*)&z[x];
+	__m256i zv = _mm256_loadu_si256(zp);
+	__m256i m = depthmask_avx2(zv, dv);
+	if(_mm256_testz_si256(m, m))
+	    continue;
+	__m256i*p = (__m256i*)&line[x];
+	__m256i d = _mm256_loadu_si256(p);
+	__m256i s = _mm256_loadu_si256((const __m256i*)&src[x-x1]);
+	__m256i alo, ahi;
+	ainv_avx2(s, &alo, &ahi);
+	__m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), alo), 8);
+	__m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ahi), 8);
+	lo = _mm256_add_epi16(lo, _mm256_unpacklo_epi8(s, zero));
+	hi = _mm256_add_epi16(hi, _mm256_unpackhi_epi8(s, zero));
+	__m256i res = _mm256_or_si256(_mm256_packus_epi16(lo, hi), alpha);
+	_mm256_storeu_si256(p, _mm256_blendv_epi8(d, res, m));
+	_mm256_storeu_si256(zp, _mm256_blendv_epi8(zv, dv, m));
+    }
+    blend_depth_c(line, z, depth, x, x2, src+(x-x1));
+}
+
+#endif
+
+/* ------------------------------ dispatch ------------------------------ */
+
+void spanfill_solid_bitmask(gfxcolor_t*line, const U32*mask, int x1, int x2, gfxcolor_t col)
+{
+    int ainv = 255-col.a;
+    if(ainv) {
+	col.r = (col.r*col.a)/255;
+	col.g = (col.g*col.a)/255;
+	col.b = (col.b*col.a)/255;
+    }
+#ifdef SPANFILL_X86
+    if(x2-x1 >= MIN_SIMD_SPAN) {
+	int level = get_simd_level();
+	if(level == 2) {solid_bitmask_avx2(line, mask, x1, x2, col, ainv);return;}
+	if(level == 1) {solid_bitmask_sse2(line, mask, x1, x2, col, ainv);return;}
+    }
+#endif
+    solid_bitmask_c(line, mask, x1, x2, col, ainv);
+}
+
+void spanfill_blend_bitmask(gfxcolor_t*line, const U32*mask, int x1, int x2, const gfxcolor_t*src)
+{
+#ifdef SPANFILL_X86
+    if(x2-x1 >= MIN_SIMD_SPAN) {
+	int level = get_simd_level();
+	if(level == 2) {blend_bitmask_avx2(line, mask, x1, x2, src);return;}
+	if(level == 1) {blend_bitmask_sse2(line, mask, x1, x2, src);return;}
+    }
+#endif
+    blend_bitmask_c(line, mask, x1, x2, src);
+}
+
+void spanfill_solid_depth(gfxcolor_t*line, int*z, U32 depth, int x1, int x2, gfxcolor_t col)
+{
+    int ainv = 255-col.a;
+    if(ainv) {
+	col.r = (col.r*col.a)>>8;
+	col.g = (col.g*col.a)>>8;
+	col.b = (col.b*col.a)>>8;
+	col.a = 255;
+    }
+#ifdef SPANFILL_X86
+    if(x2-x1 >= MIN_SIMD_SPAN) {
+	int level = get_simd_level();
+	if(level == 2) {solid_depth_avx2(line, z, depth, x1, x2, col, ainv);return;}
+	if(level == 1) {solid_depth_sse2(line, z, depth, x1, x2, col, ainv);return;}
+    }
+#endif
+    solid_depth_c(line, z, depth, x1, x2, col, ainv);
+}
+
+void spanfill_blend_depth(gfxcolor_t*line, int*z, U32 depth, int x1, int x2, const gfxcolor_t*src)
+{
+#ifdef SPANFILL_X86
+    if(x2-x1 >= MIN_SIMD_SPAN) {
+	int level = get_simd_level();
+	if(level == 2) {blend_depth_avx2(line, z, depth, x1, x2, src);return;}
+	if(level == 1) {blend_depth_sse2(line, z, depth, x1, x2, src);return;}
+    }
+#endif
+    blend_depth_c(line, z, depth, x1, x2, src);
+}
@@ -0,0 +1,61 @@
+/* spanfill.h
+   Span fill kernels for the scanline renderers, with SSE2/AVX2 versions
+   selected at runtime.
+
+   Part of the swftools package.
+
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __spanfill_h__
+#define __spanfill_h__
+
+#include "types.h"
+#include "gfxdevice.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* All functions fill the pixels x1..x2-1 of a scanline. Pixels are in
+   gfxcolor_t (or, equivalently, rfxswf RGBA) byte order. The SIMD versions
+   produce exactly the same pixels as the plain C ones. */
+
+/* Kernels for the render device (lib/devices/render.c): a pixel is
+   drawn if bit x of the clip bitmask is set, blending divides by 255. */
+
+/* fill with a solid color (not premultiplied) */
+void spanfill_solid_bitmask(gfxcolor_t*line, const U32*mask, int x1, int x2, gfxcolor_t col);
+/* blend the premultiplied pixels src[0..x2-x1-1] over the line, setting alpha to 255 */
+void spanfill_blend_bitmask(gfxcolor_t*line, const U32*mask, int x1, int x2, const gfxcolor_t*src);
+
+/* Kernels for the swf renderer (lib/modules/swfrender.c): a pixel is
+   drawn if depth>=z[x], in which case z[x] is set to depth. Blending
+   approximates the division by 255 with a shift, and saturates. */
+
+/* fill with a solid color (not premultiplied) */
+void spanfill_solid_depth(gfxcolor_t*line, int*z, U32 depth, int x1, int x2, gfxcolor_t col);
+/* blend the premultiplied pixels src[0..x2-x1-1] over the line, setting alpha to 255 */
+void spanfill_blend_depth(gfxcolor_t*line, int*z, U32 depth, int x1, int x2, const gfxcolor_t*src);
+
+/* use only the plain C versions (for testing) */
+void spanfill_disable_simd();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__spanfill_h__
@@ -0,0 +1,117 @@
+/* threads.c
+   Minimal worker pool for running independent jobs in parallel.
+
+   Part of the swftools package.
+   
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org> 
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "../config.h"
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif
+#include "threads.h"
+#include "mem.h"
+#include "log.h"
+
+int threads_num_cpus()
+{
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n >= 1)
+	return (int)n;
+#endif
+    return 1;
+}
+
+#ifdef HAVE_THREADS
+typedef struct _jobqueue {
+    pthread_mutex_t mutex;
+    int next_job;
+    int num_jobs;
+    threadjob_func_t func;
+    void*data;
+} jobqueue_t;
+
+typedef struct _worker {
+    jobqueue_t*queue;
+    int nr;
+    pthread_t thread;
+} worker_t;
+
+static void* worker_main(void*_w)
+{
+    worker_t*w = (worker_t*)_w;
+    jobqueue_t*q = w->queue;
+    while(1) {
+	pthread_mutex_lock(&q->mutex);
+	int job = q->next_job;
+	if(job < q->num_jobs)
+	    q->next_job++;
+	pthread_mutex_unlock(&q->mutex);
+	if(job >= q->num_jobs)
+	    break;
+	q->func(q->data, job, w->nr);
+    }
+    return 0;
+}
+#endif
+
+void threads_run(int num_threads, int num_jobs, threadjob_func_t func, void*data)
+{
+    int t;
+    if(num_threads > num_jobs)
+	num_threads = num_jobs;
+#ifdef HAVE_THREADS
+    if(num_threads > 1) {
+	jobqueue_t q;
+	pthread_mutex_init(&q.mutex, 0);
+	q.next_job = 0;
+	q.num_jobs = num_jobs;
+	q.func = func;
+	q.data = data;
+
+	worker_t*workers = (worker_t*)rfx_calloc(sizeof(worker_t)*num_threads);
+	/* the calling thread acts as worker 0 */
+	for(t=1;t<num_threads;t++) {
+	    workers[t].queue = &q;
+	    workers[t].nr = t;
+	    if(pthread_create(&workers[t].thread, 0, worker_main, &workers[t])) {
+		msg("<warning> Couldn't start worker thread %d", t);
+		workers[t].queue = 0;
+	    }
+	}
+	workers[0].queue = &q;
+	workers[0].nr = 0;
+	worker_main(&workers[0]);
+	for(t=1;t<num_threads;t++) {
+	    if(workers[t].queue)
+		pthread_join(workers[t].thread, 0);
+	}
+	free(workers);
+	pthread_mutex_destroy(&q.mutex);
+	return;
+    }
+#endif
+    for(t=0;t<num_jobs;t++) {
+	func(data, t, 0);
+    }
+}
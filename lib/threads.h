@@ -0,0 +1,47 @@
+/* threads.h
+   Minimal worker pool for running independent jobs in parallel.
+
+   Part of the swftools package.
+   
+   Copyright (c) 2010 Matthias Kramm <kramm@quiss.org> 
+ 
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+
+#ifndef __threads_h__
+#define __threads_h__
+
+#include "../config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* job callback. "job" is the job number (0..num_jobs-1), "thread" the
+   number of the worker executing it (0..num_threads-1). */
+typedef void (*threadjob_func_t)(void*data, int job, int thread);
+
+/* number of processors available, or 1 if unknown */
+int threads_num_cpus();
+
+/* run num_jobs jobs on (at most) num_threads workers and wait until all
+   of them are finished. Jobs are handed out in ascending order. Without
+   thread support, all jobs are executed sequentially by the caller. */
+void threads_run(int num_threads, int num_jobs, threadjob_func_t func, void*data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__threads_h__
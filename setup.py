@@ -252,7 +252,7 @@ if "freetype" not in config.libraries:
     sys.exit(1)
 
 base_sources = [
-"lib/q.c", "lib/utf8.c", "lib/png.c", "lib/jpeg.c", "lib/wav.c", "lib/mp3.c", "lib/os.c", "lib/bitio.c", "lib/log.c", "lib/mem.c", "lib/ttf.c", "lib/kdtree.c", "lib/xml.c"
+"lib/q.c", "lib/utf8.c", "lib/png.c", "lib/jpeg.c", "lib/wav.c", "lib/mp3.c", "lib/os.c", "lib/bitio.c", "lib/log.c", "lib/mem.c", "lib/ttf.c", "lib/kdtree.c", "lib/threads.c", "lib/spanfill.c", "lib/xml.c"
 ]
 rfxswf_sources = [
 "lib/modules/swfaction.c", "lib/modules/swfbits.c", "lib/modules/swfbutton.c",
@@ -265,7 +265,7 @@ rfxswf_sources = [
 "lib/action/swf4compiler.tab.c", "lib/action/swf5compiler.tab.c", "lib/action/actioncompiler.c",
 "lib/as3/assets.c", "lib/as3/abc.c", "lib/as3/state.c", "lib/as3/code.c", "lib/as3/pool.c", "lib/as3/files.c", "lib/as3/opcodes.c", 
 "lib/as3/scripts.c", "lib/as3/common.c", "lib/as3/builtin.c", "lib/as3/compiler.c", "lib/as3/expr.c", "lib/as3/import.c",
-"lib/as3/initcode.c", "lib/as3/parser.tab.c", "lib/as3/parser_help.c", "lib/as3/registry.c", "lib/as3/tokenizer.yy.c",
+"lib/as3/initcode.c", "lib/as3/cache.c", "lib/as3/parser.tab.c", "lib/as3/parser_help.c", "lib/as3/registry.c", "lib/as3/tokenizer.yy.c",
 ]
 libpdf_sources = [
 "lib/pdf/VectorGraphicOutputDev.cc",
@@ -293,7 +293,7 @@ libpdf_sources = [
 "lib/pdf/xpdf/SplashFTFontFile.cc", "lib/pdf/xpdf/SplashFTFont.cc"]
 
 libgfx_sources = [
-"lib/gfxtools.c", "lib/gfxfont.c", "lib/gfximage.c",
+"lib/gfxtools.c", "lib/gfxpath.c", "lib/gfxfont.c", "lib/gfximage.c",
 "lib/gfxpoly/active.c", "lib/gfxpoly/convert.c", "lib/gfxpoly/moments.c",
 "lib/gfxpoly/poly.c", "lib/gfxpoly/renderpoly.c", "lib/gfxpoly/stroke.c",
 "lib/gfxpoly/wind.c", "lib/gfxpoly/xrow.c",
@@ -60,6 +60,9 @@ static struct options_t options[] = {
 {"L", "local-with-filesystem"},
 {"T", "flashversion"},
 {"o", "output"},
+{"O", "optimize"},
+{"c", "cache"},
+{"t", "threads"},
 {0,0}
 };
 
@@ -118,6 +121,18 @@ int args_callback_option(char*name,char*val)
         as3_set_option("recurse","1");
 	return 0;
     }
+    else if(!strcmp(name, "O")) {
+        as3_set_option("optimize","1");
+	return 0;
+    }
+    else if(!strcmp(name, "c")) {
+        as3_set_option("cache",val);
+	return 1;
+    }
+    else if(!strcmp(name, "t")) {
+        as3_set_option("threads",val);
+	return 1;
+    }
     else if(!strcmp(name, "D")) {
         if(!strstr(val, "::")) {
             fprintf(stderr, "Error: compile definition must contain \"::\"\n");
@@ -168,6 +183,9 @@ void args_callback_usage(char *name)
     printf("-L , --local-with-filesystem     Make output file \"local with filesystem\"\n");
     printf("-T , --flashversion <num>      Set target SWF flash version to <num>.\n");
     printf("-o , --output <filename>       Set output file to <filename>.\n");
+    printf("-O , --optimize                Run a peephole optimizer over the generated bytecode\n");
+    printf("-c , --cache <dir>             Keep compiled code in <dir>, and reuse it for unchanged files\n");
+    printf("-t , --threads <num>           Tokenize source files on <num> threads (0: one per processor)\n");
     printf("\n");
 }
 int args_callback_command(char*name,char*val)
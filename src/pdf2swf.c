@@ -47,6 +47,7 @@
 #include "../lib/gfxfilter.h"
 #include "../lib/pdf/pdf.h"
 #include "../lib/log.h"
+#include "../lib/threads.h"
 
 #define SWFDIR concatPaths(getInstallationPath(), "swfs")
 
@@ -61,6 +62,7 @@ static char * pagerange = 0;
 static char * filename = 0;
 static char * password = 0;
 static int zlib = 0;
+static int lzma = 0;
 
 static char * preloader = 0;
 static char * viewer = 0;
@@ -73,6 +75,10 @@ static int max_time = 0;
 
 static int flatten = 0;
 
+static int num_threads = 1;
+
+static int stream = 0;
+
 static char* filters = 0;
 
 char* fontpaths[256];
@@ -308,6 +314,12 @@ int args_callback_option(char*name,char*val) {
 	zlib = 1;
 	return 0;
     }
+    else if (!strcmp(name, "Z"))
+    {
+	store_parameter("enablelzma", "1");
+	lzma = 1;
+	return 0;
+    }
     else if (!strcmp(name, "n"))
     {
 	store_parameter("opennewwindow", "1");
@@ -444,6 +456,18 @@ int args_callback_option(char*name,char*val) {
 	    return 1;
 	}
     }
+    else if (!strcmp(name, "N"))
+    {
+	num_threads = atoi(val);
+	if(num_threads <= 0)
+	    num_threads = threads_num_cpus();
+	return 1;
+    }
+    else if (!strcmp(name, "W"))
+    {
+	stream = 1;
+	return 0;
+    }
     else if (!strcmp(name, "V"))
     {	
 	printf("pdf2swf - part of %s %s\n", PACKAGE, VERSION);
@@ -465,6 +489,7 @@ static struct options_t options[] = {
 {"P", "password"},
 {"v", "verbose"},
 {"z", "zlib"},
+{"Z", "lzma"},
 {"i", "ignore"},
 {"j", "jpegquality"},
 {"s", "set"},
@@ -485,6 +510,8 @@ static struct options_t options[] = {
 {"Q", "maxtime"},
 {"X", "width"},
 {"Y", "height"},
+{"N", "threads"},
+{"W", "stream"},
 {0,0}
 };
 
@@ -519,6 +546,7 @@ void args_callback_usage(char *name)
     printf("-P , --password password       Use password for deciphering the pdf.\n");
     printf("-v , --verbose                 Be verbose. Use more than one -v for greater effect.\n");
     printf("-z , --zlib                    Use Flash 6 (MX) zlib compression.\n");
+    printf("-Z , --lzma                    Use Flash 11 lzma compression.\n");
     printf("-i , --ignore                  Allows pdf2swf to change the draw order of the pdf. This may make the generated\n");
     printf("-j , --jpegquality quality     Set quality of embedded jpeg pictures to quality. 0 is worst (small), 100 is best (big). (default:85)\n");
     printf("-s , --set param=value         Set a SWF encoder specific parameter.  See pdf2swf -s help for more information.\n");
@@ -536,6 +564,8 @@ void args_callback_usage(char *name)
     printf("-G , --flatten                 Remove as many clip layers from file as possible. \n");
     printf("-I , --info                    Don't do actual conversion, just display a list of all pages in the PDF.\n");
     printf("-Q , --maxtime n               Abort conversion after n seconds. Only available on Unix.\n");
+    printf("-N , --threads n               Render n pages in parallel (0: one per processor). Output is identical to single-threaded mode unless -s infoprepass=0 is used.\n");
+    printf("-W , --stream                  Write pages to the output file as soon as they are converted, instead of keeping the SWF in memory. Fonts are not reduced.\n");
     printf("\n");
 }
 
@@ -626,6 +656,90 @@ gfxdevice_t*create_output_device()
     return out;
 }
 
+struct mypage_t {
+    int x;
+    int y;
+    gfxpage_t*page;
+};
+
+/* one output frame, i.e. one page, or up to 3x3 pages when doing n-up */
+typedef struct _frame {
+    struct mypage_t pages[9];
+    int pagenum;
+    int pagenr; // the last pdf page in this frame
+    gfxresult_t*recording;
+} frame_t;
+
+static void render_frame(gfxdevice_t*out, frame_t*frame)
+{
+    struct mypage_t*pages = frame->pages;
+    int pagenum = frame->pagenum;
+    int t;
+    int xmax[xnup], ymax[xnup];
+    int x,y;
+    int width=0, height=0;
+
+    memset(xmax, 0, xnup*sizeof(int));
+    memset(ymax, 0, ynup*sizeof(int));
+
+    for(y=0;y<ynup;y++)
+    for(x=0;x<xnup;x++) {
+	int t = y*xnup + x;
+	if(!pages[t].page)
+	    continue;
+
+	if(pages[t].page->width > xmax[x])
+	    xmax[x] = (int)pages[t].page->width;
+	if(pages[t].page->height > ymax[y])
+	    ymax[y] = (int)pages[t].page->height;
+    }
+    for(x=0;x<xnup;x++) {
+	width += xmax[x];
+	xmax[x] = width;
+    }
+    for(y=0;y<ynup;y++) {
+	height += ymax[y];
+	ymax[y] = height;
+    }
+    if(custom_clip) {
+	out->startpage(out,clip_x2 - clip_x1, clip_y2 - clip_y1);
+    } else {
+	out->startpage(out,width,height);
+    }
+    for(t=0;t<pagenum;t++) {
+	int x = t%xnup;
+	int y = t/xnup;
+	int xpos = x>0?xmax[x-1]:0;
+	int ypos = y>0?ymax[y-1]:0;
+	msg("<verbose> Render (%d,%d) move:%d/%d\n",
+		(int)(pages[t].page->width + xpos),
+		(int)(pages[t].page->height + ypos), xpos, ypos);
+	pages[t].page->rendersection(pages[t].page, out, custom_move? move_x : xpos, 
+						   custom_move? move_y : ypos,
+						   custom_clip? clip_x1 : 0 + xpos, 
+						   custom_clip? clip_y1 : 0 + ypos, 
+						   custom_clip? clip_x2 : pages[t].page->width + xpos, 
+						   custom_clip? clip_y2 : pages[t].page->height + ypos);
+    }
+    out->endpage(out);
+    for(t=0;t<pagenum;t++)  {
+	pages[t].page->destroy(pages[t].page);
+	pages[t].page = 0;
+    }
+}
+
+/* worker for --threads: render a frame into a private record device.
+   The recordings are replayed into the real output device in page order
+   afterwards, so the output doesn't depend on the thread scheduling. */
+static void render_frame_job(void*data, int job, int thread)
+{
+    frame_t*frame = &((frame_t*)data)[job];
+    gfxdevice_t record;
+    gfxdevice_record_init(&record, 0);
+    render_frame(&record, frame);
+    frame->recording = record.finish(&record);
+}
+
 int main(int argn, char *argv[])
 {
     int ret;
@@ -708,6 +822,8 @@ int main(int argn, char *argv[])
     }
 
     if(info_only) {
+	/* page sizes don't need the font scan */
+	driver->setparameter(driver, "infoprepass", "0");
 	show_info(driver, filename);
 	return 0;
     }
@@ -733,6 +849,18 @@ int main(int argn, char *argv[])
 	strcpy(pattern+l+1, outputname+l);
 	outputname = pattern;
     }
+    if(stream) {
+	if(one_file_per_page)
+	    msg("<warning> --stream has no effect when writing one file per page");
+	else
+	    store_parameter("stream", outputname);
+    }
+
+    /* needs to be set before opening the document */
+    if(num_threads > 1) {
+	msg("<notice> Rendering pages with %d threads", num_threads);
+	driver->setparameter(driver, "threadsafe", "1");
+    }
 
     gfxdocument_t* pdf = driver->open(driver, filename);
     if(!pdf) {
@@ -746,12 +874,6 @@ int main(int argn, char *argv[])
 	p = p->next;
     }
 
-    struct mypage_t {
-	int x;
-	int y;
-	gfxpage_t*page;
-    } pages[4];
-
     int pagenum = 0;
     int frame = 1;
     int pagenr;
@@ -776,85 +898,67 @@ int main(int argn, char *argv[])
 
     pagenum = 0;
 
+    /* frames are rendered in batches, and replayed in order after each batch.
+       (In single-threaded mode, a batch consists of just one frame, which
+       is rendered directly to the output device.) */
+    int batch_size = num_threads>1 ? num_threads*2 : 1;
+    frame_t*batch = (frame_t*)rfx_calloc(sizeof(frame_t)*batch_size);
+    int batch_pos = 0;
+    gfxfontlist_t*replay_fonts = gfxfontlist_create();
+
     gfxdevice_t*out = create_output_device();;
     pdf->prepare(pdf, out);
 
     for(pagenr = 1; pagenr <= pdf->num_pages; pagenr++) 
     {
+	frame_t*f = &batch[batch_pos];
 	if(is_in_range(pagenr, pagerange)) {
-	    gfxpage_t* page = pages[pagenum].page = pdf->getpage(pdf, pagenr);
-	    pages[pagenum].x = 0;
-	    pages[pagenum].y = 0;
-	    pages[pagenum].page = page;
-	    pagenum++;
+	    gfxpage_t* page = pdf->getpage(pdf, pagenr);
+	    f->pages[f->pagenum].x = 0;
+	    f->pages[f->pagenum].y = 0;
+	    f->pages[f->pagenum].page = page;
+	    f->pagenum++;
 	}
-	if(pagenum == xnup*ynup || (pagenr == pdf->num_pages && pagenum>1)) {
-
-	    int t;
-	    int xmax[xnup], ymax[xnup];
-	    int x,y;
-	    int width=0, height=0;
-
-	    memset(xmax, 0, xnup*sizeof(int));
-	    memset(ymax, 0, ynup*sizeof(int));
-
-	    for(y=0;y<ynup;y++)
-	    for(x=0;x<xnup;x++) {
-		int t = y*xnup + x;
-
-		if(pages[t].page->width > xmax[x])
-		    xmax[x] = (int)pages[t].page->width;
-		if(pages[t].page->height > ymax[y])
-		    ymax[y] = (int)pages[t].page->height;
-	    }
-	    for(x=0;x<xnup;x++) {
-		width += xmax[x];
-		xmax[x] = width;
-	    }
-	    for(y=0;y<ynup;y++) {
-		height += ymax[y];
-		ymax[y] = height;
-	    }
-	    if(custom_clip) {
-		out->startpage(out,clip_x2 - clip_x1, clip_y2 - clip_y1);
-	    } else {
-		out->startpage(out,width,height);
-	    }
-	    for(t=0;t<pagenum;t++) {
-		int x = t%xnup;
-		int y = t/xnup;
-		int xpos = x>0?xmax[x-1]:0;
-		int ypos = y>0?ymax[y-1]:0;
-		msg("<verbose> Render (%d,%d) move:%d/%d\n",
-			(int)(pages[t].page->width + xpos),
-			(int)(pages[t].page->height + ypos), xpos, ypos);
-		pages[t].page->rendersection(pages[t].page, out, custom_move? move_x : xpos, 
-			                                   custom_move? move_y : ypos,
-							   custom_clip? clip_x1 : 0 + xpos, 
-							   custom_clip? clip_y1 : 0 + ypos, 
-							   custom_clip? clip_x2 : pages[t].page->width + xpos, 
-							   custom_clip? clip_y2 : pages[t].page->height + ypos);
-	    }
-	    out->endpage(out);
-	    for(t=0;t<pagenum;t++)  {
-		pages[t].page->destroy(pages[t].page);
+	if(f->pagenum == xnup*ynup || (pagenr == pdf->num_pages && f->pagenum>1)) {
+	    f->pagenr = pagenr;
+	    batch_pos++;
+	}
+	if(batch_pos == batch_size || (pagenr == pdf->num_pages && batch_pos)) {
+	    if(num_threads > 1) {
+		threads_run(num_threads, batch_pos, render_frame_job, batch);
 	    }
-	    pagenum = 0;
+	    int b;
+	    for(b=0;b<batch_pos;b++) {
+		f = &batch[b];
+		if(f->recording) {
+		    gfxresult_record_replay(f->recording, out, &replay_fonts);
+		    f->recording->destroy(f->recording);
+		    f->recording = 0;
+		} else {
+		    render_frame(out, f);
+		}
 
-	    if(one_file_per_page) {
-		gfxresult_t*result = out->finish(out);out=0;
-		char buf[1024];
-		sprintf(buf, outputname, pagenr);
-		if(result->save(result, buf) < 0) {
-		    return 1;
+		if(one_file_per_page) {
+		    gfxresult_t*result = out->finish(out);out=0;
+		    char buf[1024];
+		    sprintf(buf, outputname, f->pagenr);
+		    if(result->save(result, buf) < 0) {
+			return 1;
+		    }
+		    result->destroy(result);result=0;
+		    out = create_output_device();;
+		    pdf->prepare(pdf, out);
+		    gfxfontlist_free(replay_fonts, 0);
+		    replay_fonts = gfxfontlist_create();
+		    msg("<notice> Writing SWF file %s", buf);
 		}
-		result->destroy(result);result=0;
-		out = create_output_device();;
-                pdf->prepare(pdf, out);
-		msg("<notice> Writing SWF file %s", buf);
 	    }
+	    memset(batch, 0, sizeof(frame_t)*batch_size);
+	    batch_pos = 0;
 	}
     }
+    free(batch);
+    gfxfontlist_free(replay_fonts, 0);
    
     if(one_file_per_page) {
 	// remove empty device
@@ -872,7 +976,9 @@ int main(int argn, char *argv[])
 
 	if(preloader || viewer) {
 	    const char*zip = "";
-	    if(zlib) {
+	    if(lzma) {
+		zip = "-Z";
+	    } else if(zlib) {
 		zip = "-z";
 	    }
 	    if(!preloader && viewer) {
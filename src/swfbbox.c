@@ -608,7 +608,10 @@ int main (int argc,char ** argv)
         perror("Couldn't open file: ");
         exit(1);
     }
-    if FAILED(swf_ReadSWF(fi,&swf))
+    /* unless we write a new file (which might overwrite the input),
+       there's no need to copy the file into memory */
+    int ret = (optimize || expand) ? swf_ReadSWF(fi,&swf) : swf_MapSWF(fi,&swf);
+    if FAILED(ret)
     { 
         fprintf(stderr, "%s is not a valid SWF file or contains errors.\n",filename);
         close(fi);
@@ -337,7 +337,7 @@ char swf_IsSWF(char*filename)
 	return 0;
     read(fi, buf, 3);
     close(fi);
-    if((buf[0] == 'F' || buf[0] == 'C') && buf[1] == 'W' && buf[2] == 'S')
+    if((buf[0] == 'F' || buf[0] == 'C' || buf[0] == 'Z') && buf[1] == 'W' && buf[2] == 'S')
 	return 1;
     return 0;
 }
@@ -37,6 +37,7 @@ struct config_t
    char antistream;
    char dummy;
    char zlib;
+   char lzma;
    char cat;
    char merge;
    char isframe;
@@ -143,6 +144,11 @@ int args_callback_option(char*name,char*val) {
 	config.zlib = 1;
 	return 0;
     }
+    else if (!strcmp(name, "Z"))
+    {
+	config.lzma = 1;
+	return 0;
+    }
     else if (!strcmp(name, "r"))
     {
 
@@ -248,6 +254,7 @@ static struct options_t options[] = {
 {"B", "accelerated-blit"},
 {"L", "local-with-filesystem"},
 {"z", "zlib"},
+{"Z", "lzma"},
 {0,0}
 };
 
@@ -330,6 +337,7 @@ void args_callback_usage(char *name)
     printf("-B , --accelerated-blit        Set the \"use accelerated blit\" bit in the output file\n");
     printf("-L , --local-with-filesystem     Make output file \"local-with-filesystem\"\n");
     printf("-z , --zlib <zlib>             Enable Flash 6 (MX) Zlib Compression\n");
+    printf("-Z , --lzma                    Enable Flash 11 LZMA Compression\n");
     printf("\n");
 }
 
@@ -352,7 +360,7 @@ static void makestackmaster(SWF*swf)
     TAG*tag;
     int t;
     SRECT box;
-    int fileversion = config.zlib?6:3;
+    int fileversion = config.lzma?13:(config.zlib?6:3);
     int frameRate = 256;
     U32 fileAttributes = 0;
     RGBA rgb;
@@ -1253,6 +1261,7 @@ int main(int argn, char *argv[])
     config.stack1 = 0;
     config.dummy = 0;
     config.zlib = 0;
+    config.lzma = 0;
 
     processargs(argn, argv);
     initLog(0,-1,0,0,-1,config.loglevel);
@@ -1399,13 +1408,18 @@ int main(int argn, char *argv[])
 
     fi = open(outputname, O_BINARY|O_RDWR|O_TRUNC|O_CREAT, 0777);
 
-    if(config.zlib) {
+    if(config.lzma) {
+	if(newswf.fileVersion < 13)
+	    newswf.fileVersion = 13;
+        newswf.compressed = 2;
+	swf_WriteSWF(fi, &newswf);
+    } else if(config.zlib) {
 	if(newswf.fileVersion < 6)
 	    newswf.fileVersion = 6;
         newswf.compressed = 1;
 	swf_WriteSWF(fi, &newswf);
     } else {
-	newswf.compressed = -1; // don't compress
+	newswf.compressed = 0xff; // don't compress
 	swf_WriteSWF(fi, &newswf);
     }
     close(fi);
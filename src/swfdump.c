@@ -1164,9 +1164,10 @@ int main (int argc,char ** argv)
     }
     char header[3];
     read(f, header, 3);
-    char compressed = (header[0]=='C');
+    char compressed = (header[0]=='C' || header[0]=='Z');
     char isflash = (header[0]=='F' && header[1] == 'W' && header[2] == 'S') ||
-                   (header[0]=='C' && header[1] == 'W' && header[2] == 'S');
+                   (header[0]=='C' && header[1] == 'W' && header[2] == 'S') ||
+                   (header[0]=='Z' && header[1] == 'W' && header[2] == 'S');
     close(f);
 
     int fl=strlen(filename);
@@ -1174,7 +1175,7 @@ int main (int argc,char ** argv)
         swf_ReadABCfile(filename, &swf);
     } else {
         f = open(filename,O_RDONLY|O_BINARY);
-        if FAILED(swf_ReadSWF(f,&swf))
+        if FAILED(swf_MapSWF(f,&swf))
         { 
             fprintf(stderr, "%s is not a valid SWF file or contains errors.\n",filename);
             close(f);
@@ -1266,7 +1267,7 @@ int main (int argc,char ** argv)
     } 
     printf("[HEADER]        File version: %d\n", swf.fileVersion);
     if(compressed) {
-	printf("[HEADER]        File is zlib compressed.");
+	printf("[HEADER]        File is %s compressed.", header[0]=='Z'?"lzma":"zlib");
 	if(filesize && swf.fileSize)
 	    printf(" Ratio: %02d%%\n", filesize*100/(swf.fileSize));
 	else
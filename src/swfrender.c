@@ -21,6 +21,7 @@ static struct options_t options[] = {
 {"V", "version"},
 {"X", "width"},
 {"Y", "height"},
+{"t", "threads"},
 {0,0}
 };
 
@@ -33,6 +34,7 @@ static char*pagerange = 0;
 static int width = 0;
 static int height = 0;
 static int resolution = 0;
+static int threads = 1;
 
 typedef struct _parameter {
     const char*name;
@@ -88,6 +90,13 @@ int args_callback_option(char*name,char*val)
     } else if(!strcmp(name, "Y")) {
 	height = atoi(val);
 	return 1;
+    } else if(!strcmp(name, "t")) {
+	threads = atoi(val);
+	if(threads < 1) {
+	    fprintf(stderr, "Invalid number of threads: %s\n", val);
+	    exit(1);
+	}
+	return 1;
     } else {
         printf("Unknown option: -%s\n", name);
 	exit(1);
@@ -111,6 +120,7 @@ void args_callback_usage(char *name)
     printf("-r , --resolution dpi          Scale width and height to a specific DPI resolution, assuming input is 1px per pt (default: 72)\n");
     printf("-X , --width width             Scale output to specific width (proportional unless height specified)\n");
     printf("-Y , --height height           Scale output to specific height (proportional unless width specified)\n");
+    printf("-t , --threads num             Render and compress each page with num threads (default: 1)\n");
     printf("\n");
 }
 int args_callback_command(char*name,char*val)
@@ -201,6 +211,11 @@ int main(int argn, char*argv[])
                     if(quantize) {
                         dev->setparameter(dev, "palette", "1");
                     }
+                    if(threads > 1) {
+                        char buf[16];
+                        sprintf(buf, "%d", threads);
+                        dev->setparameter(dev, "threads", buf);
+                    }
                 if(width || height || resolution) {
                     double scale = 0.0;
                     if (resolution) {